@@ -0,0 +1,36 @@
+#pragma once
+
+typedef unsigned long long u64;
+typedef unsigned int u32;
+typedef unsigned char u8;
+
+typedef signed long long s64;
+
+void bench_puts(const char *s);
+void bench_puthex(u64 x);
+void bench_exit(void) __attribute__((noreturn));
+
+static inline u64 bench_instret(void) {
+  u64 x;
+  __asm__ volatile("rdinstret %0" : "=r"(x));
+  return x;
+}
+
+/*
+ * Host file access through semihosting (rivos-sim --semihost). Modes are
+ * fopen's: 0 "r", 1 "rb", ... 4 "w", 8 "a". Read and write return the
+ * number of bytes transferred; -1 means failure.
+ */
+enum {
+  BENCH_SH_RB = 1,
+  BENCH_SH_WB = 5,
+};
+s64 bench_sh_open(const char *path, int mode);
+s64 bench_sh_read(s64 fd, void *buf, u64 len);
+s64 bench_sh_write(s64 fd, const void *buf, u64 len);
+s64 bench_sh_flen(s64 fd);
+s64 bench_sh_close(s64 fd);
+void bench_sh_exit(int status) __attribute__((noreturn));
+
+/* Prints "name: 0x<checksum> insns=0x<count>". */
+void bench_report(const char *name, u64 checksum, u64 insns);
@@ -0,0 +1,147 @@
+#include "bench.h"
+
+/*
+ * F/D workload: vector kernels in the default rounding mode (the
+ * simulator's native fast path), then the same arithmetic under each
+ * static and dynamic non-default mode. Checksums are bit patterns, so a
+ * rounding or flag difference shows up as a mismatch against hardware.
+ */
+
+enum {
+  N = 4096,
+  MAT = 48,
+  REPS = 16,
+};
+
+static double xs[N], ys[N];
+static float fs[N];
+static double ma[MAT * MAT], mb[MAT * MAT], mc[MAT * MAT];
+
+static inline u64 bits(double d) {
+  union {
+    double d;
+    u64 u;
+  } v = {.d = d};
+  return v.u;
+}
+
+static inline u64 fold(u64 h, u64 v) {
+  return (h ^ v) * 0x100000001b3ull;
+}
+
+static inline double fsqrt(double x) {
+  double r;
+  __asm__("fsqrt.d %0, %1" : "=f"(r) : "f"(x));
+  return r;
+}
+
+static inline void set_frm(u32 rm) {
+  __asm__ volatile("fsrm %0" : : "r"(rm));
+}
+
+static inline u32 get_fflags(void) {
+  u32 x;
+  __asm__ volatile("frflags %0" : "=r"(x));
+  return x;
+}
+
+static void init(void) {
+  u64 seed = 0x9e3779b97f4a7c15ull;
+  for (int i = 0; i < N; i++) {
+    seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+    xs[i] = (double)(s64)(seed >> 11) / 4503599627370496.0;
+    ys[i] = (double)i * 0.125 - 3.0;
+    fs[i] = (float)xs[i];
+  }
+  for (int i = 0; i < MAT * MAT; i++) {
+    ma[i] = xs[i % N];
+    mb[i] = ys[(i * 7) % N];
+  }
+}
+
+static u64 daxpy(void) {
+  double a = 1.0000001;
+  for (int r = 0; r < REPS; r++) {
+    for (int i = 0; i < N; i++) {
+      ys[i] = a * xs[i] + ys[i];
+    }
+  }
+  u64 h = 0;
+  for (int i = 0; i < N; i++) {
+    h = fold(h, bits(ys[i]));
+  }
+  return h;
+}
+
+static u64 saxpy(void) {
+  float a = 0.999f, acc = 0.0f;
+  for (int r = 0; r < REPS; r++) {
+    for (int i = 0; i < N; i++) {
+      fs[i] = a * fs[i] + 0.5f;
+      acc += fs[i];
+    }
+  }
+  return (u64)bits((double)acc);
+}
+
+static u64 matmul(void) {
+  for (int i = 0; i < MAT; i++) {
+    for (int j = 0; j < MAT; j++) {
+      double s = 0.0;
+      for (int k = 0; k < MAT; k++) {
+        s += ma[i * MAT + k] * mb[k * MAT + j];
+      }
+      mc[i * MAT + j] = s;
+    }
+  }
+  u64 h = 0;
+  for (int i = 0; i < MAT * MAT; i++) {
+    h = fold(h, bits(mc[i]));
+  }
+  return h;
+}
+
+static u64 divsqrt(void) {
+  double acc = 0.0;
+  for (int r = 0; r < REPS; r++) {
+    for (int i = 1; i < N; i++) {
+      acc += fsqrt((double)i) / (xs[i] + 2.0);
+    }
+  }
+  return bits(acc);
+}
+
+/* Sums under each rounding mode; also checks that fflags accumulated. */
+static u64 rounding(void) {
+  u64 h = 0;
+  for (u32 rm = 0; rm <= 4; rm++) {
+    set_frm(rm);
+    double acc = 0.0;
+    for (int i = 0; i < N; i++) {
+      acc += xs[i] * 0.1;
+      acc -= ys[i] / 3.0;
+    }
+    h = fold(h, bits(acc));
+    h = fold(h, (u64)(s64)acc);
+  }
+  set_frm(0);
+  return fold(h, get_fflags());
+}
+
+int main(void) {
+  static const struct {
+    const char *name;
+    u64 (*fn)(void);
+  } benches[] = {
+      {"daxpy", daxpy},     {"saxpy", saxpy},       {"matmul", matmul},
+      {"divsqrt", divsqrt}, {"rounding", rounding},
+  };
+
+  init();
+  for (unsigned i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+    u64 t0 = bench_instret();
+    u64 sum = benches[i].fn();
+    bench_report(benches[i].name, sum, bench_instret() - t0);
+  }
+  return 0;
+}
@@ -0,0 +1,103 @@
+#include "bench.h"
+
+static inline long sbi_ecall(long a0, long a7) {
+  register long _a0 __asm__("a0") = a0;
+  register long _a7 __asm__("a7") = a7;
+  __asm__ volatile("ecall" : "+r"(_a0) : "r"(_a7) : "memory");
+  return _a0;
+}
+
+static void bench_putc(char c) {
+  if (c == '\n') {
+    (void)sbi_ecall('\r', 1);
+  }
+  (void)sbi_ecall(c, 1);
+}
+
+void bench_puts(const char *s) {
+  for (; *s; s++) {
+    bench_putc(*s);
+  }
+}
+
+void bench_puthex(u64 x) {
+  bench_puts("0x");
+  for (int i = 60; i >= 0; i -= 4) {
+    unsigned v = (unsigned)(x >> i) & 0xF;
+    bench_putc((v < 10) ? (char)('0' + v) : (char)('a' + (v - 10)));
+  }
+}
+
+void bench_report(const char *name, u64 checksum, u64 insns) {
+  bench_puts(name);
+  bench_puts(": ");
+  bench_puthex(checksum);
+  bench_puts(" insns=");
+  bench_puthex(insns);
+  bench_puts("\n");
+}
+
+/* The three instructions must stay together and uncompressed. */
+static s64 sh_call(long op, const u64 *args) {
+  register long a0 __asm__("a0") = op;
+  register const u64 *a1 __asm__("a1") = args;
+  __asm__ volatile(".option push\n"
+                   ".option norvc\n"
+                   ".balign 16\n"
+                   "slli x0, x0, 0x1f\n"
+                   "ebreak\n"
+                   "srai x0, x0, 7\n"
+                   ".option pop"
+                   : "+r"(a0)
+                   : "r"(a1)
+                   : "memory");
+  return a0;
+}
+
+static u64 str_len(const char *s) {
+  u64 n = 0;
+  while (s[n]) {
+    n++;
+  }
+  return n;
+}
+
+s64 bench_sh_open(const char *path, int mode) {
+  u64 args[3] = {(u64)path, (u64)mode, str_len(path)};
+  return sh_call(0x01, args);
+}
+
+s64 bench_sh_read(s64 fd, void *buf, u64 len) {
+  u64 args[3] = {(u64)fd, (u64)buf, len};
+  s64 left = sh_call(0x06, args);
+  return left < 0 || (u64)left > len ? -1 : (s64)(len - (u64)left);
+}
+
+s64 bench_sh_write(s64 fd, const void *buf, u64 len) {
+  u64 args[3] = {(u64)fd, (u64)buf, len};
+  s64 left = sh_call(0x05, args);
+  return left < 0 || (u64)left > len ? -1 : (s64)(len - (u64)left);
+}
+
+s64 bench_sh_flen(s64 fd) {
+  u64 args[1] = {(u64)fd};
+  return sh_call(0x0C, args);
+}
+
+s64 bench_sh_close(s64 fd) {
+  u64 args[1] = {(u64)fd};
+  return sh_call(0x02, args);
+}
+
+void bench_sh_exit(int status) {
+  u64 args[2] = {0x20026, (u64)(s64)status};
+  (void)sh_call(0x18, args);
+  bench_exit();
+}
+
+void bench_exit(void) {
+  (void)sbi_ecall(0, 8);
+  for (;;) {
+    __asm__ volatile("wfi");
+  }
+}
@@ -0,0 +1,209 @@
+#include "bench.h"
+
+/*
+ * Word-at-a-time string and bitmap routines. Built twice: strbench.elf for
+ * plain rv64imafd, where the bit tricks below stand in for the missing
+ * instructions, and strbench-zb.elf with Zba/Zbb/Zbs, where they become
+ * orc.b, ctz, cpop, rev8 and shNadd. Checksums must match between the two;
+ * the instret column shows the saving.
+ */
+
+enum {
+  LEN = 16 * 1024,
+  BITMAP_WORDS = 4096,
+  REPS = 64,
+};
+
+static const u64 ONES = 0x0101010101010101ull;
+static const u64 HIGHS = 0x8080808080808080ull;
+
+static u8 text_a[LEN + 8], text_b[LEN + 8];
+static u64 bitmap[BITMAP_WORDS];
+static u32 table[1024];
+
+#ifdef __riscv_zbb
+
+static inline u64 ctz64(u64 x) {
+  return (u64)__builtin_ctzll(x);
+}
+
+static inline u64 popcount64(u64 x) {
+  return (u64)__builtin_popcountll(x);
+}
+
+static inline u64 bswap64(u64 x) {
+  return __builtin_bswap64(x);
+}
+
+/* High bit set in every zero byte of x. */
+static inline u64 zero_bytes(u64 x) {
+  u64 r;
+  __asm__("orc.b %0, %1" : "=r"(r) : "r"(x));
+  return ~r & HIGHS;
+}
+
+#else
+
+static inline u64 ctz64(u64 x) {
+  static const u8 debruijn[64] = {
+      0,  1,  2,  53, 3,  7,  54, 27, 4,  38, 41, 8,  34, 55, 48, 28,
+      62, 5,  39, 46, 44, 42, 22, 9,  24, 35, 59, 56, 49, 18, 29, 11,
+      63, 52, 6,  26, 37, 40, 33, 47, 61, 45, 43, 21, 23, 58, 17, 10,
+      51, 25, 36, 32, 60, 20, 57, 16, 50, 31, 19, 15, 30, 14, 13, 12,
+  };
+  return debruijn[((x & -x) * 0x022fdd63cc95386dull) >> 58];
+}
+
+static inline u64 popcount64(u64 x) {
+  x -= (x >> 1) & 0x5555555555555555ull;
+  x = (x & 0x3333333333333333ull) + ((x >> 2) & 0x3333333333333333ull);
+  x = (x + (x >> 4)) & 0x0f0f0f0f0f0f0f0full;
+  return (x * ONES) >> 56;
+}
+
+static inline u64 bswap64(u64 x) {
+  x = ((x & 0x00ff00ff00ff00ffull) << 8) | ((x >> 8) & 0x00ff00ff00ff00ffull);
+  x = ((x & 0x0000ffff0000ffffull) << 16) | ((x >> 16) & 0x0000ffff0000ffffull);
+  return (x << 32) | (x >> 32);
+}
+
+/* Exact (no false positives above a real zero byte), unlike the cheaper
+ * (x - ONES) & ~x & HIGHS test. */
+static inline u64 zero_bytes(u64 x) {
+  u64 lo7 = ~HIGHS;
+  return ~(((x & lo7) + lo7) | x | lo7);
+}
+
+#endif
+
+static inline u64 load64(const u8 *p) {
+  u64 x;
+  __builtin_memcpy(&x, p, sizeof(x));
+  return x;
+}
+
+/* Buffers are 8-byte aligned and padded, so whole-word reads are safe. */
+static u64 str_len(const u8 *s) {
+  for (u64 i = 0;; i += 8) {
+    u64 z = zero_bytes(load64(s + i));
+    if (z) {
+      return i + ctz64(z) / 8;
+    }
+  }
+}
+
+static int str_cmp(const u8 *a, const u8 *b) {
+  for (u64 i = 0;; i += 8) {
+    u64 x = load64(a + i), y = load64(b + i);
+    u64 stop = (x ^ y) | zero_bytes(x);
+    if (stop) {
+      /* Compare as big-endian so the first differing byte decides. */
+      u64 keep = ~0ull >> (56 - (ctz64(stop) & ~7ull));
+      u64 bx = bswap64(x & keep), by = bswap64(y & keep);
+      return bx < by ? -1 : bx > by;
+    }
+  }
+}
+
+static u64 mem_chr(const u8 *s, u8 c, u64 n) {
+  u64 pattern = ONES * c;
+  for (u64 i = 0; i + 8 <= n; i += 8) {
+    u64 z = zero_bytes(load64(s + i) ^ pattern);
+    if (z) {
+      return i + ctz64(z) / 8;
+    }
+  }
+  return n;
+}
+
+static u64 bitmap_count(const u64 *map, u64 words) {
+  u64 n = 0;
+  for (u64 i = 0; i < words; i++) {
+    n += popcount64(map[i]);
+  }
+  return n;
+}
+
+/* Iterates set bits, the way an allocator or scheduler scans a bitmap. */
+static u64 bitmap_walk(const u64 *map, u64 words) {
+  u64 h = 0;
+  for (u64 i = 0; i < words; i++) {
+    for (u64 w = map[i]; w; w &= w - 1) {
+      h += i * 64 + ctz64(w);
+    }
+  }
+  return h;
+}
+
+/* Scaled indexing: sh2add/sh3add with Zba. */
+static u64 table_gather(const u32 *t, const u64 *idx, u64 n) {
+  u64 s = 0;
+  for (u64 i = 0; i < n; i++) {
+    s += t[idx[i] & 1023];
+  }
+  return s;
+}
+
+static void init(void) {
+  u64 seed = 7;
+  for (u64 i = 0; i < LEN; i++) {
+    seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+    u8 c = (u8)('a' + (seed >> 59));
+    text_a[i] = c;
+    text_b[i] = c;
+  }
+  text_a[LEN - 1] = 0;
+  text_b[LEN - 1] = 0;
+  text_b[LEN - 100] ^= 1;
+  for (u64 i = 0; i < BITMAP_WORDS; i++) {
+    seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+    bitmap[i] = seed & (seed >> 17);
+  }
+  for (u64 i = 0; i < 1024; i++) {
+    table[i] = (u32)(i * 2654435761u);
+  }
+}
+
+int main(void) {
+  init();
+
+  u64 t0 = bench_instret();
+  u64 r = 0;
+  for (int i = 0; i < REPS; i++) {
+    r += str_len(text_a + (i & 7));
+  }
+  bench_report("strlen", r, bench_instret() - t0);
+
+  t0 = bench_instret();
+  r = 0;
+  for (int i = 0; i < REPS; i++) {
+    r = r * 3 + (u64)(s64)str_cmp(text_a, i & 1 ? text_b : text_a);
+  }
+  bench_report("strcmp", r, bench_instret() - t0);
+
+  t0 = bench_instret();
+  r = 0;
+  for (int i = 0; i < REPS; i++) {
+    r += mem_chr(text_a, (u8)('{' - (i & 3)), LEN);
+  }
+  bench_report("memchr", r, bench_instret() - t0);
+
+  t0 = bench_instret();
+  r = 0;
+  for (int i = 0; i < REPS; i++) {
+    r += bitmap_count(bitmap, BITMAP_WORDS);
+  }
+  bench_report("popcount", r, bench_instret() - t0);
+
+  t0 = bench_instret();
+  r = bitmap_walk(bitmap, BITMAP_WORDS);
+  bench_report("bitwalk", r, bench_instret() - t0);
+
+  t0 = bench_instret();
+  r = 0;
+  for (int i = 0; i < REPS; i++) {
+    r += table_gather(table, bitmap, BITMAP_WORDS);
+  }
+  bench_report("gather", r, bench_instret() - t0);
+  return 0;
+}
@@ -0,0 +1,135 @@
+#include "bench.h"
+
+/*
+ * Vector kernels against their scalar equivalents: memcpy, a byte checksum
+ * and a newline count. The instret columns show how many instructions the
+ * RVV version saves at the simulator's VLEN (see --vlen).
+ */
+
+enum {
+  LEN = 64 * 1024 + 37,
+};
+
+static u8 src[LEN], dst[LEN];
+
+static void memcpy_scalar(u8 *d, const u8 *s, u64 n) {
+  for (u64 i = 0; i < n; i++) {
+    d[i] = s[i];
+  }
+}
+
+static void memcpy_rvv(u8 *d, const u8 *s, u64 n) {
+  while (n) {
+    u64 vl;
+    __asm__ volatile("vsetvli %0, %1, e8, m8, ta, ma\n"
+                     "vle8.v v8, (%2)\n"
+                     "vse8.v v8, (%3)\n"
+                     : "=&r"(vl)
+                     : "r"(n), "r"(s), "r"(d)
+                     : "memory", "v8", "v9", "v10", "v11", "v12", "v13",
+                       "v14", "v15");
+    s += vl;
+    d += vl;
+    n -= vl;
+  }
+}
+
+static u64 sum_scalar(const u8 *s, u64 n) {
+  u64 sum = 0;
+  for (u64 i = 0; i < n; i++) {
+    sum += s[i];
+  }
+  return sum;
+}
+
+/* Chunks of 256 bytes keep the e16 widening sum from overflowing. */
+static u64 sum_rvv(const u8 *s, u64 n) {
+  u64 sum = 0;
+  while (n) {
+    u64 vl, part;
+    __asm__ volatile("vsetivli zero, 1, e16, m1, ta, ma\n"
+                     "vmv.s.x v16, zero\n"
+                     "vsetvli %0, %2, e8, m8, ta, ma\n"
+                     "vle8.v v8, (%3)\n"
+                     "vwredsumu.vs v16, v8, v16\n"
+                     "vsetivli zero, 1, e16, m1, ta, ma\n"
+                     "vmv.x.s %1, v16\n"
+                     : "=&r"(vl), "=r"(part)
+                     : "r"(n < 256 ? n : 256), "r"(s)
+                     : "memory", "v8", "v9", "v10", "v11", "v12", "v13",
+                       "v14", "v15", "v16");
+    sum += part & 0xffff;
+    s += vl;
+    n -= vl;
+  }
+  return sum;
+}
+
+static u64 lines_scalar(const u8 *s, u64 n) {
+  u64 lines = 0;
+  for (u64 i = 0; i < n; i++) {
+    lines += s[i] == '\n';
+  }
+  return lines;
+}
+
+static u64 lines_rvv(const u8 *s, u64 n) {
+  u64 lines = 0;
+  while (n) {
+    u64 vl, hits;
+    __asm__ volatile("vsetvli %0, %2, e8, m8, ta, ma\n"
+                     "vle8.v v8, (%3)\n"
+                     "vmseq.vi v0, v8, 10\n"
+                     "vcpop.m %1, v0\n"
+                     : "=&r"(vl), "=r"(hits)
+                     : "r"(n), "r"(s)
+                     : "memory", "v0", "v8", "v9", "v10", "v11", "v12",
+                       "v13", "v14", "v15");
+    lines += hits;
+    s += vl;
+    n -= vl;
+  }
+  return lines;
+}
+
+static u64 checksum(const u8 *s, u64 n) {
+  u64 h = 0;
+  for (u64 i = 0; i < n; i++) {
+    h = (h ^ s[i]) * 0x100000001b3ull;
+  }
+  return h;
+}
+
+int main(void) {
+  u64 seed = 1;
+  for (u64 i = 0; i < LEN; i++) {
+    seed = seed * 6364136223846793005ull + 1442695040888963407ull;
+    u8 c = (u8)(seed >> 56);
+    src[i] = (c & 0x3f) == 0 ? '\n' : c;
+  }
+
+  u64 t0 = bench_instret();
+  memcpy_scalar(dst, src, LEN);
+  bench_report("memcpy scalar", checksum(dst, LEN), bench_instret() - t0);
+  for (u64 i = 0; i < LEN; i++) {
+    dst[i] = 0;
+  }
+  t0 = bench_instret();
+  memcpy_rvv(dst, src, LEN);
+  bench_report("memcpy rvv", checksum(dst, LEN), bench_instret() - t0);
+
+  t0 = bench_instret();
+  u64 r = sum_scalar(src, LEN);
+  bench_report("sum scalar", r, bench_instret() - t0);
+  t0 = bench_instret();
+  r = sum_rvv(src, LEN);
+  bench_report("sum rvv", r, bench_instret() - t0);
+
+  t0 = bench_instret();
+  r = lines_scalar(src, LEN);
+  bench_report("lines scalar", r, bench_instret() - t0);
+  t0 = bench_instret();
+  r = lines_rvv(src, LEN);
+  bench_report("lines rvv", r, bench_instret() - t0);
+  return 0;
+}
@@ -1,4 +1,40 @@
 #pragma once
 
+#include "types.h"
+
+enum {
+  SBI_EXT_BASE = 0x10,
+  /* rivos-sim vendor extension: bulk memory operations done by the host. */
+  SBI_EXT_RIVOS_MEM = 0x09000002,
+  /* rivos-sim vendor extension: shadow-memory hints for --sanitize. */
+  SBI_EXT_RIVOS_SAN = 0x09000003,
+};
+
 void sbi_console_putchar(int ch);
+/* Returns -1 when no input is pending. */
+int sbi_console_getchar(void);
 void sbi_shutdown(void);
+
+/* Non-zero if the SBI implementation provides extension eid. */
+long sbi_probe_extension(long eid);
+
+/*
+ * mem* on physical addresses (identical to virtual ones until paging is
+ * enabled). Under rivos-sim each is a single SBI call; elsewhere, or if the
+ * call is refused, they fall back to a byte loop. Safe to call before BSS
+ * is cleared.
+ */
+void sbi_memset(void *dst, int c, u64 n);
+void sbi_memcpy(void *dst, const void *src, u64 n);
+void sbi_memmove(void *dst, const void *src, u64 n);
+int sbi_memcmp(const void *a, const void *b, u64 n);
+
+/*
+ * Tell rivos-sim --sanitize what memory is live. alloc makes a range
+ * addressable with undefined contents, free makes it unaddressable, and
+ * stack registers [lo, hi) as a stack whose bytes below sp are dead. No-ops
+ * when the simulator is not checking.
+ */
+void sbi_san_alloc(void *p, u64 n);
+void sbi_san_free(void *p, u64 n);
+void sbi_san_stack(void *lo, void *hi);
@@ -4,17 +4,19 @@
 
 extern char __bss_start;
 extern char __bss_end;
+extern char boot_stack[];
+extern char boot_stack_top[];
 
 extern void trap_entry(void);
 
+/* One SBI call under rivos-sim, a byte loop on other firmware. */
 static void bss_clear(void) {
-  for (char *p = &__bss_start; p < &__bss_end; p++) {
-    *p = 0;
-  }
+  sbi_memset(&__bss_start, 0, (u64)(&__bss_end - &__bss_start));
 }
 
 void kmain(void) {
   bss_clear();
+  sbi_san_stack(boot_stack, boot_stack_top);
 
   w_stvec((unsigned long)trap_entry);
 
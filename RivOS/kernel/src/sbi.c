@@ -18,13 +18,157 @@ static inline long sbi_ecall(long a0, long a1, long a2, long a3,
   return _a0;
 }
 
+struct sbiret {
+  long error;
+  long value;
+};
+
+/* SBI v0.2 calling convention: a7 = extension, a6 = function. */
+static inline struct sbiret sbi_call(long eid, long fid, long a0, long a1,
+                                     long a2) {
+  register long _a0 __asm__("a0") = a0;
+  register long _a1 __asm__("a1") = a1;
+  register long _a2 __asm__("a2") = a2;
+  register long _a6 __asm__("a6") = fid;
+  register long _a7 __asm__("a7") = eid;
+  __asm__ volatile("ecall"
+                   : "+r"(_a0), "+r"(_a1)
+                   : "r"(_a2), "r"(_a6), "r"(_a7)
+                   : "memory");
+  return (struct sbiret){_a0, _a1};
+}
+
 void sbi_console_putchar(int ch) {
   (void)sbi_ecall(ch, 0, 0, 0, 0, 0, 0, 1);
 }
 
+int sbi_console_getchar(void) {
+  return (int)sbi_ecall(0, 0, 0, 0, 0, 0, 0, 2);
+}
+
 void sbi_shutdown(void) {
   (void)sbi_ecall(0, 0, 0, 0, 0, 0, 0, 8);
   for (;;) {
     __asm__ volatile("wfi");
   }
 }
+
+long sbi_probe_extension(long eid) {
+  /* Legacy-only firmware rejects the base extension itself. */
+  struct sbiret r = sbi_call(SBI_EXT_BASE, 3, eid, 0, 0);
+  return r.error ? 0 : r.value;
+}
+
+enum {
+  RIVOS_MEM_SET = 0,
+  RIVOS_MEM_COPY = 1,
+  RIVOS_MEM_MOVE = 2,
+  RIVOS_MEM_CMP = 3,
+};
+
+/*
+ * -1 until probed. Initialised so that it lives in .data: the first caller
+ * is bss_clear, which would otherwise wipe the cached answer.
+ */
+static int mem_ext = -1;
+
+static int have_mem_ext(void) {
+  if (mem_ext < 0) {
+    mem_ext = sbi_probe_extension(SBI_EXT_RIVOS_MEM) != 0;
+  }
+  return mem_ext;
+}
+
+void sbi_memset(void *dst, int c, u64 n) {
+  if (have_mem_ext() &&
+      sbi_call(SBI_EXT_RIVOS_MEM, RIVOS_MEM_SET, (long)dst, c, (long)n)
+              .error == 0) {
+    return;
+  }
+  u8 *d = dst;
+  for (u64 i = 0; i < n; i++) {
+    d[i] = (u8)c;
+  }
+}
+
+void sbi_memcpy(void *dst, const void *src, u64 n) {
+  if (have_mem_ext() &&
+      sbi_call(SBI_EXT_RIVOS_MEM, RIVOS_MEM_COPY, (long)dst, (long)src,
+               (long)n)
+              .error == 0) {
+    return;
+  }
+  u8 *d = dst;
+  const u8 *s = src;
+  for (u64 i = 0; i < n; i++) {
+    d[i] = s[i];
+  }
+}
+
+void sbi_memmove(void *dst, const void *src, u64 n) {
+  if (have_mem_ext() &&
+      sbi_call(SBI_EXT_RIVOS_MEM, RIVOS_MEM_MOVE, (long)dst, (long)src,
+               (long)n)
+              .error == 0) {
+    return;
+  }
+  u8 *d = dst;
+  const u8 *s = src;
+  if (d < s) {
+    for (u64 i = 0; i < n; i++) {
+      d[i] = s[i];
+    }
+  } else {
+    for (u64 i = n; i > 0; i--) {
+      d[i - 1] = s[i - 1];
+    }
+  }
+}
+
+int sbi_memcmp(const void *a, const void *b, u64 n) {
+  if (have_mem_ext()) {
+    struct sbiret r =
+        sbi_call(SBI_EXT_RIVOS_MEM, RIVOS_MEM_CMP, (long)a, (long)b, (long)n);
+    if (r.error == 0) {
+      return (int)r.value;
+    }
+  }
+  const u8 *x = a;
+  const u8 *y = b;
+  for (u64 i = 0; i < n; i++) {
+    if (x[i] != y[i]) {
+      return x[i] < y[i] ? -1 : 1;
+    }
+  }
+  return 0;
+}
+
+enum {
+  RIVOS_SAN_ALLOC = 0,
+  RIVOS_SAN_FREE = 1,
+  RIVOS_SAN_STACK = 3,
+};
+
+/* Like mem_ext; only asked once the first hint is given. */
+static int san_ext = -1;
+
+static void san_hint(long fid, long a, long b) {
+  if (san_ext < 0) {
+    san_ext = sbi_probe_extension(SBI_EXT_RIVOS_SAN) != 0;
+  }
+  if (san_ext) {
+    (void)sbi_call(SBI_EXT_RIVOS_SAN, fid, a, b, 0);
+  }
+}
+
+void sbi_san_alloc(void *p, u64 n) {
+  san_hint(RIVOS_SAN_ALLOC, (long)p, (long)n);
+}
+
+void sbi_san_free(void *p, u64 n) {
+  san_hint(RIVOS_SAN_FREE, (long)p, (long)n);
+}
+
+void sbi_san_stack(void *lo, void *hi) {
+  san_hint(RIVOS_SAN_STACK, (long)lo, (long)hi);
+}
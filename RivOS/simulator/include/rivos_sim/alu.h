@@ -0,0 +1,280 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * Integer ALU operations shared by the interpreter and rivos-aot output.
+ * Whether an encoding is valid depends only on the instruction word, never
+ * on the operands.
+ */
+
+static inline uint64_t sext32(uint32_t v) {
+  return (uint64_t)(int64_t)(int32_t)v;
+}
+
+static inline uint64_t alu_muldiv(uint32_t funct3, uint64_t x1, uint64_t x2) {
+  switch (funct3) {
+  case 0x0:
+    return x1 * x2;
+  case 0x1:
+    return (uint64_t)(((__int128)(int64_t)x1 * (__int128)(int64_t)x2) >> 64);
+  case 0x2:
+    return (uint64_t)(((__int128)(int64_t)x1 * (__int128)x2) >> 64);
+  case 0x3:
+    return (uint64_t)(((unsigned __int128)x1 * x2) >> 64);
+  case 0x4:
+    if (x2 == 0)
+      return UINT64_MAX;
+    if ((int64_t)x1 == INT64_MIN && (int64_t)x2 == -1)
+      return x1;
+    return (uint64_t)((int64_t)x1 / (int64_t)x2);
+  case 0x5:
+    if (x2 == 0)
+      return UINT64_MAX;
+    return x1 / x2;
+  case 0x6:
+    if (x2 == 0)
+      return x1;
+    if ((int64_t)x1 == INT64_MIN && (int64_t)x2 == -1)
+      return 0;
+    return (uint64_t)((int64_t)x1 % (int64_t)x2);
+  default:
+    if (x2 == 0)
+      return x1;
+    return x1 % x2;
+  }
+}
+
+static inline uint64_t rotl64(uint64_t x, unsigned n) {
+  n &= 63;
+  return n ? (x << n) | (x >> (64 - n)) : x;
+}
+
+static inline uint32_t rotl32(uint32_t x, unsigned n) {
+  n &= 31;
+  return n ? (x << n) | (x >> (32 - n)) : x;
+}
+
+/* 0xff for every non-zero byte of x, 0x00 for every zero byte. */
+static inline uint64_t orc_b(uint64_t x) {
+  const uint64_t lo7 = 0x7f7f7f7f7f7f7f7full;
+  uint64_t hi = (((x & lo7) + lo7) | x) & ~lo7;
+  return (hi >> 7) * 0xff;
+}
+
+/*
+ * Zba/Zbb/Zbs in the OP, OP-32, OP-IMM and OP-IMM-32 encodings the base ISA
+ * leaves unused. For the immediate forms x2 is the shift amount. Returns
+ * false for encodings that are not defined.
+ */
+static inline bool alu_bitmanip(uint32_t insn, uint64_t x1, uint64_t x2,
+                                uint64_t *out) {
+  uint32_t opcode = insn & 0x7F;
+  uint32_t funct3 = (insn >> 12) & 0x7;
+  uint32_t funct7 = insn >> 25;
+  uint32_t imm12 = insn >> 20;
+  unsigned sh = (unsigned)(x2 & 63);
+  uint64_t bit = 1ull << sh;
+
+  switch (opcode) {
+  case 0x13:
+    switch (funct3 << 6 | (insn >> 26)) {
+    case 1 << 6 | 0x12: /* bclri */
+      *out = x1 & ~bit;
+      return true;
+    case 1 << 6 | 0x0A: /* bseti */
+      *out = x1 | bit;
+      return true;
+    case 1 << 6 | 0x1A: /* binvi */
+      *out = x1 ^ bit;
+      return true;
+    case 5 << 6 | 0x12: /* bexti */
+      *out = (x1 >> sh) & 1;
+      return true;
+    case 5 << 6 | 0x18: /* rori */
+      *out = rotl64(x1, 64 - sh);
+      return true;
+    case 1 << 6 | 0x18:
+      switch (imm12) {
+      case 0x600: /* clz */
+        *out = x1 ? (uint64_t)__builtin_clzll(x1) : 64;
+        return true;
+      case 0x601: /* ctz */
+        *out = x1 ? (uint64_t)__builtin_ctzll(x1) : 64;
+        return true;
+      case 0x602: /* cpop */
+        *out = (uint64_t)__builtin_popcountll(x1);
+        return true;
+      case 0x604: /* sext.b */
+        *out = (uint64_t)(int64_t)(int8_t)x1;
+        return true;
+      case 0x605: /* sext.h */
+        *out = (uint64_t)(int64_t)(int16_t)x1;
+        return true;
+      default:
+        return false;
+      }
+    case 5 << 6 | 0x0A:
+      if (imm12 != 0x287) { /* orc.b */
+        return false;
+      }
+      *out = orc_b(x1);
+      return true;
+    case 5 << 6 | 0x1A:
+      if (imm12 != 0x6B8) { /* rev8 */
+        return false;
+      }
+      *out = __builtin_bswap64(x1);
+      return true;
+    default:
+      return false;
+    }
+  case 0x1B:
+    if (funct3 == 1 && (insn >> 26) == 0x02) { /* slli.uw */
+      *out = (x1 & 0xffffffffull) << sh;
+      return true;
+    }
+    if (funct3 == 5 && funct7 == 0x30) { /* roriw */
+      *out = sext32(rotl32((uint32_t)x1, 32 - (sh & 31)));
+      return true;
+    }
+    if (funct3 == 1 && funct7 == 0x30) {
+      uint32_t w = (uint32_t)x1;
+      switch (imm12) {
+      case 0x600: /* clzw */
+        *out = w ? (uint64_t)__builtin_clz(w) : 32;
+        return true;
+      case 0x601: /* ctzw */
+        *out = w ? (uint64_t)__builtin_ctz(w) : 32;
+        return true;
+      case 0x602: /* cpopw */
+        *out = (uint64_t)__builtin_popcount(w);
+        return true;
+      default:
+        return false;
+      }
+    }
+    return false;
+  case 0x33:
+    switch (funct7 << 3 | funct3) {
+    case 0x20 << 3 | 7: /* andn */
+      *out = x1 & ~x2;
+      return true;
+    case 0x20 << 3 | 6: /* orn */
+      *out = x1 | ~x2;
+      return true;
+    case 0x20 << 3 | 4: /* xnor */
+      *out = ~(x1 ^ x2);
+      return true;
+    case 0x05 << 3 | 4: /* min */
+      *out = (int64_t)x1 < (int64_t)x2 ? x1 : x2;
+      return true;
+    case 0x05 << 3 | 5: /* minu */
+      *out = x1 < x2 ? x1 : x2;
+      return true;
+    case 0x05 << 3 | 6: /* max */
+      *out = (int64_t)x1 > (int64_t)x2 ? x1 : x2;
+      return true;
+    case 0x05 << 3 | 7: /* maxu */
+      *out = x1 > x2 ? x1 : x2;
+      return true;
+    case 0x30 << 3 | 1: /* rol */
+      *out = rotl64(x1, sh);
+      return true;
+    case 0x30 << 3 | 5: /* ror */
+      *out = rotl64(x1, 64 - sh);
+      return true;
+    case 0x10 << 3 | 2: /* sh1add */
+    case 0x10 << 3 | 4: /* sh2add */
+    case 0x10 << 3 | 6: /* sh3add */
+      *out = (x1 << (funct3 >> 1)) + x2;
+      return true;
+    case 0x24 << 3 | 1: /* bclr */
+      *out = x1 & ~bit;
+      return true;
+    case 0x14 << 3 | 1: /* bset */
+      *out = x1 | bit;
+      return true;
+    case 0x34 << 3 | 1: /* binv */
+      *out = x1 ^ bit;
+      return true;
+    case 0x24 << 3 | 5: /* bext */
+      *out = (x1 >> sh) & 1;
+      return true;
+    default:
+      return false;
+    }
+  case 0x3B: {
+    uint64_t lo = x1 & 0xffffffffull;
+    switch (funct7 << 3 | funct3) {
+    case 0x04 << 3 | 0: /* add.uw */
+      *out = lo + x2;
+      return true;
+    case 0x10 << 3 | 2: /* sh1add.uw */
+    case 0x10 << 3 | 4: /* sh2add.uw */
+    case 0x10 << 3 | 6: /* sh3add.uw */
+      *out = (lo << (funct3 >> 1)) + x2;
+      return true;
+    case 0x30 << 3 | 1: /* rolw */
+      *out = sext32(rotl32((uint32_t)x1, (unsigned)(x2 & 31)));
+      return true;
+    case 0x30 << 3 | 5: /* rorw */
+      *out = sext32(rotl32((uint32_t)x1, 32 - (unsigned)(x2 & 31)));
+      return true;
+    case 0x04 << 3 | 4: /* zext.h */
+      if (((insn >> 20) & 0x1F) != 0) {
+        return false;
+      }
+      *out = x1 & 0xffff;
+      return true;
+    default:
+      return false;
+    }
+  }
+  default:
+    return false;
+  }
+}
+
+static inline bool alu_muldivw(uint32_t funct3, uint64_t x1, uint64_t x2,
+                               uint64_t *out) {
+  int32_t a = (int32_t)x1;
+  int32_t b = (int32_t)x2;
+
+  switch (funct3) {
+  case 0x0:
+    *out = sext32((uint32_t)a * (uint32_t)b);
+    return true;
+  case 0x4:
+    if (b == 0)
+      *out = UINT64_MAX;
+    else if (a == INT32_MIN && b == -1)
+      *out = sext32((uint32_t)a);
+    else
+      *out = sext32((uint32_t)(a / b));
+    return true;
+  case 0x5:
+    if (b == 0)
+      *out = UINT64_MAX;
+    else
+      *out = sext32((uint32_t)a / (uint32_t)b);
+    return true;
+  case 0x6:
+    if (b == 0)
+      *out = sext32((uint32_t)a);
+    else if (a == INT32_MIN && b == -1)
+      *out = 0;
+    else
+      *out = sext32((uint32_t)(a % b));
+    return true;
+  case 0x7:
+    if (b == 0)
+      *out = sext32((uint32_t)a);
+    else
+      *out = sext32((uint32_t)a % (uint32_t)b);
+    return true;
+  default:
+    return false;
+  }
+}
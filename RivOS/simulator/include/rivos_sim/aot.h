@@ -0,0 +1,206 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "rivos_sim/alu.h"
+#include "rivos_sim/cpu.h"
+#include "rivos_sim/machine.h"
+#include "rivos_sim/mem.h"
+
+/*
+ * Ahead-of-time translated code (see tools/rivos-aot.c). Each guest basic
+ * block becomes a host function that updates the integer registers and
+ * returns the next PC; the run loop adds `len` to instret. Blocks contain
+ * only instructions that cannot trap, so they always run to the end.
+ */
+typedef uint64_t (*AotBlockFn)(Machine *m, Cpu *cpu);
+
+/* How a block ends, which decides where the run loop looks for the next. */
+typedef enum {
+  AOT_EXIT_FALL,     /* falls through to succ[1] */
+  AOT_EXIT_BRANCH,   /* succ[0] if taken, else succ[1] */
+  AOT_EXIT_JUMP,     /* jal without link to succ[0] */
+  AOT_EXIT_CALL,     /* jal (succ[0]) or jalr with link; returns to succ[1] */
+  AOT_EXIT_RET,      /* jalr x0, 0(ra|t0) */
+  AOT_EXIT_INDIRECT, /* any other jalr */
+} AotExit;
+
+typedef struct {
+  uint64_t pc;
+  uint32_t len;
+  uint8_t exit;
+  /* Indices of the static successors in the image, or -1. */
+  int32_t succ[2];
+  AotBlockFn fn;
+} AotBlock;
+
+typedef struct {
+  const AotBlock *blocks;
+  size_t nblocks;
+  /* aot_hash from AOT_HASH_INIT over every block's instruction words. */
+  uint64_t code_hash;
+  const char *source;
+} AotImage;
+
+enum {
+  AOT_RAS_DEPTH = 16,
+};
+
+/*
+ * Runtime state over an image: a PC lookup table plus direct links between
+ * blocks, so most block exits need no lookup. Static successors are linked
+ * up front; each indirect jump site caches its last target and returns are
+ * predicted with a return address stack.
+ */
+typedef struct {
+  const AotImage *img;
+  Machine *m;
+  const AotBlock **table;
+  size_t mask;
+
+  /* Per block: links[2 * i + k] is succ[k] while both are live. */
+  const AotBlock **links;
+  const AotBlock **ind;
+  /* Blocks whose code has been written since load. */
+  uint8_t *dead;
+
+  const AotBlock *ras[AOT_RAS_DEPTH];
+  unsigned ras_top;
+
+  /* Dirty bitmap words covering translated code, and their code bits. */
+  size_t code_w0;
+  size_t code_words;
+  uint64_t *code_mask;
+} Aot;
+
+/*
+ * Checks that RAM holds the code the image was translated from and builds
+ * the lookup table. Turns on dirty page tracking to find code writes.
+ */
+bool aot_init(Aot *a, const AotImage *img, Machine *m);
+void aot_destroy(Aot *a);
+
+/*
+ * Retires blocks on code pages written since the last call and drops every
+ * link and prediction. The run loop calls it on fence.i (the ISA's point
+ * for making code writes visible) and between poll intervals, so host-side
+ * and unfenced writes are seen soon as well.
+ */
+void aot_sync_code(Aot *a);
+
+#define AOT_HASH_INIT 0xcbf29ce484222325ull
+
+static inline uint64_t aot_hash(uint64_t h, uint64_t pc, uint32_t insn) {
+  h = (h ^ pc) * 0x100000001b3ull;
+  return (h ^ insn) * 0x100000001b3ull;
+}
+
+static inline size_t aot_slot(uint64_t pc, size_t mask) {
+  return (size_t)((pc >> 2) * 0x9E3779B97F4A7C15ull >> 32) & mask;
+}
+
+static inline const AotBlock *aot_lookup(const Aot *a, uint64_t pc) {
+  for (size_t i = aot_slot(pc, a->mask);; i = (i + 1) & a->mask) {
+    const AotBlock *b = a->table[i];
+    if (!b || b->pc == pc) {
+      return b && !a->dead[b - a->img->blocks] ? b : NULL;
+    }
+  }
+}
+
+/* True if a code page has been written since the last aot_sync_code. */
+static inline bool aot_code_written(const Aot *a) {
+  uint64_t any = 0;
+  for (size_t i = 0; i < a->code_words; i++) {
+    any |= a->m->dirty[a->code_w0 + i] & a->code_mask[i];
+  }
+  return any != 0;
+}
+
+/* The block for next_pc after b returned it, or NULL if unknown. */
+static inline const AotBlock *aot_next(Aot *a, const AotBlock *b,
+                                       uint64_t next_pc) {
+  size_t i = (size_t)(b - a->img->blocks);
+  const AotBlock *n;
+  switch (b->exit) {
+  case AOT_EXIT_RET:
+    n = a->ras[a->ras_top];
+    a->ras[a->ras_top] = NULL;
+    a->ras_top = (a->ras_top + AOT_RAS_DEPTH - 1) % AOT_RAS_DEPTH;
+    if (n && n->pc == next_pc) {
+      return n;
+    }
+    break;
+  case AOT_EXIT_INDIRECT:
+    break;
+  case AOT_EXIT_CALL:
+    a->ras_top = (a->ras_top + 1) % AOT_RAS_DEPTH;
+    a->ras[a->ras_top] = a->links[2 * i + 1];
+    n = a->links[2 * i];
+    if (n && n->pc == next_pc) {
+      return n;
+    }
+    break;
+  default:
+    for (int k = 0; k < 2; k++) {
+      n = a->links[2 * i + k];
+      if (n && n->pc == next_pc) {
+        return n;
+      }
+    }
+    return NULL;
+  }
+
+  /* Indirect: the site's last target, else a lookup that refreshes it. */
+  n = a->ind[i];
+  if (n && n->pc == next_pc) {
+    return n;
+  }
+  n = aot_lookup(a, next_pc);
+  a->ind[i] = n;
+  return n;
+}
+
+/*
+ * Guest memory access from translated code: RAM inline, everything else
+ * through mem.c. Stores keep the dirty bitmap exact like ram_store.
+ */
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+#define AOT_RAM_FAST 1
+#else
+#define AOT_RAM_FAST 0
+#endif
+
+#define AOT_ACCESSORS(bits)                                                   \
+  static inline uint##bits##_t aot_ld##bits(Machine *m, uint64_t addr) {      \
+    uint64_t off = addr - m->ram_base;                                        \
+    if (AOT_RAM_FAST && off <= m->ram_size - bits / 8) {                      \
+      uint##bits##_t v;                                                       \
+      memcpy(&v, m->ram + off, sizeof(v));                                    \
+      return v;                                                               \
+    }                                                                         \
+    return mem_read##bits(m, addr);                                           \
+  }                                                                           \
+  static inline void aot_st##bits(Machine *m, uint64_t addr,                  \
+                                  uint##bits##_t v) {                         \
+    uint64_t off = addr - m->ram_base;                                        \
+    if (AOT_RAM_FAST && off <= m->ram_size - bits / 8) {                      \
+      size_t p0 = (size_t)(off >> RIVOS_SIM_PAGE_SHIFT);                      \
+      size_t p1 = (size_t)((off + bits / 8 - 1) >> RIVOS_SIM_PAGE_SHIFT);     \
+      machine_dirty_page(m, p0);                                              \
+      machine_dirty_page(m, p1);                                              \
+      memcpy(m->ram + off, &v, sizeof(v));                                    \
+      return;                                                                 \
+    }                                                                         \
+    mem_write##bits(m, addr, v);                                              \
+  }
+
+AOT_ACCESSORS(8)
+AOT_ACCESSORS(16)
+AOT_ACCESSORS(32)
+AOT_ACCESSORS(64)
+
+#undef AOT_ACCESSORS
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+enum {
+  BBV_DEFAULT_INTERVAL = 10 * 1000 * 1000,
+};
+
+/*
+ * Basic-block vectors for SimPoint. Every `interval` retired instructions
+ * one line "T:id:count :id:count ..." is written, where count is the
+ * number of instructions executed in block id during the interval (ids
+ * from 1 in order of first execution). Intervals are cut at exact
+ * instruction counts, so interval k starts at instruction k * interval; a
+ * block straddling the cut counts towards both.
+ */
+typedef struct {
+  FILE *out;
+  uint64_t interval;
+  uint64_t in_interval;
+  uint64_t intervals;
+
+  /* Block entry PC -> id, open addressing; pcs[i] == 0 is empty. */
+  uint64_t *pcs;
+  uint32_t *ids;
+  size_t cap;
+  uint32_t nblocks;
+
+  /* Per-id counts for the current interval and the ids touched in it. */
+  uint64_t *counts;
+  uint32_t *touched;
+  size_t ntouched;
+  size_t counts_cap;
+
+  uint64_t block_pc;
+  uint64_t block_len;
+  bool at_start;
+} Bbv;
+
+bool bbv_init(Bbv *b, const char *path, uint64_t interval);
+/* Writes the final, partial interval and closes the file. */
+bool bbv_finish(Bbv *b);
+void bbv_destroy(Bbv *b);
+
+void bbv_flush_block(Bbv *b);
+void bbv_end_interval(Bbv *b);
+
+/* Call per retired instruction; block_end as for coverage blocks. */
+static inline void bbv_retire(Bbv *b, uint64_t pc, bool block_end) {
+  if (b->at_start) {
+    b->block_pc = pc;
+    b->at_start = false;
+  }
+  b->block_len++;
+  bool cut = ++b->in_interval == b->interval;
+  if (block_end || cut) {
+    bbv_flush_block(b);
+  }
+  /* After a cut mid-block, the rest counts under the same entry PC. */
+  b->at_start = block_end;
+  if (cut) {
+    bbv_end_interval(b);
+  }
+}
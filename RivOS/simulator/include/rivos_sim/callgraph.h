@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "rivos_sim/symtab.h"
+
+/*
+ * Exact call-graph profile. Calls and returns are recognised from the
+ * calling convention: jal/jalr with rd = ra (or t0, the alternate link
+ * register) is a call, jalr x0 through ra/t0 is a return. A shadow stack
+ * of the hart's activations gives inclusive counts; traps and interrupts
+ * are frames of their own, closed by sret/mret. Functions are symbols,
+ * plus one bucket for code outside any symbol.
+ */
+typedef struct {
+  uint64_t self;
+  /* Summed over outermost activations, so recursion is not counted twice. */
+  uint64_t incl;
+  uint64_t calls;
+} CgFunc;
+
+typedef struct {
+  uint32_t caller;
+  uint32_t callee;
+  uint64_t calls;
+  uint64_t incl;
+  /* First call site seen, for callgrind's calls= line. */
+  uint64_t site;
+} CgEdge;
+
+typedef struct {
+  uint32_t func;
+  uint32_t caller;
+  uint64_t ret;
+  uint64_t site;
+  uint64_t entry;
+  bool trap;
+} CgFrame;
+
+typedef struct {
+  const SymbolTable *syms;
+  size_t nfuncs;
+  CgFunc *funcs;
+  /* Live activations per function, to find outermost ones. */
+  uint32_t *active;
+
+  CgEdge *edges;
+  size_t edge_mask;
+  size_t nedges;
+
+  CgFrame *stack;
+  size_t depth;
+  size_t stack_cap;
+
+  uint64_t insns;
+  uint64_t next_pc;
+  const Symbol *cur_sym;
+  uint32_t cur_func;
+} Callgraph;
+
+bool cg_init(Callgraph *cg, const SymbolTable *syms, uint64_t entry_pc);
+void cg_destroy(Callgraph *cg);
+
+/* After each instruction, with the PC it went to. */
+void cg_retire(Callgraph *cg, uint64_t pc, uint32_t insn, uint64_t next_pc);
+
+/* Closes the activations still open at the end of the run. */
+void cg_finish(Callgraph *cg);
+
+/* gprof-style flat profile and call graph, counted in instructions. */
+void cg_report(const Callgraph *cg, FILE *out);
+
+/* Callgrind format (events: Ir) for kcachegrind and friends. */
+bool cg_write_callgrind(const Callgraph *cg, const char *path,
+                        const char *elf_path);
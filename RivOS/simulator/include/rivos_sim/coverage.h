@@ -0,0 +1,58 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+enum {
+  COV_MAP_BITS = 16,
+  COV_MAP_SIZE = 1u << COV_MAP_BITS,
+  COV_SEEN_MIN = 1024,
+};
+
+/*
+ * AFL-style edge coverage. Each block entry bumps one byte of `map`, indexed
+ * by hash(prev block) ^ hash(current block). Block entry PCs are recorded the
+ * first time the block runs, whatever its edges collide with, so tools can
+ * map coverage back to code.
+ */
+typedef struct {
+  uint8_t *map;
+  uint32_t prev;
+
+  uint64_t *blocks;
+  size_t nblocks;
+  size_t cap;
+
+  /* The PCs in blocks, open addressing; seen[i] == 0 is empty. */
+  uint64_t *seen;
+  size_t seen_cap;
+} Coverage;
+
+bool cov_init(Coverage *c);
+void cov_reset(Coverage *c);
+void cov_destroy(Coverage *c);
+/* Adds pc to blocks unless it is there already. */
+void cov_record_block(Coverage *c, uint64_t pc);
+bool cov_dump(const Coverage *c, const char *path);
+bool cov_load(Coverage *c, const char *path);
+
+static inline uint32_t cov_hash(uint64_t pc) {
+  return (uint32_t)((pc >> 1) * 0x9E3779B97F4A7C15ull >> (64 - COV_MAP_BITS));
+}
+
+static inline size_t cov_seen_slot(uint64_t pc, size_t cap) {
+  return (size_t)((pc >> 2) * 0x9E3779B97F4A7C15ull >> 20) & (cap - 1);
+}
+
+static inline void cov_block(Coverage *c, uint64_t pc) {
+  uint32_t cur = cov_hash(pc);
+  uint8_t *e = &c->map[cur ^ c->prev];
+  uint64_t key = pc ? pc : 1;
+  /* Usually the block is in its home slot; cov_record_block probes on. */
+  if (c->seen[cov_seen_slot(key, c->seen_cap)] != key) {
+    cov_record_block(c, pc);
+  }
+  *e = (uint8_t)(*e + 1 + (*e == 0xFF));
+  c->prev = cur >> 1;
+}
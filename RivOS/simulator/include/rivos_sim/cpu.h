@@ -3,18 +3,73 @@
 #include <stdbool.h>
 #include <stdint.h>
 
+enum {
+  /* Vector register length in bits: a power of two in [MIN, MAX]. */
+  RIVOS_SIM_VLEN_MIN = 64,
+  RIVOS_SIM_VLEN_MAX = 1024,
+  RIVOS_SIM_VLEN_DEFAULT = 128,
+};
+
+enum {
+  PRIV_U = 0,
+  PRIV_S = 1,
+  PRIV_M = 3,
+};
+
 typedef struct {
   uint64_t pc;
   uint64_t x[32];
+  /* F/D registers; single-precision values are NaN-boxed. */
+  uint64_t f[32];
+  uint8_t priv;
 
-  uint64_t stvec;
-  uint64_t sepc;
-  uint64_t scause;
-  uint64_t stval;
+  /* MEIP/SEIP as driven by the PLIC; ORed into mip on read. */
+  uint64_t mip_ext;
+  uint64_t instret;
 
+  /* S-mode ecalls go to the built-in SBI rather than to M-mode code. */
+  bool sbi_host;
+  /* Stalled in wfi until mip & mie becomes non-zero. */
+  bool wfi;
   bool halted;
+  /*
+   * Linux user mode: U-mode ecalls are system calls (see user.h) and any
+   * other exception halts with its cause, pc and tval in the M-mode CSRs.
+   */
+  bool linux_user;
+
+  /* LR/SC reservation: the address of the last lr, until a trap or sc. */
+  uint64_t reservation;
+  bool reserved;
+
+  /* Traps taken, by exception code or 16 + interrupt code. S-mode ecalls
+   * served by the built-in SBI count as CAUSE_ECALL_S. */
+  uint64_t traps[32];
+
+  /*
+   * Vector registers, each vlenb bytes and packed so that a register group
+   * is contiguous. Only the first 32 * vlenb bytes are live.
+   */
+  uint16_t vlenb;
+  _Alignas(32) uint8_t v[32 * (RIVOS_SIM_VLEN_MAX / 8)];
+
+  /* Flat CSR file indexed by CSR number; see csr.c. */
+  uint64_t csr[4096];
 } Cpu;
 
 struct Machine;
 
+/*
+ * Resets the hart to start at pc in the given privilege. Starting in S-mode
+ * behaves as if SBI firmware had handed over: ecalls are served by the
+ * simulator and exceptions and S-level interrupts are delegated.
+ */
+void cpu_reset(Cpu *cpu, uint64_t pc, int priv);
+
+/* Copies architectural state, touching only implemented CSRs. */
+void cpu_copy(Cpu *dst, const Cpu *src);
+
 void cpu_exec_one(struct Machine *m, Cpu *cpu);
+
+/* Refreshes external interrupt lines and takes a pending enabled interrupt. */
+void cpu_interrupt(struct Machine *m, Cpu *cpu);
@@ -1,15 +1,133 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 
 #include "rivos_sim/cpu.h"
 
 enum {
+  CSR_FFLAGS = 0x001,
+  CSR_FRM = 0x002,
+  CSR_FCSR = 0x003,
+  CSR_VSTART = 0x008,
+  CSR_VXSAT = 0x009,
+  CSR_VXRM = 0x00a,
+  CSR_VCSR = 0x00f,
+
+  CSR_SSTATUS = 0x100,
+  CSR_SIE = 0x104,
   CSR_STVEC = 0x105,
+  CSR_SCOUNTEREN = 0x106,
+  CSR_SENVCFG = 0x10a,
+  CSR_SSCRATCH = 0x140,
   CSR_SEPC = 0x141,
   CSR_SCAUSE = 0x142,
   CSR_STVAL = 0x143,
+  CSR_SIP = 0x144,
+  CSR_SATP = 0x180,
+
+  CSR_MSTATUS = 0x300,
+  CSR_MISA = 0x301,
+  CSR_MEDELEG = 0x302,
+  CSR_MIDELEG = 0x303,
+  CSR_MIE = 0x304,
+  CSR_MTVEC = 0x305,
+  CSR_MCOUNTEREN = 0x306,
+  CSR_MENVCFG = 0x30a,
+  CSR_MCOUNTINHIBIT = 0x320,
+  CSR_MSCRATCH = 0x340,
+  CSR_MEPC = 0x341,
+  CSR_MCAUSE = 0x342,
+  CSR_MTVAL = 0x343,
+  CSR_MIP = 0x344,
+  CSR_PMPCFG0 = 0x3a0,
+  CSR_PMPCFG2 = 0x3a2,
+  CSR_PMPADDR0 = 0x3b0,
+
+  CSR_MCYCLE = 0xb00,
+  CSR_MINSTRET = 0xb02,
+
+  CSR_CYCLE = 0xc00,
+  CSR_TIME = 0xc01,
+  CSR_INSTRET = 0xc02,
+  CSR_VL = 0xc20,
+  CSR_VTYPE = 0xc21,
+  CSR_VLENB = 0xc22,
+
+  CSR_MVENDORID = 0xf11,
+  CSR_MARCHID = 0xf12,
+  CSR_MIMPID = 0xf13,
+  CSR_MHARTID = 0xf14,
+  CSR_MCONFIGPTR = 0xf15,
 };
 
-uint64_t csr_read(Cpu *cpu, uint32_t csr);
-void csr_write(Cpu *cpu, uint32_t csr, uint64_t v);
+enum {
+  MSTATUS_SIE = 1ull << 1,
+  MSTATUS_MIE = 1ull << 3,
+  MSTATUS_SPIE = 1ull << 5,
+  MSTATUS_MPIE = 1ull << 7,
+  MSTATUS_SPP = 1ull << 8,
+  MSTATUS_VS = 3ull << 9,
+  MSTATUS_VS_INITIAL = 1ull << 9,
+  MSTATUS_MPP_SHIFT = 11,
+  MSTATUS_MPP = 3ull << MSTATUS_MPP_SHIFT,
+  MSTATUS_FS = 3ull << 13,
+  MSTATUS_FS_INITIAL = 1ull << 13,
+  MSTATUS_MPRV = 1ull << 17,
+  MSTATUS_SUM = 1ull << 18,
+  MSTATUS_MXR = 1ull << 19,
+  MSTATUS_TVM = 1ull << 20,
+  MSTATUS_TW = 1ull << 21,
+  MSTATUS_TSR = 1ull << 22,
+  MSTATUS_UXL = 3ull << 32,
+  MSTATUS_SXL = 3ull << 34,
+  MSTATUS_SD = 1ull << 63,
+
+  /* sstatus is a view of these mstatus bits. */
+  SSTATUS_SIE = MSTATUS_SIE,
+  SSTATUS_SPIE = MSTATUS_SPIE,
+  SSTATUS_SPP = MSTATUS_SPP,
+
+  MIP_SSIP = 1ull << 1,
+  MIP_MSIP = 1ull << 3,
+  MIP_STIP = 1ull << 5,
+  MIP_MTIP = 1ull << 7,
+  MIP_SEIP = 1ull << 9,
+  MIP_MEIP = 1ull << 11,
+
+  SIP_SSIP = MIP_SSIP,
+  SIP_STIP = MIP_STIP,
+  SIP_SEIP = MIP_SEIP,
+};
+
+#define CAUSE_INTERRUPT (1ull << 63)
+
+enum {
+  CAUSE_MISALIGNED_FETCH = 0,
+  CAUSE_ILLEGAL_INSN = 2,
+  CAUSE_BREAKPOINT = 3,
+  CAUSE_MISALIGNED_STORE = 6,
+  CAUSE_ECALL_U = 8,
+  CAUSE_ECALL_S = 9,
+  CAUSE_ECALL_M = 11,
+
+  IRQ_S_SOFT = 1,
+  IRQ_M_SOFT = 3,
+  IRQ_S_TIMER = 5,
+  IRQ_M_TIMER = 7,
+  IRQ_S_EXT = 9,
+  IRQ_M_EXT = 11,
+};
+
+/*
+ * Both return false when the access is illegal at the current privilege
+ * (unimplemented CSR, too low a level, write to a read-only CSR); the
+ * caller raises an illegal instruction exception.
+ */
+bool csr_read(Cpu *cpu, uint32_t csr, uint64_t *v);
+bool csr_write(Cpu *cpu, uint32_t csr, uint64_t v);
+
+/* mip including the external lines driven by the PLIC. */
+static inline uint64_t csr_mip(const Cpu *cpu) {
+  return cpu->csr[CSR_MIP] | cpu->mip_ext;
+}
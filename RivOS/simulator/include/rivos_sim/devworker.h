@@ -0,0 +1,80 @@
+#pragma once
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "rivos_sim/machine.h"
+#include "rivos_sim/spsc.h"
+
+/*
+ * A device model's host thread. The CPU thread rings the doorbell with
+ * 64-bit messages and the worker runs work() for each; completions posted
+ * back are handed to complete() on the CPU thread the next time it polls
+ * for interrupts, so guest-visible state (used rings, interrupt lines)
+ * only changes on the CPU thread. Neither direction takes a lock unless
+ * the worker is asleep.
+ */
+enum {
+  DEVWORKER_RING = 1024,
+};
+
+typedef struct DevWorker DevWorker;
+
+typedef struct {
+  /* Worker thread, per doorbell message. */
+  void (*work)(DevWorker *w, uint64_t msg);
+  /* Worker thread, when the doorbell ring has run dry; optional. */
+  void (*idle)(DevWorker *w);
+  /* CPU thread, per completion posted by work(). */
+  void (*complete)(DevWorker *w, uint64_t msg);
+  /*
+   * Whether unanswered doorbells keep wfi waiting: true for devices that
+   * interrupt when they are done.
+   */
+  bool irq_source;
+} DevWorkerOps;
+
+struct DevWorker {
+  Machine *m;
+  const DevWorkerOps *ops;
+  void *opaque;
+  /* Index in m->workers; bit index % 64 of m->dev_pending. */
+  uint32_t slot;
+
+  SpscQueue doorbell;
+  SpscQueue done;
+
+  /* Messages rung (CPU thread) and fully handled (worker) so far. */
+  uint64_t rung;
+  _Atomic uint64_t served;
+  bool held;
+
+  _Atomic bool parked;
+  _Atomic bool stop;
+  pthread_mutex_t lock;
+  pthread_cond_t cond;
+  pthread_t thread;
+  bool live;
+};
+
+bool devworker_start(DevWorker *w, Machine *m, const DevWorkerOps *ops,
+                     void *opaque);
+/* Handles what is still rung, then joins the thread. */
+void devworker_stop(DevWorker *w);
+
+/* CPU thread. Waits for room if the worker is a full ring behind. */
+void devworker_ring(DevWorker *w, uint64_t msg);
+
+/* Worker thread. */
+void devworker_post(DevWorker *w, uint64_t msg);
+
+/*
+ * CPU thread: waits until every rung message has been handled, then
+ * delivers the completions, or drops them if the device is being reset.
+ */
+void devworker_quiesce(DevWorker *w, bool deliver);
+
+/* CPU thread: delivers completions of the workers flagged in dev_pending. */
+void devworker_poll(Machine *m);
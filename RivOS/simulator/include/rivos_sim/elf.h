@@ -1,8 +1,69 @@
 #pragma once
 
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 #include "rivos_sim/machine.h"
+#include "rivos_sim/symtab.h"
 
 bool load_elf(Machine *m, const char *path, uint64_t *entry_out);
+
+typedef struct {
+  uint64_t start;
+  uint64_t end;
+} ElfRange;
+
+/* Guest address ranges of the executable PT_LOAD segments; 0 on error. */
+size_t load_elf_exec_ranges(Machine *m, const char *path, ElfRange *out,
+                            size_t max);
+
+/* A PT_LOAD segment: file contents up to file_end, zero fill up to end. */
+typedef struct {
+  uint64_t start;
+  uint64_t file_end;
+  uint64_t end;
+} ElfSegment;
+
+/* Guest address ranges of all PT_LOAD segments; 0 on error. */
+size_t load_elf_segments(Machine *m, const char *path, ElfSegment *out,
+                         size_t max);
+
+/* A Linux executable as placed by load_elf_user. */
+typedef struct {
+  uint64_t entry;
+  /* Guest address of the program headers, for AT_PHDR; 0 if not loaded. */
+  uint64_t phdr;
+  uint16_t phnum;
+  uint16_t phent;
+  /* Page-aligned end of the highest segment: the initial program break. */
+  uint64_t end;
+} ElfUserImage;
+
+/*
+ * Loads a static Linux executable by virtual address: ET_EXEC where it was
+ * linked, ET_DYN (static PIE) at dyn_base. Executables that need a dynamic
+ * linker fail with ENOEXEC.
+ */
+bool load_elf_user(Machine *m, const char *path, uint64_t dyn_base,
+                   ElfUserImage *out);
+
+/*
+ * Like load_elf, but maps the loaded pages copy-on-write from a
+ * shared-memory image that every instance loading the same file shares, so
+ * pages the guest never writes (text, rodata) take host memory once. Expects
+ * freshly initialised RAM. Falls back to a private copy if the image cannot
+ * be shared. Images outlive the simulator: remove /dev/shm/rivos-img.* to
+ * reclaim them.
+ */
+bool load_elf_shared(Machine *m, const char *path, uint64_t *entry_out);
+bool load_elf_symbols(const char *path, SymbolTable *st);
+
+typedef struct {
+  char name[32];
+  uint64_t start;
+  uint64_t end;
+} ElfSection;
+
+/* Sections that occupy memory (SHF_ALLOC), names truncated; 0 on error. */
+size_t load_elf_sections(const char *path, ElfSection *out, size_t max);
@@ -0,0 +1,97 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "rivos_sim/machine.h"
+
+/*
+ * Linear framebuffer at RIVOS_SIM_FB_BASE, described by a small register
+ * window at RIVOS_SIM_FB_REGS_BASE (Linux simple-framebuffer style: no
+ * modes, no acceleration). The guest draws with plain stores and writes
+ * FB_REG_FLUSH at the end of each frame.
+ */
+enum {
+  FB_REG_WIDTH = 0x00,
+  FB_REG_HEIGHT = 0x04,
+  FB_REG_STRIDE = 0x08,
+  FB_REG_FORMAT = 0x0c,
+  FB_REG_FLUSH = 0x10,
+  FB_REG_FRAME = 0x14,
+  FB_REGS_SIZE = 0x100,
+};
+
+typedef enum {
+  FB_XRGB8888 = 0,
+  FB_RGB565 = 1,
+} FbFormat;
+
+enum {
+  FB_VERSION = 1,
+  FB_MAX_DIM = 4096,
+  /* Dirty tracking granularity in pixels, both directions. */
+  FB_TILE = 32,
+  FB_MAX_TILES = (FB_MAX_DIM / FB_TILE) * (FB_MAX_DIM / FB_TILE),
+  /* Pixels start at this offset in the backing file. */
+  FB_HEADER_SIZE = 4096,
+};
+
+/*
+ * First page of the backing file. Pixels are live (a viewer mapping the
+ * file sees every store as it happens); the fields below change only at a
+ * flush, under the same odd/even seq protocol as the stats page.
+ */
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  uint32_t width;
+  uint32_t height;
+  uint32_t stride;
+  uint32_t format;
+  uint32_t tile;
+  int32_t pid;
+  uint32_t _pad;
+  _Atomic uint64_t seq;
+  uint64_t frame;
+  /* Bytes stored to the framebuffer during the last frame. */
+  uint64_t frame_bytes;
+  /* Tiles written during the last frame, row-major. */
+  uint64_t dirty[FB_MAX_TILES / 64];
+} FbHeader;
+
+_Static_assert(sizeof(FbHeader) <= FB_HEADER_SIZE, "FbHeader too large");
+
+typedef struct {
+  uint32_t width;
+  uint32_t height;
+  FbFormat format;
+  /* Backing file shared with viewers; NULL for anonymous memory. */
+  const char *path;
+  /* Headless: write every flushed frame to DIR/frame-NNNNNN.ppm. */
+  const char *ppm_dir;
+} FbConfig;
+
+/* Parses "WxH[,xrgb8888|rgb565][,file=PATH][,ppm=DIR]"; strings borrowed. */
+bool fb_parse(FbConfig *cfg, char *spec);
+
+bool fb_add(Machine *m, const FbConfig *cfg);
+
+static inline uint32_t fb_bpp(uint32_t format) {
+  return format == FB_RGB565 ? 2 : 4;
+}
+
+static inline uint32_t fb_tiles_x(const FbHeader *h) {
+  return (h->width + h->tile - 1) / h->tile;
+}
+
+static inline uint32_t fb_tiles_y(const FbHeader *h) {
+  return (h->height + h->tile - 1) / h->tile;
+}
+
+/* Maps a backing file read-only, for viewers. NULL with errno on error. */
+const FbHeader *fb_attach(const char *path, size_t *size_out);
+
+/* Binary PPM of the pixels following the header. */
+bool fb_write_ppm(const FbHeader *h, FILE *out);
@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "rivos_sim/cpu.h"
+#include "rivos_sim/machine.h"
+
+enum {
+  FFLAG_NX = 1 << 0,
+  FFLAG_UF = 1 << 1,
+  FFLAG_OF = 1 << 2,
+  FFLAG_DZ = 1 << 3,
+  FFLAG_NV = 1 << 4,
+};
+
+enum {
+  RM_RNE = 0,
+  RM_RTZ = 1,
+  RM_RDN = 2,
+  RM_RUP = 3,
+  RM_RMM = 4,
+  RM_DYN = 7,
+};
+
+/*
+ * Executes an F/D instruction (LOAD-FP, STORE-FP, OP-FP and the fused
+ * multiply-adds). Returns false if it is illegal, including when
+ * mstatus.FS is Off.
+ */
+bool fpu_exec(Machine *m, Cpu *cpu, uint32_t insn);
+
+/*
+ * Exception flags accumulate in the host FPU (MXCSR) and are only folded
+ * into fcsr here. Call before fcsr is observed or the state is copied.
+ */
+void fpu_sync(Cpu *cpu);
+
+/* Drops host flags raised outside of guest execution. */
+void fpu_discard(void);
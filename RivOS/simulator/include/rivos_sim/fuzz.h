@@ -0,0 +1,89 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rivos_sim/coverage.h"
+#include "rivos_sim/cpu.h"
+#include "rivos_sim/machine.h"
+#include "rivos_sim/plic.h"
+#include "rivos_sim/symtab.h"
+#include "rivos_sim/uart.h"
+
+/* Function IDs of SBI_EXT_RIVOS_FUZZ (a6). */
+enum {
+  SBI_RIVOS_FUZZ_START = 0, /* a0 = buf, a1 = cap; returns a1 = input len */
+  SBI_RIVOS_FUZZ_DONE = 1,
+  SBI_RIVOS_FUZZ_CRASH = 2, /* a0 = guest-defined code */
+};
+
+enum {
+  FUZZ_MAX_MARKERS = 8,
+};
+
+typedef enum {
+  FUZZ_OK,
+  FUZZ_CRASH,
+  FUZZ_HANG,
+} FuzzStatus;
+
+typedef struct {
+  /* Snapshot point: symbol or address; NULL waits for SBI FUZZ_START. */
+  const char *at;
+  /*
+   * Input target at an `at` marker: "SYMBOL" or "ADDR:SIZE". When NULL the
+   * input is loaded into a0-a7, as if the marker function took it as args.
+   */
+  const char *buf;
+  const char *stop[FUZZ_MAX_MARKERS];
+  size_t nstop;
+  const char *crash[FUZZ_MAX_MARKERS];
+  size_t ncrash;
+
+  uint64_t boot_insns;
+  uint64_t exec_insns;
+} FuzzConfig;
+
+typedef struct Fuzz {
+  FuzzConfig cfg;
+  Machine *m;
+  Cpu *cpu;
+  Coverage cov;
+
+  uint8_t *snap_ram;
+  Cpu snap_cpu;
+  Plic snap_plic;
+  UartRegs snap_uart;
+  uint32_t snap_irq_level;
+
+  uint64_t markers[2 * FUZZ_MAX_MARKERS];
+  size_t nstop;
+  size_t nmarkers;
+
+  bool sbi_marker;
+  uint64_t in_addr;
+  uint64_t in_cap;
+
+  int event;
+  uint64_t crash_code;
+  uint64_t execs;
+} Fuzz;
+
+typedef struct {
+  uint64_t iterations;
+  uint64_t seed;
+  size_t max_len;
+  const char *corpus_dir;
+  const char *out_dir;
+} FuzzLoopConfig;
+
+void fuzz_default_config(FuzzConfig *cfg);
+bool fuzz_boot(Fuzz *f, Machine *m, Cpu *cpu, const SymbolTable *syms,
+               const FuzzConfig *cfg);
+FuzzStatus fuzz_exec(Fuzz *f, const uint8_t *data, size_t len);
+void fuzz_destroy(Fuzz *f);
+
+void fuzz_sbi_call(Fuzz *f, Cpu *cpu);
+
+int fuzz_loop(Fuzz *f, const FuzzLoopConfig *lc);
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "rivos_sim/machine.h"
+#include "rivos_sim/symtab.h"
+
+enum {
+  HEAT_READ,
+  HEAT_WRITE,
+  HEAT_FETCH,
+  HEAT_KINDS,
+};
+
+enum {
+  HEAT_DEFAULT_INTERVAL = 10 * 1000 * 1000,
+};
+
+/*
+ * Per-page access counts for guest RAM, from the CPU's own loads, stores
+ * and instruction fetches (device DMA is not counted). Each access bumps a
+ * counter and sets the page's bit in a per-interval bitmap; at the end of
+ * every interval the bitmaps give one line of working set over time.
+ */
+typedef struct Heat {
+  Machine *m;
+  size_t npages;
+  /* [page][kind] counts over the whole run. */
+  uint64_t (*counts)[HEAT_KINDS];
+  /* Pages touched this interval, one bitmap per kind. */
+  uint64_t *seen[HEAT_KINDS];
+  /* Pages touched in any interval so far. */
+  uint64_t *ever;
+  /* Intervals in which each page was touched. */
+  uint32_t *active;
+
+  uint64_t interval;
+  uint64_t in_interval;
+  uint64_t intervals;
+  /* Pages touched in closed intervals. */
+  uint64_t footprint;
+  FILE *ws;
+} Heat;
+
+/* Writes the working set to ws_path as CSV, one row per interval. */
+bool heat_init(Heat *h, Machine *m, const char *ws_path, uint64_t interval);
+void heat_destroy(Heat *h);
+
+/* Closes the current interval; instret labels the row. */
+void heat_end_interval(Heat *h, uint64_t instret);
+/* Closes a partial last interval, if any. */
+void heat_finish(Heat *h, uint64_t instret);
+
+/*
+ * Writes one CSV row per page ever touched: counts, active intervals, and
+ * the ELF sections and symbols it overlaps (elf_path may be NULL).
+ */
+bool heat_write_map(Heat *h, const char *path, const char *elf_path,
+                    const SymbolTable *syms);
+
+static inline void heat_touch(Heat *h, unsigned kind, uint64_t off) {
+  size_t page = (size_t)(off >> RIVOS_SIM_PAGE_SHIFT);
+  h->counts[page][kind]++;
+  h->seen[kind][page / 64] |= 1ull << (page % 64);
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rivos_sim/machine.h"
+
+/*
+ * Memory shared with host processes, ivshmem style. A POSIX shared-memory
+ * object is mapped at RIVOS_SIM_IVSHMEM_BASE (Machine.shm) and both sides
+ * see each other's stores as they happen. Doorbells go both ways through
+ * eventfds: the guest writes IVSHMEM_REG_DOORBELL to signal the host, and a
+ * host write to the other eventfd latches IVSHMEM_INT_DOORBELL in
+ * IVSHMEM_REG_STATUS and raises RIVOS_SIM_IVSHMEM_IRQ while unmasked.
+ *
+ * Host processes get the memory and both eventfds from a UNIX socket, one
+ * IvshmemHello with SCM_RIGHTS per connection (ivshmem_connect). Every
+ * peer shares the same two eventfds. Without a socket only the memory is
+ * shared: no host process can reach the eventfds, so neither doorbell
+ * does anything.
+ */
+enum {
+  IVSHMEM_REG_MAGIC = 0x00,
+  IVSHMEM_REG_SIZE_LO = 0x04,
+  IVSHMEM_REG_SIZE_HI = 0x08,
+  /* Interrupts enabled, IVSHMEM_INT_* bits. */
+  IVSHMEM_REG_MASK = 0x0c,
+  /* Latched interrupts; write 1s to clear. */
+  IVSHMEM_REG_STATUS = 0x10,
+  /* Write: adds the value (0 counts as 1) to the host's eventfd. */
+  IVSHMEM_REG_DOORBELL = 0x14,
+  /* Host doorbell rings received so far, modulo 2^32. */
+  IVSHMEM_REG_RINGS = 0x18,
+  IVSHMEM_REGS_SIZE = 0x100,
+
+  IVSHMEM_INT_DOORBELL = 1u << 0,
+
+  /* "RVSH" little-endian. */
+  IVSHMEM_MAGIC = 0x48535652,
+  IVSHMEM_VERSION = 1,
+  IVSHMEM_DEFAULT_SIZE = 16u * 1024u * 1024u,
+  /* Up to RIVOS_SIM_RAM_BASE. */
+  IVSHMEM_MAX_SIZE = 512u * 1024u * 1024u,
+};
+
+typedef struct {
+  /* shm_open name, such as /rivos-shm. */
+  const char *name;
+  uint64_t size;
+  /* UNIX socket handing out the fds; NULL for none. */
+  const char *sock;
+} IvshmemConfig;
+
+/* Parses "NAME[,size=N][,sock=PATH]"; strings borrowed. */
+bool ivshmem_parse(IvshmemConfig *cfg, char *spec);
+
+/*
+ * Opens (creating if needed) the object, grows it to cfg->size if it is
+ * smaller, and maps it into m. Without a size an existing object keeps its
+ * own.
+ */
+bool ivshmem_add(Machine *m, const IvshmemConfig *cfg);
+
+/* The data part of the message a peer receives on connecting. */
+typedef struct {
+  uint32_t magic;
+  uint32_t version;
+  uint64_t size;
+} IvshmemHello;
+
+/* What a host process holds after ivshmem_connect. */
+typedef struct {
+  uint8_t *mem;
+  uint64_t size;
+  /* Write 8-byte counts to ring the guest; read to wait for its rings. */
+  int to_guest;
+  int to_host;
+} IvshmemPeer;
+
+/* Connects to a running simulator's socket; false with errno on error. */
+bool ivshmem_connect(const char *sock, IvshmemPeer *p);
+void ivshmem_disconnect(IvshmemPeer *p);
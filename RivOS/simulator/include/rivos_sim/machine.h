@@ -1,5 +1,8 @@
 #pragma once
 
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
 
@@ -7,10 +10,144 @@ enum {
   RIVOS_SIM_RAM_BASE = 0x80000000ull,
   RIVOS_SIM_RAM_SIZE = 128ull * 1024ull * 1024ull,
 
+  RIVOS_SIM_PLIC_BASE = 0x0c000000ull,
+  RIVOS_SIM_PLIC_SIZE = 0x04000000ull,
+
   RIVOS_SIM_UART16550_BASE = 0x10000000ull,
+  RIVOS_SIM_UART_IRQ = 10,
+
+  /* virtio-mmio slots, laid out like QEMU virt: IRQ n + 1 for slot n. */
+  RIVOS_SIM_VIRTIO_BASE = 0x10001000ull,
+  RIVOS_SIM_VIRTIO_STRIDE = 0x1000ull,
+  RIVOS_SIM_VIRTIO_SLOTS = 8,
+  RIVOS_SIM_VIRTIO_IRQ = 1,
+
+  /* Framebuffer registers and pixels (see fb.h). */
+  RIVOS_SIM_FB_REGS_BASE = 0x10100000ull,
+  RIVOS_SIM_FB_BASE = 0x50000000ull,
+
+  /* Host-shared memory and its doorbell registers (see ivshmem.h). */
+  RIVOS_SIM_IVSHMEM_REGS_BASE = 0x10200000ull,
+  RIVOS_SIM_IVSHMEM_BASE = 0x60000000ull,
+  RIVOS_SIM_IVSHMEM_IRQ = 11,
+
+  RIVOS_SIM_PAGE_SHIFT = 12,
+  RIVOS_SIM_PAGE_SIZE = 1u << RIVOS_SIM_PAGE_SHIFT,
 };
 
+/* A device register window. Accesses are 1, 2, 4 or 8 bytes wide. */
 typedef struct {
+  uint64_t base;
+  uint64_t size;
+  void *opaque;
+  uint64_t (*read)(void *opaque, uint64_t off, unsigned size);
+  void (*write)(void *opaque, uint64_t off, unsigned size, uint64_t val);
+  void (*destroy)(void *opaque);
+} MmioRegion;
+
+enum {
+  MACHINE_MAX_MMIO = 16,
+  /* Device threads: every virtio queue of every slot, plus the UART. */
+  MACHINE_MAX_WORKERS = 160,
+};
+
+struct DevWorker;
+struct Fuzz;
+struct Heat;
+struct Plic;
+struct Sanitizer;
+struct Semihost;
+struct Uart;
+struct User;
+
+typedef struct Machine {
   uint8_t *ram;
+  /* Guest physical address of ram[0]: RIVOS_SIM_RAM_BASE on the board. */
+  uint64_t ram_base;
   size_t ram_size;
+
+  /* One bit per RAM page written since the last clear; NULL if untracked. */
+  uint64_t *dirty;
+
+  /*
+   * Host memory at [shm_base, shm_base + shm_size), loaded and stored
+   * directly like RAM but outside dirty tracking (--ivshmem). Size 0: none.
+   */
+  uint8_t *shm;
+  uint64_t shm_base;
+  uint64_t shm_size;
+
+  MmioRegion mmio[MACHINE_MAX_MMIO];
+  size_t nmmio;
+
+  struct Plic *plic;
+  struct Uart *uart;
+
+  /* Level of each external interrupt line, settable from any thread. */
+  _Atomic uint32_t irq_level;
+  /* Bumped on every rising edge; wfi sleeps until it changes. */
+  _Atomic uint32_t irq_gen;
+  /* Host threads that may still raise a line; wfi with none left halts. */
+  _Atomic int irq_sources;
+  /*
+   * Device workers with completions to deliver, one bit per slot modulo
+   * 64; checked wherever interrupts are polled.
+   */
+  _Atomic uint64_t dev_pending;
+  struct DevWorker *workers[MACHINE_MAX_WORKERS];
+  size_t nworkers;
+  pthread_mutex_t irq_lock;
+  pthread_cond_t irq_cond;
+
+  bool console_muted;
+  /* Bytes the guest has written to the console, muted or not. */
+  uint64_t console_bytes;
+  struct Fuzz *fuzz;
+  /* NULL unless semihosting calls are served. */
+  struct Semihost *semihost;
+  /* NULL unless shadow memory is kept (--sanitize). */
+  struct Sanitizer *san;
+  /* NULL unless page accesses are counted (--heat). */
+  struct Heat *heat;
+  /* NULL unless running a Linux executable (--user). */
+  struct User *user;
+  /* Exit status requested by the guest (SYS_EXIT, exit_group). */
+  int exit_code;
 } Machine;
+
+/* Allocates RAM and adds the board devices (PLIC, UART). */
+bool machine_init(Machine *m, size_t ram_size);
+/* The same with RAM at ram_base; it shadows any device it overlaps. */
+bool machine_init_at(Machine *m, uint64_t ram_base, size_t ram_size);
+void machine_destroy(Machine *m);
+
+bool machine_track_dirty(Machine *m);
+void machine_clear_dirty(Machine *m);
+
+/*
+ * Marks a RAM page dirty. Device threads mark pages too, so the OR is
+ * atomic; it is skipped when the bit is already set, as it mostly is.
+ */
+static inline void machine_dirty_page(Machine *m, size_t page) {
+  uint64_t *w = &m->dirty[page / 64];
+  uint64_t bit = 1ull << (page % 64);
+  if (!(__atomic_load_n(w, __ATOMIC_RELAXED) & bit)) {
+    __atomic_fetch_or(w, bit, __ATOMIC_RELAXED);
+  }
+}
+
+bool machine_add_mmio(Machine *m, const MmioRegion *r);
+void machine_set_irq(Machine *m, uint32_t line, bool level);
+
+/* Wakes a CPU thread sleeping in wfi so that it polls again. */
+void machine_kick(Machine *m);
+
+void machine_hold_irq_source(Machine *m);
+void machine_release_irq_source(Machine *m);
+
+/* Blocks until irq_gen differs from gen or the last source is released. */
+void machine_wait_irq(Machine *m, uint32_t gen);
+
+static inline size_t machine_page_count(const Machine *m) {
+  return m->ram_size >> RIVOS_SIM_PAGE_SHIFT;
+}
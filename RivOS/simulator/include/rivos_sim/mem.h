@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include "rivos_sim/machine.h"
@@ -9,7 +10,16 @@ uint16_t mem_read16(Machine *m, uint64_t addr);
 uint32_t mem_read32(Machine *m, uint64_t addr);
 uint64_t mem_read64(Machine *m, uint64_t addr);
 
+/* An instruction fetch: mem_read32, counted as a fetch by --heat. */
+uint32_t mem_fetch32(Machine *m, uint64_t addr);
+
 void mem_write8(Machine *m, uint64_t addr, uint8_t val);
 void mem_write16(Machine *m, uint64_t addr, uint16_t val);
 void mem_write32(Machine *m, uint64_t addr, uint32_t val);
 void mem_write64(Machine *m, uint64_t addr, uint64_t val);
+
+/* Marks RAM pages in [addr, addr + len) dirty after a bulk host-side write. */
+void mem_mark_dirty(Machine *m, uint64_t addr, uint64_t len);
+
+/* Host pointer to guest RAM [addr, addr + len), or NULL if not all RAM. */
+uint8_t *mem_ram_ptr(Machine *m, uint64_t addr, uint64_t len);
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <stdint.h>
+
+#include "rivos_sim/machine.h"
+
+/* SiFive-style PLIC with one hart: context 0 is M-mode, 1 is S-mode. */
+enum {
+  PLIC_SOURCES = 32,
+  PLIC_CONTEXTS = 2,
+  PLIC_CTX_M = 0,
+  PLIC_CTX_S = 1,
+};
+
+typedef struct Plic {
+  Machine *m;
+  uint32_t priority[PLIC_SOURCES];
+  uint32_t enable[PLIC_CONTEXTS];
+  uint32_t threshold[PLIC_CONTEXTS];
+  uint32_t claimed;
+} Plic;
+
+bool plic_add(Machine *m);
+
+/* Highest-priority claimable source for ctx, or 0 if none. */
+uint32_t plic_pending(const Plic *p, int ctx);
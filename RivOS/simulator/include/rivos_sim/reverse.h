@@ -0,0 +1,119 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "rivos_sim/cpu.h"
+#include "rivos_sim/machine.h"
+#include "rivos_sim/plic.h"
+#include "rivos_sim/run.h"
+#include "rivos_sim/symtab.h"
+#include "rivos_sim/uart.h"
+
+enum {
+  REV_DEFAULT_INTERVAL = 1000 * 1000,
+  REV_DEFAULT_MEM_MB = 256,
+  REV_MAX_WATCH = 4,
+};
+
+/*
+ * Reverse execution by checkpoint and re-execution. Every `interval`
+ * instructions the CPU, PLIC and UART registers are saved, along with the
+ * old contents of the RAM pages written since the previous checkpoint (an
+ * undo record). Going back restores the nearest checkpoint at or before the
+ * target and runs forward to it, which gives the same state as long as the
+ * machine has no inputs from the host: UART input and the device models
+ * that talk to host threads are off in this mode.
+ *
+ * Positions count the instructions run since rev_init.
+ */
+typedef struct {
+  uint64_t pos;
+  Cpu *cpu;
+  Plic plic;
+  UartRegs uart;
+  uint32_t irq_level;
+  uint64_t console_bytes;
+  int exit_code;
+
+  /* Pages written before the next checkpoint, as they were here. */
+  uint32_t *pages;
+  uint8_t *data;
+  size_t npages;
+} RevCheckpoint;
+
+typedef struct {
+  uint64_t addr;
+  unsigned len;
+} RevWatch;
+
+typedef struct {
+  uint64_t interval;
+  /* Checkpoint data kept before the oldest is dropped. */
+  uint64_t mem_cap;
+} RevConfig;
+
+typedef struct {
+  RevConfig cfg;
+  Machine *m;
+  Cpu *cpu;
+
+  /* RAM as it was at the newest checkpoint. */
+  uint8_t *shadow;
+
+  /* Checkpoints first .. first + count - 1, oldest at ckpts[0]. */
+  RevCheckpoint *ckpts;
+  size_t cap;
+  uint64_t first;
+  size_t count;
+  uint64_t bytes;
+  uint64_t dropped;
+
+  uint64_t pos;
+  /* Furthest position reached. */
+  uint64_t end;
+  /*
+   * Checkpoint the RAM differs from in m->dirty's pages. live: it is the
+   * newest, and running on takes new checkpoints.
+   */
+  uint64_t base;
+  bool live;
+
+  RevWatch watch[REV_MAX_WATCH];
+  size_t nwatch;
+  /* The last change found: which watch, and its values either side. */
+  size_t hit;
+  uint64_t hit_old;
+  uint64_t hit_new;
+} Rev;
+
+void rev_default_config(RevConfig *cfg);
+/* Takes the first checkpoint at the machine's current state. */
+bool rev_init(Rev *r, Machine *m, Cpu *cpu, const RevConfig *cfg);
+void rev_destroy(Rev *r);
+
+/* Like sim_run, taking checkpoints on the way. */
+uint64_t rev_run(Rev *r, uint64_t max_insns, RunHooks *hooks);
+
+/* Moves to position pos; false if it is before the oldest checkpoint. */
+bool rev_goto(Rev *r, uint64_t pos);
+
+/*
+ * Searches back from the current position for the last instruction that
+ * changed a watched value, and stops before it. False, without moving, if
+ * there is none in the history kept.
+ */
+bool rev_watch_back(Rev *r);
+/*
+ * The same forward, stopping after the instruction; false, at the end of
+ * the history, if there is none.
+ */
+bool rev_watch_forward(Rev *r);
+
+/*
+ * Reads commands from in until EOF or "quit"; "help" lists them. The
+ * guest's console output is muted while it is re-run.
+ */
+void rev_console(Rev *r, const SymbolTable *syms, FILE *in, FILE *out);
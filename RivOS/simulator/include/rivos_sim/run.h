@@ -0,0 +1,40 @@
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rivos_sim/aot.h"
+#include "rivos_sim/bbv.h"
+#include "rivos_sim/callgraph.h"
+#include "rivos_sim/coverage.h"
+#include "rivos_sim/cpu.h"
+#include "rivos_sim/machine.h"
+#include "rivos_sim/sanitizer.h"
+#include "rivos_sim/stats.h"
+#include "rivos_sim/timing.h"
+
+/* Optional per-instruction observers; NULL members are disabled. */
+typedef struct {
+  Timing *timing;
+  Coverage *cov;
+  Callgraph *callgraph;
+  /* Basic-block vectors per interval of the instructions run here. */
+  Bbv *bbv;
+  /* Checks each load and store; the run stops early in halt mode. */
+  Sanitizer *san;
+  /* Refreshed every STATS_SLICE instructions and when the run ends. */
+  Stats *stats;
+  /* Translated blocks; only used when no per-instruction hook is set. */
+  Aot *aot;
+
+  /*
+   * Execution stops before an instruction whose PC is listed here, except for
+   * the first instruction of a run so that a stopped run can be resumed.
+   * sim_run reports the index of the breakpoint hit in bp_hit, or -1.
+   */
+  const uint64_t *breakpoints;
+  size_t nbreakpoints;
+  int bp_hit;
+} RunHooks;
+
+uint64_t sim_run(Machine *m, Cpu *cpu, uint64_t max_insns, RunHooks *hooks);
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "rivos_sim/cpu.h"
+#include "rivos_sim/machine.h"
+#include "rivos_sim/symtab.h"
+
+/*
+ * Function IDs of SBI_EXT_RIVOS_SAN (a6): hints from the guest's allocators
+ * that drive the shadow state. Ranges must lie in RAM.
+ */
+enum {
+  SBI_RIVOS_SAN_ALLOC = 0, /* a0 = addr, a1 = len: addressable, undefined */
+  SBI_RIVOS_SAN_FREE = 1,  /* a0 = addr, a1 = len: no longer addressable */
+  SBI_RIVOS_SAN_DEFINE = 2, /* a0 = addr, a1 = len: contents are valid */
+  SBI_RIVOS_SAN_STACK = 3, /* a0 = lo, a1 = hi: a stack, dead below sp */
+};
+
+typedef enum {
+  SAN_FREED,
+  SAN_UNDEFINED,
+  SAN_DEFINED,
+} SanState;
+
+enum {
+  SAN_MAX_STACKS = 16,
+  /* Distinct faulting PCs remembered; each is reported once. */
+  SAN_SITES = 4096,
+};
+
+typedef struct {
+  uint64_t lo;
+  uint64_t hi;
+} SanStack;
+
+/*
+ * Shadow memory for guest RAM: one "addressable" and one "defined" bit per
+ * byte. Loads and stores are checked before they execute; stores and host
+ * writes (SBI mem*, DMA, semihosting) define what they write. Inside a
+ * registered stack, the bytes below sp are dead: touching them is an error,
+ * and popping a frame makes its bytes undefined again. Loads of undefined
+ * bytes are reported at the load, so copying struct padding counts too.
+ * Vector loads and stores are not checked.
+ */
+typedef struct Sanitizer {
+  Machine *m;
+  const SymbolTable *syms;
+  /* Stop the run at the first report. */
+  bool halt;
+
+  uint64_t *valid;
+  uint64_t *defined;
+  size_t words;
+
+  SanStack stacks[SAN_MAX_STACKS];
+  size_t nstacks;
+  /* sp as of the last check and the stack it points into, or -1. */
+  uint64_t sp;
+  int cur;
+
+  uint64_t sites[SAN_SITES];
+  size_t nsites;
+  uint64_t errors;
+  bool stop;
+} Sanitizer;
+
+bool san_init(Sanitizer *s, Machine *m, const SymbolTable *syms, bool halt);
+void san_destroy(Sanitizer *s);
+
+/* Loaded contents are defined, zero fill (BSS) is addressable only. */
+bool san_load_elf(Sanitizer *s, const char *path);
+
+void san_set(Sanitizer *s, uint64_t addr, uint64_t len, SanState st);
+
+/* Before each instruction; false once an error should stop the run. */
+bool san_check(Sanitizer *s, Cpu *cpu, uint64_t pc, uint32_t insn);
+
+/*
+ * Host-side accesses on the guest's behalf, from the instruction at pc:
+ * access checks a range (read also wants it defined), write defines one.
+ */
+void san_host_access(Sanitizer *s, uint64_t pc, uint64_t addr, uint64_t len,
+                     bool read);
+void san_host_write(Sanitizer *s, uint64_t addr, uint64_t len);
+void san_host_copy(Sanitizer *s, uint64_t pc, uint64_t dst, uint64_t src,
+                   uint64_t len);
+
+void san_sbi_call(Sanitizer *s, Cpu *cpu);
+
+void san_report(const Sanitizer *s, FILE *out);
@@ -1,5 +1,53 @@
 #pragma once
 
 #include "rivos_sim/cpu.h"
+#include "rivos_sim/machine.h"
 
-void sbi_handle(Cpu *cpu);
+enum {
+  SBI_EXT_LEGACY_CONSOLE_PUTCHAR = 1,
+  SBI_EXT_LEGACY_CONSOLE_GETCHAR = 2,
+  SBI_EXT_LEGACY_SHUTDOWN = 8,
+
+  SBI_EXT_BASE = 0x10,
+
+  /* Vendor extensions (0x09000000-0x09FFFFFF) implemented by rivos-sim. */
+  SBI_EXT_RIVOS_FUZZ = 0x09000001,
+  SBI_EXT_RIVOS_MEM = 0x09000002,
+  SBI_EXT_RIVOS_SAN = 0x09000003,
+};
+
+/* Function IDs of SBI_EXT_BASE (a6). */
+enum {
+  SBI_BASE_GET_SPEC_VERSION = 0,
+  SBI_BASE_GET_IMPL_ID = 1,
+  SBI_BASE_GET_IMPL_VERSION = 2,
+  SBI_BASE_PROBE_EXTENSION = 3, /* a0 = extension ID; a1 = 1 if present */
+  SBI_BASE_GET_MVENDORID = 4,
+  SBI_BASE_GET_MARCHID = 5,
+  SBI_BASE_GET_MIMPID = 6,
+};
+
+/*
+ * Function IDs of SBI_EXT_RIVOS_MEM (a6): bulk operations on guest physical
+ * RAM done with the host's mem* routines. Ranges must lie entirely in RAM.
+ * COPY and MOVE both allow overlap.
+ */
+enum {
+  SBI_RIVOS_MEM_SET = 0,  /* a0 = dst, a1 = byte, a2 = len */
+  SBI_RIVOS_MEM_COPY = 1, /* a0 = dst, a1 = src, a2 = len */
+  SBI_RIVOS_MEM_MOVE = 2, /* a0 = dst, a1 = src, a2 = len */
+  SBI_RIVOS_MEM_CMP = 3,  /* a0 = a, a1 = b, a2 = len; a1 = -1, 0 or 1 */
+};
+
+enum {
+  SBI_SUCCESS = 0,
+  SBI_ERR_FAILED = -1,
+  SBI_ERR_NOT_SUPPORTED = -2,
+  SBI_ERR_INVALID_PARAM = -3,
+  SBI_ERR_INVALID_ADDRESS = -5,
+};
+
+/* Reported by SBI_BASE_GET_IMPL_ID; outside the ranges the spec assigns. */
+#define SBI_RIVOS_IMPL_ID 0x52564f53u
+
+void sbi_handle(Machine *m, Cpu *cpu);
@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "rivos_sim/cpu.h"
+#include "rivos_sim/machine.h"
+
+/*
+ * RISC-V semihosting: an ebreak between "slli x0, x0, 0x1f" and
+ * "srai x0, x0, 7" is a host call with the operation in a0 and a pointer
+ * to a block of XLEN-sized arguments in a1; the result goes to a0.
+ * Operation numbers and semantics follow Arm semihosting.
+ */
+enum {
+  SEMIHOST_SYS_OPEN = 0x01,
+  SEMIHOST_SYS_CLOSE = 0x02,
+  SEMIHOST_SYS_WRITE = 0x05,
+  SEMIHOST_SYS_READ = 0x06,
+  SEMIHOST_SYS_SEEK = 0x0A,
+  SEMIHOST_SYS_FLEN = 0x0C,
+  SEMIHOST_SYS_CLOCK = 0x10,
+  SEMIHOST_SYS_ERRNO = 0x13,
+  SEMIHOST_SYS_EXIT = 0x18,
+  SEMIHOST_SYS_EXIT_EXTENDED = 0x20,
+};
+
+enum {
+  SEMIHOST_SLLI = 0x01f01013, /* slli x0, x0, 0x1f */
+  SEMIHOST_EBREAK = 0x00100073,
+  SEMIHOST_SRAI = 0x40705013, /* srai x0, x0, 7 */
+  SEMIHOST_MAX_FILES = 64,
+  /* SYS_EXIT reason for a normal exit; the subcode is the status. */
+  SEMIHOST_EXIT_APPLICATION = 0x20026,
+};
+
+typedef struct Semihost {
+  /* Host descriptors by guest handle; -1 when free. */
+  int fds[SEMIHOST_MAX_FILES];
+  int last_errno;
+  uint64_t start_ns;
+} Semihost;
+
+/* Enables semihosting on m; files are opened relative to the cwd. */
+void semihost_init(Semihost *sh, Machine *m);
+void semihost_destroy(Semihost *sh);
+
+/* True if the ebreak at pc is a semihosting call. */
+bool semihost_is_call(Machine *m, uint64_t pc);
+
+/* Runs the call in a0/a1. SYS_EXIT halts the CPU. */
+void semihost_call(Machine *m, Cpu *cpu);
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "rivos_sim/cpu.h"
+#include "rivos_sim/machine.h"
+#include "rivos_sim/run.h"
+#include "rivos_sim/timing.h"
+
+/*
+ * Sampled simulation from SimPoint output: the program runs functionally
+ * except for each representative interval (and an optional warm-up before
+ * it), which goes through the timing model. Per-interval results are
+ * combined by cluster weight into whole-program estimates.
+ */
+typedef struct {
+  /* Interval number: it starts at instruction index * interval. */
+  uint64_t index;
+  double weight;
+
+  /* Measured over the interval itself, not the warm-up. */
+  uint64_t insns;
+  uint64_t cycles;
+  uint64_t branch_misses;
+  bool restored;
+} SimPoint;
+
+typedef struct {
+  SimPoint *points;
+  size_t npoints;
+  uint64_t interval;
+  uint64_t warmup;
+  /*
+   * Snapshots of CPU and RAM at the start of each warm-up, saved on the
+   * first run and restored instead of fast-forwarding on later ones.
+   * Device state is not saved. NULL disables them.
+   */
+  const char *snap_dir;
+
+  /* Instructions in the whole program, or 0 if the run stopped early. */
+  uint64_t total;
+} SimPointPlan;
+
+/*
+ * Reads PREFIX.simpoints ("interval cluster" per line) and PREFIX.weights
+ * ("weight cluster"), as written by rivos-simpoint or SimPoint 3.
+ */
+bool simpoint_load(SimPointPlan *p, const char *prefix, uint64_t interval,
+                   uint64_t warmup, const char *snap_dir);
+void simpoint_free(SimPointPlan *p);
+
+/*
+ * Runs up to max_insns instructions, with fast->aot (and fast->stats) for
+ * the functional parts and t for the detailed ones. Returns the number of
+ * instructions executed, which skips whatever snapshots jumped over.
+ */
+uint64_t simpoint_run(SimPointPlan *p, Machine *m, Cpu *cpu,
+                      uint64_t max_insns, Timing *t, RunHooks *fast);
+
+void simpoint_report(const SimPointPlan *p, FILE *out);
@@ -0,0 +1,117 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/*
+ * Lock-free single-producer/single-consumer byte ring. Head and tail are
+ * free-running counters on separate cache lines; capacity is a power of two.
+ */
+typedef struct {
+  _Alignas(64) _Atomic size_t head; /* written by the producer */
+  _Alignas(64) _Atomic size_t tail; /* written by the consumer */
+  _Alignas(64) size_t mask;
+  uint8_t *buf;
+} SpscRing;
+
+static inline bool spsc_init(SpscRing *r, size_t cap) {
+  if (cap == 0 || (cap & (cap - 1))) {
+    return false;
+  }
+  atomic_init(&r->head, 0);
+  atomic_init(&r->tail, 0);
+  r->mask = cap - 1;
+  r->buf = (uint8_t *)malloc(cap);
+  return r->buf != NULL;
+}
+
+static inline void spsc_destroy(SpscRing *r) {
+  free(r->buf);
+  r->buf = NULL;
+}
+
+static inline bool spsc_empty(SpscRing *r) {
+  return atomic_load_explicit(&r->head, memory_order_acquire) ==
+         atomic_load_explicit(&r->tail, memory_order_relaxed);
+}
+
+/* Producer side; returns how many bytes fit. */
+static inline size_t spsc_push(SpscRing *r, const uint8_t *src, size_t n) {
+  size_t head = atomic_load_explicit(&r->head, memory_order_relaxed);
+  size_t tail = atomic_load_explicit(&r->tail, memory_order_acquire);
+  size_t room = r->mask + 1 - (head - tail);
+  if (n > room) {
+    n = room;
+  }
+  for (size_t i = 0; i < n; i++) {
+    r->buf[(head + i) & r->mask] = src[i];
+  }
+  atomic_store_explicit(&r->head, head + n, memory_order_release);
+  return n;
+}
+
+/* Consumer side. */
+static inline bool spsc_pop(SpscRing *r, uint8_t *out) {
+  size_t tail = atomic_load_explicit(&r->tail, memory_order_relaxed);
+  if (atomic_load_explicit(&r->head, memory_order_acquire) == tail) {
+    return false;
+  }
+  *out = r->buf[tail & r->mask];
+  atomic_store_explicit(&r->tail, tail + 1, memory_order_release);
+  return true;
+}
+
+/* The same ring for 64-bit messages (doorbells, completions). */
+typedef struct {
+  _Alignas(64) _Atomic size_t head; /* written by the producer */
+  _Alignas(64) _Atomic size_t tail; /* written by the consumer */
+  _Alignas(64) size_t mask;
+  uint64_t *buf;
+} SpscQueue;
+
+static inline bool spscq_init(SpscQueue *q, size_t cap) {
+  if (cap == 0 || (cap & (cap - 1))) {
+    return false;
+  }
+  atomic_init(&q->head, 0);
+  atomic_init(&q->tail, 0);
+  q->mask = cap - 1;
+  q->buf = (uint64_t *)malloc(cap * sizeof(uint64_t));
+  return q->buf != NULL;
+}
+
+static inline void spscq_destroy(SpscQueue *q) {
+  free(q->buf);
+  q->buf = NULL;
+}
+
+static inline bool spscq_empty(SpscQueue *q) {
+  return atomic_load_explicit(&q->head, memory_order_acquire) ==
+         atomic_load_explicit(&q->tail, memory_order_acquire);
+}
+
+/* Producer side; false if the ring is full. */
+static inline bool spscq_push(SpscQueue *q, uint64_t v) {
+  size_t head = atomic_load_explicit(&q->head, memory_order_relaxed);
+  size_t tail = atomic_load_explicit(&q->tail, memory_order_acquire);
+  if (head - tail > q->mask) {
+    return false;
+  }
+  q->buf[head & q->mask] = v;
+  atomic_store_explicit(&q->head, head + 1, memory_order_release);
+  return true;
+}
+
+/* Consumer side. */
+static inline bool spscq_pop(SpscQueue *q, uint64_t *out) {
+  size_t tail = atomic_load_explicit(&q->tail, memory_order_relaxed);
+  if (atomic_load_explicit(&q->head, memory_order_acquire) == tail) {
+    return false;
+  }
+  *out = q->buf[tail & q->mask];
+  atomic_store_explicit(&q->tail, tail + 1, memory_order_release);
+  return true;
+}
@@ -0,0 +1,81 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "rivos_sim/cpu.h"
+#include "rivos_sim/machine.h"
+#include "rivos_sim/symtab.h"
+
+enum {
+  STATS_VERSION = 1,
+  STATS_SYM_LEN = 48,
+  /* Same indexing as Cpu::traps. */
+  STATS_TRAP_SLOTS = 32,
+};
+
+#define STATS_MIPS_NS 500000000ull
+
+/*
+ * Counter snapshot as laid out in the shared page. Host byte order; readers
+ * check magic and version before trusting anything else.
+ */
+typedef struct {
+  uint64_t instret;
+  /* MIPS * 1000 over the last interval of at least STATS_MIPS_NS. */
+  uint64_t mips_milli;
+  uint64_t pc;
+  uint64_t sym_off;
+  char sym[STATS_SYM_LEN];
+  uint64_t console_bytes;
+  uint64_t traps[STATS_TRAP_SLOTS];
+  /* CLOCK_REALTIME, so other processes can judge staleness. */
+  uint64_t start_ns;
+  uint64_t update_ns;
+  uint8_t halted;
+} StatsSnapshot;
+
+/*
+ * The shared page. The simulator is the only writer: it makes seq odd,
+ * rewrites the snapshot and makes seq even again, so readers never block it
+ * and retry when they see an odd or changed seq.
+ */
+typedef struct {
+  char magic[8];
+  uint32_t version;
+  int32_t pid;
+  _Atomic uint64_t seq;
+  StatsSnapshot s;
+} StatsPage;
+
+typedef struct {
+  StatsPage *page;
+  char name[64];
+
+  const SymbolTable *syms;
+  uint64_t last_instret;
+  uint64_t last_mips_ns;
+} Stats;
+
+/*
+ * Creates the POSIX shared-memory object `name` (default "/rivos-sim.<pid>"
+ * when NULL) and maps it. syms may be NULL.
+ */
+bool stats_init(Stats *st, const char *name, const SymbolTable *syms);
+/* Unmaps and unlinks the object. */
+void stats_destroy(Stats *st);
+
+/* Refreshes the page from the hart; cheap enough to call every slice. */
+void stats_publish(Stats *st, const Machine *m, const Cpu *cpu);
+
+/* Reader side: maps an existing object read-only. */
+const StatsPage *stats_attach(const char *name);
+void stats_detach(const StatsPage *page);
+/* Copies a consistent snapshot; false if the page is not a stats page or
+ * never settles. */
+bool stats_read(const StatsPage *page, StatsSnapshot *out);
+
+/* Short name for a trap slot, or NULL for reserved codes. */
+const char *stats_trap_name(unsigned slot);
@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef enum {
+  SYMBOL_FUNC,
+  SYMBOL_OBJECT,
+} SymbolType;
+
+typedef struct {
+  uint64_t addr;
+  uint64_t size;
+  SymbolType type;
+  char *name;
+} Symbol;
+
+typedef struct {
+  Symbol *syms;
+  size_t count;
+} SymbolTable;
+
+const Symbol *symtab_lookup(const SymbolTable *st, uint64_t addr);
+/* The last symbol starting at or below addr, whether or not it covers it. */
+const Symbol *symtab_nearest(const SymbolTable *st, uint64_t addr);
+const Symbol *symtab_find(const SymbolTable *st, const char *name);
+bool symtab_resolve(const SymbolTable *st, const char *spec, uint64_t *addr_out);
+void symtab_free(SymbolTable *st);
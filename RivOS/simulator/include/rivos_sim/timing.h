@@ -0,0 +1,78 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "rivos_sim/symtab.h"
+
+typedef enum {
+  BP_STATIC,
+  BP_BIMODAL,
+  BP_GSHARE,
+} BranchPredictorKind;
+
+/* Cycle counts for one in-order, single-issue pipeline. */
+typedef struct {
+  uint32_t alu;
+  uint32_t mul;
+  uint32_t div;
+  uint32_t load;
+  uint32_t store;
+  uint32_t system;
+  uint32_t taken;
+  uint32_t mispredict;
+  uint32_t exception;
+} TimingLatency;
+
+typedef struct {
+  BranchPredictorKind bp;
+  uint32_t bp_bits;
+  uint32_t ras_depth;
+  TimingLatency lat;
+} TimingConfig;
+
+typedef struct {
+  uint64_t insns;
+  uint64_t cycles;
+} TimingFuncStats;
+
+typedef struct {
+  TimingConfig cfg;
+
+  uint64_t issue;
+  uint64_t next_issue;
+  uint64_t div_free;
+  uint64_t ready[32];
+  uint32_t from_load;
+
+  uint8_t *counters;
+  uint64_t *btb;
+  uint32_t ghr;
+
+  uint64_t *ras;
+  uint32_t ras_top;
+  uint32_t ras_count;
+
+  uint64_t insns;
+  uint64_t load_use_stalls;
+  uint64_t branches;
+  uint64_t branch_misses;
+  uint64_t jumps;
+  uint64_t jump_misses;
+  uint64_t ras_hits;
+  uint64_t ras_misses;
+  uint64_t exceptions;
+
+  const SymbolTable *syms;
+  TimingFuncStats *funcs;
+  const Symbol *cur_sym;
+  TimingFuncStats *cur_stats;
+} Timing;
+
+void timing_default_config(TimingConfig *cfg);
+bool timing_parse_latency(TimingLatency *lat, const char *spec);
+bool timing_init(Timing *t, const TimingConfig *cfg, const SymbolTable *syms);
+void timing_retire(Timing *t, uint64_t pc, uint32_t insn, uint64_t next_pc);
+void timing_report(const Timing *t, FILE *out);
+void timing_destroy(Timing *t);
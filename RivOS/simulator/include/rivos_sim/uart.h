@@ -0,0 +1,43 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "rivos_sim/machine.h"
+
+/*
+ * 16550 at RIVOS_SIM_UART16550_BASE: instant transmit, written out by a
+ * host thread, and buffered receive.
+ */
+
+bool uart_add(Machine *m);
+
+/*
+ * Feeds the receive FIFO from a host file ("-" for stdin) on a reader
+ * thread. A terminal is switched to non-canonical, no-echo mode until the
+ * machine is destroyed.
+ */
+bool uart_start_input(Machine *m, const char *path);
+
+void uart_tx(Machine *m, uint8_t ch);
+
+/* Waits until everything transmitted so far has reached stdout. */
+void uart_flush(Machine *m);
+
+/* Pops one received byte, or returns -1 when the FIFO is empty. */
+int uart_rx(Machine *m);
+
+/* Register state the guest can see, without the FIFOs (see reverse.h). */
+typedef struct {
+  uint8_t ier;
+  uint8_t lcr;
+  uint8_t mcr;
+  uint8_t scr;
+  uint8_t dll;
+  uint8_t dlm;
+  bool thre_ip;
+} UartRegs;
+
+void uart_save(Machine *m, UartRegs *r);
+/* CPU thread only; re-evaluates the interrupt line. */
+void uart_restore(Machine *m, const UartRegs *r);
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "rivos_sim/cpu.h"
+#include "rivos_sim/machine.h"
+
+/*
+ * Linux user-mode emulation. A static riscv64 Linux executable runs in
+ * U-mode with RAM at guest address 0 and no MMU, so guest pointers are
+ * offsets into RAM. An ecall is a system call (number in a7, arguments in
+ * a0-a5, result or -errno in a0) carried out by the equivalent host call;
+ * file descriptors are the host's own. Signals are never delivered: a
+ * signal the program sends itself ends the run.
+ */
+enum {
+  USER_RAM_SIZE = 1024ull * 1024ull * 1024ull,
+  /* Load address of ET_DYN (static PIE) executables. */
+  USER_DYN_BASE = 0x10000,
+  /* Reserved below the top of RAM for the stack. */
+  USER_STACK_SIZE = 8u * 1024u * 1024u,
+};
+
+typedef struct User {
+  Machine *m;
+  /* Host path of the executable, for AT_EXECFN and /proc/self/exe. */
+  const char *exe;
+  uint64_t entry;
+  uint64_t sp;
+  uint64_t brk_start;
+  uint64_t brk;
+  /*
+   * Mappings are carved downwards from the stack towards the break; only
+   * the lowest one is given back by munmap.
+   */
+  uint64_t mmap_low;
+  /* Set by exit/exit_group (status in m->exit_code) or a fatal signal. */
+  bool exited;
+  int signal;
+  /* Unsupported system calls already reported, by number. */
+  uint64_t warned[8];
+} User;
+
+/*
+ * Loads the executable into m, which must have RAM at address 0
+ * (machine_init_at), and builds the initial stack: argc, argv, envp and
+ * the auxiliary vector.
+ */
+bool user_load(User *u, Machine *m, const char *path, int argc, char **argv,
+               char **envp);
+
+/* Points a U-mode cpu (cpu_reset at u->entry) at the stack and the ABI. */
+void user_start(User *u, Cpu *cpu);
+
+/* Serves the ecall in cpu; exit and fatal signals halt it. */
+void user_syscall(Machine *m, Cpu *cpu);
+
+/*
+ * The process exit status once the CPU has halted: the program's own, or
+ * 128 + signal after a fatal signal or trap, which is reported on stderr.
+ */
+int user_exit_status(const User *u, const Cpu *cpu);
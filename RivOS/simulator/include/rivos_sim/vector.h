@@ -0,0 +1,31 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "rivos_sim/cpu.h"
+#include "rivos_sim/machine.h"
+
+/* vtype.vill, as a bit position. */
+enum {
+  VTYPE_VILL = 63,
+};
+
+/*
+ * Resets the vector unit to vill with the given VLEN and picks the host
+ * kernels (AVX2 when the CPU has it, portable loops otherwise).
+ */
+void vec_reset(Cpu *cpu, unsigned vlen);
+
+/*
+ * Executes OP-V (including vset{i}vl{i}) and the vector forms of LOAD-FP
+ * and STORE-FP. Returns false if the instruction is illegal, including
+ * when mstatus.VS is Off.
+ */
+bool vec_exec(Machine *m, Cpu *cpu, uint32_t insn);
+
+/* True for LOAD-FP/STORE-FP widths that select a vector access. */
+static inline bool vec_is_mem_width(uint32_t insn) {
+  uint32_t width = (insn >> 12) & 0x7;
+  return width == 0 || width >= 5;
+}
@@ -0,0 +1,126 @@
+#pragma once
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/uio.h>
+
+#include "rivos_sim/machine.h"
+
+/* virtio-mmio version 2 transport (virtio 1.x, split virtqueues). */
+
+enum {
+  VIRTIO_ID_BLOCK = 2,
+  VIRTIO_ID_9P = 9,
+};
+
+enum {
+  VIRTIO_F_INDIRECT_DESC = 28,
+  VIRTIO_F_VERSION_1 = 32,
+};
+
+enum {
+  VIRTIO_STATUS_ACKNOWLEDGE = 1,
+  VIRTIO_STATUS_DRIVER = 2,
+  VIRTIO_STATUS_DRIVER_OK = 4,
+  VIRTIO_STATUS_FEATURES_OK = 8,
+  VIRTIO_STATUS_NEEDS_RESET = 64,
+  VIRTIO_STATUS_FAILED = 128,
+};
+
+enum {
+  VIRTQ_MAX_SIZE = 256,
+  VIRTQ_MAX_SEGS = 64,
+};
+
+typedef struct {
+  uint32_t num;
+  _Atomic bool ready;
+  uint64_t desc;
+  uint64_t avail;
+  uint64_t used;
+  uint16_t last_avail;
+  uint16_t used_idx;
+} VirtQueue;
+
+/* A descriptor chain popped off the avail ring, mapped to host memory. */
+typedef struct {
+  uint16_t head;
+  uint32_t nin; /* device-readable segments, first in iov */
+  uint32_t nout; /* device-writable segments, after the readable ones */
+  struct iovec iov[VIRTQ_MAX_SEGS];
+  uint64_t gpa[VIRTQ_MAX_SEGS];
+} VirtqChain;
+
+typedef struct VirtioDev VirtioDev;
+
+typedef struct {
+  uint32_t device_id;
+  uint64_t features;
+  uint32_t num_queues;
+  /* Called on the CPU thread when the driver writes QueueNotify. */
+  void (*notify)(VirtioDev *d, uint32_t q);
+  /* Called on the CPU thread on a status write of zero. */
+  void (*reset)(VirtioDev *d);
+  void (*destroy)(VirtioDev *d);
+} VirtioOps;
+
+struct VirtioDev {
+  Machine *m;
+  const VirtioOps *ops;
+  void *opaque;
+  uint32_t irq;
+
+  /* Workers set NEEDS_RESET when a chain is malformed. */
+  _Atomic uint32_t status;
+  uint32_t dev_features_sel;
+  uint32_t drv_features_sel;
+  uint64_t driver_features;
+  uint32_t queue_sel;
+  _Atomic uint32_t int_status;
+
+  const uint8_t *config;
+  size_t config_size;
+
+  VirtQueue *queues;
+};
+
+/* Allocates queues and maps the device at the next free virtio slot. */
+bool virtio_mmio_add(Machine *m, VirtioDev *d, const VirtioOps *ops,
+                     void *opaque, const void *config, size_t config_size);
+
+/*
+ * Pops the next available chain; false if the ring is empty. A malformed
+ * chain sets NEEDS_RESET and also returns false.
+ */
+bool virtq_pop(VirtioDev *d, VirtQueue *q, VirtqChain *c);
+
+/* Publishes a completed chain and raises the used-buffer interrupt. */
+void virtq_push(VirtioDev *d, VirtQueue *q, const VirtqChain *c,
+                uint32_t written);
+
+/*
+ * virtq_push in two halves, for devices that complete on another thread:
+ * marking the chain's written bytes is thread-safe; publishing the used
+ * entry and raising the interrupt belong on the CPU thread.
+ */
+void virtq_mark_written(VirtioDev *d, const VirtqChain *c, uint32_t written);
+void virtq_push_used(VirtioDev *d, VirtQueue *q, uint16_t head,
+                     uint32_t written);
+
+/* Copies between a flat buffer and the chain's byte stream. */
+size_t virtq_chain_read(const VirtqChain *c, size_t off, void *dst,
+                        size_t len);
+size_t virtq_chain_write(const VirtqChain *c, size_t off, const void *src,
+                         size_t len);
+
+/* Byte length of the readable (out) and writable (in) halves. */
+size_t virtq_chain_len(const VirtqChain *c, bool writable);
+
+/*
+ * Guest memory of [off, off + len) of one half of the chain, as at most
+ * VIRTQ_MAX_SEGS iovecs for direct host I/O; returns how many.
+ */
+int virtq_chain_iov(const VirtqChain *c, bool writable, size_t off,
+                    size_t len, struct iovec *out);
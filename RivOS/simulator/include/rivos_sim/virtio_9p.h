@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+
+#include "rivos_sim/machine.h"
+
+/*
+ * virtio-9p: a host directory exported over 9P2000.L, mounted in a Linux
+ * guest with "mount -t 9p -o trans=virtio,version=9p2000.L TAG DIR".
+ * Requests are served in order on a worker thread. Tread and Twrite move
+ * file data straight between the host file and the guest's buffers.
+ * Every fid keeps its host file descriptors until it is clunked, and
+ * read-only file descriptors outlive their fids briefly, so that reopening
+ * the same file skips the open.
+ *
+ * Paths never leave the directory: fids are walked one component at a
+ * time without following symlinks, as the client resolves those itself.
+ * Files are created with the simulator's own uid and gid.
+ */
+enum {
+  VIRTIO_9P_MAX_TAG = 32,
+};
+
+typedef struct {
+  const char *path;
+  /* Mount tag the guest names; "rivos" unless given. */
+  const char *tag;
+  bool readonly;
+} P9Config;
+
+/* Parses "DIR[,tag=NAME][,ro]"; strings borrowed. */
+bool virtio_9p_parse(P9Config *cfg, char *spec);
+
+bool virtio_9p_add(Machine *m, const P9Config *cfg);
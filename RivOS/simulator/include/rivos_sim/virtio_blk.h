@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "rivos_sim/machine.h"
+
+typedef enum {
+  /* Requests are copied to and from a shared mapping of the image inline. */
+  BLK_MODE_MMAP,
+  /* One worker thread per queue does preadv/pwritev into guest RAM. */
+  BLK_MODE_THREAD,
+} BlkMode;
+
+enum {
+  VIRTIO_BLK_MAX_QUEUES = 16,
+};
+
+typedef struct {
+  const char *path;
+  bool readonly;
+  uint32_t queues;
+  BlkMode mode;
+} BlkConfig;
+
+/* Parses "PATH[,ro][,queues=N][,mmap|thread]"; the path is borrowed. */
+bool virtio_blk_parse(BlkConfig *cfg, char *spec);
+
+bool virtio_blk_add(Machine *m, const BlkConfig *cfg);
@@ -0,0 +1,130 @@
+#include <errno.h>
+#include <stdlib.h>
+
+#include "rivos_sim/aot.h"
+
+/* Static successors of live blocks; everything learned at run time goes. */
+static void relink(Aot *a) {
+  const AotImage *img = a->img;
+  for (size_t i = 0; i < img->nblocks; i++) {
+    for (int k = 0; k < 2; k++) {
+      int32_t s = img->blocks[i].succ[k];
+      bool live = s >= 0 && !a->dead[i] && !a->dead[s];
+      a->links[2 * i + k] = live ? &img->blocks[s] : NULL;
+    }
+    a->ind[i] = NULL;
+  }
+  memset(a->ras, 0, sizeof(a->ras));
+}
+
+bool aot_init(Aot *a, const AotImage *img, Machine *m) {
+  memset(a, 0, sizeof(*a));
+
+  uint64_t h = AOT_HASH_INIT;
+  uint64_t lo = UINT64_MAX, hi = 0;
+  for (size_t i = 0; i < img->nblocks; i++) {
+    const AotBlock *b = &img->blocks[i];
+    if (!mem_ram_ptr(m, b->pc, 4ull * b->len) ||
+        b->succ[0] >= (int64_t)img->nblocks ||
+        b->succ[1] >= (int64_t)img->nblocks) {
+      errno = EINVAL;
+      return false;
+    }
+    for (uint32_t k = 0; k < b->len; k++) {
+      h = aot_hash(h, b->pc + 4ull * k, mem_read32(m, b->pc + 4ull * k));
+    }
+    lo = b->pc < lo ? b->pc : lo;
+    hi = b->pc + 4ull * b->len > hi ? b->pc + 4ull * b->len : hi;
+  }
+  if (h != img->code_hash) {
+    errno = ENOEXEC;
+    return false;
+  }
+
+  size_t size = 16;
+  while (size < 2 * img->nblocks) {
+    size *= 2;
+  }
+  size_t n = img->nblocks ? img->nblocks : 1;
+  a->table = (const AotBlock **)calloc(size, sizeof(*a->table));
+  a->links = (const AotBlock **)calloc(2 * n, sizeof(*a->links));
+  a->ind = (const AotBlock **)calloc(n, sizeof(*a->ind));
+  a->dead = (uint8_t *)calloc(n, 1);
+
+  if (img->nblocks) {
+    size_t p0 = (size_t)((lo - m->ram_base) >> RIVOS_SIM_PAGE_SHIFT);
+    size_t p1 = (size_t)((hi - 1 - m->ram_base) >> RIVOS_SIM_PAGE_SHIFT);
+    a->code_w0 = p0 / 64;
+    a->code_words = p1 / 64 - p0 / 64 + 1;
+  }
+  a->code_mask = (uint64_t *)calloc(a->code_words ? a->code_words : 1,
+                                    sizeof(uint64_t));
+  if (!a->table || !a->links || !a->ind || !a->dead || !a->code_mask ||
+      !machine_track_dirty(m)) {
+    aot_destroy(a);
+    errno = ENOMEM;
+    return false;
+  }
+  a->mask = size - 1;
+  a->img = img;
+  a->m = m;
+
+  for (size_t i = 0; i < img->nblocks; i++) {
+    const AotBlock *b = &img->blocks[i];
+    size_t s = aot_slot(b->pc, a->mask);
+    while (a->table[s]) {
+      s = (s + 1) & a->mask;
+    }
+    a->table[s] = b;
+
+    uint64_t off = b->pc - m->ram_base;
+    for (uint64_t p = off >> RIVOS_SIM_PAGE_SHIFT;
+         p <= (off + 4ull * b->len - 1) >> RIVOS_SIM_PAGE_SHIFT; p++) {
+      a->code_mask[p / 64 - a->code_w0] |= 1ull << (p % 64);
+    }
+  }
+
+  /* Pages already dirty (tracking was on before) hold the hashed code. */
+  for (size_t i = 0; i < a->code_words; i++) {
+    a->code_mask[i] &= ~m->dirty[a->code_w0 + i];
+  }
+  relink(a);
+  return true;
+}
+
+void aot_destroy(Aot *a) {
+  free(a->table);
+  free(a->links);
+  free(a->ind);
+  free(a->dead);
+  free(a->code_mask);
+  a->table = NULL;
+  a->links = NULL;
+  a->ind = NULL;
+  a->dead = NULL;
+  a->code_mask = NULL;
+}
+
+void aot_sync_code(Aot *a) {
+  if (!aot_code_written(a)) {
+    return;
+  }
+  uint64_t *dirty = a->m->dirty;
+  const AotImage *img = a->img;
+  for (size_t i = 0; i < img->nblocks; i++) {
+    const AotBlock *b = &img->blocks[i];
+    uint64_t off = b->pc - a->m->ram_base;
+    for (uint64_t p = off >> RIVOS_SIM_PAGE_SHIFT;
+         p <= (off + 4ull * b->len - 1) >> RIVOS_SIM_PAGE_SHIFT; p++) {
+      uint64_t hit = dirty[p / 64] & a->code_mask[p / 64 - a->code_w0];
+      if ((hit >> (p % 64)) & 1) {
+        a->dead[i] = 1;
+      }
+    }
+  }
+  /* Dead blocks stay dead; their pages need no further watching. */
+  for (size_t i = 0; i < a->code_words; i++) {
+    a->code_mask[i] &= ~dirty[a->code_w0 + i];
+  }
+  relink(a);
+}
@@ -0,0 +1,147 @@
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rivos_sim/bbv.h"
+
+bool bbv_init(Bbv *b, const char *path, uint64_t interval) {
+  memset(b, 0, sizeof(*b));
+  b->interval = interval;
+  b->at_start = true;
+  b->cap = 4096;
+  b->pcs = (uint64_t *)calloc(b->cap, sizeof(uint64_t));
+  b->ids = (uint32_t *)calloc(b->cap, sizeof(uint32_t));
+  b->counts_cap = b->cap;
+  b->counts = (uint64_t *)calloc(b->counts_cap, sizeof(uint64_t));
+  b->touched = (uint32_t *)calloc(b->counts_cap, sizeof(uint32_t));
+  b->out = fopen(path, "w");
+  if (!b->pcs || !b->ids || !b->counts || !b->touched || !b->out) {
+    bbv_destroy(b);
+    return false;
+  }
+  return true;
+}
+
+void bbv_destroy(Bbv *b) {
+  if (b->out) {
+    fclose(b->out);
+  }
+  free(b->pcs);
+  free(b->ids);
+  free(b->counts);
+  free(b->touched);
+  memset(b, 0, sizeof(*b));
+}
+
+static size_t slot_of(uint64_t pc, size_t cap) {
+  return (size_t)((pc >> 2) * 0x9E3779B97F4A7C15ull >> 20) & (cap - 1);
+}
+
+static bool grow(Bbv *b) {
+  size_t cap = b->cap * 2;
+  uint64_t *pcs = (uint64_t *)calloc(cap, sizeof(uint64_t));
+  uint32_t *ids = (uint32_t *)calloc(cap, sizeof(uint32_t));
+  if (!pcs || !ids) {
+    free(pcs);
+    free(ids);
+    return false;
+  }
+  for (size_t i = 0; i < b->cap; i++) {
+    if (b->pcs[i]) {
+      size_t s = slot_of(b->pcs[i], cap);
+      while (pcs[s]) {
+        s = (s + 1) & (cap - 1);
+      }
+      pcs[s] = b->pcs[i];
+      ids[s] = b->ids[i];
+    }
+  }
+  free(b->pcs);
+  free(b->ids);
+  b->pcs = pcs;
+  b->ids = ids;
+  b->cap = cap;
+  return true;
+}
+
+/* Id of the block at pc, numbered from 1; 0 if out of memory. */
+static uint32_t block_id(Bbv *b, uint64_t pc) {
+  /* PC 0 marks an empty slot; no block of interest starts there. */
+  pc = pc ? pc : 1;
+  size_t s = slot_of(pc, b->cap);
+  while (b->pcs[s]) {
+    if (b->pcs[s] == pc) {
+      return b->ids[s];
+    }
+    s = (s + 1) & (b->cap - 1);
+  }
+  if (2 * (b->nblocks + 1) > b->cap) {
+    if (!grow(b)) {
+      return 0;
+    }
+    return block_id(b, pc);
+  }
+  if (b->nblocks + 1 >= b->counts_cap) {
+    size_t cap = b->counts_cap * 2;
+    uint64_t *counts = (uint64_t *)realloc(b->counts, cap * sizeof(uint64_t));
+    if (!counts) {
+      return 0;
+    }
+    b->counts = counts;
+    memset(counts + b->counts_cap, 0,
+           (cap - b->counts_cap) * sizeof(uint64_t));
+    uint32_t *touched =
+        (uint32_t *)realloc(b->touched, cap * sizeof(uint32_t));
+    if (!touched) {
+      return 0;
+    }
+    b->touched = touched;
+    b->counts_cap = cap;
+  }
+  b->pcs[s] = pc;
+  b->ids[s] = ++b->nblocks;
+  return b->ids[s];
+}
+
+void bbv_flush_block(Bbv *b) {
+  uint32_t id = block_id(b, b->block_pc);
+  if (id) {
+    if (b->counts[id] == 0) {
+      b->touched[b->ntouched++] = id;
+    }
+    b->counts[id] += b->block_len;
+  }
+  b->block_len = 0;
+}
+
+static int id_cmp(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+  return (x > y) - (x < y);
+}
+
+void bbv_end_interval(Bbv *b) {
+  qsort(b->touched, b->ntouched, sizeof(uint32_t), id_cmp);
+  fputc('T', b->out);
+  for (size_t i = 0; i < b->ntouched; i++) {
+    uint32_t id = b->touched[i];
+    fprintf(b->out, ":%" PRIu32 ":%" PRIu64 " ", id, b->counts[id]);
+    b->counts[id] = 0;
+  }
+  fputc('\n', b->out);
+  b->ntouched = 0;
+  b->in_interval = 0;
+  b->intervals++;
+}
+
+bool bbv_finish(Bbv *b) {
+  if (b->block_len) {
+    bbv_flush_block(b);
+  }
+  if (b->in_interval) {
+    bbv_end_interval(b);
+  }
+  bool ok = !ferror(b->out);
+  ok = fclose(b->out) == 0 && ok;
+  b->out = NULL;
+  return ok;
+}
@@ -0,0 +1,379 @@
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rivos_sim/callgraph.h"
+
+enum {
+  NO_CALLER = UINT32_MAX,
+  INSN_SRET = 0x10200073,
+  INSN_MRET = 0x30200073,
+};
+
+static uint32_t func_of(Callgraph *cg, uint64_t pc) {
+  const Symbol *s = cg->cur_sym;
+  if (s && pc - s->addr < s->size) {
+    return cg->cur_func;
+  }
+  s = symtab_lookup(cg->syms, pc);
+  cg->cur_sym = s;
+  cg->cur_func =
+      s ? (uint32_t)(s - cg->syms->syms) : (uint32_t)cg->syms->count;
+  return cg->cur_func;
+}
+
+static const char *func_name(const Callgraph *cg, uint32_t f) {
+  return f < cg->syms->count ? cg->syms->syms[f].name : "<unknown>";
+}
+
+static uint64_t func_addr(const Callgraph *cg, uint32_t f) {
+  return f < cg->syms->count ? cg->syms->syms[f].addr : 0;
+}
+
+static size_t edge_slot(uint32_t caller, uint32_t callee, size_t mask) {
+  uint64_t k = (uint64_t)caller << 32 | callee;
+  return (size_t)(k * 0x9E3779B97F4A7C15ull >> 32) & mask;
+}
+
+/* NULL only if the table cannot grow. */
+static CgEdge *edge(Callgraph *cg, uint32_t caller, uint32_t callee) {
+  size_t i = edge_slot(caller, callee, cg->edge_mask);
+  for (; cg->edges[i].calls; i = (i + 1) & cg->edge_mask) {
+    if (cg->edges[i].caller == caller && cg->edges[i].callee == callee) {
+      return &cg->edges[i];
+    }
+  }
+
+  if (2 * (cg->nedges + 1) > cg->edge_mask + 1) {
+    size_t size = 2 * (cg->edge_mask + 1);
+    CgEdge *t = (CgEdge *)calloc(size, sizeof(CgEdge));
+    if (!t) {
+      return NULL;
+    }
+    for (size_t j = 0; j <= cg->edge_mask; j++) {
+      const CgEdge *e = &cg->edges[j];
+      if (e->calls) {
+        size_t s = edge_slot(e->caller, e->callee, size - 1);
+        while (t[s].calls) {
+          s = (s + 1) & (size - 1);
+        }
+        t[s] = *e;
+      }
+    }
+    free(cg->edges);
+    cg->edges = t;
+    cg->edge_mask = size - 1;
+    return edge(cg, caller, callee);
+  }
+
+  cg->nedges++;
+  cg->edges[i].caller = caller;
+  cg->edges[i].callee = callee;
+  return &cg->edges[i];
+}
+
+static void push(Callgraph *cg, uint32_t caller, uint64_t target, uint64_t ret,
+                 uint64_t site, bool trap) {
+  if (cg->depth == cg->stack_cap) {
+    size_t cap = cg->stack_cap * 2;
+    CgFrame *s = (CgFrame *)realloc(cg->stack, cap * sizeof(CgFrame));
+    if (!s) {
+      return;
+    }
+    cg->stack = s;
+    cg->stack_cap = cap;
+  }
+  uint32_t f = func_of(cg, target);
+  cg->stack[cg->depth++] = (CgFrame){f, caller, ret, site, cg->insns, trap};
+  cg->active[f]++;
+  cg->funcs[f].calls++;
+  if (caller != NO_CALLER) {
+    CgEdge *e = edge(cg, caller, f);
+    if (e) {
+      e->calls++;
+      if (!e->site) {
+        e->site = site;
+      }
+    }
+  }
+}
+
+static void pop(Callgraph *cg) {
+  const CgFrame *fr = &cg->stack[--cg->depth];
+  uint64_t dur = cg->insns - fr->entry;
+  if (--cg->active[fr->func] == 0) {
+    cg->funcs[fr->func].incl += dur;
+    if (fr->caller != NO_CALLER) {
+      CgEdge *e = edge(cg, fr->caller, fr->func);
+      if (e) {
+        e->incl += dur;
+      }
+    }
+  }
+}
+
+/*
+ * Unwinds to the frame returning to target, which also handles frames left
+ * behind by longjmp-style exits. A trap handler usually resumes at epc + 4.
+ * Returns false if no frame matches.
+ */
+static bool return_to(Callgraph *cg, uint64_t target, bool from_trap) {
+  for (size_t d = cg->depth; d > 1; d--) {
+    const CgFrame *fr = &cg->stack[d - 1];
+    if (fr->ret == target || (fr->trap && from_trap && fr->ret + 4 == target)) {
+      while (cg->depth >= d) {
+        pop(cg);
+      }
+      return true;
+    }
+  }
+  return false;
+}
+
+bool cg_init(Callgraph *cg, const SymbolTable *syms, uint64_t entry_pc) {
+  memset(cg, 0, sizeof(*cg));
+  cg->syms = syms;
+  cg->nfuncs = syms->count + 1;
+  cg->funcs = (CgFunc *)calloc(cg->nfuncs, sizeof(CgFunc));
+  cg->active = (uint32_t *)calloc(cg->nfuncs, sizeof(uint32_t));
+  cg->edge_mask = 255;
+  cg->edges = (CgEdge *)calloc(cg->edge_mask + 1, sizeof(CgEdge));
+  cg->stack_cap = 256;
+  cg->stack = (CgFrame *)malloc(cg->stack_cap * sizeof(CgFrame));
+  if (!cg->funcs || !cg->active || !cg->edges || !cg->stack) {
+    cg_destroy(cg);
+    return false;
+  }
+  cg->next_pc = entry_pc;
+  push(cg, NO_CALLER, entry_pc, 0, 0, false);
+  return true;
+}
+
+void cg_destroy(Callgraph *cg) {
+  free(cg->funcs);
+  free(cg->active);
+  free(cg->edges);
+  free(cg->stack);
+  memset(cg, 0, sizeof(*cg));
+}
+
+void cg_retire(Callgraph *cg, uint64_t pc, uint32_t insn, uint64_t next_pc) {
+  /* An interrupt was taken before this instruction. */
+  if (pc != cg->next_pc) {
+    push(cg, func_of(cg, cg->next_pc), pc, cg->next_pc, cg->next_pc, true);
+  }
+  cg->next_pc = next_pc;
+
+  uint32_t f = func_of(cg, pc);
+  cg->funcs[f].self++;
+  cg->insns++;
+
+  uint32_t opcode = insn & 0x7F;
+  uint32_t rd = (insn >> 7) & 0x1F;
+  uint32_t rs1 = (insn >> 15) & 0x1F;
+  bool link_rd = rd == 1 || rd == 5;
+
+  if (opcode == 0x67 && rd == 0 && (rs1 == 1 || rs1 == 5) &&
+      (insn >> 20) == 0) {
+    return_to(cg, next_pc, false);
+  } else if ((opcode == 0x6F || opcode == 0x67) && link_rd) {
+    push(cg, f, next_pc, pc + 4, pc, false);
+  } else if (insn == INSN_SRET || insn == INSN_MRET) {
+    /* No match: the handler switched context. Close the newest trap. */
+    if (!return_to(cg, next_pc, true)) {
+      for (size_t d = cg->depth; d > 1; d--) {
+        if (cg->stack[d - 1].trap) {
+          while (cg->depth >= d) {
+            pop(cg);
+          }
+          break;
+        }
+      }
+    }
+  } else if (opcode != 0x63 && opcode != 0x6F && opcode != 0x67 &&
+             next_pc != pc + 4) {
+    /* Exception (ecalls to M/S-mode code included). */
+    push(cg, f, next_pc, pc, pc, true);
+  }
+}
+
+void cg_finish(Callgraph *cg) {
+  while (cg->depth) {
+    pop(cg);
+  }
+}
+
+static const Callgraph *sort_cg;
+
+static int self_cmp(const void *a, const void *b) {
+  const CgFunc *x = &sort_cg->funcs[*(const uint32_t *)a];
+  const CgFunc *y = &sort_cg->funcs[*(const uint32_t *)b];
+  return (x->self < y->self) - (x->self > y->self);
+}
+
+static int incl_cmp(const void *a, const void *b) {
+  const CgFunc *x = &sort_cg->funcs[*(const uint32_t *)a];
+  const CgFunc *y = &sort_cg->funcs[*(const uint32_t *)b];
+  return (x->incl < y->incl) - (x->incl > y->incl);
+}
+
+static double pct(uint64_t a, uint64_t b) {
+  return b ? 100.0 * (double)a / (double)b : 0.0;
+}
+
+static void report_flat(const Callgraph *cg, const uint32_t *order, size_t n,
+                        FILE *out) {
+  fprintf(out,
+          "Flat profile (instructions):\n\n"
+          "  %%     cumulative         self               self     total\n"
+          " insns       insns        insns     calls  ins/call  ins/call  "
+          "name\n");
+  uint64_t cum = 0;
+  for (size_t i = 0; i < n; i++) {
+    const CgFunc *f = &cg->funcs[order[i]];
+    cum += f->self;
+    fprintf(out, "%6.2f %11" PRIu64 " %12" PRIu64 " %9" PRIu64,
+            pct(f->self, cg->insns), cum, f->self, f->calls);
+    if (f->calls) {
+      fprintf(out, " %9" PRIu64 " %9" PRIu64, f->self / f->calls,
+              f->incl / f->calls);
+    } else {
+      fprintf(out, " %9s %9s", "", "");
+    }
+    fprintf(out, "  %s\n", func_name(cg, order[i]));
+  }
+}
+
+static void report_graph(const Callgraph *cg, const uint32_t *order, size_t n,
+                         const uint32_t *index, FILE *out) {
+  fprintf(out,
+          "\nCall graph (instructions; children = total - self):\n\n"
+          "index %% total        self    children     called  name\n");
+  for (size_t i = 0; i < n; i++) {
+    uint32_t fi = order[i];
+    const CgFunc *f = &cg->funcs[fi];
+
+    bool any_caller = false;
+    for (size_t k = 0; k <= cg->edge_mask; k++) {
+      const CgEdge *e = &cg->edges[k];
+      if (e->calls && e->callee == fi) {
+        fprintf(out, "%20s %11" PRIu64 " %10" PRIu64 "/%-9" PRIu64
+                     "     %s [%u]\n",
+                "", e->incl, e->calls, f->calls, func_name(cg, e->caller),
+                index[e->caller]);
+        any_caller = true;
+      }
+    }
+    if (!any_caller) {
+      fprintf(out, "%55s<spontaneous>\n", "");
+    }
+
+    char idx[16];
+    snprintf(idx, sizeof(idx), "[%u]", index[fi]);
+    fprintf(out, "%-6s %5.1f %11" PRIu64 " %11" PRIu64 " %10" PRIu64
+                 "         %s %s\n",
+            idx, pct(f->incl, cg->insns), f->self,
+            f->incl > f->self ? f->incl - f->self : 0, f->calls,
+            func_name(cg, fi), idx);
+
+    for (size_t k = 0; k <= cg->edge_mask; k++) {
+      const CgEdge *e = &cg->edges[k];
+      if (e->calls && e->caller == fi) {
+        fprintf(out, "%20s %11" PRIu64 " %10" PRIu64 "/%-9" PRIu64
+                     "     %s [%u]\n",
+                "", e->incl, e->calls, cg->funcs[e->callee].calls,
+                func_name(cg, e->callee), index[e->callee]);
+      }
+    }
+    fprintf(out, "-----------------------------------------------\n");
+  }
+}
+
+void cg_report(const Callgraph *cg, FILE *out) {
+  uint32_t *order = (uint32_t *)malloc(cg->nfuncs * sizeof(uint32_t));
+  uint32_t *index = (uint32_t *)calloc(cg->nfuncs, sizeof(uint32_t));
+  if (!order || !index) {
+    free(order);
+    free(index);
+    return;
+  }
+
+  size_t n = 0;
+  for (uint32_t i = 0; i < cg->nfuncs; i++) {
+    if (cg->funcs[i].self || cg->funcs[i].calls) {
+      order[n++] = i;
+    }
+  }
+
+  sort_cg = cg;
+  qsort(order, n, sizeof(uint32_t), self_cmp);
+  report_flat(cg, order, n, out);
+
+  qsort(order, n, sizeof(uint32_t), incl_cmp);
+  for (size_t i = 0; i < n; i++) {
+    index[order[i]] = (uint32_t)i + 1;
+  }
+  report_graph(cg, order, n, index, out);
+
+  free(order);
+  free(index);
+}
+
+/* Callgrind name compression: "(id) name" the first time, "(id)" after. */
+static void put_name(FILE *f, const char *key, const Callgraph *cg,
+                     uint32_t fi, uint8_t *named) {
+  if (named[fi]) {
+    fprintf(f, "%s=(%u)\n", key, fi + 1);
+  } else {
+    fprintf(f, "%s=(%u) %s\n", key, fi + 1, func_name(cg, fi));
+    named[fi] = 1;
+  }
+}
+
+bool cg_write_callgrind(const Callgraph *cg, const char *path,
+                        const char *elf_path) {
+  FILE *f = fopen(path, "w");
+  uint8_t *named = (uint8_t *)calloc(cg->nfuncs, 1);
+  if (!f || !named) {
+    if (f) {
+      fclose(f);
+    }
+    free(named);
+    return false;
+  }
+
+  fprintf(f,
+          "# callgrind format\n"
+          "version: 1\n"
+          "creator: rivos-sim\n"
+          "cmd: %s\n"
+          "positions: instr\n"
+          "events: Ir\n"
+          "summary: %" PRIu64 "\n\n"
+          "ob=(1) %s\n",
+          elf_path, cg->insns, elf_path);
+
+  /* Self cost sits on the function's first instruction. */
+  for (uint32_t fi = 0; fi < cg->nfuncs; fi++) {
+    const CgFunc *fn = &cg->funcs[fi];
+    if (!fn->self && !fn->calls) {
+      continue;
+    }
+    fprintf(f, "\n");
+    put_name(f, "fn", cg, fi, named);
+    fprintf(f, "0x%" PRIx64 " %" PRIu64 "\n", func_addr(cg, fi), fn->self);
+    for (size_t k = 0; k <= cg->edge_mask; k++) {
+      const CgEdge *e = &cg->edges[k];
+      if (e->calls && e->caller == fi) {
+        put_name(f, "cfn", cg, e->callee, named);
+        fprintf(f, "calls=%" PRIu64 " 0x%" PRIx64 "\n0x%" PRIx64 " %" PRIu64
+                   "\n",
+                e->calls, func_addr(cg, e->callee), e->site, e->incl);
+      }
+    }
+  }
+
+  free(named);
+  bool ok = !ferror(f);
+  return fclose(f) == 0 && ok;
+}
@@ -0,0 +1,144 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rivos_sim/coverage.h"
+
+static const char cov_magic[8] = {'R', 'V', 'C', 'O', 'V', '1', 0, 0};
+
+bool cov_init(Coverage *c) {
+  memset(c, 0, sizeof(*c));
+  c->map = (uint8_t *)calloc(1, COV_MAP_SIZE);
+  c->seen_cap = COV_SEEN_MIN;
+  c->seen = (uint64_t *)calloc(c->seen_cap, sizeof(uint64_t));
+  if (!c->map || !c->seen) {
+    cov_destroy(c);
+    return false;
+  }
+  return true;
+}
+
+void cov_reset(Coverage *c) {
+  memset(c->map, 0, COV_MAP_SIZE);
+  c->prev = 0;
+  if (c->nblocks) {
+    memset(c->seen, 0, c->seen_cap * sizeof(uint64_t));
+  }
+  c->nblocks = 0;
+}
+
+void cov_destroy(Coverage *c) {
+  free(c->map);
+  free(c->blocks);
+  free(c->seen);
+  memset(c, 0, sizeof(*c));
+}
+
+static bool grow_seen(Coverage *c) {
+  size_t cap = c->seen_cap * 2;
+  uint64_t *seen = (uint64_t *)calloc(cap, sizeof(uint64_t));
+  if (!seen) {
+    return false;
+  }
+  for (size_t i = 0; i < c->seen_cap; i++) {
+    if (c->seen[i]) {
+      size_t s = cov_seen_slot(c->seen[i], cap);
+      while (seen[s]) {
+        s = (s + 1) & (cap - 1);
+      }
+      seen[s] = c->seen[i];
+    }
+  }
+  free(c->seen);
+  c->seen = seen;
+  c->seen_cap = cap;
+  return true;
+}
+
+void cov_record_block(Coverage *c, uint64_t pc) {
+  /* PC 0 marks an empty slot, so block 0 is kept as 1. */
+  uint64_t key = pc ? pc : 1;
+  size_t s = cov_seen_slot(key, c->seen_cap);
+  while (c->seen[s]) {
+    if (c->seen[s] == key) {
+      return;
+    }
+    s = (s + 1) & (c->seen_cap - 1);
+  }
+  if (2 * (c->nblocks + 1) > c->seen_cap) {
+    if (grow_seen(c)) {
+      cov_record_block(c, pc);
+    }
+    return;
+  }
+  if (c->nblocks == c->cap) {
+    size_t cap = c->cap ? c->cap * 2 : 256;
+    uint64_t *b = (uint64_t *)realloc(c->blocks, cap * sizeof(uint64_t));
+    if (!b) {
+      return;
+    }
+    c->blocks = b;
+    c->cap = cap;
+  }
+  c->seen[s] = key;
+  c->blocks[c->nblocks++] = pc;
+}
+
+/*
+ * File layout (host byte order): magic[8], u32 map size, u32 reserved,
+ * u64 block count, map bytes, then the block entry PCs.
+ */
+bool cov_dump(const Coverage *c, const char *path) {
+  FILE *f = fopen(path, "wb");
+  if (!f) {
+    return false;
+  }
+
+  uint32_t size = COV_MAP_SIZE;
+  uint32_t reserved = 0;
+  uint64_t nblocks = c->nblocks;
+  bool ok = fwrite(cov_magic, 1, sizeof(cov_magic), f) == sizeof(cov_magic) &&
+            fwrite(&size, sizeof(size), 1, f) == 1 &&
+            fwrite(&reserved, sizeof(reserved), 1, f) == 1 &&
+            fwrite(&nblocks, sizeof(nblocks), 1, f) == 1 &&
+            fwrite(c->map, 1, COV_MAP_SIZE, f) == COV_MAP_SIZE &&
+            fwrite(c->blocks, sizeof(uint64_t), c->nblocks, f) == c->nblocks;
+
+  if (fclose(f) != 0) {
+    ok = false;
+  }
+  return ok;
+}
+
+bool cov_load(Coverage *c, const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    return false;
+  }
+
+  char magic[8];
+  uint32_t size = 0;
+  uint32_t reserved = 0;
+  uint64_t nblocks = 0;
+  if (fread(magic, 1, sizeof(magic), f) != sizeof(magic) ||
+      memcmp(magic, cov_magic, sizeof(magic)) != 0 ||
+      fread(&size, sizeof(size), 1, f) != 1 || size != COV_MAP_SIZE ||
+      fread(&reserved, sizeof(reserved), 1, f) != 1 ||
+      fread(&nblocks, sizeof(nblocks), 1, f) != 1 ||
+      fread(c->map, 1, COV_MAP_SIZE, f) != COV_MAP_SIZE) {
+    fclose(f);
+    return false;
+  }
+
+  for (uint64_t i = 0; i < nblocks; i++) {
+    uint64_t pc;
+    if (fread(&pc, sizeof(pc), 1, f) != 1) {
+      fclose(f);
+      return false;
+    }
+    cov_record_block(c, pc);
+  }
+
+  fclose(f);
+  return true;
+}
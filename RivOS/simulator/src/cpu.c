@@ -1,33 +1,330 @@
 #include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
+#include <string.h>
 
+#include "rivos_sim/alu.h"
 #include "rivos_sim/common.h"
 #include "rivos_sim/cpu.h"
 #include "rivos_sim/csr.h"
+#include "rivos_sim/fpu.h"
 #include "rivos_sim/mem.h"
+#include "rivos_sim/plic.h"
 #include "rivos_sim/sbi.h"
+#include "rivos_sim/semihost.h"
+#include "rivos_sim/user.h"
+#include "rivos_sim/vector.h"
 
-static void trap(Cpu *cpu, uint64_t scause, uint64_t sepc, uint64_t stval) {
-  cpu->scause = scause;
-  cpu->sepc = sepc;
-  cpu->stval = stval;
-  cpu->pc = cpu->stvec;
+static void trap(Cpu *cpu, uint64_t cause, uint64_t epc, uint64_t tval) {
+  bool irq = (cause & CAUSE_INTERRUPT) != 0;
+  uint64_t code = cause & 0x3f;
+  uint64_t deleg = irq ? cpu->csr[CSR_MIDELEG] : cpu->csr[CSR_MEDELEG];
+  uint64_t st = cpu->csr[CSR_MSTATUS];
+  uint64_t tvec;
+
+  cpu->traps[irq ? 16 + (code & 0xf) : code & 0xf]++;
+  cpu->reserved = false;
+  if (cpu->linux_user && !irq) {
+    cpu->csr[CSR_MCAUSE] = cause;
+    cpu->csr[CSR_MEPC] = epc;
+    cpu->csr[CSR_MTVAL] = tval;
+    cpu->pc = epc;
+    cpu->halted = true;
+    return;
+  }
+  if (cpu->priv <= PRIV_S && ((deleg >> code) & 1)) {
+    cpu->csr[CSR_SCAUSE] = cause;
+    cpu->csr[CSR_SEPC] = epc;
+    cpu->csr[CSR_STVAL] = tval;
+    st &= ~(MSTATUS_SIE | MSTATUS_SPIE | MSTATUS_SPP);
+    st |= (cpu->csr[CSR_MSTATUS] & MSTATUS_SIE) ? MSTATUS_SPIE : 0;
+    st |= cpu->priv == PRIV_S ? MSTATUS_SPP : 0;
+    cpu->priv = PRIV_S;
+    tvec = cpu->csr[CSR_STVEC];
+  } else {
+    cpu->csr[CSR_MCAUSE] = cause;
+    cpu->csr[CSR_MEPC] = epc;
+    cpu->csr[CSR_MTVAL] = tval;
+    st &= ~(MSTATUS_MIE | MSTATUS_MPIE | MSTATUS_MPP);
+    st |= (cpu->csr[CSR_MSTATUS] & MSTATUS_MIE) ? MSTATUS_MPIE : 0;
+    st |= (uint64_t)cpu->priv << MSTATUS_MPP_SHIFT;
+    cpu->priv = PRIV_M;
+    tvec = cpu->csr[CSR_MTVEC];
+  }
+  cpu->csr[CSR_MSTATUS] = st;
+
+  uint64_t base = tvec & ~3ull;
+  cpu->pc = (irq && (tvec & 3) == 1) ? base + 4 * code : base;
+}
+
+void cpu_reset(Cpu *cpu, uint64_t pc, int priv) {
+  memset(cpu, 0, sizeof(*cpu));
+  cpu->pc = pc;
+  cpu->priv = (uint8_t)priv;
+  cpu->csr[CSR_MISA] = 2ull << 62 | 1u << ('I' - 'A') | 1u << ('M' - 'A') |
+                       1u << ('A' - 'A') | 1u << ('F' - 'A') |
+                       1u << ('D' - 'A') | 1u << ('S' - 'A') |
+                       1u << ('U' - 'A') | 1u << ('V' - 'A');
+  cpu->csr[CSR_MSTATUS] = 2ull << 32 | 2ull << 34; /* UXL = SXL = 64 */
+  fpu_discard();
+  vec_reset(cpu, RIVOS_SIM_VLEN_DEFAULT);
+
+  if (priv != PRIV_M) {
+    cpu->sbi_host = true;
+    /* Firmware leaves the FPU and vector unit enabled for the supervisor. */
+    cpu->csr[CSR_MSTATUS] |= MSTATUS_FS_INITIAL | MSTATUS_VS_INITIAL;
+    cpu->csr[CSR_MEDELEG] = 0xb3ffull & ~(1ull << CAUSE_ECALL_S);
+    cpu->csr[CSR_MIDELEG] = MIP_SSIP | MIP_STIP | MIP_SEIP;
+    cpu->csr[CSR_MCOUNTEREN] = 7;
+  }
+}
+
+void cpu_interrupt(struct Machine *m, Cpu *cpu) {
+  Plic *plic = ((Machine *)m)->plic;
+  uint64_t ext = 0;
+  if (plic) {
+    ext |= plic_pending(plic, PLIC_CTX_M) ? MIP_MEIP : 0;
+    ext |= plic_pending(plic, PLIC_CTX_S) ? MIP_SEIP : 0;
+  }
+  cpu->mip_ext = ext;
+
+  uint64_t pend = csr_mip(cpu) & cpu->csr[CSR_MIE];
+  if (!pend) {
+    return;
+  }
+  cpu->wfi = false;
+
+  /* M-level interrupts preempt anything below M; S-level ones below M
+   * only if delegated, and within S only with SIE set. */
+  uint64_t st = cpu->csr[CSR_MSTATUS];
+  uint64_t deleg = cpu->csr[CSR_MIDELEG];
+  uint64_t take = 0;
+  if (cpu->priv < PRIV_M || (st & MSTATUS_MIE)) {
+    take = pend & ~deleg;
+  }
+  if (!take && (cpu->priv < PRIV_S || (cpu->priv == PRIV_S && (st & MSTATUS_SIE)))) {
+    take = pend & deleg;
+  }
+  if (!take) {
+    return;
+  }
+
+  static const uint8_t order[] = {IRQ_M_EXT,  IRQ_M_SOFT, IRQ_M_TIMER,
+                                  IRQ_S_EXT,  IRQ_S_SOFT, IRQ_S_TIMER};
+  for (size_t i = 0; i < sizeof(order); i++) {
+    if (take & (1ull << order[i])) {
+      trap(cpu, CAUSE_INTERRUPT | order[i], cpu->pc, 0);
+      return;
+    }
+  }
+}
+
+/* ECALL/EBREAK/xRET/WFI/SFENCE.VMA and the Zicsr instructions. */
+static void exec_system(Machine *m, Cpu *cpu, uint64_t pc, uint32_t insn) {
+  uint32_t rd = (insn >> 7) & 0x1F;
+  uint32_t funct3 = (insn >> 12) & 0x7;
+  uint32_t rs1 = (insn >> 15) & 0x1F;
+  uint64_t st = cpu->csr[CSR_MSTATUS];
+
+  if (funct3 == 0x0) {
+    uint32_t imm = insn >> 20;
+    if ((insn >> 25) == 0x09 && rd == 0) {
+      /* sfence.vma: no MMU, so no TLB to flush. */
+      if (cpu->priv == PRIV_U || (cpu->priv == PRIV_S && (st & MSTATUS_TVM))) {
+        trap(cpu, CAUSE_ILLEGAL_INSN, pc, insn);
+      }
+      return;
+    }
+    if (rd || rs1) {
+      trap(cpu, CAUSE_ILLEGAL_INSN, pc, insn);
+      return;
+    }
+
+    switch (imm) {
+    case 0x000:
+      if (cpu->priv == PRIV_U && cpu->linux_user) {
+        cpu->traps[CAUSE_ECALL_U]++;
+        user_syscall(m, cpu);
+      } else if (cpu->priv == PRIV_S && cpu->sbi_host) {
+        cpu->traps[CAUSE_ECALL_S]++;
+        sbi_handle(m, cpu);
+      } else {
+        trap(cpu, CAUSE_ECALL_U + cpu->priv, pc, 0);
+      }
+      return;
+    case 0x001:
+      if (semihost_is_call(m, pc)) {
+        semihost_call(m, cpu);
+        return;
+      }
+      trap(cpu, CAUSE_BREAKPOINT, pc, 0);
+      return;
+    case 0x102: /* sret */
+      if (cpu->priv < PRIV_S || (cpu->priv == PRIV_S && (st & MSTATUS_TSR))) {
+        break;
+      }
+      cpu->priv = (st & MSTATUS_SPP) ? PRIV_S : PRIV_U;
+      st &= ~(MSTATUS_SIE | MSTATUS_SPP);
+      st |= (st & MSTATUS_SPIE) ? MSTATUS_SIE : 0;
+      cpu->csr[CSR_MSTATUS] = st | MSTATUS_SPIE;
+      cpu->pc = cpu->csr[CSR_SEPC];
+      return;
+    case 0x302: /* mret */
+      if (cpu->priv < PRIV_M) {
+        break;
+      }
+      cpu->priv = (uint8_t)((st & MSTATUS_MPP) >> MSTATUS_MPP_SHIFT);
+      st &= ~(MSTATUS_MIE | MSTATUS_MPP);
+      st |= (st & MSTATUS_MPIE) ? MSTATUS_MIE : 0;
+      if (cpu->priv != PRIV_M) {
+        st &= ~MSTATUS_MPRV;
+      }
+      cpu->csr[CSR_MSTATUS] = st | MSTATUS_MPIE;
+      cpu->pc = cpu->csr[CSR_MEPC];
+      return;
+    case 0x105: /* wfi: the run loop sleeps until an interrupt is pending. */
+      if (cpu->priv == PRIV_U || (cpu->priv == PRIV_S && (st & MSTATUS_TW))) {
+        break;
+      }
+      cpu->wfi = true;
+      return;
+    default:
+      break;
+    }
+    trap(cpu, CAUSE_ILLEGAL_INSN, pc, insn);
+    return;
+  }
+
+  uint32_t csr = insn >> 20;
+  /* CSRR*I forms take the rs1 field as a 5-bit immediate. */
+  uint64_t src = (funct3 & 0x4) ? rs1 : cpu->x[rs1];
+  uint64_t old = 0;
+  uint64_t val;
+  bool write = true;
+
+  if (!csr_read(cpu, csr, &old)) {
+    trap(cpu, CAUSE_ILLEGAL_INSN, pc, insn);
+    return;
+  }
+  switch (funct3 & 0x3) {
+  case 0x1:
+    val = src;
+    break;
+  case 0x2:
+    val = old | src;
+    write = rs1 != 0;
+    break;
+  case 0x3:
+    val = old & ~src;
+    write = rs1 != 0;
+    break;
+  default:
+    trap(cpu, CAUSE_ILLEGAL_INSN, pc, insn);
+    return;
+  }
+  if (write && !csr_write(cpu, csr, val)) {
+    trap(cpu, CAUSE_ILLEGAL_INSN, pc, insn);
+    return;
+  }
+  if (rd)
+    cpu->x[rd] = old;
 }
 
-static inline uint64_t sext32(uint32_t v) {
-  return (uint64_t)(int64_t)(int32_t)v;
-} 
+/* The A extension. A single hart, so only traps and SC break a reservation. */
+static void exec_amo(Machine *m, Cpu *cpu, uint64_t pc, uint32_t insn) {
+  uint32_t rd = (insn >> 7) & 0x1F;
+  uint32_t funct3 = (insn >> 12) & 0x7;
+  uint32_t f5 = insn >> 27;
+  uint64_t addr = cpu->x[(insn >> 15) & 0x1F];
+  uint64_t src = cpu->x[(insn >> 20) & 0x1F];
+  bool dword = funct3 == 0x3;
+  uint64_t old;
+  uint64_t val;
+
+  if ((funct3 != 0x2 && !dword) || (f5 == 0x02 && ((insn >> 20) & 0x1F))) {
+    trap(cpu, CAUSE_ILLEGAL_INSN, pc, insn);
+    return;
+  }
+  if (addr & (dword ? 7 : 3)) {
+    trap(cpu, CAUSE_MISALIGNED_STORE, pc, addr);
+    return;
+  }
+
+  if (f5 == 0x03) { /* sc */
+    bool ok = cpu->reserved && cpu->reservation == addr;
+    cpu->reserved = false;
+    if (ok && dword) {
+      mem_write64(m, addr, src);
+    } else if (ok) {
+      mem_write32(m, addr, (uint32_t)src);
+    }
+    if (rd)
+      cpu->x[rd] = !ok;
+    return;
+  }
+
+  old = dword ? mem_read64(m, addr) : sext32(mem_read32(m, addr));
+  if (!dword) {
+    src = sext32((uint32_t)src);
+  }
+  switch (f5) {
+  case 0x02: /* lr */
+    cpu->reserved = true;
+    cpu->reservation = addr;
+    if (rd)
+      cpu->x[rd] = old;
+    return;
+  case 0x01:
+    val = src;
+    break;
+  case 0x00:
+    val = old + src;
+    break;
+  case 0x04:
+    val = old ^ src;
+    break;
+  case 0x0C:
+    val = old & src;
+    break;
+  case 0x08:
+    val = old | src;
+    break;
+  case 0x10:
+    val = (int64_t)old < (int64_t)src ? old : src;
+    break;
+  case 0x14:
+    val = (int64_t)old > (int64_t)src ? old : src;
+    break;
+  case 0x18:
+    val = old < src ? old : src;
+    break;
+  case 0x1C:
+    val = old > src ? old : src;
+    break;
+  default:
+    trap(cpu, CAUSE_ILLEGAL_INSN, pc, insn);
+    return;
+  }
+  if (dword) {
+    mem_write64(m, addr, val);
+  } else {
+    mem_write32(m, addr, (uint32_t)val);
+  }
+  if (rd)
+    cpu->x[rd] = old;
+}
 
 void cpu_exec_one(struct Machine *m, Cpu *cpu) {
   uint64_t pc = cpu->pc;
 
   if ((pc & 3ull) != 0) {
-    trap(cpu, 0, pc, pc);
+    trap(cpu, CAUSE_MISALIGNED_FETCH, pc, pc);
     return;
   }
 
-  uint32_t insn = mem_read32((Machine *)m, pc);
+  uint32_t insn = mem_fetch32((Machine *)m, pc);
   cpu->pc = pc + 4;
+  cpu->instret++;
 
   uint32_t opcode = insn & 0x7F;
   uint32_t rd = (insn >> 7) & 0x1F;
@@ -101,7 +398,7 @@ void cpu_exec_one(struct Machine *m, Cpu *cpu) {
       take = (x1 >= x2);
       break;
     default:
-      trap(cpu, 2, pc, insn);
+      trap(cpu, CAUSE_ILLEGAL_INSN, pc, insn);
       return;
     }
 
@@ -157,7 +454,7 @@ void cpu_exec_one(struct Machine *m, Cpu *cpu) {
       break;
     }
     default:
-      trap(cpu, 2, pc, insn);
+      trap(cpu, CAUSE_ILLEGAL_INSN, pc, insn);
       return;
     }
 
@@ -184,12 +481,20 @@ void cpu_exec_one(struct Machine *m, Cpu *cpu) {
       mem_write64((Machine *)m, addr, x2);
       break;
     default:
-      trap(cpu, 2, pc, insn);
+      trap(cpu, CAUSE_ILLEGAL_INSN, pc, insn);
       return;
     }
 
     break;
   }
+  case 0x0F:
+    /* FENCE / FENCE.I: single hart, in-order memory; device threads
+     * publish with their own barriers. */
+    if (funct3 > 0x1) {
+      trap(cpu, CAUSE_ILLEGAL_INSN, pc, insn);
+      return;
+    }
+    break;
   case 0x13: {
     uint64_t imm = sign_extend((uint64_t)(insn >> 20), 12);
 
@@ -218,25 +523,27 @@ void cpu_exec_one(struct Machine *m, Cpu *cpu) {
       if (rd)
         cpu->x[rd] = x1 & (uint64_t)imm;
       break;
-    case 0x1: {
-      uint32_t shamt = (insn >> 20) & 0x3F;
-      if (rd)
-        cpu->x[rd] = x1 << shamt;
-      break;
-    }
+    case 0x1:
     case 0x5: {
       uint32_t shamt = (insn >> 20) & 0x3F;
-      if ((insn >> 30) & 1) {
-        if (rd)
-          cpu->x[rd] = (uint64_t)((int64_t)x1 >> shamt);
-      } else {
-        if (rd)
-          cpu->x[rd] = x1 >> shamt;
+      uint32_t f6 = insn >> 26;
+      uint64_t r;
+      if (f6 == 0 && funct3 == 0x1) {
+        r = x1 << shamt;
+      } else if (f6 == 0 && funct3 == 0x5) {
+        r = x1 >> shamt;
+      } else if (f6 == 0x10 && funct3 == 0x5) {
+        r = (uint64_t)((int64_t)x1 >> shamt);
+      } else if (!alu_bitmanip(insn, x1, shamt, &r)) {
+        trap(cpu, CAUSE_ILLEGAL_INSN, pc, insn);
+        return;
       }
+      if (rd)
+        cpu->x[rd] = r;
       break;
     }
     default:
-      trap(cpu, 2, pc, insn);
+      trap(cpu, CAUSE_ILLEGAL_INSN, pc, insn);
       return;
     }
 
@@ -252,33 +559,48 @@ void cpu_exec_one(struct Machine *m, Cpu *cpu) {
         cpu->x[rd] = sext32(r);
       break;
     }
-    case 0x1: {
-      uint32_t shamt = (insn >> 20) & 0x1F;
-      uint32_t r = (uint32_t)x1 << shamt;
-      if (rd)
-        cpu->x[rd] = sext32(r);
-      break;
-    }
+    case 0x1:
     case 0x5: {
       uint32_t shamt = (insn >> 20) & 0x1F;
-      uint32_t r;
-      if ((insn >> 30) & 1) {
-        r = (uint32_t)((int32_t)(uint32_t)x1 >> shamt);
-      } else {
-        r = (uint32_t)x1 >> shamt;
+      uint64_t r;
+      if (funct7 == 0 && funct3 == 0x1) {
+        r = sext32((uint32_t)x1 << shamt);
+      } else if (funct7 == 0 && funct3 == 0x5) {
+        r = sext32((uint32_t)x1 >> shamt);
+      } else if (funct7 == 0x20 && funct3 == 0x5) {
+        r = sext32((uint32_t)((int32_t)(uint32_t)x1 >> shamt));
+      } else if (!alu_bitmanip(insn, x1, (insn >> 20) & 0x3F, &r)) {
+        trap(cpu, CAUSE_ILLEGAL_INSN, pc, insn);
+        return;
       }
       if (rd)
-        cpu->x[rd] = sext32(r);
+        cpu->x[rd] = r;
       break;
     }
     default:
-      trap(cpu, 2, pc, insn);
+      trap(cpu, CAUSE_ILLEGAL_INSN, pc, insn);
       return;
     }
 
     break;
   }
   case 0x33: {
+    if (funct7 == 0x01) {
+      if (rd)
+        cpu->x[rd] = alu_muldiv(funct3, x1, x2);
+      break;
+    }
+    if (funct7 != 0 && !(funct7 == 0x20 && (funct3 == 0 || funct3 == 5))) {
+      uint64_t r;
+      if (!alu_bitmanip(insn, x1, x2, &r)) {
+        trap(cpu, CAUSE_ILLEGAL_INSN, pc, insn);
+        return;
+      }
+      if (rd)
+        cpu->x[rd] = r;
+      break;
+    }
+
     switch (funct3) {
     case 0x0:
       if (funct7 == 0x20) {
@@ -323,13 +645,34 @@ void cpu_exec_one(struct Machine *m, Cpu *cpu) {
         cpu->x[rd] = x1 & x2;
       break;
     default:
-      trap(cpu, 2, pc, insn);
+      trap(cpu, CAUSE_ILLEGAL_INSN, pc, insn);
       return;
     }
 
     break;
   }
   case 0x3B: {
+    if (funct7 == 0x01) {
+      uint64_t r;
+      if (!alu_muldivw(funct3, x1, x2, &r)) {
+        trap(cpu, CAUSE_ILLEGAL_INSN, pc, insn);
+        return;
+      }
+      if (rd)
+        cpu->x[rd] = r;
+      break;
+    }
+    if (funct7 != 0 && !(funct7 == 0x20 && (funct3 == 0 || funct3 == 5))) {
+      uint64_t r;
+      if (!alu_bitmanip(insn, x1, x2, &r)) {
+        trap(cpu, CAUSE_ILLEGAL_INSN, pc, insn);
+        return;
+      }
+      if (rd)
+        cpu->x[rd] = r;
+      break;
+    }
+
     switch (funct3) {
     case 0x0: {
       uint32_t r;
@@ -361,48 +704,44 @@ void cpu_exec_one(struct Machine *m, Cpu *cpu) {
       break;
     }
     default:
-      trap(cpu, 2, pc, insn);
+      trap(cpu, CAUSE_ILLEGAL_INSN, pc, insn);
       return;
     }
 
     break;
   }
-  case 0x73: {
-    if (funct3 == 0x0) {
-      uint32_t imm = insn >> 20;
-      if (imm == 0) {
-        sbi_handle(cpu);
-      } else if (imm == 1) {
-        trap(cpu, 3, pc, 0);
-      } else if (imm == 0x105) {
-        /* wfi: treat as a no-op for MVP */
-      } else {
-        trap(cpu, 2, pc, insn);
-      }
-      break;
+  case 0x2F:
+    exec_amo((Machine *)m, cpu, pc, insn);
+    return;
+  case 0x07: /* LOAD-FP */
+  case 0x27: /* STORE-FP */
+    if (vec_is_mem_width(insn) ? !vec_exec((Machine *)m, cpu, insn)
+                               : !fpu_exec((Machine *)m, cpu, insn)) {
+      trap(cpu, CAUSE_ILLEGAL_INSN, pc, insn);
+      return;
     }
-
-    uint32_t csr = insn >> 20;
-    uint64_t old = csr_read(cpu, csr);
-
-    if (rd)
-      cpu->x[rd] = old;
-
-    if (funct3 == 0x1) {
-      csr_write(cpu, csr, x1);
-    } else if (funct3 == 0x2) {
-      csr_write(cpu, csr, old | x1);
-    } else if (funct3 == 0x3) {
-      csr_write(cpu, csr, old & ~x1);
-    } else {
-      trap(cpu, 2, pc, insn);
+    break;
+  case 0x43: /* FMADD */
+  case 0x47: /* FMSUB */
+  case 0x4B: /* FNMSUB */
+  case 0x4F: /* FNMADD */
+  case 0x53: /* OP-FP */
+    if (!fpu_exec((Machine *)m, cpu, insn)) {
+      trap(cpu, CAUSE_ILLEGAL_INSN, pc, insn);
       return;
     }
-
     break;
-  }
+  case 0x57: /* OP-V */
+    if (!vec_exec((Machine *)m, cpu, insn)) {
+      trap(cpu, CAUSE_ILLEGAL_INSN, pc, insn);
+      return;
+    }
+    break;
+  case 0x73:
+    exec_system((Machine *)m, cpu, pc, insn);
+    return;
   default:
-    trap(cpu, 2, pc, insn);
+    trap(cpu, CAUSE_ILLEGAL_INSN, pc, insn);
     return;
   }
 
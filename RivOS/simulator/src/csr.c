@@ -1,36 +1,326 @@
+#include <pthread.h>
+#include <stddef.h>
+#include <string.h>
+
 #include "rivos_sim/cpu.h"
 #include "rivos_sim/csr.h"
+#include "rivos_sim/fpu.h"
+
+/*
+ * The CSR file is the dense cpu->csr[] array. Plain CSRs are read straight
+ * from it and written through a mask; only views (sstatus, sie, sip),
+ * counters and WARL fields with legalisation rules take a hook.
+ */
+enum {
+  CSR_F_EXISTS = 1,
+  CSR_F_HOOK = 2,
+};
+
+typedef struct {
+  uint64_t wmask;
+  uint8_t flags;
+} CsrDesc;
+
+#define PLAIN(mask) {(mask), CSR_F_EXISTS}
+#define HOOK {0, CSR_F_EXISTS | CSR_F_HOOK}
+
+#define MIP_S_MASK (MIP_SSIP | MIP_STIP | MIP_SEIP)
+#define MIP_ALL (MIP_S_MASK | MIP_MSIP | MIP_MTIP | MIP_MEIP)
+#define SSTATUS_WMASK                                                  \
+  (MSTATUS_SIE | MSTATUS_SPIE | MSTATUS_SPP | MSTATUS_VS | MSTATUS_FS | \
+   MSTATUS_SUM | MSTATUS_MXR)
+#define SSTATUS_RMASK (SSTATUS_WMASK | MSTATUS_UXL | MSTATUS_SD)
+#define MSTATUS_WMASK                                                     \
+  (SSTATUS_WMASK | MSTATUS_MIE | MSTATUS_MPIE | MSTATUS_MPP | MSTATUS_MPRV | \
+   MSTATUS_TVM | MSTATUS_TW | MSTATUS_TSR)
+/* Every exception except ecall from M-mode may be delegated. */
+#define MEDELEG_MASK (0xb3ffull & ~(1ull << CAUSE_ECALL_M))
+#define PMPADDR_MASK ((1ull << 54) - 1)
+
+static const CsrDesc csr_desc[4096] = {
+    [CSR_FFLAGS] = HOOK,
+    [CSR_FRM] = HOOK,
+    [CSR_FCSR] = HOOK,
+    [CSR_VSTART] = HOOK,
+    [CSR_VXSAT] = HOOK,
+    [CSR_VXRM] = HOOK,
+    [CSR_VCSR] = HOOK,
+
+    [CSR_SSTATUS] = HOOK,
+    [CSR_SIE] = HOOK,
+    [CSR_STVEC] = PLAIN(~2ull),
+    [CSR_SCOUNTEREN] = PLAIN(7),
+    [CSR_SENVCFG] = PLAIN(0),
+    [CSR_SSCRATCH] = PLAIN(~0ull),
+    [CSR_SEPC] = PLAIN(~3ull),
+    [CSR_SCAUSE] = PLAIN(~0ull),
+    [CSR_STVAL] = PLAIN(~0ull),
+    [CSR_SIP] = HOOK,
+    [CSR_SATP] = HOOK,
+
+    [CSR_MSTATUS] = HOOK,
+    [CSR_MISA] = PLAIN(0),
+    [CSR_MEDELEG] = PLAIN(MEDELEG_MASK),
+    [CSR_MIDELEG] = PLAIN(MIP_S_MASK),
+    [CSR_MIE] = PLAIN(MIP_ALL),
+    [CSR_MTVEC] = PLAIN(~2ull),
+    [CSR_MCOUNTEREN] = PLAIN(7),
+    [CSR_MENVCFG] = PLAIN(0),
+    [CSR_MCOUNTINHIBIT] = PLAIN(0),
+    [CSR_MSCRATCH] = PLAIN(~0ull),
+    [CSR_MEPC] = PLAIN(~3ull),
+    [CSR_MCAUSE] = PLAIN(~0ull),
+    [CSR_MTVAL] = PLAIN(~0ull),
+    [CSR_MIP] = HOOK,
+    [CSR_PMPCFG0] = PLAIN(~0ull),
+    [CSR_PMPCFG2] = PLAIN(~0ull),
+    [CSR_PMPADDR0 + 0] = PLAIN(PMPADDR_MASK),
+    [CSR_PMPADDR0 + 1] = PLAIN(PMPADDR_MASK),
+    [CSR_PMPADDR0 + 2] = PLAIN(PMPADDR_MASK),
+    [CSR_PMPADDR0 + 3] = PLAIN(PMPADDR_MASK),
+    [CSR_PMPADDR0 + 4] = PLAIN(PMPADDR_MASK),
+    [CSR_PMPADDR0 + 5] = PLAIN(PMPADDR_MASK),
+    [CSR_PMPADDR0 + 6] = PLAIN(PMPADDR_MASK),
+    [CSR_PMPADDR0 + 7] = PLAIN(PMPADDR_MASK),
+    [CSR_PMPADDR0 + 8] = PLAIN(PMPADDR_MASK),
+    [CSR_PMPADDR0 + 9] = PLAIN(PMPADDR_MASK),
+    [CSR_PMPADDR0 + 10] = PLAIN(PMPADDR_MASK),
+    [CSR_PMPADDR0 + 11] = PLAIN(PMPADDR_MASK),
+    [CSR_PMPADDR0 + 12] = PLAIN(PMPADDR_MASK),
+    [CSR_PMPADDR0 + 13] = PLAIN(PMPADDR_MASK),
+    [CSR_PMPADDR0 + 14] = PLAIN(PMPADDR_MASK),
+    [CSR_PMPADDR0 + 15] = PLAIN(PMPADDR_MASK),
+
+    [CSR_MCYCLE] = HOOK,
+    [CSR_MINSTRET] = HOOK,
+    [CSR_CYCLE] = HOOK,
+    [CSR_TIME] = HOOK,
+    [CSR_INSTRET] = HOOK,
+    [CSR_VL] = HOOK,
+    [CSR_VTYPE] = HOOK,
+    [CSR_VLENB] = HOOK,
+
+    [CSR_MVENDORID] = PLAIN(0),
+    [CSR_MARCHID] = PLAIN(0),
+    [CSR_MIMPID] = PLAIN(0),
+    [CSR_MHARTID] = PLAIN(0),
+    [CSR_MCONFIGPTR] = PLAIN(0),
+};
+
+static inline uint64_t merge(uint64_t old, uint64_t v, uint64_t mask) {
+  return (old & ~mask) | (v & mask);
+}
+
+/* cycle/time/instret below M-mode are gated by m/scounteren. */
+static bool counter_enabled(const Cpu *cpu, uint32_t csr) {
+  uint64_t bit = 1ull << (csr - CSR_CYCLE);
+  if (cpu->priv < PRIV_M && !(cpu->csr[CSR_MCOUNTEREN] & bit)) {
+    return false;
+  }
+  if (cpu->priv < PRIV_S && !(cpu->csr[CSR_SCOUNTEREN] & bit)) {
+    return false;
+  }
+  return true;
+}
+
+/* SD summarises FS and VS; it is derived rather than stored. */
+static uint64_t mstatus_read(const Cpu *cpu) {
+  uint64_t st = cpu->csr[CSR_MSTATUS];
+  bool dirty = (st & MSTATUS_FS) == MSTATUS_FS ||
+               (st & MSTATUS_VS) == MSTATUS_VS;
+  return dirty ? st | MSTATUS_SD : st;
+}
 
-uint64_t csr_read(Cpu *cpu, uint32_t csr) {
+static bool read_hook(Cpu *cpu, uint32_t csr, uint64_t *v) {
   switch (csr) {
-  case CSR_STVEC:
-    return cpu->stvec;
-  case CSR_SEPC:
-    return cpu->sepc;
-  case CSR_SCAUSE:
-    return cpu->scause;
-  case CSR_STVAL:
-    return cpu->stval;
+  case CSR_FFLAGS:
+  case CSR_FRM:
+  case CSR_FCSR:
+    if (!(cpu->csr[CSR_MSTATUS] & MSTATUS_FS)) {
+      return false;
+    }
+    fpu_sync(cpu);
+    *v = cpu->csr[CSR_FCSR];
+    *v = csr == CSR_FFLAGS ? *v & 0x1f : csr == CSR_FRM ? *v >> 5 : *v;
+    return true;
+  case CSR_VSTART:
+  case CSR_VXSAT:
+  case CSR_VXRM:
+  case CSR_VCSR:
+  case CSR_VL:
+  case CSR_VTYPE:
+  case CSR_VLENB:
+    if (!(cpu->csr[CSR_MSTATUS] & MSTATUS_VS)) {
+      return false;
+    }
+    if (csr == CSR_VLENB) {
+      *v = cpu->vlenb;
+    } else if (csr == CSR_VCSR) {
+      *v = cpu->csr[CSR_VXRM] << 1 | cpu->csr[CSR_VXSAT];
+    } else {
+      *v = cpu->csr[csr];
+    }
+    return true;
+  case CSR_SSTATUS:
+    *v = mstatus_read(cpu) & SSTATUS_RMASK;
+    return true;
+  case CSR_MSTATUS:
+    *v = mstatus_read(cpu);
+    return true;
+  case CSR_SIE:
+    *v = cpu->csr[CSR_MIE] & cpu->csr[CSR_MIDELEG];
+    return true;
+  case CSR_SIP:
+    *v = csr_mip(cpu) & cpu->csr[CSR_MIDELEG];
+    return true;
+  case CSR_MIP:
+    *v = csr_mip(cpu);
+    return true;
+  case CSR_SATP:
+    if (cpu->priv == PRIV_S && (cpu->csr[CSR_MSTATUS] & MSTATUS_TVM)) {
+      return false;
+    }
+    *v = cpu->csr[csr];
+    return true;
+  case CSR_CYCLE:
+  case CSR_TIME:
+  case CSR_INSTRET:
+    if (!counter_enabled(cpu, csr)) {
+      return false;
+    }
+    /* No separate clock: one cycle and one tick per instruction. */
+    *v = cpu->instret;
+    return true;
+  case CSR_MCYCLE:
+  case CSR_MINSTRET:
+    *v = cpu->instret;
+    return true;
   default:
-    return 0;
+    *v = cpu->csr[csr];
+    return true;
   }
 }
 
-void csr_write(Cpu *cpu, uint32_t csr, uint64_t v) {
+static bool write_hook(Cpu *cpu, uint32_t csr, uint64_t v) {
+  uint64_t *mstatus = &cpu->csr[CSR_MSTATUS];
+  uint64_t deleg = cpu->csr[CSR_MIDELEG];
+
   switch (csr) {
-  case CSR_STVEC:
-    cpu->stvec = v;
-    break;
-  case CSR_SEPC:
-    cpu->sepc = v;
-    break;
-  case CSR_SCAUSE:
-    cpu->scause = v;
-    break;
-  case CSR_STVAL:
-    cpu->stval = v;
-    break;
+  case CSR_FFLAGS:
+  case CSR_FRM:
+  case CSR_FCSR: {
+    if (!(*mstatus & MSTATUS_FS)) {
+      return false;
+    }
+    /* Fold in pending host flags first so an frm write keeps them. */
+    fpu_sync(cpu);
+    uint64_t *fcsr = &cpu->csr[CSR_FCSR];
+    if (csr == CSR_FFLAGS) {
+      *fcsr = merge(*fcsr, v, 0x1f);
+    } else if (csr == CSR_FRM) {
+      *fcsr = merge(*fcsr, v << 5, 0xe0);
+    } else {
+      *fcsr = v & 0xff;
+    }
+    *mstatus |= MSTATUS_FS;
+    return true;
+  }
+  case CSR_VSTART:
+  case CSR_VXSAT:
+  case CSR_VXRM:
+  case CSR_VCSR:
+    if (!(*mstatus & MSTATUS_VS)) {
+      return false;
+    }
+    if (csr == CSR_VSTART) {
+      cpu->csr[csr] = v & (RIVOS_SIM_VLEN_MAX - 1);
+    } else if (csr == CSR_VCSR) {
+      cpu->csr[CSR_VXSAT] = v & 1;
+      cpu->csr[CSR_VXRM] = (v >> 1) & 3;
+    } else {
+      cpu->csr[csr] = v & (csr == CSR_VXSAT ? 1 : 3);
+    }
+    *mstatus |= MSTATUS_VS;
+    return true;
+  case CSR_SSTATUS:
+    *mstatus = merge(*mstatus, v, SSTATUS_WMASK);
+    return true;
+  case CSR_MSTATUS:
+    /* MPP is WARL: the reserved encoding 2 leaves it unchanged. */
+    if (((v & MSTATUS_MPP) >> MSTATUS_MPP_SHIFT) == 2) {
+      v = merge(v, *mstatus, MSTATUS_MPP);
+    }
+    *mstatus = merge(*mstatus, v, MSTATUS_WMASK);
+    return true;
+  case CSR_SIE:
+    cpu->csr[CSR_MIE] = merge(cpu->csr[CSR_MIE], v, deleg);
+    return true;
+  case CSR_SIP:
+    cpu->csr[CSR_MIP] = merge(cpu->csr[CSR_MIP], v, deleg & MIP_SSIP);
+    return true;
+  case CSR_MIP:
+    cpu->csr[CSR_MIP] = merge(cpu->csr[CSR_MIP], v, MIP_S_MASK);
+    return true;
+  case CSR_SATP:
+    if (cpu->priv == PRIV_S && (*mstatus & MSTATUS_TVM)) {
+      return false;
+    }
+    /* Only Bare is implemented; writes selecting another mode are ignored. */
+    if ((v >> 60) == 0) {
+      cpu->csr[CSR_SATP] = 0;
+    }
+    return true;
+  case CSR_MCYCLE:
+  case CSR_MINSTRET:
+    cpu->instret = v;
+    return true;
   default:
-    break;
+    return false;
+  }
+}
+
+bool csr_read(Cpu *cpu, uint32_t csr, uint64_t *v) {
+  const CsrDesc *d = &csr_desc[csr & 0xfff];
+  if (!(d->flags & CSR_F_EXISTS) || cpu->priv < ((csr >> 8) & 3)) {
+    return false;
+  }
+  if (d->flags & CSR_F_HOOK) {
+    return read_hook(cpu, csr, v);
+  }
+  *v = cpu->csr[csr];
+  return true;
+}
+
+bool csr_write(Cpu *cpu, uint32_t csr, uint64_t v) {
+  const CsrDesc *d = &csr_desc[csr & 0xfff];
+  if (!(d->flags & CSR_F_EXISTS) || cpu->priv < ((csr >> 8) & 3) ||
+      (csr >> 10) == 3) {
+    return false;
+  }
+  if (d->flags & CSR_F_HOOK) {
+    return write_hook(cpu, csr, v);
+  }
+  cpu->csr[csr] = merge(cpu->csr[csr], v, d->wmask);
+  return true;
+}
+
+static uint16_t impl_list[4096];
+static size_t impl_count;
+static pthread_once_t impl_once = PTHREAD_ONCE_INIT;
+
+static void build_impl_list(void) {
+  for (uint32_t i = 0; i < 4096; i++) {
+    if (csr_desc[i].flags & CSR_F_EXISTS) {
+      impl_list[impl_count++] = (uint16_t)i;
+    }
+  }
+}
+
+void cpu_copy(Cpu *dst, const Cpu *src) {
+  pthread_once(&impl_once, build_impl_list);
+  memcpy(dst, src, offsetof(Cpu, v));
+  memcpy(dst->v, src->v, 32 * (size_t)src->vlenb);
+  for (size_t i = 0; i < impl_count; i++) {
+    dst->csr[impl_list[i]] = src->csr[impl_list[i]];
   }
 }
@@ -0,0 +1,176 @@
+#include <errno.h>
+#include <sched.h>
+#include <string.h>
+
+#include "rivos_sim/devworker.h"
+
+static void flag_pending(DevWorker *w) {
+  atomic_fetch_or_explicit(&w->m->dev_pending, 1ull << (w->slot % 64),
+                           memory_order_release);
+  machine_kick(w->m);
+}
+
+/*
+ * parked is set before the last look at the ring and the CPU thread reads
+ * it after pushing, with a full fence on both sides, so one of the two
+ * sees the other's write and no doorbell is slept through.
+ */
+static void *worker_main(void *arg) {
+  DevWorker *w = (DevWorker *)arg;
+  uint64_t handled = 0;
+  for (;;) {
+    uint64_t msg;
+    if (spscq_pop(&w->doorbell, &msg)) {
+      w->ops->work(w, msg);
+      handled++;
+      continue;
+    }
+    if (w->ops->idle) {
+      w->ops->idle(w);
+    }
+    if (handled) {
+      atomic_fetch_add_explicit(&w->served, handled, memory_order_release);
+      handled = 0;
+      if (w->ops->irq_source) {
+        flag_pending(w);
+      }
+    }
+
+    pthread_mutex_lock(&w->lock);
+    atomic_store(&w->parked, true);
+    atomic_thread_fence(memory_order_seq_cst);
+    while (spscq_empty(&w->doorbell) && !atomic_load(&w->stop)) {
+      pthread_cond_wait(&w->cond, &w->lock);
+    }
+    atomic_store(&w->parked, false);
+    pthread_mutex_unlock(&w->lock);
+    if (atomic_load(&w->stop) && spscq_empty(&w->doorbell)) {
+      break;
+    }
+  }
+  return NULL;
+}
+
+bool devworker_start(DevWorker *w, Machine *m, const DevWorkerOps *ops,
+                     void *opaque) {
+  memset(w, 0, sizeof(*w));
+  if (m->nworkers == MACHINE_MAX_WORKERS) {
+    errno = ENOSPC;
+    return false;
+  }
+  w->m = m;
+  w->ops = ops;
+  w->opaque = opaque;
+  if (!spscq_init(&w->doorbell, DEVWORKER_RING) ||
+      !spscq_init(&w->done, DEVWORKER_RING)) {
+    spscq_destroy(&w->doorbell);
+    spscq_destroy(&w->done);
+    errno = ENOMEM;
+    return false;
+  }
+  pthread_mutex_init(&w->lock, NULL);
+  pthread_cond_init(&w->cond, NULL);
+  if (pthread_create(&w->thread, NULL, worker_main, w) != 0) {
+    pthread_mutex_destroy(&w->lock);
+    pthread_cond_destroy(&w->cond);
+    spscq_destroy(&w->doorbell);
+    spscq_destroy(&w->done);
+    return false;
+  }
+  w->live = true;
+  w->slot = (uint32_t)m->nworkers;
+  m->workers[m->nworkers++] = w;
+  return true;
+}
+
+void devworker_stop(DevWorker *w) {
+  if (!w->live) {
+    return;
+  }
+  pthread_mutex_lock(&w->lock);
+  atomic_store(&w->stop, true);
+  pthread_cond_signal(&w->cond);
+  pthread_mutex_unlock(&w->lock);
+  pthread_join(w->thread, NULL);
+  w->live = false;
+
+  if (w->held) {
+    w->held = false;
+    machine_release_irq_source(w->m);
+  }
+  Machine *m = w->m;
+  for (size_t i = 0; i < m->nworkers; i++) {
+    if (m->workers[i] == w) {
+      m->workers[i] = NULL;
+    }
+  }
+  pthread_mutex_destroy(&w->lock);
+  pthread_cond_destroy(&w->cond);
+  spscq_destroy(&w->doorbell);
+  spscq_destroy(&w->done);
+}
+
+/*
+ * served is read before the ring is drained: completions are posted before
+ * served moves, so a worker that has caught up has nothing left in flight.
+ */
+static bool deliver(DevWorker *w, bool drop) {
+  uint64_t served = atomic_load_explicit(&w->served, memory_order_acquire);
+  uint64_t msg;
+  while (spscq_pop(&w->done, &msg)) {
+    if (!drop) {
+      w->ops->complete(w, msg);
+    }
+  }
+  if (served != w->rung) {
+    return false;
+  }
+  if (w->held) {
+    w->held = false;
+    machine_release_irq_source(w->m);
+  }
+  return true;
+}
+
+/* Either side may wait for the other, so waiting also drains completions. */
+void devworker_ring(DevWorker *w, uint64_t msg) {
+  while (!spscq_push(&w->doorbell, msg)) {
+    deliver(w, false);
+    sched_yield();
+  }
+  w->rung++;
+  if (w->ops->irq_source && !w->held) {
+    w->held = true;
+    machine_hold_irq_source(w->m);
+  }
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load(&w->parked)) {
+    pthread_mutex_lock(&w->lock);
+    pthread_cond_signal(&w->cond);
+    pthread_mutex_unlock(&w->lock);
+  }
+}
+
+void devworker_post(DevWorker *w, uint64_t msg) {
+  while (!spscq_push(&w->done, msg)) {
+    flag_pending(w);
+    sched_yield();
+  }
+  flag_pending(w);
+}
+
+void devworker_quiesce(DevWorker *w, bool deliver_done) {
+  while (w->live && !deliver(w, !deliver_done)) {
+    sched_yield();
+  }
+}
+
+void devworker_poll(Machine *m) {
+  uint64_t mask =
+      atomic_exchange_explicit(&m->dev_pending, 0, memory_order_acquire);
+  for (size_t i = 0; i < m->nworkers && mask; i++) {
+    if (m->workers[i] && ((mask >> (i % 64)) & 1)) {
+      deliver(m->workers[i], false);
+    }
+  }
+}
@@ -1,11 +1,20 @@
+#include <dirent.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <inttypes.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
 
 #include "rivos_sim/common.h"
 #include "rivos_sim/elf.h"
 #include "rivos_sim/machine.h"
+#include "rivos_sim/symtab.h"
 
 typedef struct {
   uint8_t ident[16];
@@ -35,81 +44,138 @@ typedef struct {
   uint64_t align;
 } Elf64_Phdr;
 
+typedef struct {
+  uint32_t name;
+  uint32_t type;
+  uint64_t flags;
+  uint64_t addr;
+  uint64_t offset;
+  uint64_t size;
+  uint32_t link;
+  uint32_t info;
+  uint64_t addralign;
+  uint64_t entsize;
+} Elf64_Shdr;
+
 static uint16_t read_u16_le(const uint8_t *p) {
   return (uint16_t)p[0] | ((uint16_t)p[1] << 8);
 }
 
-bool load_elf(Machine *m, const char *path, uint64_t *entry_out) {
-  FILE *f = fopen(path, "rb");
-  if (!f) {
-    return false;
-  }
-
+static bool read_ehdr(FILE *f, Elf64_Ehdr *eh) {
   uint8_t hdr_buf[64];
   if (fread(hdr_buf, 1, sizeof(hdr_buf), f) != sizeof(hdr_buf)) {
-    fclose(f);
     return false;
   }
 
-  Elf64_Ehdr eh;
-  memcpy(&eh.ident[0], hdr_buf, 16);
-  eh.type = read_u16_le(&hdr_buf[16]);
-  eh.machine = read_u16_le(&hdr_buf[18]);
-  eh.version = read_u32_le(&hdr_buf[20]);
-  eh.entry = read_u64_le(&hdr_buf[24]);
-  eh.phoff = read_u64_le(&hdr_buf[32]);
-  eh.shoff = read_u64_le(&hdr_buf[40]);
-  eh.flags = read_u32_le(&hdr_buf[48]);
-  eh.ehsize = read_u16_le(&hdr_buf[52]);
-  eh.phentsize = read_u16_le(&hdr_buf[54]);
-  eh.phnum = read_u16_le(&hdr_buf[56]);
-  eh.shentsize = read_u16_le(&hdr_buf[58]);
-  eh.shnum = read_u16_le(&hdr_buf[60]);
-  eh.shstrndx = read_u16_le(&hdr_buf[62]);
-
-  if (eh.ident[0] != 0x7F || eh.ident[1] != 'E' || eh.ident[2] != 'L' ||
-      eh.ident[3] != 'F') {
-    fclose(f);
+  memcpy(&eh->ident[0], hdr_buf, 16);
+  eh->type = read_u16_le(&hdr_buf[16]);
+  eh->machine = read_u16_le(&hdr_buf[18]);
+  eh->version = read_u32_le(&hdr_buf[20]);
+  eh->entry = read_u64_le(&hdr_buf[24]);
+  eh->phoff = read_u64_le(&hdr_buf[32]);
+  eh->shoff = read_u64_le(&hdr_buf[40]);
+  eh->flags = read_u32_le(&hdr_buf[48]);
+  eh->ehsize = read_u16_le(&hdr_buf[52]);
+  eh->phentsize = read_u16_le(&hdr_buf[54]);
+  eh->phnum = read_u16_le(&hdr_buf[56]);
+  eh->shentsize = read_u16_le(&hdr_buf[58]);
+  eh->shnum = read_u16_le(&hdr_buf[60]);
+  eh->shstrndx = read_u16_le(&hdr_buf[62]);
+
+  if (eh->ident[0] != 0x7F || eh->ident[1] != 'E' || eh->ident[2] != 'L' ||
+      eh->ident[3] != 'F') {
     errno = EINVAL;
     return false;
   }
 
-  if (eh.ident[4] != 2) {
-    fclose(f);
+  if (eh->ident[4] != 2) {
     errno = EINVAL;
     return false;
   }
 
-  if (eh.machine != 0xF3) {
-    fclose(f);
+  if (eh->machine != 0xF3) {
     errno = EINVAL;
     return false;
   }
 
-  *entry_out = eh.entry;
+  return true;
+}
 
-  if (fseek(f, (long)eh.phoff, SEEK_SET) != 0) {
-    fclose(f);
+static bool read_at(FILE *f, uint64_t off, void *buf, size_t len) {
+  if (fseek(f, (long)off, SEEK_SET) != 0) {
+    return false;
+  }
+  return fread(buf, 1, len, f) == len;
+}
+
+/* The interpreter decodes 32-bit instructions only. */
+static bool check_no_rvc(const Elf64_Ehdr *eh, const char *path) {
+  if (eh->flags & 0x1) { /* EF_RISCV_RVC */
+    fprintf(stderr, "%s: built with the C extension, which the simulator "
+                    "does not implement (use -march=rv64g*)\n", path);
+    errno = ENOEXEC;
     return false;
   }
+  return true;
+}
+
+static bool read_phdr(FILE *f, const Elf64_Ehdr *eh, uint16_t idx,
+                      Elf64_Phdr *ph) {
+  uint8_t ph_buf[56];
+  if (!read_at(f, eh->phoff + (uint64_t)idx * sizeof(ph_buf), ph_buf,
+               sizeof(ph_buf))) {
+    return false;
+  }
+
+  ph->type = read_u32_le(&ph_buf[0]);
+  ph->flags = read_u32_le(&ph_buf[4]);
+  ph->offset = read_u64_le(&ph_buf[8]);
+  ph->vaddr = read_u64_le(&ph_buf[16]);
+  ph->paddr = read_u64_le(&ph_buf[24]);
+  ph->filesz = read_u64_le(&ph_buf[32]);
+  ph->memsz = read_u64_le(&ph_buf[40]);
+  ph->align = read_u64_le(&ph_buf[48]);
+  return true;
+}
+
+enum {
+  ELF_MAX_LOAD = 16,
+};
+
+/* A PT_LOAD segment, placed at RAM offset `off`. */
+typedef struct {
+  uint64_t off;
+  uint64_t file_off;
+  uint64_t filesz;
+  uint64_t memsz;
+  uint32_t flags;
+} LoadSeg;
+
+/* Opens the ELF and collects its PT_LOAD segments, all of which must fit
+ * in RAM. Returns NULL with errno set on failure. */
+static FILE *open_elf(const Machine *m, const char *path, uint64_t *entry_out,
+                      LoadSeg *segs, size_t *nsegs) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    return NULL;
+  }
+
+  Elf64_Ehdr eh;
+  if (!read_ehdr(f, &eh) || !check_no_rvc(&eh, path)) {
+    fclose(f);
+    return NULL;
+  }
+
+  *entry_out = eh.entry;
+  *nsegs = 0;
 
   for (uint16_t i = 0; i < eh.phnum; i++) {
-    uint8_t ph_buf[56];
-    if (fread(ph_buf, 1, sizeof(ph_buf), f) != sizeof(ph_buf)) {
+    Elf64_Phdr ph;
+    if (!read_phdr(f, &eh, i, &ph)) {
       fclose(f);
-      return false;
+      return NULL;
     }
 
-    Elf64_Phdr ph;
-    ph.type = read_u32_le(&ph_buf[0]);
-    ph.flags = read_u32_le(&ph_buf[4]);
-    ph.offset = read_u64_le(&ph_buf[8]);
-    ph.vaddr = read_u64_le(&ph_buf[16]);
-    ph.paddr = read_u64_le(&ph_buf[24]);
-    ph.filesz = read_u64_le(&ph_buf[32]);
-    ph.memsz = read_u64_le(&ph_buf[40]);
-    ph.align = read_u64_le(&ph_buf[48]);
-
     if (ph.type != 1) {
       continue;
     }
@@ -120,42 +186,558 @@ bool load_elf(Machine *m, const char *path, uint64_t *entry_out) {
 
     uint64_t dst = ph.paddr ? ph.paddr : ph.vaddr;
 
-    if (!(dst >= RIVOS_SIM_RAM_BASE && (dst + ph.memsz) <= RIVOS_SIM_RAM_BASE + m->ram_size)) {
+    if (!(dst >= m->ram_base &&
+          (dst + ph.memsz) <= m->ram_base + m->ram_size) ||
+        ph.filesz > ph.memsz) {
       fprintf(stderr, "ELF segment out of RAM: paddr=0x%016" PRIx64
                       " memsz=0x%016" PRIx64 "\n",
               dst, ph.memsz);
       fclose(f);
       errno = EINVAL;
+      return NULL;
+    }
+
+    if (*nsegs == ELF_MAX_LOAD) {
+      fclose(f);
+      errno = E2BIG;
+      return NULL;
+    }
+    segs[(*nsegs)++] = (LoadSeg){
+        .off = dst - m->ram_base,
+        .file_off = ph.offset,
+        .filesz = ph.filesz,
+        .memsz = ph.memsz,
+        .flags = ph.flags,
+    };
+  }
+  return f;
+}
+
+static bool copy_segs(Machine *m, FILE *f, const LoadSeg *segs, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    memset(&m->ram[segs[i].off], 0, (size_t)segs[i].memsz);
+    if (segs[i].filesz > 0 &&
+        !read_at(f, segs[i].file_off, &m->ram[segs[i].off],
+                 (size_t)segs[i].filesz)) {
       return false;
     }
+  }
+  return true;
+}
 
-    memset(&m->ram[dst - RIVOS_SIM_RAM_BASE], 0, (size_t)ph.memsz);
+bool load_elf(Machine *m, const char *path, uint64_t *entry_out) {
+  LoadSeg segs[ELF_MAX_LOAD];
+  size_t nsegs;
+  FILE *f = open_elf(m, path, entry_out, segs, &nsegs);
+  if (!f) {
+    return false;
+  }
+  bool ok = copy_segs(m, f, segs, nsegs);
+  fclose(f);
+  return ok;
+}
 
-    if (ph.filesz > 0) {
-      long cur = ftell(f);
-      if (cur < 0) {
-        fclose(f);
-        return false;
-      }
+bool load_elf_user(Machine *m, const char *path, uint64_t dyn_base,
+                   ElfUserImage *out) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    return false;
+  }
+  Elf64_Ehdr eh;
+  if (!read_ehdr(f, &eh) || !check_no_rvc(&eh, path)) {
+    fclose(f);
+    return false;
+  }
+  if (eh.type != 2 && eh.type != 3) { /* ET_EXEC, ET_DYN */
+    fclose(f);
+    errno = ENOEXEC;
+    return false;
+  }
+  uint64_t bias = eh.type == 3 ? dyn_base : 0;
 
-      if (fseek(f, (long)ph.offset, SEEK_SET) != 0) {
-        fclose(f);
-        return false;
-      }
+  LoadSeg segs[ELF_MAX_LOAD];
+  size_t nsegs = 0;
+  memset(out, 0, sizeof(*out));
+  out->entry = eh.entry + bias;
+  out->phnum = eh.phnum;
+  out->phent = eh.phentsize;
+  for (uint16_t i = 0; i < eh.phnum; i++) {
+    Elf64_Phdr ph;
+    if (!read_phdr(f, &eh, i, &ph)) {
+      fclose(f);
+      return false;
+    }
+    if (ph.type == 3) { /* PT_INTERP: needs a dynamic linker */
+      fclose(f);
+      errno = ENOEXEC;
+      return false;
+    }
+    if (ph.type == 6) { /* PT_PHDR */
+      out->phdr = ph.vaddr + bias;
+      continue;
+    }
+    if (ph.type != 1 || ph.memsz == 0) {
+      continue;
+    }
 
-      if (fread(&m->ram[dst - RIVOS_SIM_RAM_BASE], 1, (size_t)ph.filesz, f) !=
-          (size_t)ph.filesz) {
-        fclose(f);
-        return false;
-      }
+    uint64_t dst = ph.vaddr + bias;
+    if (dst < m->ram_base || ph.memsz > m->ram_size ||
+        dst - m->ram_base > m->ram_size - ph.memsz ||
+        ph.filesz > ph.memsz) {
+      fprintf(stderr, "ELF segment out of RAM: vaddr=0x%016" PRIx64
+                      " memsz=0x%016" PRIx64 "\n",
+              dst, ph.memsz);
+      fclose(f);
+      errno = EINVAL;
+      return false;
+    }
+    if (nsegs == ELF_MAX_LOAD) {
+      fclose(f);
+      errno = E2BIG;
+      return false;
+    }
+    segs[nsegs++] = (LoadSeg){
+        .off = dst - m->ram_base,
+        .file_off = ph.offset,
+        .filesz = ph.filesz,
+        .memsz = ph.memsz,
+        .flags = ph.flags,
+    };
+    /* Without PT_PHDR, the headers are wherever the file maps them. */
+    if (!out->phdr && eh.phoff >= ph.offset &&
+        eh.phoff - ph.offset < ph.filesz) {
+      out->phdr = dst + (eh.phoff - ph.offset);
+    }
+    if (dst + ph.memsz > out->end) {
+      out->end = dst + ph.memsz;
+    }
+  }
+  out->end = (out->end + RIVOS_SIM_PAGE_SIZE - 1) &
+             ~(uint64_t)(RIVOS_SIM_PAGE_SIZE - 1);
+
+  bool ok = copy_segs(m, f, segs, nsegs);
+  fclose(f);
+  return ok;
+}
+
+size_t load_elf_exec_ranges(Machine *m, const char *path, ElfRange *out,
+                            size_t max) {
+  LoadSeg segs[ELF_MAX_LOAD];
+  size_t nsegs;
+  uint64_t entry;
+  FILE *f = open_elf(m, path, &entry, segs, &nsegs);
+  if (!f) {
+    return 0;
+  }
+  fclose(f);
+
+  size_t n = 0;
+  for (size_t i = 0; i < nsegs && n < max; i++) {
+    if (segs[i].flags & 1) { /* PF_X */
+      out[n].start = m->ram_base + segs[i].off;
+      out[n].end = out[n].start + segs[i].memsz;
+      n++;
+    }
+  }
+  return n;
+}
+
+size_t load_elf_segments(Machine *m, const char *path, ElfSegment *out,
+                         size_t max) {
+  LoadSeg segs[ELF_MAX_LOAD];
+  size_t nsegs;
+  uint64_t entry;
+  FILE *f = open_elf(m, path, &entry, segs, &nsegs);
+  if (!f) {
+    return 0;
+  }
+  fclose(f);
+
+  size_t n = 0;
+  for (; n < nsegs && n < max; n++) {
+    out[n].start = m->ram_base + segs[n].off;
+    out[n].file_end = out[n].start + segs[n].filesz;
+    out[n].end = out[n].start + segs[n].memsz;
+  }
+  return n;
+}
+
+/*
+ * Shared images are POSIX shared-memory objects named after the ELF's
+ * device, inode, size and mtime, so a rebuilt kernel gets a fresh one. The
+ * object holds RAM [lo, lo + len) exactly as load_elf leaves it, followed by
+ * a footer that the builder writes last: a reader that sees the full size
+ * and the footer sees a complete image. The builder holds an flock on the
+ * object, so one left incomplete by a crash is rebuilt by the next user.
+ */
+static const char image_footer[8] = {'R', 'V', 'I', 'M', 'G', '1', 0, 0};
+
+static bool image_complete(int fd, uint64_t len) {
+  struct stat sb;
+  char footer[sizeof(image_footer)];
+  return fstat(fd, &sb) == 0 &&
+         (uint64_t)sb.st_size == len + sizeof(image_footer) &&
+         pread(fd, footer, sizeof(footer), (off_t)len) ==
+             (ssize_t)sizeof(footer) &&
+         memcmp(footer, image_footer, sizeof(footer)) == 0;
+}
+
+/* Gaps between segments are left as holes, which read as zero. */
+static bool build_image(int fd, FILE *f, const LoadSeg *segs, size_t n,
+                        uint64_t lo, uint64_t len) {
+  for (size_t i = 0; i < n; i++) {
+    if (segs[i].filesz == 0) {
+      continue;
+    }
+    uint8_t *buf = (uint8_t *)malloc((size_t)segs[i].filesz);
+    bool ok = buf && read_at(f, segs[i].file_off, buf, (size_t)segs[i].filesz) &&
+              pwrite(fd, buf, (size_t)segs[i].filesz,
+                     (off_t)(segs[i].off - lo)) == (ssize_t)segs[i].filesz;
+    free(buf);
+    if (!ok) {
+      return false;
+    }
+  }
+  return pwrite(fd, image_footer, sizeof(image_footer), (off_t)len) ==
+         (ssize_t)sizeof(image_footer);
+}
+
+/*
+ * Opens the named image, building it if it is missing or incomplete. Waits
+ * for an instance that is building it; the lock goes if that one dies.
+ */
+static int open_image(const char *name, FILE *f, const LoadSeg *segs,
+                      size_t n, uint64_t lo, uint64_t len) {
+  int fd = shm_open(name, O_RDWR | O_CREAT, 0644);
+  if (fd < 0 && errno == EACCES) {
+    /* Another user's image: usable if complete, but not rebuildable. */
+    fd = shm_open(name, O_RDONLY, 0);
+  }
+  if (fd < 0) {
+    return -1;
+  }
+  if (image_complete(fd, len)) {
+    return fd;
+  }
+
+  int err;
+  if (flock(fd, LOCK_EX) != 0) {
+    err = errno;
+  } else if (image_complete(fd, len)) {
+    flock(fd, LOCK_UN);
+    return fd;
+  } else if (ftruncate(fd, 0) == 0 && build_image(fd, f, segs, n, lo, len)) {
+    flock(fd, LOCK_UN);
+    return fd;
+  } else {
+    err = errno;
+  }
+  close(fd);
+  errno = err;
+  return -1;
+}
+
+/*
+ * Unlinks images of earlier versions of the same file, which would
+ * otherwise stay in /dev/shm until reboot. Instances still using one keep
+ * their mapping.
+ */
+static void remove_stale_images(const char *name, const struct stat *sb) {
+  char prefix[64];
+  int plen = snprintf(prefix, sizeof(prefix), "rivos-img.%jx.%jx.",
+                      (uintmax_t)sb->st_dev, (uintmax_t)sb->st_ino);
+  DIR *d = opendir("/dev/shm");
+  if (!d) {
+    return;
+  }
+  struct dirent *e;
+  while ((e = readdir(d))) {
+    if (strncmp(e->d_name, prefix, (size_t)plen) == 0 &&
+        strcmp(e->d_name, name + 1) != 0) {
+      char stale[sizeof(e->d_name) + 1];
+      snprintf(stale, sizeof(stale), "/%s", e->d_name);
+      shm_unlink(stale);
+    }
+  }
+  closedir(d);
+}
+
+bool load_elf_shared(Machine *m, const char *path, uint64_t *entry_out) {
+  LoadSeg segs[ELF_MAX_LOAD];
+  size_t nsegs;
+  FILE *f = open_elf(m, path, entry_out, segs, &nsegs);
+  if (!f) {
+    return false;
+  }
+
+  uint64_t lo = m->ram_size, hi = 0;
+  for (size_t i = 0; i < nsegs; i++) {
+    lo = segs[i].off < lo ? segs[i].off : lo;
+    hi = segs[i].off + segs[i].memsz > hi ? segs[i].off + segs[i].memsz : hi;
+  }
+  if (nsegs == 0) {
+    fclose(f);
+    return true;
+  }
+  lo &= ~(uint64_t)(RIVOS_SIM_PAGE_SIZE - 1);
+  hi = (hi + RIVOS_SIM_PAGE_SIZE - 1) & ~(uint64_t)(RIVOS_SIM_PAGE_SIZE - 1);
+
+  struct stat sb;
+  char name[128];
+  int fd = -1;
+  if (fstat(fileno(f), &sb) == 0) {
+    snprintf(name, sizeof(name), "/rivos-img.%jx.%jx.%jx.%jx",
+             (uintmax_t)sb.st_dev, (uintmax_t)sb.st_ino,
+             (uintmax_t)sb.st_size,
+             (uintmax_t)sb.st_mtim.tv_sec * 1000000000u +
+                 (uintmax_t)sb.st_mtim.tv_nsec);
+    fd = open_image(name, f, segs, nsegs, lo, hi - lo);
+    if (fd >= 0) {
+      remove_stale_images(name, &sb);
+    }
+  }
+
+  /* Private pages over the shared object: untouched ones stay shared with
+   * every other instance, written ones are copied on first store. */
+  void *p = MAP_FAILED;
+  if (fd >= 0) {
+    p = mmap(m->ram + lo, (size_t)(hi - lo), PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_FIXED, fd, 0);
+    int err = errno;
+    close(fd);
+    if (p == MAP_FAILED) {
+      /* A failed MAP_FIXED may have unmapped the range; put RAM back. */
+      mmap(m->ram + lo, (size_t)(hi - lo), PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0);
+    }
+    errno = err;
+  }
+  if (p == MAP_FAILED) {
+    fprintf(stderr, "[rivos-sim] cannot share image of %s (%s), loading "
+                    "privately\n",
+            path, strerror(errno));
+    bool ok = copy_segs(m, f, segs, nsegs);
+    fclose(f);
+    return ok;
+  }
+
+  fclose(f);
+  return true;
+}
+
+static bool read_shdr(FILE *f, const Elf64_Ehdr *eh, uint16_t idx,
+                      Elf64_Shdr *sh) {
+  uint8_t sh_buf[64];
+  if (!read_at(f, eh->shoff + (uint64_t)idx * eh->shentsize, sh_buf,
+               sizeof(sh_buf))) {
+    return false;
+  }
+
+  sh->name = read_u32_le(&sh_buf[0]);
+  sh->type = read_u32_le(&sh_buf[4]);
+  sh->flags = read_u64_le(&sh_buf[8]);
+  sh->addr = read_u64_le(&sh_buf[16]);
+  sh->offset = read_u64_le(&sh_buf[24]);
+  sh->size = read_u64_le(&sh_buf[32]);
+  sh->link = read_u32_le(&sh_buf[40]);
+  sh->info = read_u32_le(&sh_buf[44]);
+  sh->addralign = read_u64_le(&sh_buf[48]);
+  sh->entsize = read_u64_le(&sh_buf[56]);
+  return true;
+}
+
+static int symbol_cmp(const void *a, const void *b) {
+  const Symbol *sa = (const Symbol *)a;
+  const Symbol *sb = (const Symbol *)b;
+  if (sa->addr != sb->addr) {
+    return (sa->addr < sb->addr) ? -1 : 1;
+  }
+  /* Prefer sized symbols over zero-sized assembler labels at the same address. */
+  if (sa->size != sb->size) {
+    return (sa->size > sb->size) ? -1 : 1;
+  }
+  return 0;
+}
+
+/*
+ * Collects FUNC, OBJECT and NOTYPE symbols from .symtab, sorted by address.
+ * NOTYPE symbols take their type from the section they live in. Zero-sized
+ * symbols (assembly labels such as trap_entry) are extended up to the next
+ * symbol so that every PC inside them can be attributed.
+ */
+bool load_elf_symbols(const char *path, SymbolTable *st) {
+  st->syms = NULL;
+  st->count = 0;
+
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    return false;
+  }
 
-      if (fseek(f, cur, SEEK_SET) != 0) {
+  Elf64_Ehdr eh;
+  if (!read_ehdr(f, &eh)) {
+    fclose(f);
+    return false;
+  }
+
+  Elf64_Shdr symsh;
+  bool found = false;
+  for (uint16_t i = 0; i < eh.shnum; i++) {
+    if (!read_shdr(f, &eh, i, &symsh)) {
+      fclose(f);
+      return false;
+    }
+    if (symsh.type == 2) {
+      found = true;
+      break;
+    }
+  }
+
+  if (!found || symsh.entsize != 24) {
+    fclose(f);
+    return true;
+  }
+
+  Elf64_Shdr strsh;
+  if (!read_shdr(f, &eh, (uint16_t)symsh.link, &strsh)) {
+    fclose(f);
+    return false;
+  }
+
+  uint8_t *symdata = (uint8_t *)malloc((size_t)symsh.size);
+  char *strdata = (char *)malloc((size_t)strsh.size + 1);
+  if (!symdata || !strdata ||
+      !read_at(f, symsh.offset, symdata, (size_t)symsh.size) ||
+      !read_at(f, strsh.offset, strdata, (size_t)strsh.size)) {
+    free(symdata);
+    free(strdata);
+    fclose(f);
+    return false;
+  }
+  strdata[strsh.size] = '\0';
+
+  size_t nsyms = (size_t)(symsh.size / 24);
+  st->syms = (Symbol *)calloc(nsyms ? nsyms : 1, sizeof(Symbol));
+  if (!st->syms) {
+    free(symdata);
+    free(strdata);
+    fclose(f);
+    return false;
+  }
+
+  for (size_t i = 0; i < nsyms; i++) {
+    const uint8_t *p = &symdata[i * 24];
+    uint32_t name = read_u32_le(&p[0]);
+    uint8_t type = p[4] & 0xF;
+    uint16_t shndx = read_u16_le(&p[6]);
+    uint64_t value = read_u64_le(&p[8]);
+    uint64_t size = read_u64_le(&p[16]);
+
+    if (type > 2) {
+      continue;
+    }
+    if (shndx == 0 || shndx >= 0xFF00 || name == 0 || name >= strsh.size) {
+      continue;
+    }
+
+    SymbolType stype = (type == 1) ? SYMBOL_OBJECT : SYMBOL_FUNC;
+    if (type == 0) {
+      Elf64_Shdr owner;
+      if (!read_shdr(f, &eh, shndx, &owner)) {
+        free(symdata);
+        free(strdata);
         fclose(f);
+        symtab_free(st);
         return false;
       }
+      stype = (owner.flags & 0x4) ? SYMBOL_FUNC : SYMBOL_OBJECT;
     }
+    /* Skip the mapping and local-label symbols the assembler emits. */
+    const char *nm = &strdata[name];
+    if (nm[0] == '$' || (nm[0] == '.' && nm[1] == 'L')) {
+      continue;
+    }
+
+    Symbol *s = &st->syms[st->count];
+    size_t len = strlen(nm);
+    s->name = (char *)malloc(len + 1);
+    if (!s->name) {
+      free(symdata);
+      free(strdata);
+      fclose(f);
+      symtab_free(st);
+      return false;
+    }
+    memcpy(s->name, nm, len + 1);
+    s->addr = value;
+    s->size = size;
+    s->type = stype;
+    st->count++;
   }
 
+  free(symdata);
+  free(strdata);
   fclose(f);
+
+  qsort(st->syms, st->count, sizeof(Symbol), symbol_cmp);
+
+  size_t out = 0;
+  for (size_t i = 0; i < st->count; i++) {
+    if (out > 0 && st->syms[out - 1].addr == st->syms[i].addr) {
+      free(st->syms[i].name);
+      continue;
+    }
+    st->syms[out++] = st->syms[i];
+  }
+  st->count = out;
+
+  for (size_t i = 0; i < st->count; i++) {
+    if (st->syms[i].size == 0) {
+      st->syms[i].size = (i + 1 < st->count)
+                             ? st->syms[i + 1].addr - st->syms[i].addr
+                             : 1;
+    }
+  }
+
   return true;
 }
+
+size_t load_elf_sections(const char *path, ElfSection *out, size_t max) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    return 0;
+  }
+  Elf64_Ehdr eh;
+  Elf64_Shdr strsh;
+  if (!read_ehdr(f, &eh) || eh.shstrndx >= eh.shnum ||
+      !read_shdr(f, &eh, eh.shstrndx, &strsh)) {
+    fclose(f);
+    return 0;
+  }
+
+  size_t n = 0;
+  for (uint16_t i = 1; i < eh.shnum && n < max; i++) {
+    Elf64_Shdr sh;
+    if (!read_shdr(f, &eh, i, &sh)) {
+      break;
+    }
+    /* SHF_ALLOC: occupies memory at run time. */
+    if (!(sh.flags & 0x2) || sh.size == 0 || sh.name >= strsh.size) {
+      continue;
+    }
+    ElfSection *s = &out[n];
+    memset(s->name, 0, sizeof(s->name));
+    uint64_t len = strsh.size - sh.name;
+    if (len > sizeof(s->name) - 1) {
+      len = sizeof(s->name) - 1;
+    }
+    if (!read_at(f, strsh.offset + sh.name, s->name, (size_t)len)) {
+      continue;
+    }
+    s->start = sh.addr;
+    s->end = sh.addr + sh.size;
+    n++;
+  }
+  fclose(f);
+  return n;
+}
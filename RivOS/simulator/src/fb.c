@@ -0,0 +1,316 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "rivos_sim/fb.h"
+
+static const char fb_magic[8] = {'R', 'V', 'F', 'B', 'U', 'F', 0, 0};
+
+typedef struct {
+  FbHeader *hdr;
+  uint8_t *pixels;
+  size_t map_size;
+  uint64_t fb_size;
+  uint32_t bpp;
+  uint32_t stride;
+  uint32_t tiles_x;
+  uint32_t ntiles;
+
+  /* Accumulated for the frame in progress. */
+  uint64_t dirty[FB_MAX_TILES / 64];
+  uint64_t bytes;
+
+  uint64_t total_bytes;
+  const char *ppm_dir;
+} Fb;
+
+static inline void mark_tile(Fb *fb, uint64_t off) {
+  uint32_t y = (uint32_t)(off / fb->stride);
+  uint32_t x = (uint32_t)(off % fb->stride) / fb->bpp;
+  uint32_t t = (y / FB_TILE) * fb->tiles_x + x / FB_TILE;
+  fb->dirty[t / 64] |= 1ull << (t % 64);
+}
+
+static uint64_t pix_read(void *opaque, uint64_t off, unsigned size) {
+  const Fb *fb = (const Fb *)opaque;
+  uint64_t v = 0;
+  for (unsigned i = 0; i < size; i++) {
+    v |= (uint64_t)fb->pixels[off + i] << (8 * i);
+  }
+  return v;
+}
+
+/* A store never spans more than two tiles, and those hold its ends. */
+static void pix_write(void *opaque, uint64_t off, unsigned size,
+                      uint64_t val) {
+  Fb *fb = (Fb *)opaque;
+  for (unsigned i = 0; i < size; i++) {
+    fb->pixels[off + i] = (uint8_t)(val >> (8 * i));
+  }
+  mark_tile(fb, off);
+  mark_tile(fb, off + size - 1);
+  fb->bytes += size;
+}
+
+static unsigned count_tiles(const uint64_t *bits, uint32_t ntiles) {
+  unsigned n = 0;
+  for (uint32_t i = 0; i < (ntiles + 63) / 64; i++) {
+    n += (unsigned)__builtin_popcountll(bits[i]);
+  }
+  return n;
+}
+
+static void dump_frame(Fb *fb) {
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/frame-%06" PRIu64 ".ppm", fb->ppm_dir,
+           fb->hdr->frame);
+  FILE *f = fopen(path, "wb");
+  bool ok = f && fb_write_ppm(fb->hdr, f);
+  if (f && fclose(f) != 0) {
+    ok = false;
+  }
+  if (!ok) {
+    fprintf(stderr, "[rivos-sim] fb: cannot write %s: %s\n", path,
+            strerror(errno));
+  }
+  fprintf(stderr, "[rivos-sim] fb frame %" PRIu64 ": %" PRIu64
+          " bytes stored, %u/%u tiles dirty\n",
+          fb->hdr->frame, fb->hdr->frame_bytes,
+          count_tiles(fb->hdr->dirty, fb->ntiles), fb->ntiles);
+}
+
+static void flush(Fb *fb) {
+  FbHeader *h = fb->hdr;
+  atomic_fetch_add_explicit(&h->seq, 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  memcpy(h->dirty, fb->dirty, sizeof(h->dirty));
+  h->frame++;
+  h->frame_bytes = fb->bytes;
+  atomic_fetch_add_explicit(&h->seq, 1, memory_order_release);
+
+  fb->total_bytes += fb->bytes;
+  fb->bytes = 0;
+  memset(fb->dirty, 0, sizeof(fb->dirty));
+  if (fb->ppm_dir) {
+    dump_frame(fb);
+  }
+}
+
+static uint64_t regs_read(void *opaque, uint64_t off, unsigned size) {
+  const Fb *fb = (const Fb *)opaque;
+  (void)size;
+  switch (off) {
+  case FB_REG_WIDTH:
+    return fb->hdr->width;
+  case FB_REG_HEIGHT:
+    return fb->hdr->height;
+  case FB_REG_STRIDE:
+    return fb->stride;
+  case FB_REG_FORMAT:
+    return fb->hdr->format;
+  case FB_REG_FRAME:
+    return (uint32_t)fb->hdr->frame;
+  default:
+    return 0;
+  }
+}
+
+static void regs_write(void *opaque, uint64_t off, unsigned size,
+                       uint64_t val) {
+  (void)size;
+  (void)val;
+  if (off == FB_REG_FLUSH) {
+    flush((Fb *)opaque);
+  }
+}
+
+static void fb_destroy(void *opaque) {
+  Fb *fb = (Fb *)opaque;
+  if (fb->hdr->frame) {
+    fprintf(stderr,
+            "[rivos-sim] fb: %" PRIu64 " frames, %" PRIu64
+            " bytes stored per frame on average\n",
+            fb->hdr->frame, fb->total_bytes / fb->hdr->frame);
+  }
+  munmap(fb->hdr, fb->map_size);
+  free(fb);
+}
+
+bool fb_parse(FbConfig *cfg, char *spec) {
+  memset(cfg, 0, sizeof(*cfg));
+  cfg->format = FB_XRGB8888;
+
+  char *save = NULL;
+  char *dims = strtok_r(spec, ",", &save);
+  if (!dims) {
+    return false;
+  }
+  char *end = NULL;
+  unsigned long w = strtoul(dims, &end, 10);
+  if (*end != 'x') {
+    return false;
+  }
+  unsigned long h = strtoul(end + 1, &end, 10);
+  if (*end || w == 0 || h == 0 || w > FB_MAX_DIM || h > FB_MAX_DIM) {
+    return false;
+  }
+  cfg->width = (uint32_t)w;
+  cfg->height = (uint32_t)h;
+
+  for (char *tok; (tok = strtok_r(NULL, ",", &save)) != NULL;) {
+    if (strcmp(tok, "xrgb8888") == 0) {
+      cfg->format = FB_XRGB8888;
+    } else if (strcmp(tok, "rgb565") == 0) {
+      cfg->format = FB_RGB565;
+    } else if (strncmp(tok, "file=", 5) == 0 && tok[5]) {
+      cfg->path = tok + 5;
+    } else if (strncmp(tok, "ppm=", 4) == 0 && tok[4]) {
+      cfg->ppm_dir = tok + 4;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool fb_add(Machine *m, const FbConfig *cfg) {
+  Fb *fb = (Fb *)calloc(1, sizeof(*fb));
+  if (!fb) {
+    return false;
+  }
+  fb->bpp = fb_bpp(cfg->format);
+  fb->stride = cfg->width * fb->bpp;
+  fb->fb_size = (uint64_t)fb->stride * cfg->height;
+  fb->map_size = FB_HEADER_SIZE + fb->fb_size;
+  fb->tiles_x = (cfg->width + FB_TILE - 1) / FB_TILE;
+  fb->ntiles = fb->tiles_x * ((cfg->height + FB_TILE - 1) / FB_TILE);
+  fb->ppm_dir = cfg->ppm_dir;
+
+  /* The viewer maps the same file: no copies at flush, just the header. */
+  void *p = MAP_FAILED;
+  if (cfg->path) {
+    int fd = open(cfg->path, O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+      free(fb);
+      return false;
+    }
+    if (ftruncate(fd, (off_t)fb->map_size) == 0) {
+      p = mmap(NULL, fb->map_size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    }
+    int err = errno;
+    close(fd);
+    errno = err;
+  } else {
+    p = mmap(NULL, fb->map_size, PROT_READ | PROT_WRITE,
+             MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  }
+  if (p == MAP_FAILED) {
+    free(fb);
+    return false;
+  }
+  fb->hdr = (FbHeader *)p;
+  fb->pixels = (uint8_t *)p + FB_HEADER_SIZE;
+
+  FbHeader *h = fb->hdr;
+  h->version = FB_VERSION;
+  h->width = cfg->width;
+  h->height = cfg->height;
+  h->stride = fb->stride;
+  h->format = cfg->format;
+  h->tile = FB_TILE;
+  h->pid = (int32_t)getpid();
+  atomic_thread_fence(memory_order_release);
+  memcpy(h->magic, fb_magic, sizeof(fb_magic));
+
+  MmioRegion pix = {
+      .base = RIVOS_SIM_FB_BASE,
+      .size = fb->fb_size,
+      .opaque = fb,
+      .read = pix_read,
+      .write = pix_write,
+  };
+  MmioRegion regs = {
+      .base = RIVOS_SIM_FB_REGS_BASE,
+      .size = FB_REGS_SIZE,
+      .opaque = fb,
+      .read = regs_read,
+      .write = regs_write,
+      .destroy = fb_destroy,
+  };
+  /* Once the regs are in, machine_destroy owns fb. */
+  if (!machine_add_mmio(m, &regs)) {
+    fb_destroy(fb);
+    errno = ENOSPC;
+    return false;
+  }
+  if (!machine_add_mmio(m, &pix)) {
+    errno = ENOSPC;
+    return false;
+  }
+  return true;
+}
+
+const FbHeader *fb_attach(const char *path, size_t *size_out) {
+  int fd = open(path, O_RDONLY);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat st;
+  void *p = MAP_FAILED;
+  if (fstat(fd, &st) == 0 && (size_t)st.st_size >= FB_HEADER_SIZE) {
+    p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+  } else {
+    errno = EINVAL;
+  }
+  int err = errno;
+  close(fd);
+  if (p == MAP_FAILED) {
+    errno = err;
+    return NULL;
+  }
+
+  const FbHeader *h = (const FbHeader *)p;
+  if (memcmp(h->magic, fb_magic, sizeof(fb_magic)) != 0 ||
+      h->version != FB_VERSION ||
+      (size_t)st.st_size < FB_HEADER_SIZE + (size_t)h->stride * h->height) {
+    munmap(p, (size_t)st.st_size);
+    errno = EINVAL;
+    return NULL;
+  }
+  *size_out = (size_t)st.st_size;
+  return h;
+}
+
+bool fb_write_ppm(const FbHeader *h, FILE *out) {
+  const uint8_t *pixels = (const uint8_t *)h + FB_HEADER_SIZE;
+  uint8_t *row = (uint8_t *)malloc((size_t)h->width * 3);
+  if (!row) {
+    return false;
+  }
+  fprintf(out, "P6\n%u %u\n255\n", h->width, h->height);
+  for (uint32_t y = 0; y < h->height; y++) {
+    const uint8_t *src = pixels + (size_t)y * h->stride;
+    for (uint32_t x = 0; x < h->width; x++) {
+      uint8_t *d = row + 3 * x;
+      if (h->format == FB_RGB565) {
+        uint32_t v = (uint32_t)src[2 * x] | (uint32_t)src[2 * x + 1] << 8;
+        d[0] = (uint8_t)((v >> 11) * 255 / 31);
+        d[1] = (uint8_t)(((v >> 5) & 0x3f) * 255 / 63);
+        d[2] = (uint8_t)((v & 0x1f) * 255 / 31);
+      } else {
+        d[0] = src[4 * x + 2];
+        d[1] = src[4 * x + 1];
+        d[2] = src[4 * x];
+      }
+    }
+    fwrite(row, 3, h->width, out);
+  }
+  free(row);
+  return !ferror(out);
+}
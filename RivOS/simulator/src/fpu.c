@@ -0,0 +1,730 @@
+#include <fenv.h>
+#include <math.h>
+#include <string.h>
+
+#include "rivos_sim/csr.h"
+#include "rivos_sim/fpu.h"
+#include "rivos_sim/mem.h"
+
+/*
+ * Round-to-nearest-even runs as plain host arithmetic; this file is built
+ * with -frounding-math -ffp-contract=off so the compiler neither folds nor
+ * fuses it. RTZ/RDN/RUP switch the host rounding mode around the one
+ * operation. RMM has no host equivalent: add/sub/mul and narrowing
+ * conversions detect exact ties with an error-free transform and step
+ * away from zero; div/sqrt cannot produce ties in binary; fused
+ * multiply-add uses RNE.
+ */
+
+#define CANON_S 0x7fc00000u
+#define CANON_D 0x7ff8000000000000ull
+#define BOX_S 0xffffffff00000000ull
+
+enum {
+  FMT_S = 0,
+  FMT_D = 1,
+};
+
+static const int host_rm[] = {
+    [RM_RNE] = FE_TONEAREST,
+    [RM_RTZ] = FE_TOWARDZERO,
+    [RM_RDN] = FE_DOWNWARD,
+    [RM_RUP] = FE_UPWARD,
+    [RM_RMM] = FE_TONEAREST,
+};
+
+void fpu_sync(Cpu *cpu) {
+  int ex = fetestexcept(FE_ALL_EXCEPT);
+  if (!ex) {
+    return;
+  }
+  uint64_t fl = 0;
+  fl |= (ex & FE_INEXACT) ? FFLAG_NX : 0;
+  fl |= (ex & FE_UNDERFLOW) ? FFLAG_UF : 0;
+  fl |= (ex & FE_OVERFLOW) ? FFLAG_OF : 0;
+  fl |= (ex & FE_DIVBYZERO) ? FFLAG_DZ : 0;
+  fl |= (ex & FE_INVALID) ? FFLAG_NV : 0;
+  cpu->csr[CSR_FCSR] |= fl;
+  feclearexcept(FE_ALL_EXCEPT);
+}
+
+void fpu_discard(void) {
+  feclearexcept(FE_ALL_EXCEPT);
+}
+
+static inline uint64_t sign_extend_12(uint32_t imm) {
+  return (uint64_t)(int64_t)((int32_t)(imm << 20) >> 20);
+}
+
+static inline void raise_flags(Cpu *cpu, uint64_t fl) {
+  cpu->csr[CSR_FCSR] |= fl;
+}
+
+static inline uint32_t f2u(float f) {
+  uint32_t u;
+  memcpy(&u, &f, sizeof(u));
+  return u;
+}
+
+static inline float u2f(uint32_t u) {
+  float f;
+  memcpy(&f, &u, sizeof(f));
+  return f;
+}
+
+static inline uint64_t d2u(double d) {
+  uint64_t u;
+  memcpy(&u, &d, sizeof(u));
+  return u;
+}
+
+static inline double u2d(uint64_t u) {
+  double d;
+  memcpy(&d, &u, sizeof(d));
+  return d;
+}
+
+/* A single-precision operand must be NaN-boxed; anything else reads as
+ * the canonical NaN. */
+static inline float get_s(const Cpu *cpu, uint32_t r) {
+  uint64_t v = cpu->f[r];
+  return (v >> 32) == 0xffffffffu ? u2f((uint32_t)v) : u2f(CANON_S);
+}
+
+static inline double get_d(const Cpu *cpu, uint32_t r) {
+  return u2d(cpu->f[r]);
+}
+
+static inline void set_s_bits(Cpu *cpu, uint32_t r, uint32_t bits) {
+  cpu->f[r] = BOX_S | bits;
+}
+
+/* Arithmetic results: any NaN becomes the canonical NaN. */
+static inline void set_s(Cpu *cpu, uint32_t r, float v) {
+  set_s_bits(cpu, r, isnan(v) ? CANON_S : f2u(v));
+}
+
+static inline void set_d(Cpu *cpu, uint32_t r, double v) {
+  cpu->f[r] = isnan(v) ? CANON_D : d2u(v);
+}
+
+static inline bool is_snan_s(float v) {
+  return isnan(v) && !(f2u(v) & 0x00400000u);
+}
+
+static inline bool is_snan_d(double v) {
+  return isnan(v) && !(d2u(v) & 0x0008000000000000ull);
+}
+
+/* Error-free transforms: the exact result is r + e (e == 0 if exact). */
+static inline double two_sum(double a, double b, double r) {
+  double bv = r - a;
+  return (a - (r - bv)) + (b - bv);
+}
+
+/*
+ * Given the RNE result r of an operation whose exact value is r + e, moves
+ * r one ulp away from zero if the exact value was a tie.
+ */
+static double tie_away_d(double r, double e) {
+  if (e == 0 || isinf(r) || isnan(r) || (e > 0) != (r > 0)) {
+    return r;
+  }
+  double away = nextafter(r, copysign(INFINITY, r));
+  return fabs(e) == fabs(away - r) / 2 ? away : r;
+}
+
+static float tie_away_s(float r, double exact) {
+  if (isinf(r) || isnan(r)) {
+    return r;
+  }
+  double e = exact - (double)r;
+  if (e == 0 || (e > 0) != (r > 0)) {
+    return r;
+  }
+  float away = nextafterf(r, copysignf(INFINITY, r));
+  return fabs(e) == fabs((double)away - (double)r) / 2 ? away : r;
+}
+
+enum {
+  OP_ADD,
+  OP_SUB,
+  OP_MUL,
+  OP_DIV,
+  OP_SQRT,
+};
+
+static double arith_d(int op, double a, double b) {
+  switch (op) {
+  case OP_ADD:
+    return a + b;
+  case OP_SUB:
+    return a - b;
+  case OP_MUL:
+    return a * b;
+  case OP_DIV:
+    return a / b;
+  default:
+    return sqrt(a);
+  }
+}
+
+static float arith_s(int op, float a, float b) {
+  switch (op) {
+  case OP_ADD:
+    return a + b;
+  case OP_SUB:
+    return a - b;
+  case OP_MUL:
+    return a * b;
+  case OP_DIV:
+    return a / b;
+  default:
+    return sqrtf(a);
+  }
+}
+
+static double rmm_d(int op, double a, double b) {
+  double r = arith_d(op, a, b);
+  switch (op) {
+  case OP_ADD:
+    return tie_away_d(r, two_sum(a, b, r));
+  case OP_SUB:
+    return tie_away_d(r, two_sum(a, -b, r));
+  case OP_MUL:
+    return tie_away_d(r, fma(a, b, -r));
+  default:
+    return r;
+  }
+}
+
+static float rmm_s(int op, float a, float b) {
+  float r = arith_s(op, a, b);
+  /* float sums and products are exact in double. */
+  switch (op) {
+  case OP_ADD:
+    return tie_away_s(r, (double)a + (double)b);
+  case OP_SUB:
+    return tie_away_s(r, (double)a - (double)b);
+  case OP_MUL:
+    return tie_away_s(r, (double)a * (double)b);
+  default:
+    return r;
+  }
+}
+
+static double op_d(int rm, int op, double a, double b) {
+  if (rm == RM_RNE) {
+    return arith_d(op, a, b);
+  }
+  if (rm == RM_RMM) {
+    return rmm_d(op, a, b);
+  }
+  int old = fegetround();
+  fesetround(host_rm[rm]);
+  double r = arith_d(op, a, b);
+  fesetround(old);
+  return r;
+}
+
+static float op_s(int rm, int op, float a, float b) {
+  if (rm == RM_RNE) {
+    return arith_s(op, a, b);
+  }
+  if (rm == RM_RMM) {
+    return rmm_s(op, a, b);
+  }
+  int old = fegetround();
+  fesetround(host_rm[rm]);
+  float r = arith_s(op, a, b);
+  fesetround(old);
+  return r;
+}
+
+static double fma_d(int rm, double a, double b, double c) {
+  if (rm == RM_RNE || rm == RM_RMM) {
+    return fma(a, b, c);
+  }
+  int old = fegetround();
+  fesetround(host_rm[rm]);
+  double r = fma(a, b, c);
+  fesetround(old);
+  return r;
+}
+
+static float fma_s(int rm, float a, float b, float c) {
+  if (rm == RM_RNE || rm == RM_RMM) {
+    return fmaf(a, b, c);
+  }
+  int old = fegetround();
+  fesetround(host_rm[rm]);
+  float r = fmaf(a, b, c);
+  fesetround(old);
+  return r;
+}
+
+/* Integer to float/double; only inexact conversions depend on rm. */
+static double i2d(int rm, int64_t v, bool is_unsigned) {
+  if (rm == RM_RNE || rm == RM_RMM) {
+    double r = is_unsigned ? (double)(uint64_t)v : (double)v;
+    if (rm == RM_RMM) {
+      long double exact = is_unsigned ? (long double)(uint64_t)v : (long double)v;
+      r = tie_away_d(r, (double)(exact - (long double)r));
+    }
+    return r;
+  }
+  int old = fegetround();
+  fesetround(host_rm[rm]);
+  double r = is_unsigned ? (double)(uint64_t)v : (double)v;
+  fesetround(old);
+  return r;
+}
+
+static float i2s(int rm, int64_t v, bool is_unsigned) {
+  if (rm == RM_RNE || rm == RM_RMM) {
+    float r = is_unsigned ? (float)(uint64_t)v : (float)v;
+    if (rm == RM_RMM) {
+      long double exact = is_unsigned ? (long double)(uint64_t)v : (long double)v;
+      double e = (double)(exact - (long double)r);
+      /* tie_away_s wants the exact value; v may not fit a double, so
+       * compare the residual against half an ulp of r directly. */
+      if (e != 0 && !isinf(r) && (e > 0) == (r > 0)) {
+        float away = nextafterf(r, copysignf(INFINITY, r));
+        if (fabs(e) == fabs((double)away - (double)r) / 2) {
+          r = away;
+        }
+      }
+    }
+    return r;
+  }
+  int old = fegetround();
+  fesetround(host_rm[rm]);
+  float r = is_unsigned ? (float)(uint64_t)v : (float)v;
+  fesetround(old);
+  return r;
+}
+
+static float d2s(int rm, double v) {
+  if (rm == RM_RNE) {
+    return (float)v;
+  }
+  if (rm == RM_RMM) {
+    return tie_away_s((float)v, v);
+  }
+  int old = fegetround();
+  fesetround(host_rm[rm]);
+  float r = (float)v;
+  fesetround(old);
+  return r;
+}
+
+/*
+ * Float to integer with RISC-V semantics: NaN and positive overflow give
+ * the maximum, negative overflow the minimum, both with NV; an inexact
+ * in-range result sets NX.
+ */
+static uint64_t f2i(Cpu *cpu, int rm, double v, int width, bool is_unsigned) {
+  if (isnan(v)) {
+    raise_flags(cpu, FFLAG_NV);
+    if (is_unsigned) {
+      return width == 32 ? (uint64_t)(int64_t)(int32_t)UINT32_MAX : UINT64_MAX;
+    }
+    return width == 32 ? (uint64_t)INT32_MAX : (uint64_t)INT64_MAX;
+  }
+
+  double r;
+  switch (rm) {
+  case RM_RTZ:
+    r = trunc(v);
+    break;
+  case RM_RDN:
+    r = floor(v);
+    break;
+  case RM_RUP:
+    r = ceil(v);
+    break;
+  case RM_RMM:
+    r = round(v);
+    break;
+  default:
+    r = nearbyint(v);
+    break;
+  }
+
+  double lo, hi;
+  if (is_unsigned) {
+    lo = 0;
+    hi = width == 32 ? 4294967295.0 : 18446744073709551615.0;
+  } else {
+    lo = width == 32 ? -2147483648.0 : -9223372036854775808.0;
+    hi = width == 32 ? 2147483647.0 : 9223372036854775807.0;
+  }
+
+  if (r < lo) {
+    raise_flags(cpu, FFLAG_NV);
+    return is_unsigned ? 0
+                       : (width == 32 ? (uint64_t)(int64_t)INT32_MIN
+                                      : (uint64_t)INT64_MIN);
+  }
+  /* hi is not representable for 64-bit; >= catches its rounded value. */
+  if ((width == 64 && r >= hi) || (width == 32 && r > hi)) {
+    raise_flags(cpu, FFLAG_NV);
+    if (is_unsigned) {
+      return width == 32 ? (uint64_t)(int64_t)(int32_t)UINT32_MAX : UINT64_MAX;
+    }
+    return width == 32 ? (uint64_t)INT32_MAX : (uint64_t)INT64_MAX;
+  }
+  if (r != v) {
+    raise_flags(cpu, FFLAG_NX);
+  }
+
+  if (is_unsigned) {
+    uint64_t u = (uint64_t)r;
+    return width == 32 ? (uint64_t)(int64_t)(int32_t)(uint32_t)u : u;
+  }
+  int64_t s = (int64_t)r;
+  return width == 32 ? (uint64_t)(int64_t)(int32_t)s : (uint64_t)s;
+}
+
+/* fmin/fmax: a NaN operand yields the other one, -0 < +0, and any
+ * signalling NaN raises NV. */
+static double minmax_d(Cpu *cpu, double a, double b, bool max) {
+  if (is_snan_d(a) || is_snan_d(b)) {
+    raise_flags(cpu, FFLAG_NV);
+  }
+  if (isnan(a) && isnan(b)) {
+    return u2d(CANON_D);
+  }
+  if (isnan(a)) {
+    return b;
+  }
+  if (isnan(b)) {
+    return a;
+  }
+  if (a == b) {
+    return (signbit(a) != max) ? a : b;
+  }
+  return (a < b) != max ? a : b;
+}
+
+static float minmax_s(Cpu *cpu, float a, float b, bool max) {
+  if (is_snan_s(a) || is_snan_s(b)) {
+    raise_flags(cpu, FFLAG_NV);
+  }
+  if (isnan(a) && isnan(b)) {
+    return u2f(CANON_S);
+  }
+  if (isnan(a)) {
+    return b;
+  }
+  if (isnan(b)) {
+    return a;
+  }
+  if (a == b) {
+    return (signbit(a) != max) ? a : b;
+  }
+  return (a < b) != max ? a : b;
+}
+
+/* feq is quiet (NV only for sNaN); flt/fle signal on any NaN. */
+static uint64_t compare(Cpu *cpu, uint32_t funct3, double a, double b,
+                        bool snan) {
+  if (isnan(a) || isnan(b)) {
+    if (funct3 != 2 || snan) {
+      raise_flags(cpu, FFLAG_NV);
+    }
+    return 0;
+  }
+  switch (funct3) {
+  case 0:
+    return a <= b;
+  case 1:
+    return a < b;
+  default:
+    return a == b;
+  }
+}
+
+static uint64_t classify(uint64_t sign, uint64_t exp, uint64_t frac,
+                         uint64_t exp_max, uint64_t quiet_bit) {
+  if (exp == exp_max) {
+    if (frac == 0) {
+      return sign ? 1u << 0 : 1u << 7;
+    }
+    return (frac & quiet_bit) ? 1u << 9 : 1u << 8;
+  }
+  if (exp == 0) {
+    if (frac == 0) {
+      return sign ? 1u << 3 : 1u << 4;
+    }
+    return sign ? 1u << 2 : 1u << 5;
+  }
+  return sign ? 1u << 1 : 1u << 6;
+}
+
+static uint64_t fclass_s(float v) {
+  uint32_t u = f2u(v);
+  return classify(u >> 31, (u >> 23) & 0xff, u & 0x7fffff, 0xff, 0x400000);
+}
+
+static uint64_t fclass_d(double v) {
+  uint64_t u = d2u(v);
+  return classify(u >> 63, (u >> 52) & 0x7ff, u & 0xfffffffffffffull, 0x7ff,
+                  0x8000000000000ull);
+}
+
+static uint64_t sgnj(uint64_t a, uint64_t b, uint32_t funct3,
+                     uint64_t sign_bit) {
+  switch (funct3) {
+  case 0:
+    return (a & ~sign_bit) | (b & sign_bit);
+  case 1:
+    return (a & ~sign_bit) | (~b & sign_bit);
+  default:
+    return a ^ (b & sign_bit);
+  }
+}
+
+static inline void mark_dirty(Cpu *cpu) {
+  cpu->csr[CSR_MSTATUS] |= MSTATUS_FS;
+}
+
+/* Resolves the instruction's rm field; -1 for reserved encodings. */
+static inline int resolve_rm(const Cpu *cpu, uint32_t rm) {
+  if (rm == RM_DYN) {
+    rm = (uint32_t)(cpu->csr[CSR_FCSR] >> 5) & 7;
+  }
+  return rm <= RM_RMM ? (int)rm : -1;
+}
+
+static bool exec_fma(Cpu *cpu, uint32_t insn, int rm) {
+  uint32_t opcode = insn & 0x7F;
+  uint32_t rd = (insn >> 7) & 0x1F;
+  uint32_t rs1 = (insn >> 15) & 0x1F;
+  uint32_t rs2 = (insn >> 20) & 0x1F;
+  uint32_t rs3 = insn >> 27;
+  uint32_t fmt = (insn >> 25) & 0x3;
+
+  /* fmadd: a*b+c, fmsub: a*b-c, fnmsub: -a*b+c, fnmadd: -a*b-c */
+  bool neg_prod = opcode == 0x4B || opcode == 0x4F;
+  bool neg_add = opcode == 0x47 || opcode == 0x4F;
+
+  if (fmt == FMT_S) {
+    float a = get_s(cpu, rs1), b = get_s(cpu, rs2), c = get_s(cpu, rs3);
+    set_s(cpu, rd, fma_s(rm, neg_prod ? -a : a, b, neg_add ? -c : c));
+  } else if (fmt == FMT_D) {
+    double a = get_d(cpu, rs1), b = get_d(cpu, rs2), c = get_d(cpu, rs3);
+    set_d(cpu, rd, fma_d(rm, neg_prod ? -a : a, b, neg_add ? -c : c));
+  } else {
+    return false;
+  }
+  return true;
+}
+
+static bool exec_op_fp(Cpu *cpu, uint32_t insn) {
+  uint32_t rd = (insn >> 7) & 0x1F;
+  uint32_t funct3 = (insn >> 12) & 0x7;
+  uint32_t rs1 = (insn >> 15) & 0x1F;
+  uint32_t rs2 = (insn >> 20) & 0x1F;
+  uint32_t funct7 = insn >> 25;
+  bool dbl = funct7 & 1;
+  int rm = resolve_rm(cpu, funct3);
+
+  switch (funct7 >> 2) {
+  case 0x00: /* fadd */
+  case 0x01: /* fsub */
+  case 0x02: /* fmul */
+  case 0x03: /* fdiv */
+  case 0x0B: /* fsqrt */ {
+    static const int ops[] = {OP_ADD, OP_SUB, OP_MUL, OP_DIV};
+    int op = (funct7 >> 2) == 0x0B ? OP_SQRT : ops[funct7 >> 2];
+    if (rm < 0 || (op == OP_SQRT && rs2 != 0)) {
+      return false;
+    }
+    if (dbl) {
+      set_d(cpu, rd, op_d(rm, op, get_d(cpu, rs1), get_d(cpu, rs2)));
+    } else {
+      set_s(cpu, rd, op_s(rm, op, get_s(cpu, rs1), get_s(cpu, rs2)));
+    }
+    break;
+  }
+  case 0x04: /* fsgnj */
+    if (funct3 > 2) {
+      return false;
+    }
+    if (dbl) {
+      cpu->f[rd] = sgnj(cpu->f[rs1], cpu->f[rs2], funct3, 1ull << 63);
+    } else {
+      set_s_bits(cpu, rd,
+                 (uint32_t)sgnj(f2u(get_s(cpu, rs1)), f2u(get_s(cpu, rs2)),
+                                funct3, 1u << 31));
+    }
+    break;
+  case 0x05: /* fmin, fmax */
+    if (funct3 > 1) {
+      return false;
+    }
+    if (dbl) {
+      set_d(cpu, rd, minmax_d(cpu, get_d(cpu, rs1), get_d(cpu, rs2), funct3));
+    } else {
+      set_s(cpu, rd, minmax_s(cpu, get_s(cpu, rs1), get_s(cpu, rs2), funct3));
+    }
+    break;
+  case 0x08: /* fcvt.s.d, fcvt.d.s */
+    if (rm < 0) {
+      return false;
+    }
+    if (dbl && rs2 == 0) {
+      float v = get_s(cpu, rs1);
+      if (is_snan_s(v)) {
+        raise_flags(cpu, FFLAG_NV);
+      }
+      set_d(cpu, rd, (double)v);
+    } else if (!dbl && rs2 == 1) {
+      double v = get_d(cpu, rs1);
+      if (is_snan_d(v)) {
+        raise_flags(cpu, FFLAG_NV);
+      }
+      set_s(cpu, rd, d2s(rm, v));
+    } else {
+      return false;
+    }
+    break;
+  case 0x14: /* feq, flt, fle */ {
+    if (funct3 > 2) {
+      return false;
+    }
+    uint64_t r;
+    if (dbl) {
+      double a = get_d(cpu, rs1), b = get_d(cpu, rs2);
+      r = compare(cpu, funct3, a, b, is_snan_d(a) || is_snan_d(b));
+    } else {
+      float a = get_s(cpu, rs1), b = get_s(cpu, rs2);
+      r = compare(cpu, funct3, a, b, is_snan_s(a) || is_snan_s(b));
+    }
+    if (rd) {
+      cpu->x[rd] = r;
+    }
+    break;
+  }
+  case 0x18: /* fcvt.{w,wu,l,lu}.{s,d} */ {
+    if (rm < 0 || rs2 > 3) {
+      return false;
+    }
+    double v = dbl ? get_d(cpu, rs1) : (double)get_s(cpu, rs1);
+    uint64_t r = f2i(cpu, rm, v, rs2 < 2 ? 32 : 64, rs2 & 1);
+    if (rd) {
+      cpu->x[rd] = r;
+    }
+    break;
+  }
+  case 0x1A: /* fcvt.{s,d}.{w,wu,l,lu} */ {
+    if (rm < 0 || rs2 > 3) {
+      return false;
+    }
+    uint64_t x = cpu->x[rs1];
+    int64_t v;
+    switch (rs2) {
+    case 0:
+      v = (int32_t)x;
+      break;
+    case 1:
+      v = (int64_t)(uint32_t)x;
+      break;
+    default:
+      v = (int64_t)x;
+      break;
+    }
+    if (dbl) {
+      set_d(cpu, rd, i2d(rm, v, rs2 == 3));
+    } else {
+      set_s(cpu, rd, i2s(rm, v, rs2 == 3));
+    }
+    break;
+  }
+  case 0x1C: /* fmv.x.{w,d}, fclass */
+    if (rs2 != 0 || funct3 > 1) {
+      return false;
+    }
+    if (rd) {
+      if (funct3 == 0) {
+        cpu->x[rd] = dbl ? cpu->f[rs1]
+                         : (uint64_t)(int64_t)(int32_t)(uint32_t)cpu->f[rs1];
+      } else {
+        cpu->x[rd] = dbl ? fclass_d(get_d(cpu, rs1))
+                         : fclass_s(get_s(cpu, rs1));
+      }
+    }
+    /* Moves and fclass do not change FP state. */
+    return true;
+  case 0x1E: /* fmv.{w,d}.x */
+    if (rs2 != 0 || funct3 != 0) {
+      return false;
+    }
+    if (dbl) {
+      cpu->f[rd] = cpu->x[rs1];
+    } else {
+      set_s_bits(cpu, rd, (uint32_t)cpu->x[rs1]);
+    }
+    break;
+  default:
+    return false;
+  }
+  mark_dirty(cpu);
+  return true;
+}
+
+bool fpu_exec(Machine *m, Cpu *cpu, uint32_t insn) {
+  if (!(cpu->csr[CSR_MSTATUS] & MSTATUS_FS)) {
+    return false;
+  }
+
+  uint32_t opcode = insn & 0x7F;
+  uint32_t rd = (insn >> 7) & 0x1F;
+  uint32_t funct3 = (insn >> 12) & 0x7;
+  uint32_t rs1 = (insn >> 15) & 0x1F;
+  uint32_t rs2 = (insn >> 20) & 0x1F;
+  uint64_t base = cpu->x[rs1];
+
+  switch (opcode) {
+  case 0x07: { /* flw, fld */
+    uint64_t addr = base + sign_extend_12(insn >> 20);
+    if (funct3 == 2) {
+      set_s_bits(cpu, rd, mem_read32(m, addr));
+    } else if (funct3 == 3) {
+      cpu->f[rd] = mem_read64(m, addr);
+    } else {
+      return false;
+    }
+    mark_dirty(cpu);
+    return true;
+  }
+  case 0x27: { /* fsw, fsd */
+    uint32_t imm = ((insn >> 25) << 5) | ((insn >> 7) & 0x1F);
+    uint64_t addr = base + sign_extend_12(imm);
+    if (funct3 == 2) {
+      mem_write32(m, addr, (uint32_t)cpu->f[rs2]);
+    } else if (funct3 == 3) {
+      mem_write64(m, addr, cpu->f[rs2]);
+    } else {
+      return false;
+    }
+    return true;
+  }
+  case 0x43:
+  case 0x47:
+  case 0x4B:
+  case 0x4F: {
+    int rm = resolve_rm(cpu, funct3);
+    if (rm < 0 || !exec_fma(cpu, insn, rm)) {
+      return false;
+    }
+    mark_dirty(cpu);
+    return true;
+  }
+  case 0x53:
+    return exec_op_fp(cpu, insn);
+  default:
+    return false;
+  }
+}
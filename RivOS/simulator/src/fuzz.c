@@ -0,0 +1,578 @@
+#include <dirent.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+
+#include "rivos_sim/common.h"
+#include "rivos_sim/fpu.h"
+#include "rivos_sim/fuzz.h"
+#include "rivos_sim/mem.h"
+#include "rivos_sim/run.h"
+#include "rivos_sim/sbi.h"
+
+enum {
+  FUZZ_EVENT_NONE,
+  FUZZ_EVENT_START,
+  FUZZ_EVENT_DONE,
+  FUZZ_EVENT_CRASH,
+};
+
+void fuzz_default_config(FuzzConfig *cfg) {
+  memset(cfg, 0, sizeof(*cfg));
+  cfg->boot_insns = 1000ull * 1000ull * 1000ull;
+  cfg->exec_insns = 1000ull * 1000ull;
+}
+
+static bool in_ram(const Machine *m, uint64_t addr, uint64_t len) {
+  return addr >= m->ram_base && len <= m->ram_size &&
+         addr - m->ram_base <= m->ram_size - len;
+}
+
+void fuzz_sbi_call(Fuzz *f, Cpu *cpu) {
+  uint64_t fid = cpu->x[16];
+
+  switch (fid) {
+  case SBI_RIVOS_FUZZ_START:
+    if (!f->sbi_marker || !in_ram(f->m, cpu->x[10], cpu->x[11])) {
+      cpu->x[10] = (uint64_t)(int64_t)SBI_ERR_INVALID_PARAM;
+      return;
+    }
+    f->in_addr = cpu->x[10];
+    f->in_cap = cpu->x[11];
+    f->event = FUZZ_EVENT_START;
+    cpu->x[10] = SBI_SUCCESS;
+    cpu->x[11] = 0;
+    cpu->halted = true;
+    return;
+  case SBI_RIVOS_FUZZ_DONE:
+    f->event = FUZZ_EVENT_DONE;
+    cpu->x[10] = SBI_SUCCESS;
+    cpu->halted = true;
+    return;
+  case SBI_RIVOS_FUZZ_CRASH:
+    f->event = FUZZ_EVENT_CRASH;
+    f->crash_code = cpu->x[10];
+    cpu->x[10] = SBI_SUCCESS;
+    cpu->halted = true;
+    return;
+  default:
+    cpu->x[10] = (uint64_t)(int64_t)SBI_ERR_NOT_SUPPORTED;
+    return;
+  }
+}
+
+static bool resolve_buf(Fuzz *f, const SymbolTable *syms, const char *spec) {
+  const char *colon = strchr(spec, ':');
+  if (colon) {
+    char *end = NULL;
+    f->in_addr = strtoull(spec, &end, 0);
+    if (end != colon) {
+      return false;
+    }
+    f->in_cap = strtoull(colon + 1, &end, 0);
+    return *end == '\0' && f->in_cap > 0;
+  }
+
+  const Symbol *s = symtab_find(syms, spec);
+  if (!s) {
+    return false;
+  }
+  f->in_addr = s->addr;
+  f->in_cap = s->size;
+  return s->size > 0;
+}
+
+static bool resolve_markers(Fuzz *f, const SymbolTable *syms,
+                            const char *const *specs, size_t n) {
+  for (size_t i = 0; i < n; i++) {
+    if (!symtab_resolve(syms, specs[i], &f->markers[f->nmarkers])) {
+      fprintf(stderr, "fuzz: unknown symbol or address: %s\n", specs[i]);
+      return false;
+    }
+    f->nmarkers++;
+  }
+  return true;
+}
+
+/*
+ * Boots the guest up to the snapshot marker, then keeps a copy of RAM and the
+ * CPU. From here on the store path tracks dirty pages so each execution only
+ * has to restore what the previous one touched.
+ */
+bool fuzz_boot(Fuzz *f, Machine *m, Cpu *cpu, const SymbolTable *syms,
+               const FuzzConfig *cfg) {
+  memset(f, 0, sizeof(*f));
+  f->cfg = *cfg;
+  f->m = m;
+  f->cpu = cpu;
+  m->fuzz = f;
+
+  if (!cov_init(&f->cov) || !machine_track_dirty(m)) {
+    fprintf(stderr, "fuzz: out of memory\n");
+    return false;
+  }
+
+  if (!resolve_markers(f, syms, cfg->stop, cfg->nstop)) {
+    return false;
+  }
+  f->nstop = f->nmarkers;
+  if (!resolve_markers(f, syms, cfg->crash, cfg->ncrash)) {
+    return false;
+  }
+
+  RunHooks hooks = {0};
+  uint64_t marker = 0;
+  f->sbi_marker = cfg->at == NULL;
+  if (!f->sbi_marker) {
+    if (!symtab_resolve(syms, cfg->at, &marker)) {
+      fprintf(stderr, "fuzz: unknown marker: %s\n", cfg->at);
+      return false;
+    }
+    if (cfg->buf && !resolve_buf(f, syms, cfg->buf)) {
+      fprintf(stderr, "fuzz: invalid input buffer: %s\n", cfg->buf);
+      return false;
+    }
+    if (cfg->buf && !in_ram(m, f->in_addr, f->in_cap)) {
+      fprintf(stderr, "fuzz: input buffer outside RAM\n");
+      return false;
+    }
+    if (!cfg->buf) {
+      f->in_cap = 8 * sizeof(uint64_t);
+    }
+    hooks.breakpoints = &marker;
+    hooks.nbreakpoints = 1;
+  }
+
+  sim_run(m, cpu, cfg->boot_insns, &hooks);
+
+  bool reached = f->sbi_marker ? f->event == FUZZ_EVENT_START
+                               : hooks.bp_hit == 0;
+  if (!reached) {
+    fprintf(stderr, "fuzz: snapshot marker not reached during boot\n");
+    return false;
+  }
+
+  f->snap_ram = (uint8_t *)malloc(m->ram_size);
+  if (!f->snap_ram) {
+    fprintf(stderr, "fuzz: out of memory\n");
+    return false;
+  }
+  memcpy(f->snap_ram, m->ram, m->ram_size);
+
+  cpu->halted = false;
+  fpu_sync(cpu);
+  f->snap_cpu = *cpu;
+  f->snap_plic = *m->plic;
+  uart_save(m, &f->snap_uart);
+  f->snap_irq_level = atomic_load(&m->irq_level);
+  machine_clear_dirty(m);
+  return true;
+}
+
+static void restore_snapshot(Fuzz *f) {
+  Machine *m = f->m;
+  size_t words = (machine_page_count(m) + 63) / 64;
+
+  for (size_t w = 0; w < words; w++) {
+    uint64_t bits = m->dirty[w];
+    while (bits) {
+      size_t page = w * 64 + (size_t)__builtin_ctzll(bits);
+      size_t off = page << RIVOS_SIM_PAGE_SHIFT;
+      memcpy(&m->ram[off], &f->snap_ram[off], RIVOS_SIM_PAGE_SIZE);
+      bits &= bits - 1;
+    }
+    m->dirty[w] = 0;
+  }
+
+  *m->plic = f->snap_plic;
+  atomic_store(&m->irq_level, f->snap_irq_level);
+  uart_restore(m, &f->snap_uart);
+  fpu_discard();
+  cpu_copy(f->cpu, &f->snap_cpu);
+}
+
+FuzzStatus fuzz_exec(Fuzz *f, const uint8_t *data, size_t len) {
+  Machine *m = f->m;
+  Cpu *cpu = f->cpu;
+
+  restore_snapshot(f);
+
+  size_t n = len < f->in_cap ? len : (size_t)f->in_cap;
+  if (!f->sbi_marker && !f->cfg.buf) {
+    uint8_t regs[8 * sizeof(uint64_t)];
+    memset(regs, 0, sizeof(regs));
+    memcpy(regs, data, n);
+    for (int i = 0; i < 8; i++) {
+      cpu->x[10 + i] = read_u64_le(&regs[i * 8]);
+    }
+  } else {
+    memcpy(&m->ram[f->in_addr - m->ram_base], data, n);
+    mem_mark_dirty(m, f->in_addr, n);
+    if (!f->sbi_marker) {
+      cpu->x[10] = f->in_addr;
+    }
+    cpu->x[11] = n;
+  }
+
+  f->event = FUZZ_EVENT_NONE;
+  f->cov.prev = 0;
+  f->execs++;
+
+  RunHooks hooks = {
+      .cov = &f->cov,
+      .breakpoints = f->markers,
+      .nbreakpoints = f->nmarkers,
+  };
+  sim_run(m, cpu, f->cfg.exec_insns, &hooks);
+
+  if (hooks.bp_hit >= 0) {
+    return (size_t)hooks.bp_hit < f->nstop ? FUZZ_OK : FUZZ_CRASH;
+  }
+  if (f->event == FUZZ_EVENT_CRASH) {
+    return FUZZ_CRASH;
+  }
+  if (cpu->halted) {
+    return FUZZ_OK;
+  }
+  return FUZZ_HANG;
+}
+
+void fuzz_destroy(Fuzz *f) {
+  if (f->m) {
+    f->m->fuzz = NULL;
+  }
+  free(f->snap_ram);
+  f->snap_ram = NULL;
+  cov_destroy(&f->cov);
+}
+
+/* ---- built-in mutator ---------------------------------------------------- */
+
+typedef struct {
+  uint8_t *data;
+  size_t len;
+} FuzzInput;
+
+typedef struct {
+  FuzzInput *items;
+  size_t count;
+  size_t cap;
+} FuzzQueue;
+
+static uint64_t rng_next(uint64_t *s) {
+  uint64_t x = *s;
+  x ^= x >> 12;
+  x ^= x << 25;
+  x ^= x >> 27;
+  *s = x;
+  return x * 0x2545F4914F6CDD1Dull;
+}
+
+static size_t rng_below(uint64_t *s, size_t n) {
+  return n ? (size_t)(rng_next(s) % n) : 0;
+}
+
+/* AFL hit-count classes: 1, 2, 3, 4-7, 8-15, 16-31, 32-127, 128+. */
+static uint8_t count_class(uint8_t c) {
+  if (c == 0)
+    return 0;
+  if (c <= 3)
+    return (uint8_t)(1u << (c - 1));
+  if (c <= 7)
+    return 8;
+  if (c <= 15)
+    return 16;
+  if (c <= 31)
+    return 32;
+  if (c <= 127)
+    return 64;
+  return 128;
+}
+
+static bool has_new_bits(uint8_t *virgin, const uint8_t *map) {
+  const uint64_t *words = (const uint64_t *)map;
+  bool found = false;
+
+  for (size_t w = 0; w < COV_MAP_SIZE / 8; w++) {
+    if (!words[w]) {
+      continue;
+    }
+    for (size_t i = w * 8; i < w * 8 + 8; i++) {
+      uint8_t cls = count_class(map[i]);
+      if (cls & virgin[i]) {
+        virgin[i] &= (uint8_t)~cls;
+        found = true;
+      }
+    }
+  }
+  return found;
+}
+
+static bool queue_push(FuzzQueue *q, const uint8_t *data, size_t len) {
+  if (q->count == q->cap) {
+    size_t cap = q->cap ? q->cap * 2 : 64;
+    FuzzInput *items = (FuzzInput *)realloc(q->items, cap * sizeof(FuzzInput));
+    if (!items) {
+      return false;
+    }
+    q->items = items;
+    q->cap = cap;
+  }
+
+  uint8_t *copy = (uint8_t *)malloc(len ? len : 1);
+  if (!copy) {
+    return false;
+  }
+  memcpy(copy, data, len);
+  q->items[q->count].data = copy;
+  q->items[q->count].len = len;
+  q->count++;
+  return true;
+}
+
+static void queue_free(FuzzQueue *q) {
+  for (size_t i = 0; i < q->count; i++) {
+    free(q->items[i].data);
+  }
+  free(q->items);
+}
+
+static void save_input(const char *dir, const char *kind, uint64_t id,
+                       const uint8_t *data, size_t len) {
+  char path[4096];
+  snprintf(path, sizeof(path), "%s/%s-%06" PRIu64, dir, kind, id);
+
+  FILE *f = fopen(path, "wb");
+  if (!f) {
+    fprintf(stderr, "fuzz: cannot write %s: %s\n", path, strerror(errno));
+    return;
+  }
+  if (len) {
+    fwrite(data, 1, len, f);
+  }
+  fclose(f);
+}
+
+static void load_corpus(FuzzQueue *seeds, const char *dir, size_t max_len) {
+  DIR *d = opendir(dir);
+  if (!d) {
+    fprintf(stderr, "fuzz: cannot open corpus %s: %s\n", dir, strerror(errno));
+    return;
+  }
+
+  uint8_t *buf = (uint8_t *)malloc(max_len ? max_len : 1);
+  struct dirent *de;
+  while (buf && (de = readdir(d)) != NULL) {
+    if (de->d_name[0] == '.') {
+      continue;
+    }
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s/%s", dir, de->d_name);
+    FILE *f = fopen(path, "rb");
+    if (!f) {
+      continue;
+    }
+    size_t n = fread(buf, 1, max_len, f);
+    fclose(f);
+    queue_push(seeds, buf, n);
+  }
+
+  free(buf);
+  closedir(d);
+}
+
+static size_t mutate(uint64_t *rng, uint8_t *buf, size_t len, size_t max_len,
+                     const FuzzQueue *q) {
+  static const int8_t interesting8[] = {-128, -1, 0, 1, 16, 32, 64, 100, 127};
+  static const int32_t interesting32[] = {
+      -2147483647 - 1, -100663046, -32769, -32768, -129, -128, -1, 0, 1,
+      16, 32, 64, 100, 127, 128, 255, 256, 512, 1000, 1024, 4096, 32767,
+      32768, 65535, 65536, 100663045, 2147483647};
+
+  size_t rounds = 1u << (1 + rng_below(rng, 4));
+  for (size_t r = 0; r < rounds; r++) {
+    if (len == 0) {
+      if (max_len == 0) {
+        return 0;
+      }
+      buf[0] = (uint8_t)rng_next(rng);
+      len = 1;
+      continue;
+    }
+
+    size_t pos = rng_below(rng, len);
+    switch (rng_below(rng, 10)) {
+    case 0:
+      buf[pos] ^= (uint8_t)(1u << rng_below(rng, 8));
+      break;
+    case 1:
+      buf[pos] = (uint8_t)rng_next(rng);
+      break;
+    case 2:
+      buf[pos] = (uint8_t)interesting8[rng_below(
+          rng, sizeof(interesting8) / sizeof(interesting8[0]))];
+      break;
+    case 3:
+      buf[pos] = (uint8_t)(buf[pos] + 1 + rng_below(rng, 35));
+      break;
+    case 4:
+      buf[pos] = (uint8_t)(buf[pos] - 1 - rng_below(rng, 35));
+      break;
+    case 5:
+      if (len >= 4) {
+        int32_t v = interesting32[rng_below(
+            rng, sizeof(interesting32) / sizeof(interesting32[0]))];
+        pos = rng_below(rng, len - 3);
+        memcpy(&buf[pos], &v, sizeof(v));
+      }
+      break;
+    case 6:
+      if (len > 1) {
+        size_t del = 1 + rng_below(rng, len - pos);
+        memmove(&buf[pos], &buf[pos + del], len - pos - del);
+        len -= del;
+      }
+      break;
+    case 7:
+      if (len < max_len) {
+        size_t ins = 1 + rng_below(rng, max_len - len);
+        size_t src = rng_below(rng, len);
+        if (ins > len - src) {
+          ins = len - src;
+        }
+        memmove(&buf[pos + ins], &buf[pos], len - pos);
+        memmove(&buf[pos], &buf[src < pos ? src : src + ins], ins);
+        len += ins;
+      }
+      break;
+    case 8:
+      if (q->count > 1) {
+        const FuzzInput *other = &q->items[rng_below(rng, q->count)];
+        if (other->len > 0) {
+          size_t from = rng_below(rng, other->len);
+          size_t n = other->len - from;
+          if (n > max_len - pos) {
+            n = max_len - pos;
+          }
+          memcpy(&buf[pos], &other->data[from], n);
+          if (pos + n > len) {
+            len = pos + n;
+          }
+        }
+      }
+      break;
+    default: {
+      size_t n = 1 + rng_below(rng, len - pos < 16 ? len - pos : 16);
+      memset(&buf[pos], (int)(uint8_t)rng_next(rng), n);
+      break;
+    }
+    }
+  }
+
+  return len;
+}
+
+int fuzz_loop(Fuzz *f, const FuzzLoopConfig *lc) {
+  size_t max_len = (size_t)f->in_cap;
+  if (lc->max_len && lc->max_len < max_len) {
+    max_len = lc->max_len;
+  }
+
+  if (mkdir(lc->out_dir, 0755) != 0 && errno != EEXIST) {
+    fprintf(stderr, "fuzz: cannot create %s: %s\n", lc->out_dir,
+            strerror(errno));
+    return 1;
+  }
+
+  uint8_t *virgin = (uint8_t *)malloc(COV_MAP_SIZE);
+  uint8_t *crash_virgin = (uint8_t *)malloc(COV_MAP_SIZE);
+  uint8_t *buf = (uint8_t *)malloc(max_len ? max_len : 1);
+  if (!virgin || !crash_virgin || !buf) {
+    free(virgin);
+    free(crash_virgin);
+    free(buf);
+    fprintf(stderr, "fuzz: out of memory\n");
+    return 1;
+  }
+  memset(virgin, 0xFF, COV_MAP_SIZE);
+  memset(crash_virgin, 0xFF, COV_MAP_SIZE);
+
+  uint64_t rng = lc->seed ? lc->seed : (uint64_t)time(NULL) | 1;
+  FuzzQueue seeds = {0};
+  FuzzQueue queue = {0};
+  if (lc->corpus_dir) {
+    load_corpus(&seeds, lc->corpus_dir, max_len);
+  }
+  if (seeds.count == 0) {
+    memset(buf, 0, max_len);
+    queue_push(&seeds, buf, max_len < 16 ? max_len : 16);
+  }
+
+  uint64_t crashes = 0;
+  uint64_t hangs = 0;
+  time_t start = time(NULL);
+  time_t last = start;
+
+  for (size_t i = 0; i < seeds.count; i++) {
+    cov_reset(&f->cov);
+    FuzzStatus st = fuzz_exec(f, seeds.items[i].data, seeds.items[i].len);
+    has_new_bits(virgin, f->cov.map);
+    if (st != FUZZ_OK) {
+      fprintf(stderr, "fuzz: seed %zu does not run cleanly (%s)\n", i,
+              st == FUZZ_CRASH ? "crash" : "hang");
+    }
+    queue_push(&queue, seeds.items[i].data, seeds.items[i].len);
+  }
+  queue_free(&seeds);
+
+  for (uint64_t iter = 0; lc->iterations == 0 || iter < lc->iterations;
+       iter++) {
+    const FuzzInput *parent = &queue.items[iter % queue.count];
+    memcpy(buf, parent->data, parent->len);
+    size_t len = mutate(&rng, buf, parent->len, max_len, &queue);
+
+    cov_reset(&f->cov);
+    FuzzStatus st = fuzz_exec(f, buf, len);
+
+    if (st == FUZZ_OK) {
+      if (has_new_bits(virgin, f->cov.map)) {
+        queue_push(&queue, buf, len);
+        save_input(lc->out_dir, "queue", queue.count, buf, len);
+      }
+    } else if (has_new_bits(crash_virgin, f->cov.map)) {
+      if (st == FUZZ_CRASH) {
+        crashes++;
+        save_input(lc->out_dir, "crash", crashes, buf, len);
+      } else {
+        hangs++;
+        save_input(lc->out_dir, "hang", hangs, buf, len);
+      }
+    }
+
+    time_t now = time(NULL);
+    if (now != last) {
+      last = now;
+      fprintf(stderr,
+              "[fuzz] execs=%" PRIu64 " (%.0f/s) corpus=%zu crashes=%" PRIu64
+              " hangs=%" PRIu64 "\n",
+              f->execs, (double)f->execs / (double)(now - start), queue.count,
+              crashes, hangs);
+    }
+  }
+
+  fprintf(stderr,
+          "[fuzz] done: execs=%" PRIu64 " corpus=%zu crashes=%" PRIu64
+          " hangs=%" PRIu64 "\n",
+          f->execs, queue.count, crashes, hangs);
+
+  queue_free(&queue);
+  free(virgin);
+  free(crash_virgin);
+  free(buf);
+  return crashes ? 1 : 0;
+}
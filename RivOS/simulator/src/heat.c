@@ -0,0 +1,144 @@
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rivos_sim/elf.h"
+#include "rivos_sim/heat.h"
+
+enum {
+  HEAT_MAX_SECTIONS = 64,
+};
+
+bool heat_init(Heat *h, Machine *m, const char *ws_path, uint64_t interval) {
+  memset(h, 0, sizeof(*h));
+  h->m = m;
+  h->npages = machine_page_count(m);
+  h->interval = interval;
+  size_t words = (h->npages + 63) / 64;
+  h->counts = calloc(h->npages, sizeof(*h->counts));
+  h->ever = (uint64_t *)calloc(words, sizeof(uint64_t));
+  h->active = (uint32_t *)calloc(h->npages, sizeof(uint32_t));
+  bool ok = h->counts && h->ever && h->active;
+  for (unsigned k = 0; k < HEAT_KINDS; k++) {
+    h->seen[k] = (uint64_t *)calloc(words, sizeof(uint64_t));
+    ok = ok && h->seen[k];
+  }
+  h->ws = ok ? fopen(ws_path, "w") : NULL;
+  if (!h->ws) {
+    heat_destroy(h);
+    return false;
+  }
+  fprintf(h->ws, "interval,instret,read_pages,written_pages,fetched_pages,"
+                 "touched_pages,new_pages,footprint_pages\n");
+  return true;
+}
+
+void heat_destroy(Heat *h) {
+  if (h->ws) {
+    fclose(h->ws);
+  }
+  free(h->counts);
+  free(h->ever);
+  free(h->active);
+  for (unsigned k = 0; k < HEAT_KINDS; k++) {
+    free(h->seen[k]);
+  }
+  memset(h, 0, sizeof(*h));
+}
+
+void heat_end_interval(Heat *h, uint64_t instret) {
+  uint64_t kind_pages[HEAT_KINDS] = {0};
+  uint64_t touched = 0, fresh = 0, footprint = 0;
+  for (size_t w = 0; w < (h->npages + 63) / 64; w++) {
+    uint64_t any = 0;
+    for (unsigned k = 0; k < HEAT_KINDS; k++) {
+      kind_pages[k] += (uint64_t)__builtin_popcountll(h->seen[k][w]);
+      any |= h->seen[k][w];
+      h->seen[k][w] = 0;
+    }
+    touched += (uint64_t)__builtin_popcountll(any);
+    fresh += (uint64_t)__builtin_popcountll(any & ~h->ever[w]);
+    h->ever[w] |= any;
+    footprint += (uint64_t)__builtin_popcountll(h->ever[w]);
+    for (; any; any &= any - 1) {
+      h->active[w * 64 + (size_t)__builtin_ctzll(any)]++;
+    }
+  }
+  fprintf(h->ws,
+          "%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64
+          ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 "\n",
+          h->intervals, instret, kind_pages[HEAT_READ],
+          kind_pages[HEAT_WRITE], kind_pages[HEAT_FETCH], touched, fresh,
+          footprint);
+  h->intervals++;
+  h->in_interval = 0;
+  h->footprint = footprint;
+}
+
+void heat_finish(Heat *h, uint64_t instret) {
+  if (h->in_interval) {
+    heat_end_interval(h, instret);
+  }
+  fflush(h->ws);
+}
+
+/* Symbols overlapping the page: the first, and how many more. */
+static const Symbol *page_symbols(const SymbolTable *st, uint64_t lo,
+                                  uint64_t hi, size_t *more) {
+  const Symbol *first = symtab_lookup(st, lo);
+  size_t n = first ? 1 : 0;
+  size_t a = 0, b = st->count;
+  while (a < b) {
+    size_t mid = a + (b - a) / 2;
+    if (st->syms[mid].addr <= lo) {
+      a = mid + 1;
+    } else {
+      b = mid;
+    }
+  }
+  for (; a < st->count && st->syms[a].addr < hi; a++) {
+    if (!first) {
+      first = &st->syms[a];
+    }
+    n++;
+  }
+  *more = n ? n - 1 : 0;
+  return first;
+}
+
+bool heat_write_map(Heat *h, const char *path, const char *elf_path,
+                    const SymbolTable *syms) {
+  ElfSection secs[HEAT_MAX_SECTIONS];
+  size_t nsecs =
+      elf_path ? load_elf_sections(elf_path, secs, HEAT_MAX_SECTIONS) : 0;
+
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    return false;
+  }
+  fprintf(f, "page,reads,writes,fetches,active_intervals,sections,symbol,"
+             "more_symbols\n");
+  for (size_t p = 0; p < h->npages; p++) {
+    const uint64_t *c = h->counts[p];
+    if (!c[HEAT_READ] && !c[HEAT_WRITE] && !c[HEAT_FETCH]) {
+      continue;
+    }
+    uint64_t lo = h->m->ram_base + ((uint64_t)p << RIVOS_SIM_PAGE_SHIFT);
+    uint64_t hi = lo + RIVOS_SIM_PAGE_SIZE;
+    fprintf(f, "0x%" PRIx64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu64 ",%" PRIu32
+               ",",
+            lo, c[HEAT_READ], c[HEAT_WRITE], c[HEAT_FETCH], h->active[p]);
+    const char *sep = "";
+    for (size_t i = 0; i < nsecs; i++) {
+      if (secs[i].start < hi && lo < secs[i].end) {
+        fprintf(f, "%s%s", sep, secs[i].name);
+        sep = " ";
+      }
+    }
+    size_t more = 0;
+    const Symbol *s = syms ? page_symbols(syms, lo, hi, &more) : NULL;
+    fprintf(f, ",%s,%zu\n", s ? s->name : "", more);
+  }
+  bool ok = !ferror(f);
+  return fclose(f) == 0 && ok;
+}
@@ -0,0 +1,413 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/eventfd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#include "rivos_sim/ivshmem.h"
+
+typedef struct {
+  Machine *m;
+  uint8_t *mem;
+  uint64_t size;
+  int shm_fd;
+  int to_guest;
+  int to_host;
+
+  _Atomic uint32_t status;
+  _Atomic uint32_t mask;
+  _Atomic uint32_t rings;
+
+  const char *sock;
+  int listen_fd;
+  int wake[2];
+  bool server_live;
+  pthread_t server;
+} Ivshmem;
+
+/* Fds a peer receives, in this order. */
+enum {
+  PEER_FD_SHM,
+  PEER_FD_TO_GUEST,
+  PEER_FD_TO_HOST,
+  PEER_NFDS,
+};
+
+/* The server thread may latch a ring between the two; check again. */
+static void update_irq(Ivshmem *s) {
+  bool level = atomic_load(&s->status) & atomic_load(&s->mask);
+  machine_set_irq(s->m, RIVOS_SIM_IVSHMEM_IRQ, level);
+  if (!level && (atomic_load(&s->status) & atomic_load(&s->mask))) {
+    machine_set_irq(s->m, RIVOS_SIM_IVSHMEM_IRQ, true);
+  }
+}
+
+static uint64_t regs_read(void *opaque, uint64_t off, unsigned size) {
+  Ivshmem *s = (Ivshmem *)opaque;
+  (void)size;
+  switch (off) {
+  case IVSHMEM_REG_MAGIC:
+    return IVSHMEM_MAGIC;
+  case IVSHMEM_REG_SIZE_LO:
+    return (uint32_t)s->size;
+  case IVSHMEM_REG_SIZE_HI:
+    return (uint32_t)(s->size >> 32);
+  case IVSHMEM_REG_MASK:
+    return atomic_load(&s->mask);
+  case IVSHMEM_REG_STATUS:
+    return atomic_load(&s->status);
+  case IVSHMEM_REG_RINGS:
+    return atomic_load(&s->rings);
+  default:
+    return 0;
+  }
+}
+
+static void regs_write(void *opaque, uint64_t off, unsigned size,
+                       uint64_t val) {
+  Ivshmem *s = (Ivshmem *)opaque;
+  (void)size;
+  switch (off) {
+  case IVSHMEM_REG_MASK:
+    atomic_store(&s->mask, (uint32_t)val & IVSHMEM_INT_DOORBELL);
+    update_irq(s);
+    break;
+  case IVSHMEM_REG_STATUS:
+    atomic_fetch_and(&s->status, ~(uint32_t)val);
+    update_irq(s);
+    break;
+  case IVSHMEM_REG_DOORBELL: {
+    uint64_t n = (uint32_t)val ? (uint32_t)val : 1;
+    (void)!write(s->to_host, &n, sizeof(n));
+    break;
+  }
+  default:
+    break;
+  }
+}
+
+static void send_fds(Ivshmem *s, int conn) {
+  IvshmemHello hello = {IVSHMEM_MAGIC, IVSHMEM_VERSION, s->size};
+  struct iovec iov = {&hello, sizeof(hello)};
+  union {
+    char buf[CMSG_SPACE(PEER_NFDS * sizeof(int))];
+    struct cmsghdr align;
+  } ctl;
+  memset(&ctl, 0, sizeof(ctl));
+  struct msghdr msg = {
+      .msg_iov = &iov,
+      .msg_iovlen = 1,
+      .msg_control = ctl.buf,
+      .msg_controllen = sizeof(ctl.buf),
+  };
+  struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+  c->cmsg_level = SOL_SOCKET;
+  c->cmsg_type = SCM_RIGHTS;
+  c->cmsg_len = CMSG_LEN(PEER_NFDS * sizeof(int));
+  int fds[PEER_NFDS] = {s->shm_fd, s->to_guest, s->to_host};
+  memcpy(CMSG_DATA(c), fds, sizeof(fds));
+  if (sendmsg(conn, &msg, MSG_NOSIGNAL) < 0) {
+    fprintf(stderr, "[rivos-sim] ivshmem: cannot send fds: %s\n",
+            strerror(errno));
+  }
+}
+
+/* Hands out fds to connecting peers and turns their rings into IRQs. */
+static void *server_main(void *arg) {
+  Ivshmem *s = (Ivshmem *)arg;
+  struct pollfd fds[3] = {{s->wake[0], POLLIN, 0},
+                          {s->to_guest, POLLIN, 0},
+                          {s->listen_fd, POLLIN, 0}};
+  for (;;) {
+    if (poll(fds, 3, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    if (fds[0].revents) {
+      break;
+    }
+    uint64_t n;
+    if ((fds[1].revents & POLLIN) &&
+        read(s->to_guest, &n, sizeof(n)) == sizeof(n)) {
+      atomic_fetch_add(&s->rings, (uint32_t)n);
+      atomic_fetch_or(&s->status, IVSHMEM_INT_DOORBELL);
+      if (atomic_load(&s->mask) & IVSHMEM_INT_DOORBELL) {
+        machine_set_irq(s->m, RIVOS_SIM_IVSHMEM_IRQ, true);
+      }
+    }
+    if (fds[2].revents & POLLIN) {
+      int conn = accept4(s->listen_fd, NULL, NULL, SOCK_CLOEXEC);
+      if (conn >= 0) {
+        send_fds(s, conn);
+        close(conn);
+      }
+    }
+  }
+  machine_release_irq_source(s->m);
+  return NULL;
+}
+
+static void ivshmem_destroy(void *opaque) {
+  Ivshmem *s = (Ivshmem *)opaque;
+  if (s->server_live) {
+    (void)!write(s->wake[1], "", 1);
+    pthread_join(s->server, NULL);
+    close(s->wake[0]);
+    close(s->wake[1]);
+  }
+  if (s->listen_fd >= 0) {
+    close(s->listen_fd);
+    unlink(s->sock);
+  }
+  if (s->to_guest >= 0) {
+    close(s->to_guest);
+  }
+  if (s->to_host >= 0) {
+    close(s->to_host);
+  }
+  if (s->mem) {
+    munmap(s->mem, s->size);
+  }
+  if (s->shm_fd >= 0) {
+    close(s->shm_fd);
+  }
+  free(s);
+}
+
+bool ivshmem_parse(IvshmemConfig *cfg, char *spec) {
+  memset(cfg, 0, sizeof(*cfg));
+  char *save = NULL;
+  char *name = strtok_r(spec, ",", &save);
+  if (!name || name[0] != '/' || !name[1] || strchr(name + 1, '/')) {
+    return false;
+  }
+  cfg->name = name;
+  for (char *tok; (tok = strtok_r(NULL, ",", &save)) != NULL;) {
+    if (strncmp(tok, "size=", 5) == 0 && tok[5]) {
+      char *end = NULL;
+      unsigned long long v = strtoull(tok + 5, &end, 0);
+      if (*end == 'K' || *end == 'k') {
+        v <<= 10;
+        end++;
+      } else if (*end == 'M' || *end == 'm') {
+        v <<= 20;
+        end++;
+      }
+      if (*end || v == 0 || v > IVSHMEM_MAX_SIZE) {
+        return false;
+      }
+      cfg->size = v;
+    } else if (strncmp(tok, "sock=", 5) == 0 && tok[5]) {
+      cfg->sock = tok + 5;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+static int listen_on(const char *path) {
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  if (strlen(path) >= sizeof(addr.sun_path)) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  strcpy(addr.sun_path, path);
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return -1;
+  }
+  /* A socket left behind by an earlier run. */
+  unlink(path);
+  if (bind(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0 ||
+      listen(fd, 8) != 0) {
+    int err = errno;
+    close(fd);
+    errno = err;
+    return -1;
+  }
+  return fd;
+}
+
+static bool ivshmem_open(Ivshmem *s, const IvshmemConfig *cfg) {
+  s->shm_fd = shm_open(cfg->name, O_RDWR | O_CREAT | O_CLOEXEC, 0600);
+  struct stat st;
+  if (s->shm_fd < 0 || fstat(s->shm_fd, &st) != 0) {
+    return false;
+  }
+  uint64_t size = cfg->size ? cfg->size : (uint64_t)st.st_size;
+  if (size == 0) {
+    size = IVSHMEM_DEFAULT_SIZE;
+  }
+  uint64_t page_mask = RIVOS_SIM_PAGE_SIZE - 1;
+  size = (size + page_mask) & ~page_mask;
+  if (size > IVSHMEM_MAX_SIZE) {
+    errno = EFBIG;
+    return false;
+  }
+  if ((uint64_t)st.st_size < size &&
+      ftruncate(s->shm_fd, (off_t)size) != 0) {
+    return false;
+  }
+  void *p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, s->shm_fd, 0);
+  if (p == MAP_FAILED) {
+    return false;
+  }
+  s->mem = (uint8_t *)p;
+  s->size = size;
+
+  s->to_guest = eventfd(0, EFD_CLOEXEC);
+  s->to_host = eventfd(0, EFD_CLOEXEC);
+  if (s->to_guest < 0 || s->to_host < 0) {
+    return false;
+  }
+  if (cfg->sock) {
+    s->sock = cfg->sock;
+    s->listen_fd = listen_on(cfg->sock);
+    if (s->listen_fd < 0 || pipe(s->wake) != 0) {
+      return false;
+    }
+    machine_hold_irq_source(s->m);
+    if (pthread_create(&s->server, NULL, server_main, s) != 0) {
+      machine_release_irq_source(s->m);
+      close(s->wake[0]);
+      close(s->wake[1]);
+      return false;
+    }
+    s->server_live = true;
+  }
+  return true;
+}
+
+bool ivshmem_add(Machine *m, const IvshmemConfig *cfg) {
+  Ivshmem *s = (Ivshmem *)calloc(1, sizeof(*s));
+  if (!s) {
+    return false;
+  }
+  s->m = m;
+  s->shm_fd = s->to_guest = s->to_host = s->listen_fd = -1;
+  if (!ivshmem_open(s, cfg)) {
+    int err = errno;
+    ivshmem_destroy(s);
+    errno = err;
+    return false;
+  }
+
+  MmioRegion regs = {
+      .base = RIVOS_SIM_IVSHMEM_REGS_BASE,
+      .size = IVSHMEM_REGS_SIZE,
+      .opaque = s,
+      .read = regs_read,
+      .write = regs_write,
+      .destroy = ivshmem_destroy,
+  };
+  /* Once the regs are in, machine_destroy owns s. */
+  if (!machine_add_mmio(m, &regs)) {
+    ivshmem_destroy(s);
+    errno = ENOSPC;
+    return false;
+  }
+  /* The memory itself is not a device: loads and stores go straight to it. */
+  m->shm = s->mem;
+  m->shm_base = RIVOS_SIM_IVSHMEM_BASE;
+  m->shm_size = s->size;
+  return true;
+}
+
+bool ivshmem_connect(const char *sock, IvshmemPeer *p) {
+  memset(p, 0, sizeof(*p));
+  p->to_guest = p->to_host = -1;
+  struct sockaddr_un addr = {.sun_family = AF_UNIX};
+  if (strlen(sock) >= sizeof(addr.sun_path)) {
+    errno = ENAMETOOLONG;
+    return false;
+  }
+  strcpy(addr.sun_path, sock);
+  int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (fd < 0) {
+    return false;
+  }
+  if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) != 0) {
+    int err = errno;
+    close(fd);
+    errno = err;
+    return false;
+  }
+
+  IvshmemHello hello;
+  struct iovec iov = {&hello, sizeof(hello)};
+  union {
+    char buf[CMSG_SPACE(PEER_NFDS * sizeof(int))];
+    struct cmsghdr align;
+  } ctl;
+  struct msghdr msg = {
+      .msg_iov = &iov,
+      .msg_iovlen = 1,
+      .msg_control = ctl.buf,
+      .msg_controllen = sizeof(ctl.buf),
+  };
+  ssize_t n = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+  int err = errno;
+  close(fd);
+  struct cmsghdr *c = n > 0 ? CMSG_FIRSTHDR(&msg) : NULL;
+  int fds[PEER_NFDS];
+  size_t nfds = 0;
+  if (c && c->cmsg_level == SOL_SOCKET && c->cmsg_type == SCM_RIGHTS) {
+    nfds = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    nfds = nfds < PEER_NFDS ? nfds : PEER_NFDS;
+    memcpy(fds, CMSG_DATA(c), nfds * sizeof(int));
+  }
+  if (nfds != PEER_NFDS) {
+    for (size_t i = 0; i < nfds; i++) {
+      close(fds[i]);
+    }
+    errno = n < 0 ? err : EPROTO;
+    return false;
+  }
+  p->to_guest = fds[PEER_FD_TO_GUEST];
+  p->to_host = fds[PEER_FD_TO_HOST];
+
+  void *mem = MAP_FAILED;
+  if ((size_t)n == sizeof(hello) && hello.magic == IVSHMEM_MAGIC &&
+      hello.version == IVSHMEM_VERSION) {
+    mem = mmap(NULL, hello.size, PROT_READ | PROT_WRITE, MAP_SHARED,
+               fds[PEER_FD_SHM], 0);
+  } else {
+    errno = EPROTO;
+  }
+  err = errno;
+  close(fds[PEER_FD_SHM]);
+  if (mem == MAP_FAILED) {
+    ivshmem_disconnect(p);
+    errno = err;
+    return false;
+  }
+  p->mem = (uint8_t *)mem;
+  p->size = hello.size;
+  return true;
+}
+
+void ivshmem_disconnect(IvshmemPeer *p) {
+  if (p->mem) {
+    munmap(p->mem, p->size);
+  }
+  if (p->to_guest >= 0) {
+    close(p->to_guest);
+  }
+  if (p->to_host >= 0) {
+    close(p->to_host);
+  }
+  memset(p, 0, sizeof(*p));
+  p->to_guest = p->to_host = -1;
+}
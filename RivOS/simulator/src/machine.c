@@ -0,0 +1,113 @@
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "rivos_sim/machine.h"
+#include "rivos_sim/plic.h"
+#include "rivos_sim/uart.h"
+
+bool machine_init(Machine *m, size_t ram_size) {
+  return machine_init_at(m, RIVOS_SIM_RAM_BASE, ram_size);
+}
+
+bool machine_init_at(Machine *m, uint64_t ram_base, size_t ram_size) {
+  memset(m, 0, sizeof(*m));
+  m->ram_base = ram_base;
+  m->ram_size = ram_size;
+  pthread_mutex_init(&m->irq_lock, NULL);
+  pthread_cond_init(&m->irq_cond, NULL);
+  /* Page-aligned and lazily zeroed; load_elf_shared maps image pages over
+   * parts of it. */
+  void *ram = mmap(NULL, ram_size, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+  m->ram = ram == MAP_FAILED ? NULL : (uint8_t *)ram;
+  if (!m->ram || !plic_add(m) || !uart_add(m)) {
+    machine_destroy(m);
+    return false;
+  }
+  return true;
+}
+
+void machine_destroy(Machine *m) {
+  for (size_t i = m->nmmio; i > 0; i--) {
+    MmioRegion *r = &m->mmio[i - 1];
+    if (r->destroy) {
+      r->destroy(r->opaque);
+    }
+  }
+  m->nmmio = 0;
+  m->plic = NULL;
+  m->uart = NULL;
+
+  if (m->ram) {
+    munmap(m->ram, m->ram_size);
+  }
+  free(m->dirty);
+  m->ram = NULL;
+  m->dirty = NULL;
+  pthread_mutex_destroy(&m->irq_lock);
+  pthread_cond_destroy(&m->irq_cond);
+}
+
+bool machine_track_dirty(Machine *m) {
+  if (m->dirty) {
+    return true;
+  }
+  size_t words = (machine_page_count(m) + 63) / 64;
+  m->dirty = (uint64_t *)calloc(words, sizeof(uint64_t));
+  return m->dirty != NULL;
+}
+
+void machine_clear_dirty(Machine *m) {
+  if (m->dirty) {
+    memset(m->dirty, 0, ((machine_page_count(m) + 63) / 64) * sizeof(uint64_t));
+  }
+}
+
+bool machine_add_mmio(Machine *m, const MmioRegion *r) {
+  if (m->nmmio == MACHINE_MAX_MMIO) {
+    return false;
+  }
+  for (size_t i = 0; i < m->nmmio; i++) {
+    const MmioRegion *o = &m->mmio[i];
+    if (r->base < o->base + o->size && o->base < r->base + r->size) {
+      return false;
+    }
+  }
+  m->mmio[m->nmmio++] = *r;
+  return true;
+}
+
+void machine_kick(Machine *m) {
+  atomic_fetch_add(&m->irq_gen, 1);
+  pthread_mutex_lock(&m->irq_lock);
+  pthread_cond_broadcast(&m->irq_cond);
+  pthread_mutex_unlock(&m->irq_lock);
+}
+
+void machine_set_irq(Machine *m, uint32_t line, bool level) {
+  if (level) {
+    if (!(atomic_fetch_or(&m->irq_level, 1u << line) & (1u << line))) {
+      machine_kick(m);
+    }
+  } else {
+    atomic_fetch_and(&m->irq_level, ~(1u << line));
+  }
+}
+
+void machine_hold_irq_source(Machine *m) {
+  atomic_fetch_add(&m->irq_sources, 1);
+}
+
+void machine_release_irq_source(Machine *m) {
+  atomic_fetch_sub(&m->irq_sources, 1);
+  machine_kick(m);
+}
+
+void machine_wait_irq(Machine *m, uint32_t gen) {
+  pthread_mutex_lock(&m->irq_lock);
+  while (atomic_load(&m->irq_gen) == gen && atomic_load(&m->irq_sources) > 0) {
+    pthread_cond_wait(&m->irq_cond, &m->irq_lock);
+  }
+  pthread_mutex_unlock(&m->irq_lock);
+}
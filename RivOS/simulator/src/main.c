@@ -1,12 +1,38 @@
 #include <errno.h>
 #include <inttypes.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
 
+#include "rivos_sim/aot.h"
+#include "rivos_sim/bbv.h"
+#include "rivos_sim/callgraph.h"
+#include "rivos_sim/coverage.h"
 #include "rivos_sim/cpu.h"
 #include "rivos_sim/elf.h"
+#include "rivos_sim/fb.h"
+#include "rivos_sim/fuzz.h"
+#include "rivos_sim/heat.h"
+#include "rivos_sim/ivshmem.h"
 #include "rivos_sim/machine.h"
+#include "rivos_sim/reverse.h"
+#include "rivos_sim/run.h"
+#include "rivos_sim/sanitizer.h"
+#include "rivos_sim/semihost.h"
+#include "rivos_sim/simpoint.h"
+#include "rivos_sim/stats.h"
+#include "rivos_sim/symtab.h"
+#include "rivos_sim/timing.h"
+#include "rivos_sim/uart.h"
+#include "rivos_sim/user.h"
+#include "rivos_sim/vector.h"
+#include "rivos_sim/virtio_9p.h"
+#include "rivos_sim/virtio_blk.h"
+
+/* Present only in rivos-sim-aot, linked with rivos-aot output. */
+extern const AotImage rivos_aot_image __attribute__((weak));
 
 static void die(const char *msg) {
   fprintf(stderr, "%s\n", msg);
@@ -15,50 +41,683 @@ static void die(const char *msg) {
 
 static void usage(const char *argv0) {
   fprintf(stderr,
-          "usage: %s <kernel.elf> [max_insns]\n"
+          "usage: %s [options] <kernel.elf> [max_insns]\n"
+          "       %s --user [options] <program> [args...]\n"
+          "\n"
+          "Runs a minimal RV64IMFDV interpreter with a virt-style PLIC and UART16550,\n"
+          "minimal CSR/trap + legacy SBI (console_putchar/getchar/shutdown)\n"
+          "emulation.\n"
+          "\n"
+          "options:\n"
+          "  --timing[=static|bimodal|gshare]\n"
+          "                       estimate cycles and CPI per function with an\n"
+          "                       in-order pipeline model (default: gshare)\n"
+          "  --timing-lat=CLASS=N[,CLASS=N...]\n"
+          "                       override latencies; classes are alu, mul, div,\n"
+          "                       load, store, system, taken, mispredict, exception\n"
+          "  --timing-bp-bits=N   predictor/BTB table size as log2 (default 12)\n"
+          "  --timing-ras=N       return address stack depth (default 8)\n"
+          "  --cov=FILE           record edge coverage and write it to FILE at exit\n"
+          "                       (render with rivos-cov)\n"
+          "  --callgraph=FILE     count instructions per function and call edge\n"
+          "                       through a shadow call stack; prints a gprof-style\n"
+          "                       profile and writes FILE in callgrind format\n"
+          "  --bbv=FILE           write SimPoint basic-block vectors, one line per\n"
+          "                       interval, to FILE (cluster with rivos-simpoint)\n"
+          "  --bbv-interval=N     instructions per interval for --bbv and\n"
+          "                       --simpoints (default 10000000)\n"
+          "  --simpoints=PREFIX   run functionally except for the intervals in\n"
+          "                       PREFIX.simpoints, which get the timing model,\n"
+          "                       and report estimates weighted by\n"
+          "                       PREFIX.weights\n"
+          "  --simpoint-warmup=N  timing-model warm-up before each interval\n"
+          "  --simpoint-snapshots=DIR\n"
+          "                       save CPU and RAM at each interval in DIR and\n"
+          "                       start from there on later runs (device state\n"
+          "                       is not saved)\n"
+          "  --heat=PREFIX        count guest RAM reads, writes and fetches per page;\n"
+          "                       write the working set per interval to\n"
+          "                       PREFIX.ws.csv and a per-page heat map with ELF\n"
+          "                       sections and symbols to PREFIX.heat.csv\n"
+          "  --heat-interval=N    instructions per --heat interval (default\n"
+          "                       10000000)\n"
+          "  --sanitize[=halt]    keep shadow memory and report loads of undefined\n"
+          "                       bytes and accesses outside allocated memory or\n"
+          "                       below sp (guest hints via SBI); halt stops at\n"
+          "                       the first report with exit status 1\n"
+          "  --stats[=NAME]       publish live counters in POSIX shared memory NAME\n"
+          "                       (default /rivos-sim.<pid>; view with rivos-top)\n"
+          "  --share-image        map the ELF's pages copy-on-write from a shared\n"
+          "                       memory image, so instances running the same\n"
+          "                       kernel share its read-only pages\n"
+          "  --no-aot             interpret even if native code was linked in\n"
+          "                       (rivos-sim-aot only)\n"
+          "  --semihost           serve RISC-V semihosting calls (file I/O on the\n"
+          "                       host, relative to the current directory)\n"
+          "  --user               run a static riscv64 Linux executable in U-mode,\n"
+          "                       serving its system calls on the host; the\n"
+          "                       arguments after it are passed to the program,\n"
+          "                       which runs until it exits\n"
+          "  --boot-mode=s|m      start the ELF in S-mode with SBI provided by the\n"
+          "                       simulator (default), or in M-mode as firmware\n"
+          "  --vlen=BITS          vector register length, a power of two in\n"
+          "                       64..1024 (default 128)\n"
+          "  --input=FILE|-|none  UART receive source (default: - for stdin);\n"
+          "                       a file is replayed as fast as the guest reads\n"
+          "  --blk=IMAGE[,ro][,queues=N][,mmap|thread]\n"
+          "                       attach a virtio-blk disk at the next virtio-mmio\n"
+          "                       slot (0x10001000 + n*0x1000, IRQ n+1); thread\n"
+          "                       mode (default) serves each queue from a worker,\n"
+          "                       mmap mode copies inline from a shared mapping\n"
+          "  --9p=DIR[,tag=NAME][,ro]\n"
+          "                       export DIR over virtio-9p (9P2000.L) at the\n"
+          "                       next virtio-mmio slot; the guest mounts TAG\n"
+          "                       (default rivos) with trans=virtio\n"
+          "  --fb=WxH[,xrgb8888|rgb565][,file=PATH][,ppm=DIR]\n"
+          "                       framebuffer at 0x50000000, registers at\n"
+          "                       0x10100000; file= shares the pixels with\n"
+          "                       rivos-fbview, ppm= dumps every flushed frame\n"
+          "  --ivshmem=NAME[,size=N][,sock=PATH]\n"
+          "                       map POSIX shared memory NAME at 0x60000000\n"
+          "                       with doorbell registers at 0x10200000 (IRQ\n"
+          "                       11); sock= hands the memory and doorbell\n"
+          "                       eventfds to host processes (rivos-ivshmem);\n"
+          "                       without it the doorbells are not connected\n"
+          "\n"
+          "reverse execution (checkpoint, then re-run to go back):\n"
+          "  --reverse[=N]        checkpoint every N instructions (default\n"
+          "                       1000000); when the run ends, read debugger\n"
+          "                       commands from stdin (help lists them), such as\n"
+          "                       rstep, goto and rcont to a watchpoint. UART\n"
+          "                       input is off and host-backed devices cannot\n"
+          "                       be used, so re-runs repeat exactly\n"
+          "  --reverse-mem=MB     checkpoint memory before the oldest are\n"
+          "                       dropped (default 256)\n"
           "\n"
-          "Runs a minimal RV64 interpreter with virt UART16550 output and\n"
-          "minimal CSR/trap + legacy SBI (console_putchar/shutdown) emulation.\n",
-          argv0);
+          "fuzzing (boot once, snapshot, then reset dirty pages per input):\n"
+          "  --fuzz[=N]           run N mutated inputs (default: forever)\n"
+          "  --fuzz-at=SYM|ADDR   snapshot when PC reaches SYM (default: guest\n"
+          "                       SBI FUZZ_START call, which also names the buffer)\n"
+          "  --fuzz-buf=SYM|ADDR:SIZE\n"
+          "                       input buffer for --fuzz-at (default: a0-a7)\n"
+          "  --fuzz-stop=SYM|ADDR input done when PC reaches it (repeatable)\n"
+          "  --fuzz-crash=SYM|ADDR\n"
+          "                       report a crash when PC reaches it (repeatable)\n"
+          "  --fuzz-timeout=N     instructions per input before it is a hang\n"
+          "  --fuzz-corpus=DIR    seed inputs\n"
+          "  --fuzz-out=DIR       queue/crash/hang outputs (default: fuzz-out)\n"
+          "  --fuzz-seed=N        mutator RNG seed\n"
+          "  --fuzz-max-len=N     cap input length\n",
+          argv0, argv0);
+}
+
+/* Returns the value of "--name=value", "" for a bare "--name", else NULL. */
+static const char *opt_arg(const char *arg, const char *name) {
+  size_t n = strlen(name);
+  if (strncmp(arg, "--", 2) != 0 || strncmp(arg + 2, name, n) != 0) {
+    return NULL;
+  }
+  if (arg[2 + n] == '\0') {
+    return "";
+  }
+  if (arg[2 + n] == '=') {
+    return arg + 3 + n;
+  }
+  return NULL;
+}
+
+static uint64_t parse_u64(const char *v, const char *what) {
+  char *end = NULL;
+  unsigned long long x = strtoull(v, &end, 0);
+  if (!*v || *end) {
+    fprintf(stderr, "invalid %s: %s\n", what, v);
+    exit(2);
+  }
+  return (uint64_t)x;
+}
+
+static uint32_t parse_u32(const char *v, const char *what) {
+  char *end = NULL;
+  unsigned long x = strtoul(v, &end, 0);
+  if (!*v || *end || x > UINT32_MAX) {
+    fprintf(stderr, "invalid %s: %s\n", what, v);
+    exit(2);
+  }
+  return (uint32_t)x;
 }
 
 int main(int argc, char **argv) {
-  if (argc < 2) {
+  bool timing_on = false;
+  const char *cov_path = NULL;
+  const char *callgraph_path = NULL;
+  const char *bbv_path = NULL;
+  uint64_t bbv_interval = BBV_DEFAULT_INTERVAL;
+  const char *simpoints = NULL;
+  uint64_t simpoint_warmup = 0;
+  const char *snap_dir = NULL;
+  const char *heat_prefix = NULL;
+  uint64_t heat_interval = HEAT_DEFAULT_INTERVAL;
+  bool san_on = false;
+  bool san_halt = false;
+  bool stats_on = false;
+  bool share_image = false;
+  bool semihost_on = false;
+  bool user_on = false;
+  bool aot_on = &rivos_aot_image != NULL;
+  const char *stats_name = NULL;
+  bool fuzz_on = false;
+  bool rev_on = false;
+  RevConfig rev_cfg;
+  rev_default_config(&rev_cfg);
+  const char *input = "-";
+  int boot_priv = PRIV_S;
+  unsigned vlen = RIVOS_SIM_VLEN_DEFAULT;
+  BlkConfig blks[RIVOS_SIM_VIRTIO_SLOTS];
+  size_t nblks = 0;
+  P9Config p9_cfg;
+  bool p9_on = false;
+  FbConfig fb_cfg;
+  bool fb_on = false;
+  IvshmemConfig shm_cfg;
+  bool shm_on = false;
+  FuzzConfig fuzz_cfg;
+  fuzz_default_config(&fuzz_cfg);
+  FuzzLoopConfig fuzz_loop_cfg = {.out_dir = "fuzz-out"};
+  TimingConfig timing_cfg;
+  timing_default_config(&timing_cfg);
+
+  int argi = 1;
+  for (; argi < argc && strncmp(argv[argi], "--", 2) == 0; argi++) {
+    const char *arg = argv[argi];
+    const char *v;
+
+    if ((v = opt_arg(arg, "timing"))) {
+      timing_on = true;
+      if (strcmp(v, "static") == 0) {
+        timing_cfg.bp = BP_STATIC;
+      } else if (strcmp(v, "bimodal") == 0) {
+        timing_cfg.bp = BP_BIMODAL;
+      } else if (*v == '\0' || strcmp(v, "gshare") == 0) {
+        timing_cfg.bp = BP_GSHARE;
+      } else {
+        die("invalid --timing predictor");
+      }
+    } else if ((v = opt_arg(arg, "timing-lat"))) {
+      if (!timing_parse_latency(&timing_cfg.lat, v)) {
+        die("invalid --timing-lat");
+      }
+    } else if ((v = opt_arg(arg, "timing-bp-bits"))) {
+      timing_cfg.bp_bits = parse_u32(v, "--timing-bp-bits");
+      if (timing_cfg.bp_bits < 1 || timing_cfg.bp_bits > 24) {
+        die("--timing-bp-bits must be 1..24");
+      }
+    } else if ((v = opt_arg(arg, "timing-ras"))) {
+      timing_cfg.ras_depth = parse_u32(v, "--timing-ras");
+    } else if ((v = opt_arg(arg, "cov")) && *v) {
+      cov_path = v;
+    } else if ((v = opt_arg(arg, "callgraph")) && *v) {
+      callgraph_path = v;
+    } else if ((v = opt_arg(arg, "bbv")) && *v) {
+      bbv_path = v;
+    } else if ((v = opt_arg(arg, "bbv-interval"))) {
+      bbv_interval = parse_u64(v, "--bbv-interval");
+      if (bbv_interval == 0) {
+        die("--bbv-interval must be positive");
+      }
+    } else if ((v = opt_arg(arg, "simpoints")) && *v) {
+      simpoints = v;
+    } else if ((v = opt_arg(arg, "simpoint-warmup"))) {
+      simpoint_warmup = parse_u64(v, "--simpoint-warmup");
+    } else if ((v = opt_arg(arg, "simpoint-snapshots")) && *v) {
+      snap_dir = v;
+    } else if ((v = opt_arg(arg, "heat")) && *v) {
+      heat_prefix = v;
+    } else if ((v = opt_arg(arg, "heat-interval"))) {
+      heat_interval = parse_u64(v, "--heat-interval");
+      if (heat_interval == 0) {
+        die("--heat-interval must be positive");
+      }
+    } else if ((v = opt_arg(arg, "reverse"))) {
+      rev_on = true;
+      if (*v) {
+        rev_cfg.interval = parse_u64(v, "--reverse");
+        if (rev_cfg.interval == 0) {
+          die("--reverse interval must be positive");
+        }
+      }
+    } else if ((v = opt_arg(arg, "reverse-mem"))) {
+      uint64_t mb = parse_u64(v, "--reverse-mem");
+      if (mb > UINT64_MAX >> 20) {
+        die("--reverse-mem is too large");
+      }
+      rev_cfg.mem_cap = mb << 20;
+    } else if ((v = opt_arg(arg, "sanitize"))) {
+      if (*v && strcmp(v, "halt") != 0) {
+        die("invalid --sanitize mode");
+      }
+      san_on = true;
+      san_halt = *v != '\0';
+    } else if ((v = opt_arg(arg, "stats"))) {
+      stats_on = true;
+      stats_name = *v ? v : NULL;
+    } else if ((v = opt_arg(arg, "share-image")) && !*v) {
+      share_image = true;
+    } else if ((v = opt_arg(arg, "no-aot")) && !*v) {
+      aot_on = false;
+    } else if ((v = opt_arg(arg, "semihost")) && !*v) {
+      semihost_on = true;
+    } else if ((v = opt_arg(arg, "user")) && !*v) {
+      user_on = true;
+    } else if ((v = opt_arg(arg, "boot-mode")) && *v) {
+      if (strcmp(v, "s") == 0) {
+        boot_priv = PRIV_S;
+      } else if (strcmp(v, "m") == 0) {
+        boot_priv = PRIV_M;
+      } else {
+        die("invalid --boot-mode");
+      }
+    } else if ((v = opt_arg(arg, "vlen")) && *v) {
+      vlen = parse_u32(v, "--vlen");
+      if (vlen < RIVOS_SIM_VLEN_MIN || vlen > RIVOS_SIM_VLEN_MAX ||
+          (vlen & (vlen - 1))) {
+        die("--vlen must be a power of two in 64..1024");
+      }
+    } else if ((v = opt_arg(arg, "input")) && *v) {
+      input = strcmp(v, "none") == 0 ? NULL : v;
+    } else if ((v = opt_arg(arg, "blk")) && *v) {
+      if (nblks == RIVOS_SIM_VIRTIO_SLOTS) {
+        die("too many --blk devices");
+      }
+      if (!virtio_blk_parse(&blks[nblks++], (char *)v)) {
+        die("invalid --blk");
+      }
+    } else if ((v = opt_arg(arg, "9p")) && *v) {
+      if (!virtio_9p_parse(&p9_cfg, (char *)v)) {
+        die("invalid --9p");
+      }
+      p9_on = true;
+    } else if ((v = opt_arg(arg, "fb")) && *v) {
+      if (!fb_parse(&fb_cfg, (char *)v)) {
+        die("invalid --fb");
+      }
+      fb_on = true;
+    } else if ((v = opt_arg(arg, "ivshmem")) && *v) {
+      if (!ivshmem_parse(&shm_cfg, (char *)v)) {
+        die("invalid --ivshmem");
+      }
+      shm_on = true;
+    } else if ((v = opt_arg(arg, "fuzz"))) {
+      fuzz_on = true;
+      fuzz_loop_cfg.iterations = *v ? parse_u64(v, "--fuzz") : 0;
+    } else if ((v = opt_arg(arg, "fuzz-at")) && *v) {
+      fuzz_cfg.at = v;
+    } else if ((v = opt_arg(arg, "fuzz-buf")) && *v) {
+      fuzz_cfg.buf = v;
+    } else if ((v = opt_arg(arg, "fuzz-stop")) && *v) {
+      if (fuzz_cfg.nstop == FUZZ_MAX_MARKERS) {
+        die("too many --fuzz-stop markers");
+      }
+      fuzz_cfg.stop[fuzz_cfg.nstop++] = v;
+    } else if ((v = opt_arg(arg, "fuzz-crash")) && *v) {
+      if (fuzz_cfg.ncrash == FUZZ_MAX_MARKERS) {
+        die("too many --fuzz-crash markers");
+      }
+      fuzz_cfg.crash[fuzz_cfg.ncrash++] = v;
+    } else if ((v = opt_arg(arg, "fuzz-timeout"))) {
+      fuzz_cfg.exec_insns = parse_u64(v, "--fuzz-timeout");
+    } else if ((v = opt_arg(arg, "fuzz-corpus")) && *v) {
+      fuzz_loop_cfg.corpus_dir = v;
+    } else if ((v = opt_arg(arg, "fuzz-out")) && *v) {
+      fuzz_loop_cfg.out_dir = v;
+    } else if ((v = opt_arg(arg, "fuzz-seed"))) {
+      fuzz_loop_cfg.seed = parse_u64(v, "--fuzz-seed");
+    } else if ((v = opt_arg(arg, "fuzz-max-len"))) {
+      fuzz_loop_cfg.max_len = (size_t)parse_u64(v, "--fuzz-max-len");
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+
+  if (argi >= argc) {
     usage(argv[0]);
     return 2;
   }
 
-  const char *elf_path = argv[1];
+  if (san_on && fuzz_on) {
+    die("--sanitize cannot be combined with --fuzz");
+  }
+  if (heat_prefix && fuzz_on) {
+    die("--heat cannot be combined with --fuzz");
+  }
+  if (fuzz_on && (nblks || p9_on || fb_on || shm_on)) {
+    /* Their state lives outside the snapshot: host files and threads. */
+    die("--fuzz cannot be combined with --blk, --9p, --fb or --ivshmem");
+  }
+  if (heat_prefix && aot_on) {
+    /* Native blocks access RAM directly, out of the counters' sight. */
+    fprintf(stderr, "[rivos-sim] --heat: interpreting\n");
+    aot_on = false;
+  }
+
+  if (rev_on && (fuzz_on || user_on || semihost_on || san_on || heat_prefix ||
+                 simpoints || nblks || p9_on || fb_on || shm_on)) {
+    die("--reverse cannot be combined with --fuzz, --user, --semihost, "
+        "--sanitize, --heat, --simpoints, --blk, --9p, --fb or --ivshmem");
+  }
+  if (rev_on) {
+    /* Checkpoints rely on the store path's dirty bits. */
+    if (aot_on) {
+      fprintf(stderr, "[rivos-sim] --reverse: interpreting\n");
+      aot_on = false;
+    }
+    /* Bytes arriving from the host could not be replayed; stdin is ours. */
+    input = NULL;
+  }
+
+  if (simpoints && (fuzz_on || bbv_path || cov_path || callgraph_path ||
+                    san_on)) {
+    die("--simpoints cannot be combined with --fuzz, --bbv, --cov, "
+        "--callgraph or --sanitize");
+  }
+  if (simpoints) {
+    /* The timing model is the detailed model sampled intervals run. */
+    timing_on = true;
+  }
+
+  if (user_on &&
+      (fuzz_on || nblks || p9_on || fb_on || shm_on || share_image)) {
+    die("--user cannot be combined with --fuzz, --blk, --9p, --fb, "
+        "--ivshmem or --share-image");
+  }
+
+  const char *elf_path = argv[argi];
   uint64_t max_insns = 50ull * 1000ull * 1000ull;
-  if (argc >= 3) {
-    max_insns = strtoull(argv[2], NULL, 0);
+  if (user_on) {
+    /* The program's stdin is its own; the UART is not used. */
+    max_insns = UINT64_MAX;
+    input = NULL;
+    boot_priv = PRIV_U;
+  } else if (argi + 1 < argc) {
+    max_insns = strtoull(argv[argi + 1], NULL, 0);
     if (max_insns == 0) {
       die("invalid max_insns");
     }
   }
 
   Machine m;
-  m.ram_size = (size_t)RIVOS_SIM_RAM_SIZE;
-  m.ram = (uint8_t *)calloc(1, m.ram_size);
-  if (!m.ram) {
+  if (!(user_on ? machine_init_at(&m, 0, (size_t)USER_RAM_SIZE)
+                : machine_init(&m, (size_t)RIVOS_SIM_RAM_SIZE))) {
     die("failed to allocate RAM");
   }
 
+  for (size_t i = 0; i < nblks; i++) {
+    if (!virtio_blk_add(&m, &blks[i])) {
+      fprintf(stderr, "failed to attach %s: %s\n", blks[i].path,
+              strerror(errno));
+      machine_destroy(&m);
+      return 1;
+    }
+  }
+  if (p9_on && !virtio_9p_add(&m, &p9_cfg)) {
+    fprintf(stderr, "failed to export %s: %s\n", p9_cfg.path,
+            strerror(errno));
+    machine_destroy(&m);
+    return 1;
+  }
+
+  if (fb_on && !fb_add(&m, &fb_cfg)) {
+    fprintf(stderr, "failed to create framebuffer: %s\n", strerror(errno));
+    machine_destroy(&m);
+    return 1;
+  }
+
+  if (shm_on && !ivshmem_add(&m, &shm_cfg)) {
+    fprintf(stderr, "failed to map %s: %s\n", shm_cfg.name, strerror(errno));
+    machine_destroy(&m);
+    return 1;
+  }
+
+  Semihost semihost;
+  if (semihost_on) {
+    semihost_init(&semihost, &m);
+  }
+
   uint64_t entry = 0;
-  if (!load_elf(&m, elf_path, &entry)) {
+  User user;
+  if (user_on) {
+    if (!user_load(&user, &m, elf_path, argc - argi, argv + argi, environ)) {
+      fprintf(stderr, "failed to load %s: %s\n", elf_path, strerror(errno));
+      machine_destroy(&m);
+      return 1;
+    }
+    entry = user.entry;
+  } else if (!(share_image ? load_elf_shared : load_elf)(&m, elf_path,
+                                                          &entry)) {
     fprintf(stderr, "failed to load ELF: %s\n", strerror(errno));
-    free(m.ram);
+    machine_destroy(&m);
     return 1;
   }
 
+  SymbolTable syms = {NULL, 0};
+  if (timing_on || fuzz_on || stats_on || callgraph_path || san_on ||
+      heat_prefix || rev_on) {
+    if (!load_elf_symbols(elf_path, &syms)) {
+      fprintf(stderr, "failed to read ELF symbols: %s\n", strerror(errno));
+    }
+  }
+
+  Timing timing;
+  if (timing_on) {
+    if (!timing_init(&timing, &timing_cfg, &syms)) {
+      die("failed to allocate timing model");
+    }
+  }
+
+  Coverage cov;
+  if (cov_path && !cov_init(&cov)) {
+    die("failed to allocate coverage map");
+  }
+
+  Callgraph callgraph;
+  if (callgraph_path && !cg_init(&callgraph, &syms, entry)) {
+    die("failed to allocate call graph");
+  }
+
+  Bbv bbv;
+  if (bbv_path && !bbv_init(&bbv, bbv_path, bbv_interval)) {
+    fprintf(stderr, "failed to open %s: %s\n", bbv_path, strerror(errno));
+    return 1;
+  }
+
+  SimPointPlan plan;
+  if (simpoints && !simpoint_load(&plan, simpoints, bbv_interval,
+                                  simpoint_warmup, snap_dir)) {
+    fprintf(stderr, "failed to read simpoints %s: %s\n", simpoints,
+            strerror(errno));
+    return 1;
+  }
+
+  Sanitizer san;
+  if (san_on) {
+    if (!san_init(&san, &m, &syms, san_halt)) {
+      die("failed to allocate shadow memory");
+    }
+    if (!san_load_elf(&san, elf_path)) {
+      fprintf(stderr, "failed to read ELF segments: %s\n", strerror(errno));
+    }
+  }
+
+  Heat heat;
+  char heat_path[PATH_MAX];
+  if (heat_prefix) {
+    snprintf(heat_path, sizeof(heat_path), "%s.ws.csv", heat_prefix);
+    if (!heat_init(&heat, &m, heat_path, heat_interval)) {
+      fprintf(stderr, "failed to open %s: %s\n", heat_path, strerror(errno));
+      return 1;
+    }
+    m.heat = &heat;
+  }
+
   Cpu cpu;
-  memset(&cpu, 0, sizeof(cpu));
-  cpu.pc = entry;
+  cpu_reset(&cpu, entry, boot_priv);
+  vec_reset(&cpu, vlen);
+  if (user_on) {
+    user_start(&user, &cpu);
+  }
+
+  if (fuzz_on) {
+    if (argi + 1 < argc) {
+      fuzz_cfg.boot_insns = max_insns;
+    }
+
+    Fuzz fuzz;
+    int rc = 1;
+    if (fuzz_boot(&fuzz, &m, &cpu, &syms, &fuzz_cfg)) {
+      m.console_muted = true;
+      rc = fuzz_loop(&fuzz, &fuzz_loop_cfg);
+    }
+    fuzz_destroy(&fuzz);
+    symtab_free(&syms);
+    machine_destroy(&m);
+    return rc;
+  }
+
+  if (input && !uart_start_input(&m, input)) {
+    fprintf(stderr, "failed to open input %s: %s\n", input, strerror(errno));
+    symtab_free(&syms);
+    machine_destroy(&m);
+    return 1;
+  }
+
+  Stats stats;
+  if (stats_on) {
+    if (stats_init(&stats, stats_name, &syms)) {
+      fprintf(stderr, "[rivos-sim] stats in shared memory %s\n", stats.name);
+    } else {
+      fprintf(stderr, "failed to create stats page: %s\n", strerror(errno));
+      stats_on = false;
+    }
+  }
+
+  Aot aot;
+  if (aot_on) {
+    if (aot_init(&aot, &rivos_aot_image, &m)) {
+      fprintf(stderr, "[rivos-sim] %zu native blocks from %s\n",
+              rivos_aot_image.nblocks, rivos_aot_image.source);
+    } else {
+      fprintf(stderr, "native code does not match %s (%s), interpreting\n",
+              elf_path, strerror(errno));
+      aot_on = false;
+    }
+  }
+
+  RunHooks hooks = {
+      .timing = timing_on ? &timing : NULL,
+      .cov = cov_path ? &cov : NULL,
+      .callgraph = callgraph_path ? &callgraph : NULL,
+      .bbv = bbv_path ? &bbv : NULL,
+      .san = san_on ? &san : NULL,
+      .stats = stats_on ? &stats : NULL,
+      .aot = aot_on ? &aot : NULL,
+  };
+  Rev rev;
+  if (rev_on && !rev_init(&rev, &m, &cpu, &rev_cfg)) {
+    die("failed to allocate checkpoints");
+  }
+  if (simpoints) {
+    hooks.timing = NULL;
+    simpoint_run(&plan, &m, &cpu, max_insns, &timing, &hooks);
+  } else if (rev_on) {
+    rev_run(&rev, max_insns, &hooks);
+  } else {
+    sim_run(&m, &cpu, max_insns, &hooks);
+  }
+  uart_flush(&m);
+  if (rev_on) {
+    /* Moving around the history must not change how the run ended. */
+    int exit_code = m.exit_code;
+    rev_console(&rev, &syms, stdin, stdout);
+    rev_destroy(&rev);
+    m.exit_code = exit_code;
+  }
+  /* A sampled run may stop short of the end on purpose. */
+  if (user_on && cpu.halted) {
+    m.exit_code = user_exit_status(&user, &cpu);
+  }
+
+  if (aot_on) {
+    aot_destroy(&aot);
+  }
+
+  if (stats_on) {
+    stats_destroy(&stats);
+  }
+
+  if (simpoints) {
+    simpoint_report(&plan, stderr);
+    simpoint_free(&plan);
+  } else if (timing_on) {
+    timing_report(&timing, stderr);
+  }
+  if (timing_on) {
+    timing_destroy(&timing);
+  }
+
+  if (bbv_path) {
+    if (!bbv_finish(&bbv)) {
+      fprintf(stderr, "failed to write %s: %s\n", bbv_path, strerror(errno));
+    }
+    fprintf(stderr, "[bbv] %" PRIu64 " intervals, %" PRIu32 " blocks\n",
+            bbv.intervals, bbv.nblocks);
+    bbv_destroy(&bbv);
+  }
+
+  if (heat_prefix) {
+    m.heat = NULL;
+    heat_finish(&heat, cpu.instret);
+    snprintf(heat_path, sizeof(heat_path), "%s.heat.csv", heat_prefix);
+    if (!heat_write_map(&heat, heat_path, elf_path, &syms)) {
+      fprintf(stderr, "failed to write %s: %s\n", heat_path, strerror(errno));
+    }
+    fprintf(stderr, "[heat] %" PRIu64 " intervals, %" PRIu64
+                    " pages touched\n",
+            heat.intervals, heat.footprint);
+    heat_destroy(&heat);
+  }
+
+  if (callgraph_path) {
+    cg_finish(&callgraph);
+    cg_report(&callgraph, stderr);
+    if (!cg_write_callgrind(&callgraph, callgraph_path, elf_path)) {
+      fprintf(stderr, "failed to write call graph to %s: %s\n",
+              callgraph_path, strerror(errno));
+    }
+    cg_destroy(&callgraph);
+  }
+
+  if (san_on) {
+    san_report(&san, stderr);
+    if (san.stop) {
+      m.exit_code = 1;
+    }
+    san_destroy(&san);
+  }
+
+  if (cov_path) {
+    if (!cov_dump(&cov, cov_path)) {
+      fprintf(stderr, "failed to write coverage to %s: %s\n", cov_path,
+              strerror(errno));
+    }
+    cov_destroy(&cov);
+  }
 
-  for (uint64_t i = 0; i < max_insns && !cpu.halted; i++) {
-    cpu_exec_one((struct Machine *)&m, &cpu);
+  if (semihost_on) {
+    semihost_destroy(&semihost);
   }
 
-  free(m.ram);
-  return 0;
+  int exit_code = m.exit_code;
+  symtab_free(&syms);
+  machine_destroy(&m);
+  return exit_code;
 }
@@ -1,64 +1,179 @@
-#include <stdio.h>
-
+#include "rivos_sim/heat.h"
 #include "rivos_sim/machine.h"
 #include "rivos_sim/mem.h"
+#include "rivos_sim/sanitizer.h"
 
-uint8_t mem_read8(Machine *m, uint64_t addr) {
-  if (addr >= RIVOS_SIM_RAM_BASE && addr < RIVOS_SIM_RAM_BASE + m->ram_size) {
-    return m->ram[addr - RIVOS_SIM_RAM_BASE];
+static inline bool in_ram(const Machine *m, uint64_t addr, unsigned size) {
+  return addr >= m->ram_base &&
+         addr - m->ram_base <= m->ram_size - size;
+}
+
+static inline bool in_shm(const Machine *m, uint64_t addr, unsigned size) {
+  return addr - m->shm_base < m->shm_size &&
+         addr - m->shm_base <= m->shm_size - size;
+}
+
+static inline void mark_dirty(Machine *m, uint64_t off) {
+  machine_dirty_page(m, (size_t)(off >> RIVOS_SIM_PAGE_SHIFT));
+}
+
+void mem_mark_dirty(Machine *m, uint64_t addr, uint64_t len) {
+  if (m->san) {
+    san_host_write(m->san, addr, len);
+  }
+  if (!m->dirty || len == 0) {
+    return;
+  }
+  uint64_t off = addr - m->ram_base;
+  for (uint64_t p = off >> RIVOS_SIM_PAGE_SHIFT;
+       p <= (off + len - 1) >> RIVOS_SIM_PAGE_SHIFT; p++) {
+    machine_dirty_page(m, (size_t)p);
   }
-  return 0;
 }
 
-void mem_write8(Machine *m, uint64_t addr, uint8_t val) {
-  if (addr >= RIVOS_SIM_RAM_BASE && addr < RIVOS_SIM_RAM_BASE + m->ram_size) {
-    m->ram[addr - RIVOS_SIM_RAM_BASE] = val;
+uint8_t *mem_ram_ptr(Machine *m, uint64_t addr, uint64_t len) {
+  if (addr < m->ram_base || addr - m->ram_base > m->ram_size ||
+      len > m->ram_size - (addr - m->ram_base)) {
+    return NULL;
+  }
+  return m->ram + (addr - m->ram_base);
+}
+
+static const MmioRegion *find_mmio(const Machine *m, uint64_t addr) {
+  for (size_t i = 0; i < m->nmmio; i++) {
+    const MmioRegion *r = &m->mmio[i];
+    if (addr - r->base < r->size) {
+      return r;
+    }
+  }
+  return NULL;
+}
+
+/*
+ * Device accesses go to the owning region at their full width so that
+ * 32-bit registers are read and written in one call. Anything else off the
+ * end of RAM reads as zero and drops writes.
+ */
+static uint64_t io_read(Machine *m, uint64_t addr, unsigned size) {
+  const MmioRegion *r = find_mmio(m, addr);
+  if (r && addr - r->base <= r->size - size && r->read) {
+    return r->read(r->opaque, addr - r->base, size);
+  }
+  uint64_t v = 0;
+  for (unsigned i = 0; i < size; i++) {
+    if (in_ram(m, addr + i, 1)) {
+      v |= (uint64_t)m->ram[addr + i - m->ram_base] << (8 * i);
+    }
+  }
+  return v;
+}
+
+static void io_write(Machine *m, uint64_t addr, unsigned size, uint64_t val) {
+  const MmioRegion *r = find_mmio(m, addr);
+  if (r && addr - r->base <= r->size - size) {
+    if (r->write) {
+      r->write(r->opaque, addr - r->base, size, val);
+    }
     return;
   }
 
-  if (addr == RIVOS_SIM_UART16550_BASE) {
-    putchar((int)val);
-    fflush(stdout);
+  /* Straddles the end of RAM. */
+  for (unsigned i = 0; i < size; i++) {
+    if (in_ram(m, addr + i, 1)) {
+      uint64_t off = addr + i - m->ram_base;
+      if (m->dirty) {
+        mark_dirty(m, off);
+      }
+      m->ram[off] = (uint8_t)(val >> (8 * i));
+    }
+  }
+}
+
+static inline uint64_t ram_load(const uint8_t *p, unsigned size) {
+  uint64_t v = 0;
+  for (unsigned i = 0; i < size; i++) {
+    v |= (uint64_t)p[i] << (8 * i);
+  }
+  return v;
+}
+
+static inline void host_store(uint8_t *p, unsigned size, uint64_t val) {
+  for (unsigned i = 0; i < size; i++) {
+    p[i] = (uint8_t)(val >> (8 * i));
+  }
+}
+
+static inline void ram_store(Machine *m, uint64_t off, unsigned size,
+                             uint64_t val) {
+  if (m->dirty) {
+    mark_dirty(m, off);
+    mark_dirty(m, off + size - 1);
+  }
+  host_store(m->ram + off, size, val);
+}
+
+static inline uint64_t load(Machine *m, uint64_t addr, unsigned size,
+                            unsigned kind) {
+  if (in_ram(m, addr, size)) {
+    if (m->heat) {
+      heat_touch(m->heat, kind, addr - m->ram_base);
+    }
+    return ram_load(m->ram + (addr - m->ram_base), size);
+  }
+  if (in_shm(m, addr, size)) {
+    return ram_load(m->shm + (addr - m->shm_base), size);
+  }
+  return io_read(m, addr, size);
+}
+
+static inline void store(Machine *m, uint64_t addr, unsigned size,
+                         uint64_t val) {
+  if (in_ram(m, addr, size)) {
+    if (m->heat) {
+      heat_touch(m->heat, HEAT_WRITE, addr - m->ram_base);
+    }
+    ram_store(m, addr - m->ram_base, size, val);
     return;
   }
+  if (in_shm(m, addr, size)) {
+    host_store(m->shm + (addr - m->shm_base), size, val);
+    return;
+  }
+  io_write(m, addr, size, val);
+}
+
+uint8_t mem_read8(Machine *m, uint64_t addr) {
+  return (uint8_t)load(m, addr, 1, HEAT_READ);
 }
 
 uint16_t mem_read16(Machine *m, uint64_t addr) {
-  uint16_t v = 0;
-  v |= (uint16_t)mem_read8(m, addr);
-  v |= (uint16_t)mem_read8(m, addr + 1) << 8;
-  return v;
+  return (uint16_t)load(m, addr, 2, HEAT_READ);
 }
 
 uint32_t mem_read32(Machine *m, uint64_t addr) {
-  uint32_t v = 0;
-  v |= (uint32_t)mem_read8(m, addr);
-  v |= (uint32_t)mem_read8(m, addr + 1) << 8;
-  v |= (uint32_t)mem_read8(m, addr + 2) << 16;
-  v |= (uint32_t)mem_read8(m, addr + 3) << 24;
-  return v;
+  return (uint32_t)load(m, addr, 4, HEAT_READ);
 }
 
 uint64_t mem_read64(Machine *m, uint64_t addr) {
-  uint64_t v = 0;
-  v |= (uint64_t)mem_read32(m, addr);
-  v |= (uint64_t)mem_read32(m, addr + 4) << 32;
-  return v;
+  return load(m, addr, 8, HEAT_READ);
+}
+
+uint32_t mem_fetch32(Machine *m, uint64_t addr) {
+  return (uint32_t)load(m, addr, 4, HEAT_FETCH);
+}
+
+void mem_write8(Machine *m, uint64_t addr, uint8_t val) {
+  store(m, addr, 1, val);
 }
 
 void mem_write16(Machine *m, uint64_t addr, uint16_t val) {
-  mem_write8(m, addr, (uint8_t)val);
-  mem_write8(m, addr + 1, (uint8_t)(val >> 8));
+  store(m, addr, 2, val);
 }
 
 void mem_write32(Machine *m, uint64_t addr, uint32_t val) {
-  mem_write8(m, addr, (uint8_t)val);
-  mem_write8(m, addr + 1, (uint8_t)(val >> 8));
-  mem_write8(m, addr + 2, (uint8_t)(val >> 16));
-  mem_write8(m, addr + 3, (uint8_t)(val >> 24));
+  store(m, addr, 4, val);
 }
 
 void mem_write64(Machine *m, uint64_t addr, uint64_t val) {
-  mem_write32(m, addr, (uint32_t)val);
-  mem_write32(m, addr + 4, (uint32_t)(val >> 32));
+  store(m, addr, 8, val);
 }
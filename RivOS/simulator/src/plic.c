@@ -0,0 +1,128 @@
+#include <stdlib.h>
+
+#include "rivos_sim/plic.h"
+
+enum {
+  PLIC_PRIORITY = 0x000000,
+  PLIC_PENDING = 0x001000,
+  PLIC_ENABLE = 0x002000,
+  PLIC_ENABLE_STRIDE = 0x80,
+  PLIC_CONTEXT = 0x200000,
+  PLIC_CONTEXT_STRIDE = 0x1000,
+};
+
+/* Source 0 does not exist; a claimed source stays masked until completion. */
+static uint32_t pending_bits(const Plic *p) {
+  return atomic_load(&p->m->irq_level) & ~p->claimed & ~1u;
+}
+
+uint32_t plic_pending(const Plic *p, int ctx) {
+  uint32_t bits = pending_bits(p) & p->enable[ctx];
+  uint32_t best = 0;
+  uint32_t best_prio = p->threshold[ctx];
+  while (bits) {
+    uint32_t s = (uint32_t)__builtin_ctz(bits);
+    bits &= bits - 1;
+    if (p->priority[s] > best_prio) {
+      best = s;
+      best_prio = p->priority[s];
+    }
+  }
+  return best;
+}
+
+static uint64_t plic_read(void *opaque, uint64_t off, unsigned size) {
+  Plic *p = (Plic *)opaque;
+  if (size != 4) {
+    return 0;
+  }
+  if (off < PLIC_SOURCES * 4) {
+    return p->priority[off / 4];
+  }
+  if (off == PLIC_PENDING) {
+    return pending_bits(p);
+  }
+  if (off >= PLIC_ENABLE &&
+      off < PLIC_ENABLE + PLIC_CONTEXTS * PLIC_ENABLE_STRIDE) {
+    uint64_t rel = off - PLIC_ENABLE;
+    return rel % PLIC_ENABLE_STRIDE == 0 ? p->enable[rel / PLIC_ENABLE_STRIDE]
+                                         : 0;
+  }
+  if (off >= PLIC_CONTEXT &&
+      off < PLIC_CONTEXT + PLIC_CONTEXTS * PLIC_CONTEXT_STRIDE) {
+    int ctx = (int)((off - PLIC_CONTEXT) / PLIC_CONTEXT_STRIDE);
+    switch ((off - PLIC_CONTEXT) % PLIC_CONTEXT_STRIDE) {
+    case 0:
+      return p->threshold[ctx];
+    case 4: {
+      uint32_t s = plic_pending(p, ctx);
+      p->claimed |= (s ? 1u << s : 0);
+      return s;
+    }
+    default:
+      return 0;
+    }
+  }
+  return 0;
+}
+
+static void plic_write(void *opaque, uint64_t off, unsigned size,
+                       uint64_t val) {
+  Plic *p = (Plic *)opaque;
+  uint32_t v = (uint32_t)val;
+  if (size != 4) {
+    return;
+  }
+  if (off < PLIC_SOURCES * 4) {
+    if (off) {
+      p->priority[off / 4] = v & 7;
+    }
+    return;
+  }
+  if (off >= PLIC_ENABLE &&
+      off < PLIC_ENABLE + PLIC_CONTEXTS * PLIC_ENABLE_STRIDE) {
+    uint64_t rel = off - PLIC_ENABLE;
+    if (rel % PLIC_ENABLE_STRIDE == 0) {
+      p->enable[rel / PLIC_ENABLE_STRIDE] = v & ~1u;
+    }
+    return;
+  }
+  if (off >= PLIC_CONTEXT &&
+      off < PLIC_CONTEXT + PLIC_CONTEXTS * PLIC_CONTEXT_STRIDE) {
+    int ctx = (int)((off - PLIC_CONTEXT) / PLIC_CONTEXT_STRIDE);
+    switch ((off - PLIC_CONTEXT) % PLIC_CONTEXT_STRIDE) {
+    case 0:
+      p->threshold[ctx] = v & 7;
+      break;
+    case 4:
+      if (v < PLIC_SOURCES && (p->enable[ctx] & (1u << v))) {
+        p->claimed &= ~(1u << v);
+      }
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+bool plic_add(Machine *m) {
+  Plic *p = (Plic *)calloc(1, sizeof(*p));
+  if (!p) {
+    return false;
+  }
+  p->m = m;
+  MmioRegion r = {
+      .base = RIVOS_SIM_PLIC_BASE,
+      .size = RIVOS_SIM_PLIC_SIZE,
+      .opaque = p,
+      .read = plic_read,
+      .write = plic_write,
+      .destroy = free,
+  };
+  if (!machine_add_mmio(m, &r)) {
+    free(p);
+    return false;
+  }
+  m->plic = p;
+  return true;
+}
@@ -0,0 +1,544 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "rivos_sim/fpu.h"
+#include "rivos_sim/mem.h"
+#include "rivos_sim/reverse.h"
+
+void rev_default_config(RevConfig *cfg) {
+  cfg->interval = REV_DEFAULT_INTERVAL;
+  cfg->mem_cap = (uint64_t)REV_DEFAULT_MEM_MB << 20;
+}
+
+static RevCheckpoint *ckpt(const Rev *r, uint64_t n) {
+  return &r->ckpts[n - r->first];
+}
+
+static uint64_t newest(const Rev *r) {
+  return r->first + r->count - 1;
+}
+
+static size_t record_bytes(size_t npages) {
+  return npages * (sizeof(uint32_t) + RIVOS_SIM_PAGE_SIZE);
+}
+
+static int cmp_page(const void *a, const void *b) {
+  uint32_t x = *(const uint32_t *)a, y = *(const uint32_t *)b;
+  return x < y ? -1 : x > y;
+}
+
+/* The record's copy of page, or NULL. */
+static const uint8_t *record_find(const RevCheckpoint *c, uint32_t page) {
+  const uint32_t *p =
+      c->npages ? (const uint32_t *)bsearch(&page, c->pages, c->npages,
+                                            sizeof(page), cmp_page)
+                : NULL;
+  return p ? c->data + (size_t)(p - c->pages) * RIVOS_SIM_PAGE_SIZE : NULL;
+}
+
+static void drop_oldest(Rev *r) {
+  RevCheckpoint *c = ckpt(r, r->first);
+  r->bytes -= sizeof(Cpu) + record_bytes(c->npages);
+  free(c->cpu);
+  free(c->pages);
+  free(c->data);
+  r->first++;
+  r->count--;
+  r->dropped++;
+  memmove(r->ckpts, r->ckpts + 1, r->count * sizeof(*r->ckpts));
+}
+
+/*
+ * Closes the newest checkpoint's undo record from the pages written since
+ * (the shadow holds their old contents), then adds a checkpoint here.
+ */
+static bool checkpoint(Rev *r) {
+  Machine *m = r->m;
+  size_t words = (machine_page_count(m) + 63) / 64;
+
+  if (r->count == r->cap) {
+    size_t cap = r->cap ? 2 * r->cap : 64;
+    RevCheckpoint *ckpts =
+        (RevCheckpoint *)realloc(r->ckpts, cap * sizeof(*ckpts));
+    if (!ckpts) {
+      return false;
+    }
+    r->ckpts = ckpts;
+    r->cap = cap;
+  }
+  Cpu *cpu = (Cpu *)calloc(1, sizeof(Cpu));
+  if (!cpu) {
+    return false;
+  }
+
+  if (r->count) {
+    RevCheckpoint *k = ckpt(r, newest(r));
+    size_t n = 0;
+    for (size_t w = 0; w < words; w++) {
+      n += (size_t)__builtin_popcountll(m->dirty[w]);
+    }
+    if (n) {
+      k->pages = (uint32_t *)malloc(n * sizeof(uint32_t));
+      k->data = (uint8_t *)malloc(n * RIVOS_SIM_PAGE_SIZE);
+      if (!k->pages || !k->data) {
+        free(k->pages);
+        free(k->data);
+        k->pages = NULL;
+        k->data = NULL;
+        free(cpu);
+        return false;
+      }
+    }
+    size_t i = 0;
+    for (size_t w = 0; w < words; w++) {
+      for (uint64_t bits = m->dirty[w]; bits; bits &= bits - 1) {
+        size_t page = w * 64 + (size_t)__builtin_ctzll(bits);
+        size_t off = page << RIVOS_SIM_PAGE_SHIFT;
+        k->pages[i] = (uint32_t)page;
+        memcpy(k->data + i * RIVOS_SIM_PAGE_SIZE, r->shadow + off,
+               RIVOS_SIM_PAGE_SIZE);
+        memcpy(r->shadow + off, m->ram + off, RIVOS_SIM_PAGE_SIZE);
+        i++;
+      }
+    }
+    k->npages = n;
+    r->bytes += record_bytes(n);
+  }
+  machine_clear_dirty(m);
+
+  RevCheckpoint *c = &r->ckpts[r->count];
+  memset(c, 0, sizeof(*c));
+  c->pos = r->pos;
+  fpu_sync(r->cpu);
+  cpu_copy(cpu, r->cpu);
+  c->cpu = cpu;
+  c->plic = *m->plic;
+  uart_save(m, &c->uart);
+  c->irq_level = atomic_load(&m->irq_level);
+  c->console_bytes = m->console_bytes;
+  c->exit_code = m->exit_code;
+  r->count++;
+  r->bytes += sizeof(Cpu);
+  r->base = newest(r);
+  r->live = true;
+
+  while (r->bytes > r->cfg.mem_cap && r->count > 1) {
+    drop_oldest(r);
+  }
+  return true;
+}
+
+/* RAM contents of page at checkpoint n. */
+static const uint8_t *page_at(const Rev *r, uint64_t n, uint32_t page) {
+  for (; n < newest(r); n++) {
+    const uint8_t *data = record_find(ckpt(r, n), page);
+    if (data) {
+      return data;
+    }
+  }
+  return r->shadow + ((size_t)page << RIVOS_SIM_PAGE_SHIFT);
+}
+
+/*
+ * The pages that may differ from checkpoint n are those written since the
+ * base checkpoint and those in the records between the two; the dirty
+ * bitmap collects them before they are put back.
+ */
+static void restore(Rev *r, uint64_t n) {
+  Machine *m = r->m;
+  size_t words = (machine_page_count(m) + 63) / 64;
+  uint64_t lo = n < r->base ? n : r->base;
+  uint64_t hi = n < r->base ? r->base : n;
+  for (uint64_t i = lo; i < hi; i++) {
+    const RevCheckpoint *c = ckpt(r, i);
+    for (size_t j = 0; j < c->npages; j++) {
+      m->dirty[c->pages[j] / 64] |= 1ull << (c->pages[j] % 64);
+    }
+  }
+  for (size_t w = 0; w < words; w++) {
+    for (uint64_t bits = m->dirty[w]; bits; bits &= bits - 1) {
+      uint32_t page = (uint32_t)(w * 64 + (size_t)__builtin_ctzll(bits));
+      memcpy(m->ram + ((size_t)page << RIVOS_SIM_PAGE_SHIFT),
+             page_at(r, n, page), RIVOS_SIM_PAGE_SIZE);
+    }
+  }
+  machine_clear_dirty(m);
+
+  const RevCheckpoint *c = ckpt(r, n);
+  *m->plic = c->plic;
+  atomic_store(&m->irq_level, c->irq_level);
+  uart_restore(m, &c->uart);
+  m->console_bytes = c->console_bytes;
+  m->exit_code = c->exit_code;
+  fpu_discard();
+  cpu_copy(r->cpu, c->cpu);
+  r->pos = c->pos;
+  r->base = n;
+  r->live = n == newest(r);
+}
+
+/* Runs up to n instructions, passing or taking checkpoints. */
+static uint64_t advance(Rev *r, uint64_t n, RunHooks *hooks) {
+  uint64_t done = 0;
+  while (done < n && !r->cpu->halted) {
+    uint64_t next = r->live ? ckpt(r, r->base)->pos + r->cfg.interval
+                            : ckpt(r, r->base + 1)->pos;
+    uint64_t chunk = next - r->pos < n - done ? next - r->pos : n - done;
+    uint64_t ran = sim_run(r->m, r->cpu, chunk, hooks);
+    r->pos += ran;
+    done += ran;
+    if (r->pos > r->end) {
+      r->end = r->pos;
+    }
+    if (r->pos == next) {
+      if (!r->live) {
+        /* Re-run up to the next checkpoint: RAM matches it again. */
+        machine_clear_dirty(r->m);
+        r->base++;
+        r->live = r->base == newest(r);
+      } else if (!checkpoint(r)) {
+        fprintf(stderr, "[reverse] no memory for a checkpoint at %" PRIu64
+                        "\n", r->pos);
+        break;
+      }
+    }
+    if (ran < chunk) {
+      break;
+    }
+  }
+  return done;
+}
+
+bool rev_init(Rev *r, Machine *m, Cpu *cpu, const RevConfig *cfg) {
+  memset(r, 0, sizeof(*r));
+  r->cfg = *cfg;
+  r->m = m;
+  r->cpu = cpu;
+  if (!machine_track_dirty(m)) {
+    return false;
+  }
+  r->shadow = (uint8_t *)calloc(1, m->ram_size);
+  if (!r->shadow) {
+    return false;
+  }
+  /* Untouched pages stay shared zero pages in both. */
+  static const uint8_t zero[RIVOS_SIM_PAGE_SIZE];
+  for (size_t off = 0; off < m->ram_size; off += RIVOS_SIM_PAGE_SIZE) {
+    if (memcmp(m->ram + off, zero, RIVOS_SIM_PAGE_SIZE) != 0) {
+      memcpy(r->shadow + off, m->ram + off, RIVOS_SIM_PAGE_SIZE);
+    }
+  }
+  machine_clear_dirty(m);
+  return checkpoint(r);
+}
+
+void rev_destroy(Rev *r) {
+  while (r->count) {
+    drop_oldest(r);
+  }
+  free(r->ckpts);
+  free(r->shadow);
+  memset(r, 0, sizeof(*r));
+}
+
+uint64_t rev_run(Rev *r, uint64_t max_insns, RunHooks *hooks) {
+  if (hooks) {
+    hooks->bp_hit = -1;
+  }
+  return advance(r, max_insns, hooks);
+}
+
+bool rev_goto(Rev *r, uint64_t pos) {
+  if (pos < ckpt(r, r->first)->pos) {
+    return false;
+  }
+  uint64_t n = pos / r->cfg.interval;
+  if (n > newest(r)) {
+    n = newest(r);
+  }
+  if (pos < r->pos || ckpt(r, n)->pos > r->pos) {
+    restore(r, n);
+  }
+  advance(r, pos - r->pos, NULL);
+  return true;
+}
+
+static uint64_t watch_value(const Rev *r, const RevWatch *w) {
+  const uint8_t *p = r->m->ram + (w->addr - r->m->ram_base);
+  uint64_t v = 0;
+  for (unsigned i = 0; i < w->len; i++) {
+    v |= (uint64_t)p[i] << (8 * i);
+  }
+  return v;
+}
+
+/*
+ * Steps to pos `end` one instruction at a time. Each change to a watched
+ * value is noted in r->hit*; with `first`, the scan stops at the first.
+ * Returns the position just after the last change seen, or 0.
+ */
+static uint64_t scan(Rev *r, uint64_t end, bool first) {
+  uint64_t old[REV_MAX_WATCH];
+  for (size_t i = 0; i < r->nwatch; i++) {
+    old[i] = watch_value(r, &r->watch[i]);
+  }
+  uint64_t found = 0;
+  while (r->pos < end && advance(r, 1, NULL) == 1) {
+    for (size_t i = 0; i < r->nwatch; i++) {
+      uint64_t v = watch_value(r, &r->watch[i]);
+      if (v != old[i]) {
+        r->hit = i;
+        r->hit_old = old[i];
+        r->hit_new = v;
+        old[i] = v;
+        found = r->pos;
+      }
+    }
+    if (found && first) {
+      break;
+    }
+  }
+  return found;
+}
+
+/* Whether a watched page may have been written from checkpoint n on. */
+static bool may_change(const Rev *r, uint64_t n) {
+  for (size_t i = 0; i < r->nwatch; i++) {
+    const RevWatch *w = &r->watch[i];
+    uint64_t off = w->addr - r->m->ram_base;
+    for (uint64_t p = off >> RIVOS_SIM_PAGE_SHIFT;
+         p <= (off + w->len - 1) >> RIVOS_SIM_PAGE_SHIFT; p++) {
+      /* The newest checkpoint has no record yet; it must be live. */
+      bool written = n < newest(r)
+                         ? record_find(ckpt(r, n), (uint32_t)p) != NULL
+                         : (r->m->dirty[p / 64] >> (p % 64)) & 1;
+      if (written) {
+        return true;
+      }
+    }
+  }
+  return false;
+}
+
+bool rev_watch_back(Rev *r) {
+  uint64_t start = r->pos;
+  if (!r->nwatch || start == 0) {
+    return false;
+  }
+  uint64_t n = (start - 1) / r->cfg.interval;
+  if (n > newest(r)) {
+    n = newest(r);
+  }
+  /* Intervals whose records miss every watched page are not re-run. */
+  for (; n >= r->first; n--) {
+    uint64_t end = n < newest(r) ? ckpt(r, n + 1)->pos : start;
+    if (end > start) {
+      end = start;
+    }
+    if (may_change(r, n)) {
+      restore(r, n);
+      uint64_t hit = scan(r, end, false);
+      if (hit) {
+        rev_goto(r, hit - 1);
+        return true;
+      }
+    }
+    if (n == 0) {
+      break;
+    }
+  }
+  rev_goto(r, start);
+  return false;
+}
+
+bool rev_watch_forward(Rev *r) {
+  return r->nwatch && scan(r, r->end, true) != 0;
+}
+
+/* Console. */
+
+static const char *const reg_names[32] = {
+    "zero", "ra", "sp", "gp", "tp",  "t0",  "t1", "t2", "s0", "s1", "a0",
+    "a1",   "a2", "a3", "a4", "a5",  "a6",  "a7", "s2", "s3", "s4", "s5",
+    "s6",   "s7", "s8", "s9", "s10", "s11", "t3", "t4", "t5", "t6",
+};
+
+static void print_where(const Rev *r, const SymbolTable *syms, FILE *out) {
+  uint64_t pc = r->cpu->pc;
+  fprintf(out, "%" PRIu64 ": pc 0x%" PRIx64, r->pos, pc);
+  const Symbol *s = symtab_lookup(syms, pc);
+  if (s) {
+    fprintf(out, " <%s+0x%" PRIx64 ">", s->name, pc - s->addr);
+  }
+  if (r->cpu->halted) {
+    fprintf(out, " (halted)");
+  }
+  fputc('\n', out);
+}
+
+static void print_info(const Rev *r, FILE *out) {
+  fprintf(out,
+          "position %" PRIu64 " of %" PRIu64 ", instret %" PRIu64
+          ", priv %u\n"
+          "%zu checkpoints from %" PRIu64 " every %" PRIu64
+          " instructions, %.1f MiB (%" PRIu64 " dropped)\n",
+          r->pos, r->end, r->cpu->instret, r->cpu->priv, r->count,
+          ckpt(r, r->first)->pos, r->cfg.interval,
+          (double)r->bytes / (1 << 20), r->dropped);
+  for (size_t i = 0; i < r->nwatch; i++) {
+    fprintf(out, "watch %zu: 0x%" PRIx64 " len %u = 0x%" PRIx64 "\n", i,
+            r->watch[i].addr, r->watch[i].len,
+            watch_value(r, &r->watch[i]));
+  }
+}
+
+static void print_regs(const Rev *r, FILE *out) {
+  for (int i = 1; i < 32; i++) {
+    fprintf(out, "%-4s 0x%016" PRIx64 "%s", reg_names[i], r->cpu->x[i],
+            i % 4 == 3 ? "\n" : "  ");
+  }
+}
+
+static void print_mem(const Rev *r, uint64_t addr, uint64_t len, FILE *out) {
+  const uint8_t *p = mem_ram_ptr(r->m, addr, len);
+  if (!p) {
+    fprintf(out, "not RAM: 0x%" PRIx64 "\n", addr);
+    return;
+  }
+  for (uint64_t i = 0; i < len; i += 16) {
+    fprintf(out, "0x%" PRIx64 ":", addr + i);
+    for (uint64_t j = i; j < len && j < i + 16; j++) {
+      fprintf(out, " %02x", p[j]);
+    }
+    fputc('\n', out);
+  }
+}
+
+static void print_hit(const Rev *r, FILE *out) {
+  const RevWatch *w = &r->watch[r->hit];
+  fprintf(out, "watch %zu: 0x%" PRIx64 " 0x%" PRIx64 " -> 0x%" PRIx64 "\n",
+          r->hit, w->addr, r->hit_old, r->hit_new);
+}
+
+static const char console_help[] =
+    "  where                position, pc and symbol\n"
+    "  info                 history and watchpoints\n"
+    "  regs                 integer registers\n"
+    "  x ADDR|SYM [LEN]     dump LEN bytes of RAM (default 64)\n"
+    "  step [N]             run N instructions forward (default 1)\n"
+    "  rstep [N]            go N instructions back (default 1)\n"
+    "  goto POS             go to position POS\n"
+    "  watch ADDR|SYM [LEN] watch LEN bytes (1..8, default 8) for changes\n"
+    "  unwatch              drop all watchpoints\n"
+    "  cont                 forward to the next watched change\n"
+    "  rcont                back to the last watched change\n"
+    "  quit\n";
+
+static bool parse_num(const char *s, uint64_t *out) {
+  char *end = NULL;
+  if (!s || !*s) {
+    return false;
+  }
+  errno = 0;
+  *out = strtoull(s, &end, 0);
+  return !*end && errno == 0;
+}
+
+void rev_console(Rev *r, const SymbolTable *syms, FILE *in, FILE *out) {
+  Machine *m = r->m;
+  bool muted = m->console_muted;
+  bool tty = isatty(fileno(in));
+  char line[256];
+
+  m->console_muted = true;
+  print_where(r, syms, out);
+  for (;;) {
+    if (tty) {
+      fputs("(rev) ", out);
+    }
+    fflush(out);
+    if (!fgets(line, sizeof(line), in)) {
+      break;
+    }
+    char *save = NULL;
+    char *cmd = strtok_r(line, " \t\r\n", &save);
+    char *a1 = strtok_r(NULL, " \t\r\n", &save);
+    char *a2 = strtok_r(NULL, " \t\r\n", &save);
+    uint64_t n = 1, addr = 0;
+    if (!cmd || cmd[0] == '#') {
+      continue;
+    }
+
+    if (strcmp(cmd, "quit") == 0 || strcmp(cmd, "q") == 0) {
+      break;
+    } else if (strcmp(cmd, "help") == 0) {
+      fputs(console_help, out);
+    } else if (strcmp(cmd, "where") == 0) {
+      print_where(r, syms, out);
+    } else if (strcmp(cmd, "info") == 0) {
+      print_info(r, out);
+    } else if (strcmp(cmd, "regs") == 0) {
+      print_regs(r, out);
+    } else if (strcmp(cmd, "x") == 0 &&
+               symtab_resolve(syms, a1 ? a1 : "", &addr) &&
+               (!a2 || parse_num(a2, &n))) {
+      print_mem(r, addr, a2 ? n : 64, out);
+    } else if ((strcmp(cmd, "step") == 0 || strcmp(cmd, "s") == 0) &&
+               (!a1 || parse_num(a1, &n))) {
+      uint64_t to = r->pos + n < r->pos ? UINT64_MAX : r->pos + n;
+      if (rev_goto(r, to) && r->pos != to) {
+        fprintf(out, "stopped: the guest halted\n");
+      }
+      print_where(r, syms, out);
+    } else if ((strcmp(cmd, "rstep") == 0 || strcmp(cmd, "rs") == 0) &&
+               (!a1 || parse_num(a1, &n))) {
+      if (n > r->pos || !rev_goto(r, r->pos - n)) {
+        fprintf(out, "not in the history kept (oldest %" PRIu64 ")\n",
+                ckpt(r, r->first)->pos);
+      }
+      print_where(r, syms, out);
+    } else if (strcmp(cmd, "goto") == 0 && parse_num(a1, &n)) {
+      if (!rev_goto(r, n)) {
+        fprintf(out, "not in the history kept (oldest %" PRIu64 ")\n",
+                ckpt(r, r->first)->pos);
+      } else if (r->pos != n) {
+        fprintf(out, "stopped: the guest halted\n");
+      }
+      print_where(r, syms, out);
+    } else if (strcmp(cmd, "watch") == 0 &&
+               symtab_resolve(syms, a1 ? a1 : "", &addr) &&
+               (!a2 || parse_num(a2, &n))) {
+      unsigned len = a2 ? (unsigned)n : 8;
+      if (r->nwatch == REV_MAX_WATCH || len < 1 || len > 8 ||
+          !mem_ram_ptr(m, addr, len)) {
+        fprintf(out, "cannot watch 0x%" PRIx64 "\n", addr);
+      } else {
+        r->watch[r->nwatch++] = (RevWatch){addr, len};
+        fprintf(out, "watch %zu: 0x%" PRIx64 " len %u\n", r->nwatch - 1,
+                addr, len);
+      }
+    } else if (strcmp(cmd, "unwatch") == 0) {
+      r->nwatch = 0;
+    } else if (strcmp(cmd, "cont") == 0 || strcmp(cmd, "c") == 0) {
+      if (rev_watch_forward(r)) {
+        print_hit(r, out);
+      } else {
+        fprintf(out, "end of history\n");
+      }
+      print_where(r, syms, out);
+    } else if (strcmp(cmd, "rcont") == 0 || strcmp(cmd, "rc") == 0) {
+      if (rev_watch_back(r)) {
+        print_hit(r, out);
+      } else {
+        fprintf(out, "no change in the history kept\n");
+      }
+      print_where(r, syms, out);
+    } else {
+      fprintf(out, "unknown command; try help\n");
+    }
+  }
+  m->console_muted = muted;
+}
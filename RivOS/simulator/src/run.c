@@ -0,0 +1,256 @@
+#include <stdio.h>
+
+#include "rivos_sim/csr.h"
+#include "rivos_sim/devworker.h"
+#include "rivos_sim/heat.h"
+#include "rivos_sim/mem.h"
+#include "rivos_sim/run.h"
+#include "rivos_sim/uart.h"
+
+/*
+ * Interrupts are sampled every IRQ_POLL_INTERVAL instructions rather than
+ * each one; delivery is asynchronous anyway and wfi checks immediately.
+ * Device completions are picked up at the same points. The points follow
+ * instret, not the run, so re-running from a checkpoint takes interrupts
+ * at the same instructions however the run is sliced.
+ */
+enum {
+  IRQ_POLL_INTERVAL = 64,
+};
+
+/*
+ * Stats publishing granularity, a multiple of IRQ_POLL_INTERVAL. The plain
+ * loop is run slice by slice so it needs no extra check per instruction.
+ */
+enum {
+  STATS_SLICE = 1u << 20,
+};
+
+static inline void check_interrupts(Machine *m, Cpu *cpu) {
+  if (atomic_load_explicit(&m->dev_pending, memory_order_relaxed)) {
+    devworker_poll(m);
+  }
+  if (atomic_load_explicit(&m->irq_level, memory_order_relaxed) ||
+      (cpu->csr[CSR_MIP] & cpu->csr[CSR_MIE])) {
+    cpu_interrupt((struct Machine *)m, cpu);
+  }
+}
+
+static inline void poll_interrupts(Machine *m, Cpu *cpu) {
+  if (cpu->instret % IRQ_POLL_INTERVAL == 0) {
+    check_interrupts(m, cpu);
+  }
+}
+
+static void wait_for_interrupt(Machine *m, Cpu *cpu) {
+  for (;;) {
+    uint32_t gen = atomic_load(&m->irq_gen);
+    devworker_poll(m);
+    cpu_interrupt((struct Machine *)m, cpu);
+    if (!cpu->wfi) {
+      return;
+    }
+    if (atomic_load(&m->irq_sources) == 0) {
+      if (!m->console_muted) {
+        uart_flush(m);
+        fprintf(stderr, "[rivos-sim] wfi with no interrupt source left\n");
+      }
+      cpu->wfi = false;
+      cpu->halted = true;
+      return;
+    }
+    machine_wait_irq(m, gen);
+  }
+}
+
+static uint64_t run_plain(Machine *m, Cpu *cpu, uint64_t max_insns) {
+  uint64_t i = 0;
+  for (; i < max_insns && !cpu->halted; i++) {
+    poll_interrupts(m, cpu);
+    cpu_exec_one((struct Machine *)m, cpu);
+    if (cpu->wfi) {
+      wait_for_interrupt(m, cpu);
+    }
+  }
+  return i;
+}
+
+/*
+ * Translated blocks where the image has one for the PC, the interpreter for
+ * everything else. Blocks never trap or wait, so interrupts are polled
+ * between them at the usual interval; a block's successor usually comes
+ * from its links rather than a lookup.
+ */
+static uint64_t run_aot(Machine *m, Cpu *cpu, uint64_t max_insns,
+                        Aot *aot) {
+  uint64_t i = 0;
+  uint64_t next_poll = 0;
+  const AotBlock *b = NULL;
+  while (i < max_insns && !cpu->halted) {
+    if (i >= next_poll) {
+      check_interrupts(m, cpu);
+      next_poll = i + IRQ_POLL_INTERVAL;
+      if (aot_code_written(aot)) {
+        aot_sync_code(aot);
+        b = NULL;
+      }
+    }
+    if (!b || b->pc != cpu->pc) {
+      b = aot_lookup(aot, cpu->pc);
+    }
+    if (b && b->len <= max_insns - i) {
+      uint64_t next = b->fn(m, cpu);
+      cpu->pc = next;
+      cpu->instret += b->len;
+      i += b->len;
+      b = aot_next(aot, b, next);
+      continue;
+    }
+
+    uint32_t insn = mem_read32(m, cpu->pc);
+    cpu_exec_one((struct Machine *)m, cpu);
+    i++;
+    b = NULL;
+    if ((insn & 0x707F) == 0x100F) { /* fence.i */
+      aot_sync_code(aot);
+    }
+    if (cpu->wfi) {
+      wait_for_interrupt(m, cpu);
+    }
+  }
+  return i;
+}
+
+static uint64_t run_fast(Machine *m, Cpu *cpu, uint64_t max_insns,
+                         const RunHooks *hooks) {
+  return hooks && hooks->aot ? run_aot(m, cpu, max_insns, hooks->aot)
+                             : run_plain(m, cpu, max_insns);
+}
+
+/*
+ * A block ends at any non-sequential PC (taken branch, jump, trap) and after
+ * every conditional branch, so fall-through paths count as blocks of their
+ * own. Coverage is updated once per block; only the timing model looks at
+ * every instruction.
+ */
+static int find_breakpoint(const RunHooks *hooks, uint64_t pc) {
+  for (size_t i = 0; i < hooks->nbreakpoints; i++) {
+    if (hooks->breakpoints[i] == pc) {
+      return (int)i;
+    }
+  }
+  return -1;
+}
+
+/* The next instruction for the hooks, without counting it as a load. */
+static inline uint32_t peek_insn(Machine *m, uint64_t pc) {
+  const uint8_t *p = mem_ram_ptr(m, pc, 4);
+  if (!p) {
+    return mem_read32(m, pc);
+  }
+  return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 |
+         (uint32_t)p[3] << 24;
+}
+
+static uint64_t run_hooked(Machine *m, Cpu *cpu, uint64_t max_insns,
+                           RunHooks *hooks) {
+  Timing *timing = hooks->timing;
+  Coverage *cov = hooks->cov;
+  bool block_start = true;
+
+  uint64_t i = 0;
+  for (; i < max_insns && !cpu->halted; i++) {
+    poll_interrupts(m, cpu);
+    uint64_t pc = cpu->pc;
+
+    if (hooks->nbreakpoints && i > 0) {
+      int bp = find_breakpoint(hooks, pc);
+      if (bp >= 0) {
+        hooks->bp_hit = bp;
+        break;
+      }
+    }
+
+    uint32_t insn = peek_insn(m, pc);
+
+    if (hooks->stats && i % STATS_SLICE == 0 && i > 0) {
+      stats_publish(hooks->stats, m, cpu);
+    }
+
+    if (cov && block_start) {
+      cov_block(cov, pc);
+    }
+
+    if (hooks->san && !san_check(hooks->san, cpu, pc, insn)) {
+      cpu->halted = true;
+      break;
+    }
+
+    cpu_exec_one((struct Machine *)m, cpu);
+    if (cpu->wfi) {
+      wait_for_interrupt(m, cpu);
+    }
+    block_start = cpu->pc != pc + 4 || (insn & 0x7F) == 0x63;
+    if (hooks->bbv) {
+      bbv_retire(hooks->bbv, pc, block_start);
+    }
+
+    if (timing) {
+      timing_retire(timing, pc, insn, cpu->pc);
+    }
+    if (hooks->callgraph) {
+      cg_retire(hooks->callgraph, pc, insn, cpu->pc);
+    }
+  }
+  return i;
+}
+
+static uint64_t dispatch(Machine *m, Cpu *cpu, uint64_t max_insns,
+                         RunHooks *hooks) {
+  if (!hooks) {
+    return run_plain(m, cpu, max_insns);
+  }
+
+  hooks->bp_hit = -1;
+  uint64_t n;
+  if (hooks->timing || hooks->cov || hooks->callgraph || hooks->san ||
+      hooks->bbv || hooks->nbreakpoints) {
+    n = run_hooked(m, cpu, max_insns, hooks);
+  } else if (!hooks->stats) {
+    return run_fast(m, cpu, max_insns, hooks);
+  } else {
+    n = 0;
+    while (n < max_insns && !cpu->halted) {
+      uint64_t left = max_insns - n;
+      n += run_fast(m, cpu, left < STATS_SLICE ? left : STATS_SLICE, hooks);
+      stats_publish(hooks->stats, m, cpu);
+    }
+  }
+  if (hooks->stats) {
+    stats_publish(hooks->stats, m, cpu);
+  }
+  return n;
+}
+
+/* With --heat, runs are cut at interval boundaries to close each one. */
+uint64_t sim_run(Machine *m, Cpu *cpu, uint64_t max_insns, RunHooks *hooks) {
+  Heat *h = m->heat;
+  if (!h) {
+    return dispatch(m, cpu, max_insns, hooks);
+  }
+  uint64_t n = 0;
+  while (n < max_insns && !cpu->halted) {
+    uint64_t left = max_insns - n;
+    uint64_t room = h->interval - h->in_interval;
+    uint64_t done = dispatch(m, cpu, left < room ? left : room, hooks);
+    n += done;
+    h->in_interval += done;
+    if (h->in_interval >= h->interval) {
+      heat_end_interval(h, cpu->instret);
+    }
+    if (hooks && hooks->bp_hit >= 0) {
+      break;
+    }
+  }
+  return n;
+}
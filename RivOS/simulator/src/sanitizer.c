@@ -0,0 +1,434 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rivos_sim/csr.h"
+#include "rivos_sim/elf.h"
+#include "rivos_sim/sanitizer.h"
+#include "rivos_sim/sbi.h"
+#include "rivos_sim/vector.h"
+
+typedef enum {
+  SAN_ERR_UNADDRESSABLE,
+  SAN_ERR_UNDEFINED,
+  SAN_ERR_DEAD_STACK,
+} SanError;
+
+enum {
+  ACC_LOAD = 1,
+  ACC_STORE = 2,
+  /* How far past the end of a symbol an address is still blamed on it. */
+  NEAR_SYMBOL = 4096,
+  ELF_MAX_SEGMENTS = 16,
+};
+
+static bool in_ram(const Sanitizer *s, uint64_t addr, uint64_t len) {
+  return addr >= s->m->ram_base &&
+         addr - s->m->ram_base <= s->m->ram_size &&
+         len <= s->m->ram_size - (addr - s->m->ram_base);
+}
+
+/* Device threads write guest memory too, hence the atomics. */
+static void bits_assign(uint64_t *map, uint64_t off, uint64_t len, bool on) {
+  uint64_t end = off + len;
+  while (off < end) {
+    unsigned b = (unsigned)(off % 64);
+    uint64_t n = end - off < 64 - b ? end - off : 64 - b;
+    uint64_t mask = (n == 64 ? ~0ull : (1ull << n) - 1) << b;
+    if (on) {
+      __atomic_fetch_or(&map[off / 64], mask, __ATOMIC_RELAXED);
+    } else {
+      __atomic_fetch_and(&map[off / 64], ~mask, __ATOMIC_RELAXED);
+    }
+    off += n;
+  }
+}
+
+static bool bit(const uint64_t *map, uint64_t off) {
+  return (__atomic_load_n(&map[off / 64], __ATOMIC_RELAXED) >> (off % 64)) & 1;
+}
+
+/* Bits [off, off + n) as a value, for n in 1..64. */
+static uint64_t bits_get(const uint64_t *map, uint64_t off, unsigned n) {
+  unsigned b = (unsigned)(off % 64);
+  uint64_t v = __atomic_load_n(&map[off / 64], __ATOMIC_RELAXED) >> b;
+  if (b && b + n > 64) {
+    v |= __atomic_load_n(&map[off / 64 + 1], __ATOMIC_RELAXED) << (64 - b);
+  }
+  return n == 64 ? v : v & ((1ull << n) - 1);
+}
+
+/* Sets bits [off, off + n) to val, for n in 1..64. */
+static void bits_put(uint64_t *map, uint64_t off, unsigned n, uint64_t val) {
+  while (n) {
+    unsigned b = (unsigned)(off % 64);
+    unsigned k = n < 64 - b ? n : 64 - b;
+    uint64_t mask = k == 64 ? ~0ull : (1ull << k) - 1;
+    uint64_t v = val & mask;
+    __atomic_fetch_or(&map[off / 64], v << b, __ATOMIC_RELAXED);
+    __atomic_fetch_and(&map[off / 64], ~((mask & ~v) << b), __ATOMIC_RELAXED);
+    off += k;
+    n -= k;
+    val = k < 64 ? val >> k : 0;
+  }
+}
+
+/* Index of the first clear bit in [off, off + len), or len. */
+static uint64_t first_clear(const uint64_t *map, uint64_t off, uint64_t len) {
+  for (uint64_t i = 0; i < len; i++) {
+    if (!bit(map, off + i)) {
+      return i;
+    }
+  }
+  return len;
+}
+
+bool san_init(Sanitizer *s, Machine *m, const SymbolTable *syms, bool halt) {
+  memset(s, 0, sizeof(*s));
+  s->m = m;
+  s->syms = syms;
+  s->halt = halt;
+  s->cur = -1;
+  s->words = (m->ram_size + 63) / 64;
+  s->valid = (uint64_t *)calloc(s->words, sizeof(uint64_t));
+  s->defined = (uint64_t *)calloc(s->words, sizeof(uint64_t));
+  if (!s->valid || !s->defined) {
+    san_destroy(s);
+    errno = ENOMEM;
+    return false;
+  }
+  m->san = s;
+  return true;
+}
+
+void san_destroy(Sanitizer *s) {
+  if (s->m && s->m->san == s) {
+    s->m->san = NULL;
+  }
+  free(s->valid);
+  free(s->defined);
+  s->valid = NULL;
+  s->defined = NULL;
+}
+
+void san_set(Sanitizer *s, uint64_t addr, uint64_t len, SanState st) {
+  if (!in_ram(s, addr, len)) {
+    return;
+  }
+  uint64_t off = addr - s->m->ram_base;
+  bits_assign(s->valid, off, len, st != SAN_FREED);
+  bits_assign(s->defined, off, len, st == SAN_DEFINED);
+}
+
+bool san_load_elf(Sanitizer *s, const char *path) {
+  ElfSegment segs[ELF_MAX_SEGMENTS];
+  size_t n = load_elf_segments(s->m, path, segs, ELF_MAX_SEGMENTS);
+  if (n == 0) {
+    return false;
+  }
+  for (size_t i = 0; i < n; i++) {
+    san_set(s, segs[i].start, segs[i].file_end - segs[i].start, SAN_DEFINED);
+    san_set(s, segs[i].file_end, segs[i].end - segs[i].file_end,
+            SAN_UNDEFINED);
+  }
+  return true;
+}
+
+/* "sym+0x10", "8 bytes past sym" or nothing. */
+static void describe(const Sanitizer *s, uint64_t addr, char *buf,
+                     size_t len) {
+  buf[0] = '\0';
+  if (!s->syms) {
+    return;
+  }
+  const Symbol *best = symtab_lookup(s->syms, addr);
+  if (best) {
+    snprintf(buf, len, " (%s+0x%" PRIx64 ")", best->name, addr - best->addr);
+    return;
+  }
+  if (!(best = symtab_nearest(s->syms, addr))) {
+    return;
+  }
+  uint64_t off = addr - best->addr;
+  if (best->size == 0 && off < NEAR_SYMBOL) {
+    snprintf(buf, len, " (%s+0x%" PRIx64 ")", best->name, off);
+  } else if (off - best->size < NEAR_SYMBOL) {
+    snprintf(buf, len, " (%" PRIu64 " bytes past %s)", off - best->size,
+             best->name);
+  }
+}
+
+/* True the first time pc is seen, while there is room to remember it. */
+static bool new_site(Sanitizer *s, uint64_t pc) {
+  size_t mask = SAN_SITES - 1;
+  size_t i = (size_t)((pc >> 2) * 0x9e3779b97f4a7c15ull >> 32) & mask;
+  while (s->sites[i]) {
+    if (s->sites[i] == pc) {
+      return false;
+    }
+    i = (i + 1) & mask;
+  }
+  if (s->nsites == SAN_SITES * 3 / 4) {
+    return false;
+  }
+  s->sites[i] = pc;
+  if (++s->nsites == SAN_SITES * 3 / 4) {
+    fprintf(stderr, "[rivos-sim] sanitizer: too many sites, not showing "
+                    "any more\n");
+  }
+  return true;
+}
+
+static void report(Sanitizer *s, uint64_t pc, SanError err, int acc,
+                   uint64_t addr, uint64_t size) {
+  static const char *const what[] = {
+      [SAN_ERR_UNADDRESSABLE] = "unaddressable memory",
+      [SAN_ERR_UNDEFINED] = "undefined memory",
+      [SAN_ERR_DEAD_STACK] = "dead stack below sp",
+  };
+  s->errors++;
+  s->stop = s->halt;
+  if (!new_site(s, pc)) {
+    return;
+  }
+  char at[160], in[160];
+  describe(s, addr, at, sizeof(at));
+  describe(s, pc, in, sizeof(in));
+  fprintf(stderr,
+          "[rivos-sim] sanitizer: %" PRIu64 "-byte %s %s at "
+          "0x%016" PRIx64 "%s, pc 0x%016" PRIx64 "%s\n",
+          size, acc & ACC_LOAD ? "load of" : "store to", what[err], addr, at,
+          pc, in);
+}
+
+static int find_stack(const Sanitizer *s, uint64_t sp) {
+  for (size_t i = 0; i < s->nstacks; i++) {
+    if (sp >= s->stacks[i].lo && sp <= s->stacks[i].hi) {
+      return (int)i;
+    }
+  }
+  return -1;
+}
+
+/* Popping frames kills their contents; switching stacks kills nothing. */
+static void sp_moved(Sanitizer *s, uint64_t sp) {
+  int k = find_stack(s, sp);
+  if (k >= 0 && k == s->cur && sp > s->sp) {
+    bits_assign(s->defined, s->sp - s->m->ram_base, sp - s->sp, false);
+  }
+  s->cur = k;
+  s->sp = sp;
+}
+
+static void check_access(Sanitizer *s, uint64_t pc, uint64_t addr,
+                         uint64_t size, int acc) {
+  if (!in_ram(s, addr, size)) {
+    return;
+  }
+  uint64_t off = addr - s->m->ram_base;
+  uint64_t i;
+  if (s->cur >= 0 && addr < s->sp && addr + size > s->stacks[s->cur].lo) {
+    report(s, pc, SAN_ERR_DEAD_STACK, acc, addr, size);
+  } else if ((i = first_clear(s->valid, off, size)) < size) {
+    report(s, pc, SAN_ERR_UNADDRESSABLE, acc, addr + i, size);
+  } else if ((acc & ACC_LOAD) &&
+             (i = first_clear(s->defined, off, size)) < size) {
+    report(s, pc, SAN_ERR_UNDEFINED, acc, addr + i, size);
+  }
+  if (acc & ACC_STORE) {
+    bits_assign(s->defined, off, size, true);
+  }
+}
+
+/* Vector loads and stores, element by element as vector.c runs them. */
+static void check_vector(Sanitizer *s, const Cpu *cpu, uint64_t pc,
+                         uint32_t insn, int acc) {
+  uint32_t f3 = (insn >> 12) & 7;
+  uint32_t rs2 = (insn >> 20) & 31;
+  uint32_t mop = (insn >> 26) & 3;
+  uint32_t nf = (insn >> 29) + 1;
+  bool vm = (insn >> 25) & 1;
+  uint64_t base = cpu->x[(insn >> 15) & 31];
+  unsigned eew = f3 == 0 ? 1 : 1u << (f3 - 4);
+  uint64_t vtype = cpu->csr[CSR_VTYPE];
+  uint64_t vl = cpu->csr[CSR_VL];
+
+  if ((insn >> 28) & 1) {
+    return;
+  }
+  if (mop == 0 && rs2 == 0x08) { /* whole registers */
+    check_access(s, pc, base, (uint64_t)nf * cpu->vlenb, acc);
+    return;
+  }
+  if (vtype >> VTYPE_VILL) {
+    return;
+  }
+  if (mop == 0 && rs2 == 0x0B) { /* vlm.v / vsm.v */
+    if (vl) {
+      check_access(s, pc, base, (vl + 7) / 8, acc);
+    }
+    return;
+  }
+  bool indexed = mop & 1;
+  unsigned sb = indexed ? 1u << ((vtype >> 3) & 7) : eew;
+  uint64_t stride = mop == 2 ? cpu->x[rs2] : (uint64_t)nf * sb;
+  const uint8_t *index = cpu->v + (size_t)rs2 * cpu->vlenb;
+  for (uint64_t i = cpu->csr[CSR_VSTART]; i < vl; i++) {
+    if (!vm && !((cpu->v[i / 8] >> (i % 8)) & 1)) {
+      continue;
+    }
+    uint64_t off = 0;
+    if (indexed) {
+      memcpy(&off, index + i * eew, eew);
+    }
+    /* A segment's fields are contiguous. */
+    check_access(s, pc, base + (indexed ? off : i * stride),
+                 (uint64_t)nf * sb, acc);
+  }
+}
+
+bool san_check(Sanitizer *s, Cpu *cpu, uint64_t pc, uint32_t insn) {
+  if (cpu->x[2] != s->sp) {
+    sp_moved(s, cpu->x[2]);
+  }
+
+  uint32_t f3 = (insn >> 12) & 7;
+  uint64_t base = cpu->x[(insn >> 15) & 31];
+  int64_t imm_i = (int64_t)(int32_t)insn >> 20;
+  int64_t imm_s = ((int64_t)(int32_t)insn >> 25) * 32 + ((insn >> 7) & 0x1f);
+
+  switch (insn & 0x7f) {
+  case 0x03: /* LOAD */
+    if (f3 != 7) {
+      check_access(s, pc, base + (uint64_t)imm_i, 1u << (f3 & 3), ACC_LOAD);
+    }
+    break;
+  case 0x23: /* STORE */
+    if (f3 < 4) {
+      check_access(s, pc, base + (uint64_t)imm_s, 1u << f3, ACC_STORE);
+    }
+    break;
+  case 0x07: /* LOAD-FP; other widths are vector */
+    if (f3 == 2 || f3 == 3) {
+      check_access(s, pc, base + (uint64_t)imm_i, 1u << f3, ACC_LOAD);
+    } else if (f3 == 0 || f3 >= 5) {
+      check_vector(s, cpu, pc, insn, ACC_LOAD);
+    }
+    break;
+  case 0x27: /* STORE-FP */
+    if (f3 == 2 || f3 == 3) {
+      check_access(s, pc, base + (uint64_t)imm_s, 1u << f3, ACC_STORE);
+    } else if (f3 == 0 || f3 >= 5) {
+      check_vector(s, cpu, pc, insn, ACC_STORE);
+    }
+    break;
+  case 0x2f: /* LR, SC and AMOs */
+    if (f3 == 2 || f3 == 3) {
+      uint32_t f5 = insn >> 27;
+      int acc = f5 == 2   ? ACC_LOAD
+                : f5 == 3 ? ACC_STORE
+                          : ACC_LOAD | ACC_STORE;
+      check_access(s, pc, base, 1u << f3, acc);
+    }
+    break;
+  default:
+    break;
+  }
+  return !s->stop;
+}
+
+void san_host_access(Sanitizer *s, uint64_t pc, uint64_t addr, uint64_t len,
+                     bool read) {
+  if (!in_ram(s, addr, len)) {
+    return;
+  }
+  uint64_t off = addr - s->m->ram_base;
+  uint64_t i;
+  if ((i = first_clear(s->valid, off, len)) < len) {
+    report(s, pc, SAN_ERR_UNADDRESSABLE, read ? ACC_LOAD : ACC_STORE,
+           addr + i, len);
+  } else if (read && (i = first_clear(s->defined, off, len)) < len) {
+    report(s, pc, SAN_ERR_UNDEFINED, ACC_LOAD, addr + i, len);
+  }
+}
+
+void san_host_write(Sanitizer *s, uint64_t addr, uint64_t len) {
+  if (in_ram(s, addr, len)) {
+    bits_assign(s->defined, addr - s->m->ram_base, len, true);
+  }
+}
+
+/* Definedness travels with the data, so copies are not errors by
+ * themselves. */
+void san_host_copy(Sanitizer *s, uint64_t pc, uint64_t dst, uint64_t src,
+                   uint64_t len) {
+  san_host_access(s, pc, src, len, false);
+  san_host_access(s, pc, dst, len, false);
+  if (!in_ram(s, dst, len) || !in_ram(s, src, len)) {
+    return;
+  }
+  uint64_t d = dst - s->m->ram_base;
+  uint64_t o = src - s->m->ram_base;
+  /* A word of bits at a time, in the direction that is safe to overlap. */
+  for (uint64_t k = 0; k < len;) {
+    unsigned n = len - k < 64 ? (unsigned)(len - k) : 64;
+    uint64_t i = d < o ? k : len - k - n;
+    bits_put(s->defined, d + i, n, bits_get(s->defined, o + i, n));
+    k += n;
+  }
+}
+
+static int64_t add_stack(Sanitizer *s, uint64_t lo, uint64_t hi,
+                         uint64_t sp) {
+  int k = -1;
+  for (size_t i = 0; i < s->nstacks; i++) {
+    if (s->stacks[i].lo == lo && s->stacks[i].hi == hi) {
+      k = (int)i;
+    }
+  }
+  if (k < 0) {
+    if (s->nstacks == SAN_MAX_STACKS) {
+      return SBI_ERR_FAILED;
+    }
+    k = (int)s->nstacks++;
+    s->stacks[k] = (SanStack){lo, hi};
+  }
+  bits_assign(s->valid, lo - s->m->ram_base, hi - lo, true);
+  if (sp >= lo && sp <= hi) {
+    bits_assign(s->defined, lo - s->m->ram_base, sp - lo, false);
+  }
+  s->cur = find_stack(s, sp);
+  s->sp = sp;
+  return SBI_SUCCESS;
+}
+
+void san_sbi_call(Sanitizer *s, Cpu *cpu) {
+  uint64_t a = cpu->x[10];
+  uint64_t b = cpu->x[11];
+  uint64_t fid = cpu->x[16];
+  int64_t ret = SBI_SUCCESS;
+
+  if (fid > SBI_RIVOS_SAN_STACK) {
+    ret = SBI_ERR_NOT_SUPPORTED;
+  } else if (fid == SBI_RIVOS_SAN_STACK ? b < a || !in_ram(s, a, b - a)
+                                        : !in_ram(s, a, b)) {
+    ret = SBI_ERR_INVALID_ADDRESS;
+  } else if (fid == SBI_RIVOS_SAN_STACK) {
+    ret = add_stack(s, a, b, cpu->x[2]);
+  } else {
+    static const SanState state[] = {
+        [SBI_RIVOS_SAN_ALLOC] = SAN_UNDEFINED,
+        [SBI_RIVOS_SAN_FREE] = SAN_FREED,
+        [SBI_RIVOS_SAN_DEFINE] = SAN_DEFINED,
+    };
+    san_set(s, a, b, state[fid]);
+  }
+  cpu->x[10] = (uint64_t)ret;
+  cpu->x[11] = 0;
+}
+
+void san_report(const Sanitizer *s, FILE *out) {
+  fprintf(out, "[rivos-sim] sanitizer: %" PRIu64 " errors at %zu sites\n",
+          s->errors, s->nsites);
+}
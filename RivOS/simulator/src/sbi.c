@@ -1,24 +1,164 @@
 #include <stdint.h>
-#include <stdio.h>
+#include <string.h>
 
+#include "rivos_sim/fuzz.h"
+#include "rivos_sim/mem.h"
+#include "rivos_sim/sanitizer.h"
 #include "rivos_sim/sbi.h"
+#include "rivos_sim/uart.h"
 
-void sbi_handle(Cpu *cpu) {
+static bool has_extension(const Machine *m, uint64_t ext) {
+  switch (ext) {
+  case SBI_EXT_LEGACY_CONSOLE_PUTCHAR:
+  case SBI_EXT_LEGACY_CONSOLE_GETCHAR:
+  case SBI_EXT_LEGACY_SHUTDOWN:
+  case SBI_EXT_BASE:
+  case SBI_EXT_RIVOS_MEM:
+    return true;
+  case SBI_EXT_RIVOS_FUZZ:
+    return m->fuzz != NULL;
+  case SBI_EXT_RIVOS_SAN:
+    return m->san != NULL;
+  default:
+    return false;
+  }
+}
+
+static void set_ret(Cpu *cpu, int64_t error, uint64_t value) {
+  cpu->x[10] = (uint64_t)error;
+  cpu->x[11] = value;
+}
+
+static void base_call(Machine *m, Cpu *cpu) {
+  switch (cpu->x[16]) {
+  case SBI_BASE_GET_SPEC_VERSION:
+    set_ret(cpu, SBI_SUCCESS, 2); /* v0.2 */
+    return;
+  case SBI_BASE_GET_IMPL_ID:
+    set_ret(cpu, SBI_SUCCESS, SBI_RIVOS_IMPL_ID);
+    return;
+  case SBI_BASE_GET_IMPL_VERSION:
+    set_ret(cpu, SBI_SUCCESS, 1);
+    return;
+  case SBI_BASE_PROBE_EXTENSION:
+    set_ret(cpu, SBI_SUCCESS, has_extension(m, cpu->x[10]));
+    return;
+  case SBI_BASE_GET_MVENDORID:
+  case SBI_BASE_GET_MARCHID:
+  case SBI_BASE_GET_MIMPID:
+    set_ret(cpu, SBI_SUCCESS, 0);
+    return;
+  default:
+    set_ret(cpu, SBI_ERR_NOT_SUPPORTED, 0);
+    return;
+  }
+}
+
+/*
+ * One ecall instead of a store per byte. Written ranges are marked dirty so
+ * fuzz snapshot restore sees them, like any other host-side write. The
+ * sanitizer checks the ranges as if the guest had looped over them.
+ */
+static void mem_call(Machine *m, Cpu *cpu) {
+  uint64_t a = cpu->x[10];
+  uint64_t b = cpu->x[11];
+  uint64_t len = cpu->x[12];
+  uint8_t *dst = mem_ram_ptr(m, a, len);
+  uint64_t pc = cpu->pc - 4;
+
+  switch (cpu->x[16]) {
+  case SBI_RIVOS_MEM_SET:
+    if (!dst) {
+      break;
+    }
+    if (m->san) {
+      san_host_access(m->san, pc, a, len, false);
+    }
+    memset(dst, (int)(uint8_t)b, (size_t)len);
+    mem_mark_dirty(m, a, len);
+    set_ret(cpu, SBI_SUCCESS, 0);
+    return;
+  case SBI_RIVOS_MEM_COPY:
+  case SBI_RIVOS_MEM_MOVE: {
+    const uint8_t *src = mem_ram_ptr(m, b, len);
+    if (!dst || !src) {
+      break;
+    }
+    memmove(dst, src, (size_t)len);
+    mem_mark_dirty(m, a, len);
+    if (m->san) {
+      san_host_copy(m->san, pc, a, b, len);
+    }
+    set_ret(cpu, SBI_SUCCESS, 0);
+    return;
+  }
+  case SBI_RIVOS_MEM_CMP: {
+    const uint8_t *rhs = mem_ram_ptr(m, b, len);
+    if (!dst || !rhs) {
+      break;
+    }
+    if (m->san) {
+      san_host_access(m->san, pc, a, len, true);
+      san_host_access(m->san, pc, b, len, true);
+    }
+    int c = memcmp(dst, rhs, (size_t)len);
+    set_ret(cpu, SBI_SUCCESS, (uint64_t)(int64_t)((c > 0) - (c < 0)));
+    return;
+  }
+  default:
+    set_ret(cpu, SBI_ERR_NOT_SUPPORTED, 0);
+    return;
+  }
+  set_ret(cpu, SBI_ERR_INVALID_ADDRESS, 0);
+}
+
+void sbi_handle(Machine *m, Cpu *cpu) {
   uint64_t ext = cpu->x[17];
 
-  if (ext == 1) {
-    uint8_t ch = (uint8_t)cpu->x[10];
-    putchar((int)ch);
-    fflush(stdout);
+  if (ext == SBI_EXT_LEGACY_CONSOLE_PUTCHAR) {
+    uart_tx(m, (uint8_t)cpu->x[10]);
     cpu->x[10] = 0;
     return;
   }
 
-  if (ext == 8) {
+  if (ext == SBI_EXT_LEGACY_CONSOLE_GETCHAR) {
+    cpu->x[10] = (uint64_t)(int64_t)uart_rx(m);
+    return;
+  }
+
+  if (ext == SBI_EXT_LEGACY_SHUTDOWN) {
     cpu->halted = true;
     cpu->x[10] = 0;
     return;
   }
 
+  if (ext == SBI_EXT_BASE) {
+    base_call(m, cpu);
+    return;
+  }
+
+  if (ext == SBI_EXT_RIVOS_MEM) {
+    mem_call(m, cpu);
+    return;
+  }
+
+  if (ext == SBI_EXT_RIVOS_SAN) {
+    if (m->san) {
+      san_sbi_call(m->san, cpu);
+    } else {
+      cpu->x[10] = (uint64_t)(int64_t)SBI_ERR_NOT_SUPPORTED;
+    }
+    return;
+  }
+
+  if (ext == SBI_EXT_RIVOS_FUZZ) {
+    if (m->fuzz) {
+      fuzz_sbi_call(m->fuzz, cpu);
+    } else {
+      cpu->x[10] = (uint64_t)(int64_t)SBI_ERR_NOT_SUPPORTED;
+    }
+    return;
+  }
+
   cpu->x[10] = (uint64_t)-1;
 }
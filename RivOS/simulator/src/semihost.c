@@ -0,0 +1,227 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rivos_sim/mem.h"
+#include "rivos_sim/semihost.h"
+#include "rivos_sim/uart.h"
+
+/* Handle for ":tt" opened for writing: the console, through the UART. */
+enum {
+  FD_CONSOLE = -2,
+};
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+void semihost_init(Semihost *sh, Machine *m) {
+  for (int i = 0; i < SEMIHOST_MAX_FILES; i++) {
+    sh->fds[i] = -1;
+  }
+  sh->last_errno = 0;
+  sh->start_ns = now_ns();
+  m->semihost = sh;
+}
+
+void semihost_destroy(Semihost *sh) {
+  for (int i = 0; i < SEMIHOST_MAX_FILES; i++) {
+    if (sh->fds[i] >= 0) {
+      close(sh->fds[i]);
+    }
+    sh->fds[i] = -1;
+  }
+}
+
+bool semihost_is_call(Machine *m, uint64_t pc) {
+  return m->semihost && mem_read32(m, pc - 4) == SEMIHOST_SLLI &&
+         mem_read32(m, pc + 4) == SEMIHOST_SRAI;
+}
+
+static int64_t fail(Semihost *sh, int err) {
+  sh->last_errno = err;
+  return -1;
+}
+
+static int *handle(Semihost *sh, uint64_t h) {
+  if (h >= SEMIHOST_MAX_FILES || sh->fds[h] == -1) {
+    sh->last_errno = EBADF;
+    return NULL;
+  }
+  return &sh->fds[h];
+}
+
+/* Mode is fopen's r, rb, r+, r+b, w, wb, w+, w+b, a, ab, a+, a+b. */
+static int64_t sys_open(Semihost *sh, Machine *m, const uint64_t *arg) {
+  uint64_t mode = arg[1];
+  uint64_t len = arg[2];
+  const uint8_t *p = mem_ram_ptr(m, arg[0], len);
+  char name[4096];
+  if (!p || len >= sizeof(name) || mode > 11) {
+    return fail(sh, EINVAL);
+  }
+  memcpy(name, p, (size_t)len);
+  name[len] = '\0';
+
+  int slot = 0;
+  while (slot < SEMIHOST_MAX_FILES && sh->fds[slot] != -1) {
+    slot++;
+  }
+  if (slot == SEMIHOST_MAX_FILES) {
+    return fail(sh, EMFILE);
+  }
+
+  int fd;
+  if (strcmp(name, ":tt") == 0) {
+    fd = mode < 4 ? dup(STDIN_FILENO) : mode < 8 ? FD_CONSOLE
+                                                 : dup(STDERR_FILENO);
+  } else {
+    static const int flags[3] = {
+        0,
+        O_CREAT | O_TRUNC,
+        O_CREAT | O_APPEND,
+    };
+    int acc = (mode & 2) ? O_RDWR : mode < 4 ? O_RDONLY : O_WRONLY;
+    fd = open(name, acc | flags[mode / 4] | O_CLOEXEC, 0644);
+  }
+  if (fd == -1) {
+    return fail(sh, errno);
+  }
+  sh->fds[slot] = fd;
+  return slot;
+}
+
+static int64_t sys_close(Semihost *sh, const uint64_t *arg) {
+  int *fd = handle(sh, arg[0]);
+  if (!fd) {
+    return -1;
+  }
+  int rc = *fd >= 0 ? close(*fd) : 0;
+  *fd = -1;
+  return rc == 0 ? 0 : fail(sh, errno);
+}
+
+/* READ and WRITE return the number of bytes not transferred. */
+static int64_t sys_rw(Semihost *sh, Machine *m, const uint64_t *arg,
+                      bool write_op) {
+  int *fd = handle(sh, arg[0]);
+  uint64_t len = arg[2];
+  uint8_t *buf = mem_ram_ptr(m, arg[1], len);
+  if (!fd) {
+    return (int64_t)len;
+  }
+  if (!buf) {
+    sh->last_errno = EFAULT;
+    return (int64_t)len;
+  }
+
+  if (*fd == FD_CONSOLE) {
+    if (!write_op) {
+      sh->last_errno = EBADF;
+      return (int64_t)len;
+    }
+    for (uint64_t i = 0; i < len; i++) {
+      uart_tx(m, buf[i]);
+    }
+    return 0;
+  }
+
+  uint64_t done = 0;
+  while (done < len) {
+    ssize_t n = write_op ? write(*fd, buf + done, (size_t)(len - done))
+                         : read(*fd, buf + done, (size_t)(len - done));
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n < 0) {
+      sh->last_errno = errno;
+      break;
+    }
+    if (n == 0) {
+      break;
+    }
+    done += (uint64_t)n;
+  }
+  if (!write_op) {
+    mem_mark_dirty(m, arg[1], done);
+  }
+  return (int64_t)(len - done);
+}
+
+static int64_t sys_seek(Semihost *sh, const uint64_t *arg) {
+  int *fd = handle(sh, arg[0]);
+  if (!fd) {
+    return -1;
+  }
+  if (*fd < 0 || lseek(*fd, (off_t)arg[1], SEEK_SET) < 0) {
+    return fail(sh, *fd < 0 ? ESPIPE : errno);
+  }
+  return 0;
+}
+
+static int64_t sys_flen(Semihost *sh, const uint64_t *arg) {
+  int *fd = handle(sh, arg[0]);
+  if (!fd) {
+    return -1;
+  }
+  struct stat st;
+  if (*fd < 0 || fstat(*fd, &st) != 0) {
+    return fail(sh, *fd < 0 ? EINVAL : errno);
+  }
+  return (int64_t)st.st_size;
+}
+
+static void sys_exit(Machine *m, Cpu *cpu, const uint64_t *arg) {
+  m->exit_code = arg[0] == SEMIHOST_EXIT_APPLICATION ? (int)arg[1] : 1;
+  cpu->halted = true;
+}
+
+void semihost_call(Machine *m, Cpu *cpu) {
+  Semihost *sh = m->semihost;
+  uint64_t op = cpu->x[10];
+  uint64_t arg[3];
+  for (unsigned i = 0; i < 3; i++) {
+    arg[i] = mem_read64(m, cpu->x[11] + 8 * i);
+  }
+
+  int64_t ret;
+  switch (op) {
+  case SEMIHOST_SYS_OPEN:
+    ret = sys_open(sh, m, arg);
+    break;
+  case SEMIHOST_SYS_CLOSE:
+    ret = sys_close(sh, arg);
+    break;
+  case SEMIHOST_SYS_WRITE:
+    ret = sys_rw(sh, m, arg, true);
+    break;
+  case SEMIHOST_SYS_READ:
+    ret = sys_rw(sh, m, arg, false);
+    break;
+  case SEMIHOST_SYS_SEEK:
+    ret = sys_seek(sh, arg);
+    break;
+  case SEMIHOST_SYS_FLEN:
+    ret = sys_flen(sh, arg);
+    break;
+  case SEMIHOST_SYS_CLOCK:
+    ret = (int64_t)((now_ns() - sh->start_ns) / 10000000ull);
+    break;
+  case SEMIHOST_SYS_ERRNO:
+    ret = sh->last_errno;
+    break;
+  case SEMIHOST_SYS_EXIT:
+  case SEMIHOST_SYS_EXIT_EXTENDED:
+    sys_exit(m, cpu, arg);
+    return;
+  default:
+    ret = fail(sh, ENOSYS);
+    break;
+  }
+  cpu->x[10] = (uint64_t)ret;
+}
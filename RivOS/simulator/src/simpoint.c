@@ -0,0 +1,314 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "rivos_sim/fpu.h"
+#include "rivos_sim/simpoint.h"
+#include "rivos_sim/user.h"
+
+static int point_cmp(const void *a, const void *b) {
+  uint64_t x = ((const SimPoint *)a)->index;
+  uint64_t y = ((const SimPoint *)b)->index;
+  return (x > y) - (x < y);
+}
+
+bool simpoint_load(SimPointPlan *p, const char *prefix, uint64_t interval,
+                   uint64_t warmup, const char *snap_dir) {
+  memset(p, 0, sizeof(*p));
+  p->interval = interval;
+  p->warmup = warmup;
+  p->snap_dir = snap_dir;
+
+  char path[PATH_MAX];
+  snprintf(path, sizeof(path), "%s.simpoints", prefix);
+  FILE *sf = fopen(path, "r");
+  snprintf(path, sizeof(path), "%s.weights", prefix);
+  FILE *wf = fopen(path, "r");
+  int err = sf && wf ? EINVAL : errno;
+  bool ok = sf && wf;
+
+  /* Both files are in cluster order in practice, but match by cluster. */
+  double weights[1024] = {0};
+  double w;
+  unsigned long long idx, cluster;
+  while (ok && fscanf(wf, "%lf %llu", &w, &cluster) == 2) {
+    if (cluster >= sizeof(weights) / sizeof(weights[0])) {
+      ok = false;
+      break;
+    }
+    weights[cluster] = w;
+  }
+  size_t cap = 0;
+  while (ok && fscanf(sf, "%llu %llu", &idx, &cluster) == 2) {
+    if (cluster >= sizeof(weights) / sizeof(weights[0])) {
+      ok = false;
+      break;
+    }
+    if (p->npoints == cap) {
+      cap = cap ? 2 * cap : 16;
+      SimPoint *pts = (SimPoint *)realloc(p->points, cap * sizeof(SimPoint));
+      if (!pts) {
+        ok = false;
+        break;
+      }
+      p->points = pts;
+    }
+    p->points[p->npoints++] = (SimPoint){.index = idx,
+                                         .weight = weights[cluster]};
+  }
+  if (sf) {
+    fclose(sf);
+  }
+  if (wf) {
+    fclose(wf);
+  }
+  if (!ok || p->npoints == 0) {
+    simpoint_free(p);
+    errno = err;
+    return false;
+  }
+  qsort(p->points, p->npoints, sizeof(SimPoint), point_cmp);
+  return true;
+}
+
+void simpoint_free(SimPointPlan *p) {
+  free(p->points);
+  p->points = NULL;
+  p->npoints = 0;
+}
+
+/*
+ * Snapshot layout (host byte order, same simulator build): magic, then u64
+ * position, sizeof(Cpu), ram_base, ram_size, user brk and mmap_low, the
+ * Cpu, and each non-zero RAM page as u64 page number + contents, ended by
+ * UINT64_MAX.
+ */
+static const char snap_magic[8] = {'R', 'V', 'S', 'N', 'A', 'P', '1', 0};
+
+static void snap_path(const SimPointPlan *p, const SimPoint *sp, char *out,
+                      size_t cap) {
+  snprintf(out, cap, "%s/simpoint-%" PRIu64 ".snap", p->snap_dir, sp->index);
+}
+
+static bool page_is_zero(const uint8_t *pg) {
+  static const uint8_t zero[RIVOS_SIM_PAGE_SIZE];
+  return memcmp(pg, zero, RIVOS_SIM_PAGE_SIZE) == 0;
+}
+
+static bool snap_save(const char *path, const Machine *m, Cpu *cpu,
+                      uint64_t pos) {
+  FILE *f = fopen(path, "wb");
+  if (!f) {
+    return false;
+  }
+  fpu_sync(cpu);
+  uint64_t hdr[6] = {pos, sizeof(Cpu), m->ram_base, m->ram_size, 0, 0};
+  if (m->user) {
+    hdr[4] = m->user->brk;
+    hdr[5] = m->user->mmap_low;
+  }
+  bool ok = fwrite(snap_magic, 1, sizeof(snap_magic), f) ==
+                sizeof(snap_magic) &&
+            fwrite(hdr, sizeof(hdr), 1, f) == 1 &&
+            fwrite(cpu, sizeof(*cpu), 1, f) == 1;
+  for (uint64_t pg = 0; ok && pg < machine_page_count(m); pg++) {
+    const uint8_t *data = m->ram + (pg << RIVOS_SIM_PAGE_SHIFT);
+    if (!page_is_zero(data)) {
+      ok = fwrite(&pg, sizeof(pg), 1, f) == 1 &&
+           fwrite(data, RIVOS_SIM_PAGE_SIZE, 1, f) == 1;
+    }
+  }
+  uint64_t end = UINT64_MAX;
+  ok = ok && fwrite(&end, sizeof(end), 1, f) == 1;
+  ok = fclose(f) == 0 && ok;
+  if (!ok) {
+    remove(path);
+  }
+  return ok;
+}
+
+/* False, with the machine untouched, unless the snapshot fits it. */
+static bool snap_load(const char *path, Machine *m, Cpu *cpu, uint64_t pos) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    return false;
+  }
+  char magic[8];
+  uint64_t hdr[6];
+  if (fread(magic, 1, sizeof(magic), f) != sizeof(magic) ||
+      memcmp(magic, snap_magic, sizeof(magic)) != 0 ||
+      fread(hdr, sizeof(hdr), 1, f) != 1 || hdr[0] != pos ||
+      hdr[1] != sizeof(Cpu) || hdr[2] != m->ram_base ||
+      hdr[3] != m->ram_size) {
+    fclose(f);
+    return false;
+  }
+
+  /* Fresh zero pages, as machine_init leaves them. */
+  if (mmap(m->ram, m->ram_size, PROT_READ | PROT_WRITE,
+           MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1,
+           0) == MAP_FAILED) {
+    fclose(f);
+    return false;
+  }
+  bool ok = fread(cpu, sizeof(*cpu), 1, f) == 1;
+  /* Host flags from the run that got here are not the snapshot's. */
+  fpu_discard();
+  uint64_t pg;
+  while (ok && (ok = fread(&pg, sizeof(pg), 1, f) == 1) && pg != UINT64_MAX) {
+    ok = pg < machine_page_count(m) &&
+         fread(m->ram + (pg << RIVOS_SIM_PAGE_SHIFT), RIVOS_SIM_PAGE_SIZE, 1,
+               f) == 1;
+  }
+  fclose(f);
+  if (!ok) {
+    fprintf(stderr, "[simpoint] truncated snapshot %s\n", path);
+    exit(1);
+  }
+  if (m->user) {
+    m->user->brk = hdr[4];
+    m->user->mmap_low = hdr[5];
+  }
+  if (m->dirty) {
+    memset(m->dirty, 0xFF,
+           ((machine_page_count(m) + 63) / 64) * sizeof(uint64_t));
+  }
+  return true;
+}
+
+static bool total_file(const SimPointPlan *p, char *out, size_t cap) {
+  if (!p->snap_dir) {
+    return false;
+  }
+  snprintf(out, cap, "%s/simpoint.total", p->snap_dir);
+  return true;
+}
+
+uint64_t simpoint_run(SimPointPlan *p, Machine *m, Cpu *cpu,
+                      uint64_t max_insns, Timing *t, RunHooks *fast) {
+  RunHooks detail = {.timing = t, .stats = fast ? fast->stats : NULL};
+  uint64_t pos = 0, executed = 0;
+  bool skipped = false;
+  char path[PATH_MAX];
+
+  for (size_t i = 0; i < p->npoints && !cpu->halted; i++) {
+    SimPoint *sp = &p->points[i];
+    uint64_t start = sp->index * p->interval;
+    if (start < pos || start >= max_insns) {
+      continue;
+    }
+    uint64_t warm = start - pos > p->warmup ? start - p->warmup : pos;
+
+    if (p->snap_dir) {
+      snap_path(p, sp, path, sizeof(path));
+    }
+    if (p->snap_dir && warm > pos && snap_load(path, m, cpu, warm)) {
+      sp->restored = true;
+      skipped = true;
+      pos = warm;
+    } else if (warm > pos) {
+      uint64_t n = sim_run(m, cpu, warm - pos, fast);
+      pos += n;
+      executed += n;
+      if (pos < warm) {
+        break;
+      }
+      if (p->snap_dir && !snap_save(path, m, cpu, pos)) {
+        fprintf(stderr, "[simpoint] cannot save %s: %s\n", path,
+                strerror(errno));
+      }
+    }
+
+    uint64_t n = sim_run(m, cpu, start - pos, &detail);
+    pos += n;
+    executed += n;
+    if (pos < start) {
+      break;
+    }
+    uint64_t c0 = t->issue, i0 = t->insns, b0 = t->branch_misses;
+    uint64_t len = max_insns - pos < p->interval ? max_insns - pos
+                                                 : p->interval;
+    n = sim_run(m, cpu, len, &detail);
+    pos += n;
+    executed += n;
+    sp->insns = t->insns - i0;
+    sp->cycles = t->issue - c0;
+    sp->branch_misses = t->branch_misses - b0;
+  }
+
+  /* The tail only tells the program length, which a past run recorded. */
+  FILE *f;
+  if (skipped && total_file(p, path, sizeof(path)) &&
+      (f = fopen(path, "r"))) {
+    unsigned long long total = 0;
+    if (fscanf(f, "%llu", &total) == 1) {
+      p->total = total;
+    }
+    fclose(f);
+    if (p->total) {
+      return executed;
+    }
+  }
+  if (!cpu->halted && pos < max_insns) {
+    uint64_t n = sim_run(m, cpu, max_insns - pos, fast);
+    pos += n;
+    executed += n;
+  }
+  if (cpu->halted && !skipped) {
+    p->total = pos;
+    if (total_file(p, path, sizeof(path)) && (f = fopen(path, "w"))) {
+      fprintf(f, "%" PRIu64 "\n", pos);
+      fclose(f);
+    }
+  }
+  return executed;
+}
+
+static double ratio(uint64_t a, uint64_t b) {
+  return b ? (double)a / (double)b : 0.0;
+}
+
+void simpoint_report(const SimPointPlan *p, FILE *out) {
+  double wsum = 0, cpi = 0, mpki = 0;
+  uint64_t detailed = 0;
+  fprintf(out, "[simpoint] %10s %8s %12s %12s %7s %8s\n", "interval",
+          "weight", "insns", "cycles", "CPI", "br-MPKI");
+  for (size_t i = 0; i < p->npoints; i++) {
+    const SimPoint *sp = &p->points[i];
+    if (!sp->insns) {
+      fprintf(out, "[simpoint] %10" PRIu64 " %8.4f %12s  (not reached)\n",
+              sp->index, sp->weight, "-");
+      continue;
+    }
+    double c = ratio(sp->cycles, sp->insns);
+    double b = 1000.0 * ratio(sp->branch_misses, sp->insns);
+    fprintf(out,
+            "[simpoint] %10" PRIu64 " %8.4f %12" PRIu64 " %12" PRIu64
+            " %7.3f %8.3f%s\n",
+            sp->index, sp->weight, sp->insns, sp->cycles, c, b,
+            sp->restored ? "  (snapshot)" : "");
+    wsum += sp->weight;
+    cpi += sp->weight * c;
+    mpki += sp->weight * b;
+    detailed += sp->insns;
+  }
+  if (wsum == 0) {
+    fprintf(out, "[simpoint] no interval was reached\n");
+    return;
+  }
+  /* Weights of unreached points are shared out among the rest. */
+  cpi /= wsum;
+  mpki /= wsum;
+  fprintf(out, "[simpoint] weighted CPI=%.3f br-MPKI=%.3f (weight %.3f)\n",
+          cpi, mpki, wsum);
+  if (p->total) {
+    fprintf(out,
+            "[simpoint] estimated cycles=%.0f for %" PRIu64
+            " insns, %.2f%% simulated in detail\n",
+            cpi * (double)p->total, p->total,
+            100.0 * ratio(detailed, p->total));
+  }
+}
@@ -0,0 +1,172 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rivos_sim/stats.h"
+
+static const char stats_magic[8] = {'R', 'V', 'S', 'T', 'A', 'T', 'S', 0};
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+bool stats_init(Stats *st, const char *name, const SymbolTable *syms) {
+  memset(st, 0, sizeof(*st));
+  if (name) {
+    snprintf(st->name, sizeof(st->name), "%s%s", name[0] == '/' ? "" : "/",
+             name);
+  } else {
+    snprintf(st->name, sizeof(st->name), "/rivos-sim.%d", (int)getpid());
+  }
+
+  int fd = shm_open(st->name, O_RDWR | O_CREAT | O_TRUNC, 0644);
+  if (fd < 0) {
+    return false;
+  }
+  void *p = MAP_FAILED;
+  if (ftruncate(fd, sizeof(StatsPage)) == 0) {
+    p = mmap(NULL, sizeof(StatsPage), PROT_READ | PROT_WRITE, MAP_SHARED, fd,
+             0);
+  }
+  int err = errno;
+  close(fd);
+  if (p == MAP_FAILED) {
+    shm_unlink(st->name);
+    errno = err;
+    return false;
+  }
+
+  st->page = (StatsPage *)p;
+  st->syms = syms;
+  st->last_mips_ns = now_ns();
+  st->page->version = STATS_VERSION;
+  st->page->pid = (int32_t)getpid();
+  st->page->s.start_ns = st->last_mips_ns;
+  /* Magic last: a reader that sees it sees a fully initialised page. */
+  atomic_thread_fence(memory_order_release);
+  memcpy(st->page->magic, stats_magic, sizeof(stats_magic));
+  return true;
+}
+
+void stats_destroy(Stats *st) {
+  if (st->page) {
+    munmap(st->page, sizeof(StatsPage));
+    shm_unlink(st->name);
+  }
+  st->page = NULL;
+}
+
+void stats_publish(Stats *st, const Machine *m, const Cpu *cpu) {
+  StatsPage *page = st->page;
+  StatsSnapshot s = page->s;
+  uint64_t t = now_ns();
+
+  s.instret = cpu->instret;
+  s.update_ns = t;
+  if (t - st->last_mips_ns >= STATS_MIPS_NS) {
+    s.mips_milli = (cpu->instret - st->last_instret) * 1000ull /
+                   ((t - st->last_mips_ns) / 1000 + 1);
+    st->last_instret = cpu->instret;
+    st->last_mips_ns = t;
+  }
+
+  s.pc = cpu->pc;
+  const Symbol *sym = st->syms ? symtab_lookup(st->syms, cpu->pc) : NULL;
+  if (sym) {
+    snprintf(s.sym, sizeof(s.sym), "%s", sym->name);
+    s.sym_off = cpu->pc - sym->addr;
+  } else {
+    s.sym[0] = '\0';
+    s.sym_off = 0;
+  }
+  s.console_bytes = m->console_bytes;
+  memcpy(s.traps, cpu->traps, sizeof(s.traps));
+  s.halted = cpu->halted;
+
+  uint64_t seq = atomic_load_explicit(&page->seq, memory_order_relaxed);
+  atomic_store_explicit(&page->seq, seq + 1, memory_order_relaxed);
+  atomic_thread_fence(memory_order_release);
+  page->s = s;
+  atomic_store_explicit(&page->seq, seq + 2, memory_order_release);
+}
+
+const StatsPage *stats_attach(const char *name) {
+  char path[64];
+  snprintf(path, sizeof(path), "%s%s", name[0] == '/' ? "" : "/", name);
+  int fd = shm_open(path, O_RDONLY, 0);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat sb;
+  void *p = MAP_FAILED;
+  if (fstat(fd, &sb) == 0 && (size_t)sb.st_size >= sizeof(StatsPage)) {
+    p = mmap(NULL, sizeof(StatsPage), PROT_READ, MAP_SHARED, fd, 0);
+  } else {
+    errno = EINVAL;
+  }
+  int err = errno;
+  close(fd);
+  errno = err;
+  return p == MAP_FAILED ? NULL : (const StatsPage *)p;
+}
+
+void stats_detach(const StatsPage *page) {
+  munmap((void *)page, sizeof(StatsPage));
+}
+
+/* Lock-free on both sides; the reader spins only while a publish is in
+ * flight, which is a few hundred bytes of copying, and gives up if the
+ * writer died half way. */
+bool stats_read(const StatsPage *page, StatsSnapshot *out) {
+  if (memcmp(page->magic, stats_magic, sizeof(stats_magic)) != 0 ||
+      page->version != STATS_VERSION) {
+    return false;
+  }
+  StatsPage *p = (StatsPage *)page;
+  for (int tries = 0; tries < (1 << 20); tries++) {
+    uint64_t seq = atomic_load_explicit(&p->seq, memory_order_acquire);
+    if (seq & 1) {
+      continue;
+    }
+    memcpy(out, (const void *)&page->s, sizeof(*out));
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&p->seq, memory_order_relaxed) == seq) {
+      out->sym[STATS_SYM_LEN - 1] = '\0';
+      return true;
+    }
+  }
+  return false;
+}
+
+const char *stats_trap_name(unsigned slot) {
+  static const char *const names[STATS_TRAP_SLOTS] = {
+      [0] = "fetch-misaligned",
+      [1] = "fetch-fault",
+      [2] = "illegal-insn",
+      [3] = "breakpoint",
+      [4] = "load-misaligned",
+      [5] = "load-fault",
+      [6] = "store-misaligned",
+      [7] = "store-fault",
+      [8] = "ecall-u",
+      [9] = "ecall-s",
+      [11] = "ecall-m",
+      [12] = "fetch-page-fault",
+      [13] = "load-page-fault",
+      [15] = "store-page-fault",
+      [16 + 1] = "irq-s-soft",
+      [16 + 3] = "irq-m-soft",
+      [16 + 5] = "irq-s-timer",
+      [16 + 7] = "irq-m-timer",
+      [16 + 9] = "irq-s-ext",
+      [16 + 11] = "irq-m-ext",
+  };
+  return slot < STATS_TRAP_SLOTS ? names[slot] : NULL;
+}
@@ -0,0 +1,63 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "rivos_sim/symtab.h"
+
+const Symbol *symtab_nearest(const SymbolTable *st, uint64_t addr) {
+  size_t lo = 0;
+  size_t hi = st->count;
+
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (st->syms[mid].addr <= addr) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+
+  return lo ? &st->syms[lo - 1] : NULL;
+}
+
+const Symbol *symtab_lookup(const SymbolTable *st, uint64_t addr) {
+  const Symbol *s = symtab_nearest(st, addr);
+  if (!s || addr - s->addr >= s->size) {
+    return NULL;
+  }
+  return s;
+}
+
+const Symbol *symtab_find(const SymbolTable *st, const char *name) {
+  for (size_t i = 0; i < st->count; i++) {
+    if (strcmp(st->syms[i].name, name) == 0) {
+      return &st->syms[i];
+    }
+  }
+  return NULL;
+}
+
+/* Accepts a symbol name or a numeric address such as 0x80200000. */
+bool symtab_resolve(const SymbolTable *st, const char *spec,
+                    uint64_t *addr_out) {
+  if (spec[0] >= '0' && spec[0] <= '9') {
+    char *end = NULL;
+    *addr_out = strtoull(spec, &end, 0);
+    return *end == '\0';
+  }
+
+  const Symbol *s = symtab_find(st, spec);
+  if (!s) {
+    return false;
+  }
+  *addr_out = s->addr;
+  return true;
+}
+
+void symtab_free(SymbolTable *st) {
+  for (size_t i = 0; i < st->count; i++) {
+    free(st->syms[i].name);
+  }
+  free(st->syms);
+  st->syms = NULL;
+  st->count = 0;
+}
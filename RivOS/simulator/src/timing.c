@@ -0,0 +1,478 @@
+#include <inttypes.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rivos_sim/common.h"
+#include "rivos_sim/timing.h"
+
+typedef enum {
+  IC_ALU,
+  IC_MUL,
+  IC_DIV,
+  IC_LOAD,
+  IC_STORE,
+  IC_BRANCH,
+  IC_JAL,
+  IC_JALR,
+  IC_SYSTEM,
+} InsnClass;
+
+typedef struct {
+  InsnClass cls;
+  uint32_t rd;
+  uint32_t rs1;
+  uint32_t rs2;
+} InsnInfo;
+
+static InsnInfo classify(uint32_t insn) {
+  uint32_t opcode = insn & 0x7F;
+  uint32_t rd = (insn >> 7) & 0x1F;
+  uint32_t funct3 = (insn >> 12) & 0x7;
+  uint32_t rs1 = (insn >> 15) & 0x1F;
+  uint32_t rs2 = (insn >> 20) & 0x1F;
+  uint32_t funct7 = (insn >> 25) & 0x7F;
+
+  InsnInfo ii = {IC_ALU, 0, 0, 0};
+
+  switch (opcode) {
+  case 0x37:
+  case 0x17:
+    ii.rd = rd;
+    break;
+  case 0x6F:
+    ii.cls = IC_JAL;
+    ii.rd = rd;
+    break;
+  case 0x67:
+    ii.cls = IC_JALR;
+    ii.rd = rd;
+    ii.rs1 = rs1;
+    break;
+  case 0x63:
+    ii.cls = IC_BRANCH;
+    ii.rs1 = rs1;
+    ii.rs2 = rs2;
+    break;
+  case 0x03:
+    ii.cls = IC_LOAD;
+    ii.rd = rd;
+    ii.rs1 = rs1;
+    break;
+  case 0x23:
+    ii.cls = IC_STORE;
+    ii.rs1 = rs1;
+    ii.rs2 = rs2;
+    break;
+  case 0x13:
+  case 0x1B:
+    ii.rd = rd;
+    ii.rs1 = rs1;
+    break;
+  case 0x33:
+  case 0x3B:
+    if (funct7 == 0x01) {
+      ii.cls = (funct3 < 4) ? IC_MUL : IC_DIV;
+    }
+    ii.rd = rd;
+    ii.rs1 = rs1;
+    ii.rs2 = rs2;
+    break;
+  case 0x2F:
+    /* An AMO's result comes from memory, like a load's. */
+    ii.cls = IC_LOAD;
+    ii.rd = rd;
+    ii.rs1 = rs1;
+    ii.rs2 = rs2;
+    break;
+  /* F/D: only integer-register dependencies are tracked. */
+  case 0x07:
+    ii.cls = IC_LOAD;
+    ii.rs1 = rs1;
+    break;
+  case 0x27:
+    ii.cls = IC_STORE;
+    ii.rs1 = rs1;
+    break;
+  case 0x43:
+  case 0x47:
+  case 0x4B:
+  case 0x4F:
+    ii.cls = IC_MUL;
+    break;
+  case 0x53:
+    /* fdiv and fsqrt are iterative; everything else is pipelined. */
+    ii.cls = ((funct7 >> 2) == 0x03 || (funct7 >> 2) == 0x0B) ? IC_DIV : IC_MUL;
+    if ((funct7 >> 2) == 0x1E || (funct7 >> 2) == 0x1A) {
+      ii.rs1 = rs1;
+    } else if ((funct7 >> 2) == 0x14 || (funct7 >> 2) == 0x18 ||
+               (funct7 >> 2) == 0x1C) {
+      ii.rd = rd;
+    }
+    break;
+  case 0x57:
+    /* Vector ops: only the scalar operand and vsetvl's rd are tracked. */
+    if (funct3 == 7) {
+      ii.rd = rd;
+    }
+    if (funct3 == 4 || funct3 == 6 || funct3 == 7) {
+      ii.rs1 = rs1;
+    }
+    break;
+  case 0x73:
+    ii.cls = IC_SYSTEM;
+    ii.rd = rd;
+    if (funct3 != 0 && funct3 < 4) {
+      ii.rs1 = rs1;
+    }
+    break;
+  default:
+    ii.cls = IC_SYSTEM;
+    break;
+  }
+
+  return ii;
+}
+
+static inline bool is_link(uint32_t r) { return r == 1 || r == 5; }
+
+static uint64_t branch_offset(uint32_t insn) {
+  uint64_t imm = 0;
+  imm |= (uint64_t)((insn >> 31) & 0x1) << 12;
+  imm |= (uint64_t)((insn >> 25) & 0x3F) << 5;
+  imm |= (uint64_t)((insn >> 8) & 0xF) << 1;
+  imm |= (uint64_t)((insn >> 7) & 0x1) << 11;
+  return sign_extend(imm, 13);
+}
+
+void timing_default_config(TimingConfig *cfg) {
+  cfg->bp = BP_GSHARE;
+  cfg->bp_bits = 12;
+  cfg->ras_depth = 8;
+  cfg->lat.alu = 1;
+  cfg->lat.mul = 3;
+  cfg->lat.div = 34;
+  cfg->lat.load = 3;
+  cfg->lat.store = 1;
+  cfg->lat.system = 4;
+  cfg->lat.taken = 1;
+  cfg->lat.mispredict = 4;
+  cfg->lat.exception = 8;
+}
+
+/* Parses "mul=3,div=20,load=2,..." into the matching latency fields. */
+bool timing_parse_latency(TimingLatency *lat, const char *spec) {
+  static const struct {
+    const char *name;
+    size_t off;
+  } fields[] = {
+      {"alu", offsetof(TimingLatency, alu)},
+      {"mul", offsetof(TimingLatency, mul)},
+      {"div", offsetof(TimingLatency, div)},
+      {"load", offsetof(TimingLatency, load)},
+      {"store", offsetof(TimingLatency, store)},
+      {"system", offsetof(TimingLatency, system)},
+      {"taken", offsetof(TimingLatency, taken)},
+      {"branch", offsetof(TimingLatency, mispredict)},
+      {"mispredict", offsetof(TimingLatency, mispredict)},
+      {"exception", offsetof(TimingLatency, exception)},
+  };
+
+  const char *p = spec;
+  while (*p) {
+    const char *eq = strchr(p, '=');
+    if (!eq) {
+      return false;
+    }
+
+    size_t n = (size_t)(eq - p);
+    char *end = NULL;
+    unsigned long v = strtoul(eq + 1, &end, 0);
+    if (end == eq + 1 || (*end != ',' && *end != '\0')) {
+      return false;
+    }
+
+    bool matched = false;
+    for (size_t i = 0; i < sizeof(fields) / sizeof(fields[0]); i++) {
+      if (strlen(fields[i].name) == n && strncmp(fields[i].name, p, n) == 0) {
+        *(uint32_t *)((char *)lat + fields[i].off) = (uint32_t)v;
+        matched = true;
+        break;
+      }
+    }
+    if (!matched) {
+      return false;
+    }
+
+    p = (*end == ',') ? end + 1 : end;
+  }
+
+  return true;
+}
+
+bool timing_init(Timing *t, const TimingConfig *cfg, const SymbolTable *syms) {
+  memset(t, 0, sizeof(*t));
+  t->cfg = *cfg;
+  t->syms = syms;
+
+  size_t entries = (size_t)1 << cfg->bp_bits;
+  t->counters = (uint8_t *)malloc(entries);
+  t->btb = (uint64_t *)calloc(entries, sizeof(uint64_t));
+  t->ras = (uint64_t *)calloc(cfg->ras_depth ? cfg->ras_depth : 1,
+                              sizeof(uint64_t));
+  t->funcs = (TimingFuncStats *)calloc(syms->count + 1,
+                                       sizeof(TimingFuncStats));
+  if (!t->counters || !t->btb || !t->ras || !t->funcs) {
+    timing_destroy(t);
+    return false;
+  }
+
+  /* Weakly taken, so loop back-edges warm up quickly. */
+  memset(t->counters, 2, entries);
+  return true;
+}
+
+void timing_destroy(Timing *t) {
+  free(t->counters);
+  free(t->btb);
+  free(t->ras);
+  free(t->funcs);
+  t->counters = NULL;
+  t->btb = NULL;
+  t->ras = NULL;
+  t->funcs = NULL;
+}
+
+static bool predict_branch(Timing *t, uint64_t pc, uint64_t target,
+                           bool taken) {
+  if (t->cfg.bp == BP_STATIC) {
+    /* Backward taken, forward not taken. */
+    return (target < pc) == taken;
+  }
+
+  uint32_t mask = (1u << t->cfg.bp_bits) - 1;
+  uint32_t idx = (uint32_t)(pc >> 2);
+  if (t->cfg.bp == BP_GSHARE) {
+    idx ^= t->ghr;
+  }
+  idx &= mask;
+
+  uint8_t *c = &t->counters[idx];
+  bool pred = *c >= 2;
+  if (taken) {
+    if (*c < 3)
+      (*c)++;
+  } else {
+    if (*c > 0)
+      (*c)--;
+  }
+
+  t->ghr = ((t->ghr << 1) | (taken ? 1u : 0u)) & mask;
+  return pred == taken;
+}
+
+static void ras_push(Timing *t, uint64_t ret) {
+  if (t->cfg.ras_depth == 0) {
+    return;
+  }
+  t->ras_top = (t->ras_top + 1) % t->cfg.ras_depth;
+  t->ras[t->ras_top] = ret;
+  if (t->ras_count < t->cfg.ras_depth) {
+    t->ras_count++;
+  }
+}
+
+static bool ras_pop(Timing *t, uint64_t *ret) {
+  if (t->ras_count == 0) {
+    return false;
+  }
+  *ret = t->ras[t->ras_top];
+  t->ras_top = (t->ras_top + t->cfg.ras_depth - 1) % t->cfg.ras_depth;
+  t->ras_count--;
+  return true;
+}
+
+static TimingFuncStats *func_stats(Timing *t, uint64_t pc) {
+  const Symbol *s = t->cur_sym;
+  if (s && pc - s->addr < s->size) {
+    return t->cur_stats;
+  }
+
+  s = symtab_lookup(t->syms, pc);
+  t->cur_sym = s;
+  t->cur_stats = s ? &t->funcs[s - t->syms->syms] : &t->funcs[t->syms->count];
+  return t->cur_stats;
+}
+
+void timing_retire(Timing *t, uint64_t pc, uint32_t insn, uint64_t next_pc) {
+  const TimingLatency *lat = &t->cfg.lat;
+  InsnInfo ii = classify(insn);
+
+  uint64_t issue = t->next_issue;
+  uint32_t src = t->ready[ii.rs1] > t->ready[ii.rs2] ? ii.rs1 : ii.rs2;
+  if (t->ready[src] > issue) {
+    if (t->from_load & (1u << src)) {
+      t->load_use_stalls += t->ready[src] - issue;
+    }
+    issue = t->ready[src];
+  }
+  if (ii.cls == IC_DIV && t->div_free > issue) {
+    issue = t->div_free;
+  }
+
+  uint64_t redirect = 0;
+  uint64_t fallthrough = pc + 4;
+  bool control = false;
+
+  switch (ii.cls) {
+  case IC_MUL:
+    t->ready[ii.rd] = issue + lat->mul;
+    break;
+  case IC_DIV:
+    t->ready[ii.rd] = issue + lat->div;
+    t->div_free = issue + lat->div;
+    break;
+  case IC_LOAD:
+    t->ready[ii.rd] = issue + lat->load;
+    break;
+  case IC_STORE:
+    redirect = lat->store > 1 ? lat->store - 1 : 0;
+    break;
+  case IC_BRANCH: {
+    control = true;
+    bool taken = next_pc != fallthrough;
+    uint64_t target = pc + branch_offset(insn);
+    t->branches++;
+    if (!predict_branch(t, pc, target, taken)) {
+      t->branch_misses++;
+      redirect = lat->mispredict;
+    } else if (taken) {
+      redirect = lat->taken;
+    }
+    break;
+  }
+  case IC_JAL:
+    control = true;
+    t->ready[ii.rd] = issue + lat->alu;
+    if (is_link(ii.rd)) {
+      ras_push(t, fallthrough);
+    }
+    redirect = lat->taken;
+    break;
+  case IC_JALR: {
+    control = true;
+    t->jumps++;
+    t->ready[ii.rd] = issue + lat->alu;
+
+    uint64_t predicted = 0;
+    bool have = false;
+    if (ii.rd == 0 && is_link(ii.rs1)) {
+      have = ras_pop(t, &predicted);
+      if (have && predicted == next_pc) {
+        t->ras_hits++;
+      } else {
+        t->ras_misses++;
+      }
+    } else {
+      uint32_t idx = (uint32_t)(pc >> 2) & ((1u << t->cfg.bp_bits) - 1);
+      predicted = t->btb[idx];
+      have = true;
+      t->btb[idx] = next_pc;
+    }
+    if (is_link(ii.rd)) {
+      ras_push(t, fallthrough);
+    }
+
+    if (!have || predicted != next_pc) {
+      t->jump_misses++;
+      redirect = lat->mispredict;
+    } else {
+      redirect = lat->taken;
+    }
+    break;
+  }
+  case IC_SYSTEM:
+    t->ready[ii.rd] = issue + lat->system;
+    redirect = lat->system > 1 ? lat->system - 1 : 0;
+    break;
+  default:
+    t->ready[ii.rd] = issue + lat->alu;
+    break;
+  }
+  t->ready[0] = 0;
+  t->from_load &= ~(1u << ii.rd);
+  if (ii.cls == IC_LOAD && ii.rd) {
+    t->from_load |= 1u << ii.rd;
+  }
+
+  /* Any other non-sequential PC is a trap: flush the pipeline. */
+  if (!control && next_pc != fallthrough) {
+    t->exceptions++;
+    redirect = lat->exception;
+  }
+
+  TimingFuncStats *fs = func_stats(t, pc);
+  fs->insns++;
+  fs->cycles += issue + 1 + redirect - t->issue;
+
+  t->insns++;
+  t->issue = issue + 1 + redirect;
+  t->next_issue = t->issue;
+}
+
+static int func_cmp(const void *a, const void *b) {
+  const TimingFuncStats *fa = *(const TimingFuncStats *const *)a;
+  const TimingFuncStats *fb = *(const TimingFuncStats *const *)b;
+  if (fa->cycles != fb->cycles) {
+    return (fa->cycles > fb->cycles) ? -1 : 1;
+  }
+  return 0;
+}
+
+static double ratio(uint64_t num, uint64_t den) {
+  return den ? (double)num / (double)den : 0.0;
+}
+
+void timing_report(const Timing *t, FILE *out) {
+  static const char *const bp_names[] = {"static", "bimodal", "gshare"};
+
+  fprintf(out,
+          "[timing] insns=%" PRIu64 " cycles=%" PRIu64 " CPI=%.3f\n"
+          "[timing] predictor=%s branches=%" PRIu64 " mispredicts=%" PRIu64
+          " (%.2f%%) load-use stalls=%" PRIu64 "\n"
+          "[timing] indirect=%" PRIu64 " mispredicts=%" PRIu64
+          " ras hits=%" PRIu64 " misses=%" PRIu64 " exceptions=%" PRIu64 "\n",
+          t->insns, t->issue, ratio(t->issue, t->insns), bp_names[t->cfg.bp],
+          t->branches, t->branch_misses,
+          100.0 * ratio(t->branch_misses, t->branches), t->load_use_stalls,
+          t->jumps, t->jump_misses, t->ras_hits, t->ras_misses,
+          t->exceptions);
+
+  size_t n = t->syms->count + 1;
+  const TimingFuncStats **order =
+      (const TimingFuncStats **)malloc(n * sizeof(*order));
+  if (!order) {
+    return;
+  }
+
+  size_t used = 0;
+  for (size_t i = 0; i < n; i++) {
+    if (t->funcs[i].insns) {
+      order[used++] = &t->funcs[i];
+    }
+  }
+  qsort(order, used, sizeof(*order), func_cmp);
+
+  fprintf(out, "[timing] %14s %14s %7s %6s  %s\n", "cycles", "insns", "CPI",
+          "%cyc", "function");
+  for (size_t i = 0; i < used; i++) {
+    size_t idx = (size_t)(order[i] - t->funcs);
+    const char *name = idx < t->syms->count ? t->syms->syms[idx].name : "?";
+    fprintf(out, "[timing] %14" PRIu64 " %14" PRIu64 " %7.3f %5.1f%%  %s\n",
+            order[i]->cycles, order[i]->insns,
+            ratio(order[i]->cycles, order[i]->insns),
+            100.0 * ratio(order[i]->cycles, t->issue), name);
+  }
+
+  free(order);
+}
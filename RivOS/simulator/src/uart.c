@@ -0,0 +1,371 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "rivos_sim/devworker.h"
+#include "rivos_sim/spsc.h"
+#include "rivos_sim/uart.h"
+
+enum {
+  UART_RBR = 0, /* THR on write, DLL with DLAB */
+  UART_IER = 1, /* DLM with DLAB */
+  UART_IIR = 2, /* FCR on write */
+  UART_LCR = 3,
+  UART_MCR = 4,
+  UART_LSR = 5,
+  UART_MSR = 6,
+  UART_SCR = 7,
+};
+
+enum {
+  IER_RDI = 0x01,
+  IER_THRI = 0x02,
+  LCR_DLAB = 0x80,
+  LSR_DR = 0x01,
+  LSR_THRE = 0x20,
+  LSR_TEMT = 0x40,
+  IIR_NO_INT = 0x01,
+  IIR_THRI = 0x02,
+  IIR_RDI = 0x04,
+  IIR_FIFO = 0xc0,
+};
+
+enum {
+  UART_RX_RING = 1 << 16,
+  UART_TX_BUF = 4096,
+  UART_MMIO_SIZE = 0x100,
+};
+
+typedef struct Uart {
+  SpscRing rx;
+  Machine *m;
+  _Atomic uint8_t ier;
+  uint8_t lcr;
+  uint8_t mcr;
+  uint8_t scr;
+  uint8_t dll;
+  uint8_t dlm;
+  bool thre_ip;
+
+  int in_fd;
+  int wake[2];
+  bool reader_live;
+  pthread_t reader;
+  bool tty_saved;
+  struct termios tty;
+
+  /* Transmit: bytes go to a writer thread, which batches them. */
+  DevWorker tx;
+  size_t tx_len;
+  uint8_t tx_buf[UART_TX_BUF];
+} Uart;
+
+static bool rx_irq(Uart *u) {
+  return (atomic_load(&u->ier) & IER_RDI) && !spsc_empty(&u->rx);
+}
+
+/* CPU thread only. The reader thread may raise the line between the
+ * computation and the store, so re-check receive after lowering it. */
+static void update_irq(Uart *u) {
+  bool level = rx_irq(u) || ((atomic_load(&u->ier) & IER_THRI) && u->thre_ip);
+  machine_set_irq(u->m, RIVOS_SIM_UART_IRQ, level);
+  if (!level && rx_irq(u)) {
+    machine_set_irq(u->m, RIVOS_SIM_UART_IRQ, true);
+  }
+}
+
+static void tx_flush(DevWorker *w) {
+  Uart *u = (Uart *)w->opaque;
+  for (size_t done = 0; done < u->tx_len;) {
+    ssize_t n = write(STDOUT_FILENO, u->tx_buf + done, u->tx_len - done);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+    done += (size_t)n;
+  }
+  u->tx_len = 0;
+}
+
+static void tx_byte(DevWorker *w, uint64_t ch) {
+  Uart *u = (Uart *)w->opaque;
+  u->tx_buf[u->tx_len++] = (uint8_t)ch;
+  if (u->tx_len == UART_TX_BUF) {
+    tx_flush(w);
+  }
+}
+
+static const DevWorkerOps tx_ops = {
+    .work = tx_byte,
+    .idle = tx_flush,
+};
+
+void uart_tx(Machine *m, uint8_t ch) {
+  m->console_bytes++;
+  if (m->console_muted) {
+    return;
+  }
+  if (m->uart->tx.live) {
+    devworker_ring(&m->uart->tx, ch);
+  } else {
+    putchar((int)ch);
+    fflush(stdout);
+  }
+}
+
+void uart_flush(Machine *m) {
+  devworker_quiesce(&m->uart->tx, true);
+}
+
+int uart_rx(Machine *m) {
+  Uart *u = m->uart;
+  uint8_t ch;
+  if (!spsc_pop(&u->rx, &ch)) {
+    return -1;
+  }
+  update_irq(u);
+  return ch;
+}
+
+void uart_save(Machine *m, UartRegs *r) {
+  Uart *u = m->uart;
+  r->ier = atomic_load(&u->ier);
+  r->lcr = u->lcr;
+  r->mcr = u->mcr;
+  r->scr = u->scr;
+  r->dll = u->dll;
+  r->dlm = u->dlm;
+  r->thre_ip = u->thre_ip;
+}
+
+void uart_restore(Machine *m, const UartRegs *r) {
+  Uart *u = m->uart;
+  atomic_store(&u->ier, r->ier);
+  u->lcr = r->lcr;
+  u->mcr = r->mcr;
+  u->scr = r->scr;
+  u->dll = r->dll;
+  u->dlm = r->dlm;
+  u->thre_ip = r->thre_ip;
+  update_irq(u);
+}
+
+static uint64_t uart_read(void *opaque, uint64_t off, unsigned size) {
+  Uart *u = (Uart *)opaque;
+  (void)size;
+
+  switch (off) {
+  case UART_RBR:
+    if (u->lcr & LCR_DLAB) {
+      return u->dll;
+    } else {
+      int ch = uart_rx(u->m);
+      return ch < 0 ? 0 : (uint64_t)ch;
+    }
+  case UART_IER:
+    return (u->lcr & LCR_DLAB) ? u->dlm : atomic_load(&u->ier);
+  case UART_IIR: {
+    uint8_t iir = IIR_FIFO | IIR_NO_INT;
+    if (rx_irq(u)) {
+      iir = IIR_FIFO | IIR_RDI;
+    } else if ((atomic_load(&u->ier) & IER_THRI) && u->thre_ip) {
+      iir = IIR_FIFO | IIR_THRI;
+      u->thre_ip = false;
+      update_irq(u);
+    }
+    return iir;
+  }
+  case UART_LCR:
+    return u->lcr;
+  case UART_MCR:
+    return u->mcr;
+  case UART_LSR:
+    return LSR_THRE | LSR_TEMT | (spsc_empty(&u->rx) ? 0 : LSR_DR);
+  case UART_MSR:
+    return 0xb0; /* CTS, DSR, DCD */
+  case UART_SCR:
+    return u->scr;
+  default:
+    return 0;
+  }
+}
+
+static void uart_write(void *opaque, uint64_t off, unsigned size,
+                       uint64_t val) {
+  Uart *u = (Uart *)opaque;
+  uint8_t v = (uint8_t)val;
+  (void)size;
+
+  switch (off) {
+  case UART_RBR:
+    if (u->lcr & LCR_DLAB) {
+      u->dll = v;
+    } else {
+      uart_tx(u->m, v);
+      u->thre_ip = true;
+      update_irq(u);
+    }
+    break;
+  case UART_IER:
+    if (u->lcr & LCR_DLAB) {
+      u->dlm = v;
+    } else {
+      uint8_t old = atomic_exchange(&u->ier, v & 0x0f);
+      if ((v & IER_THRI) && !(old & IER_THRI)) {
+        u->thre_ip = true;
+      }
+      update_irq(u);
+    }
+    break;
+  case UART_LCR:
+    u->lcr = v;
+    break;
+  case UART_MCR:
+    u->mcr = v;
+    break;
+  case UART_SCR:
+    u->scr = v;
+    break;
+  default:
+    break;
+  }
+}
+
+static void *reader_main(void *arg) {
+  Uart *u = (Uart *)arg;
+  uint8_t buf[4096];
+  struct pollfd fds[2] = {{u->in_fd, POLLIN, 0}, {u->wake[0], POLLIN, 0}};
+
+  for (;;) {
+    if (poll(fds, 2, -1) < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      break;
+    }
+    if (fds[1].revents) {
+      break;
+    }
+    ssize_t n = read(u->in_fd, buf, sizeof(buf));
+    if (n < 0 && (errno == EINTR || errno == EAGAIN)) {
+      continue;
+    }
+    if (n <= 0) {
+      break;
+    }
+
+    for (size_t done = 0; done < (size_t)n;) {
+      size_t k = spsc_push(&u->rx, buf + done, (size_t)n - done);
+      done += k;
+      if (atomic_load(&u->ier) & IER_RDI) {
+        machine_set_irq(u->m, RIVOS_SIM_UART_IRQ, true);
+      }
+      if (done < (size_t)n) {
+        /* FIFO full: the guest is behind; wait for it or for shutdown. */
+        if (poll(&fds[1], 1, 1) > 0) {
+          goto out;
+        }
+      }
+    }
+  }
+out:
+  machine_release_irq_source(u->m);
+  return NULL;
+}
+
+static void uart_destroy(void *opaque) {
+  Uart *u = (Uart *)opaque;
+  devworker_stop(&u->tx);
+  if (u->reader_live) {
+    (void)!write(u->wake[1], "", 1);
+    pthread_join(u->reader, NULL);
+    close(u->wake[0]);
+    close(u->wake[1]);
+  }
+  if (u->tty_saved) {
+    tcsetattr(u->in_fd, TCSANOW, &u->tty);
+  }
+  if (u->in_fd > STDIN_FILENO) {
+    close(u->in_fd);
+  }
+  spsc_destroy(&u->rx);
+  free(u);
+}
+
+bool uart_add(Machine *m) {
+  size_t sz = (sizeof(Uart) + 63) & ~(size_t)63;
+  Uart *u = (Uart *)aligned_alloc(64, sz);
+  if (!u) {
+    return false;
+  }
+  memset(u, 0, sizeof(*u));
+  u->m = m;
+  u->in_fd = -1;
+  if (!spsc_init(&u->rx, UART_RX_RING)) {
+    free(u);
+    return false;
+  }
+
+  MmioRegion r = {
+      .base = RIVOS_SIM_UART16550_BASE,
+      .size = UART_MMIO_SIZE,
+      .opaque = u,
+      .read = uart_read,
+      .write = uart_write,
+      .destroy = uart_destroy,
+  };
+  if (!machine_add_mmio(m, &r)) {
+    spsc_destroy(&u->rx);
+    free(u);
+    return false;
+  }
+  m->uart = u;
+  if (!devworker_start(&u->tx, m, &tx_ops, u)) {
+    fprintf(stderr, "[rivos-sim] no UART writer thread: %s\n",
+            strerror(errno));
+  }
+  return true;
+}
+
+bool uart_start_input(Machine *m, const char *path) {
+  Uart *u = m->uart;
+  if (u->reader_live) {
+    errno = EBUSY;
+    return false;
+  }
+
+  u->in_fd = strcmp(path, "-") == 0 ? STDIN_FILENO : open(path, O_RDONLY);
+  if (u->in_fd < 0) {
+    return false;
+  }
+  if (pipe(u->wake) != 0) {
+    return false;
+  }
+
+  if (isatty(u->in_fd) && tcgetattr(u->in_fd, &u->tty) == 0) {
+    struct termios raw = u->tty;
+    raw.c_lflag &= ~(tcflag_t)(ICANON | ECHO);
+    raw.c_iflag &= ~(tcflag_t)ICRNL;
+    raw.c_cc[VMIN] = 1;
+    raw.c_cc[VTIME] = 0;
+    u->tty_saved = tcsetattr(u->in_fd, TCSANOW, &raw) == 0;
+  }
+
+  machine_hold_irq_source(m);
+  if (pthread_create(&u->reader, NULL, reader_main, u) != 0) {
+    machine_release_irq_source(m);
+    close(u->wake[0]);
+    close(u->wake[1]);
+    return false;
+  }
+  u->reader_live = true;
+  return true;
+}
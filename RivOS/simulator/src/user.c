@@ -0,0 +1,1036 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/random.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/times.h>
+#include <sys/uio.h>
+#include <sys/utsname.h>
+#include <termios.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rivos_sim/common.h"
+#include "rivos_sim/csr.h"
+#include "rivos_sim/elf.h"
+#include "rivos_sim/mem.h"
+#include "rivos_sim/user.h"
+
+/* riscv64 system call numbers (asm-generic). */
+enum {
+  NR_GETCWD = 17,
+  NR_DUP = 23,
+  NR_DUP3 = 24,
+  NR_FCNTL = 25,
+  NR_IOCTL = 29,
+  NR_MKDIRAT = 34,
+  NR_UNLINKAT = 35,
+  NR_FTRUNCATE = 46,
+  NR_FACCESSAT = 48,
+  NR_CHDIR = 49,
+  NR_OPENAT = 56,
+  NR_CLOSE = 57,
+  NR_PIPE2 = 59,
+  NR_GETDENTS64 = 61,
+  NR_LSEEK = 62,
+  NR_READ = 63,
+  NR_WRITE = 64,
+  NR_READV = 65,
+  NR_WRITEV = 66,
+  NR_PREAD64 = 67,
+  NR_PWRITE64 = 68,
+  NR_READLINKAT = 78,
+  NR_NEWFSTATAT = 79,
+  NR_FSTAT = 80,
+  NR_FSYNC = 82,
+  NR_EXIT = 93,
+  NR_EXIT_GROUP = 94,
+  NR_SET_TID_ADDRESS = 96,
+  NR_FUTEX = 98,
+  NR_SET_ROBUST_LIST = 99,
+  NR_NANOSLEEP = 101,
+  NR_CLOCK_GETTIME = 113,
+  NR_CLOCK_GETRES = 114,
+  NR_CLOCK_NANOSLEEP = 115,
+  NR_SCHED_GETAFFINITY = 123,
+  NR_SCHED_YIELD = 124,
+  NR_KILL = 129,
+  NR_TKILL = 130,
+  NR_TGKILL = 131,
+  NR_SIGALTSTACK = 132,
+  NR_RT_SIGACTION = 134,
+  NR_RT_SIGPROCMASK = 135,
+  NR_TIMES = 153,
+  NR_UNAME = 160,
+  NR_GETRLIMIT = 163,
+  NR_UMASK = 166,
+  NR_PRCTL = 167,
+  NR_GETTIMEOFDAY = 169,
+  NR_GETPID = 172,
+  NR_GETPPID = 173,
+  NR_GETUID = 174,
+  NR_GETEUID = 175,
+  NR_GETGID = 176,
+  NR_GETEGID = 177,
+  NR_GETTID = 178,
+  NR_BRK = 214,
+  NR_MUNMAP = 215,
+  NR_MREMAP = 216,
+  NR_MMAP = 222,
+  NR_MPROTECT = 226,
+  NR_MADVISE = 233,
+  NR_RISCV_FLUSH_ICACHE = 259,
+  NR_PRLIMIT64 = 261,
+  NR_GETRANDOM = 278,
+};
+
+/* Guest ABI constants where a host may differ. */
+enum {
+  G_MAP_FIXED = 0x10,
+  G_MAP_ANONYMOUS = 0x20,
+  G_MAP_FIXED_NOREPLACE = 0x100000,
+  G_MADV_DONTNEED = 4,
+  G_RLIMIT_STACK = 3,
+  G_RLIMIT_NOFILE = 7,
+  G_TCGETS = 0x5401,
+  G_TCSETS = 0x5402,
+  G_TCSETSW = 0x5403,
+  G_TCSETSF = 0x5404,
+  G_TIOCGWINSZ = 0x5413,
+  G_F_GETFL = 3,
+  G_F_SETFL = 4,
+  /* Kernel struct termios: four flag words, c_line and 19 control chars. */
+  G_TERMIOS_SIZE = 36,
+  G_NCCS = 19,
+  G_STAT_SIZE = 128,
+};
+
+enum {
+  AT_NULL = 0,
+  AT_PHDR = 3,
+  AT_PHENT = 4,
+  AT_PHNUM = 5,
+  AT_PAGESZ = 6,
+  AT_BASE = 7,
+  AT_FLAGS = 8,
+  AT_ENTRY = 9,
+  AT_UID = 11,
+  AT_EUID = 12,
+  AT_GID = 13,
+  AT_EGID = 14,
+  AT_HWCAP = 16,
+  AT_CLKTCK = 17,
+  AT_SECURE = 23,
+  AT_RANDOM = 25,
+  AT_EXECFN = 31,
+};
+
+static const struct {
+  int guest;
+  int host;
+} open_flags[] = {
+    {000000100, O_CREAT},     {000000200, O_EXCL},
+    {000000400, O_NOCTTY},    {000001000, O_TRUNC},
+    {000002000, O_APPEND},    {000004000, O_NONBLOCK},
+    {000010000, O_DSYNC},     {000020000, O_ASYNC},
+    {000040000, O_DIRECT},    {000200000, O_DIRECTORY},
+    {000400000, O_NOFOLLOW},  {001000000, O_NOATIME},
+    {002000000, O_CLOEXEC},   {004010000, O_SYNC},
+    {010000000, O_PATH},      {020200000, O_TMPFILE},
+};
+
+static int host_open_flags(uint64_t g) {
+  int h = (int)(g & 3); /* O_RDONLY, O_WRONLY, O_RDWR */
+  for (size_t i = 0; i < sizeof(open_flags) / sizeof(open_flags[0]); i++) {
+    if (((int)g & open_flags[i].guest) == open_flags[i].guest) {
+      h |= open_flags[i].host;
+    }
+  }
+  return h;
+}
+
+static int guest_open_flags(int h) {
+  int g = h & O_ACCMODE;
+  for (size_t i = 0; i < sizeof(open_flags) / sizeof(open_flags[0]); i++) {
+    if ((h & open_flags[i].host) == open_flags[i].host) {
+      g |= open_flags[i].guest;
+    }
+  }
+  return g;
+}
+
+static void put_u32(uint8_t *p, uint32_t v) {
+  for (unsigned i = 0; i < 4; i++) {
+    p[i] = (uint8_t)(v >> (8 * i));
+  }
+}
+
+static void put_u64(uint8_t *p, uint64_t v) {
+  put_u32(p, (uint32_t)v);
+  put_u32(p + 4, (uint32_t)(v >> 32));
+}
+
+static uint64_t page_up(uint64_t x) {
+  return (x + RIVOS_SIM_PAGE_SIZE - 1) & ~(uint64_t)(RIVOS_SIM_PAGE_SIZE - 1);
+}
+
+/* Result of a host call: the value, or -errno when it failed. */
+static int64_t host_ret(int64_t r) {
+  return r < 0 ? -(int64_t)errno : r;
+}
+
+static uint8_t *guest_ptr(User *u, uint64_t addr, uint64_t len) {
+  return mem_ram_ptr(u->m, addr, len);
+}
+
+static bool copy_out(User *u, uint64_t addr, const void *src, size_t len) {
+  uint8_t *p = guest_ptr(u, addr, len);
+  if (!p) {
+    return false;
+  }
+  memcpy(p, src, len);
+  mem_mark_dirty(u->m, addr, len);
+  return true;
+}
+
+static bool copy_in(User *u, void *dst, uint64_t addr, size_t len) {
+  const uint8_t *p = guest_ptr(u, addr, len);
+  if (!p) {
+    return false;
+  }
+  memcpy(dst, p, len);
+  return true;
+}
+
+/* Copies a NUL-terminated guest string; returns 0 or -errno. */
+static int64_t guest_path(User *u, uint64_t addr, char *out, size_t cap) {
+  const uint8_t *p = guest_ptr(u, addr, 1);
+  if (!p) {
+    return -EFAULT;
+  }
+  uint64_t avail = u->m->ram_size - addr;
+  const uint8_t *nul = memchr(p, 0, avail < cap ? (size_t)avail : cap);
+  if (!nul) {
+    return avail < cap ? -EFAULT : -ENAMETOOLONG;
+  }
+  memcpy(out, p, (size_t)(nul - p) + 1);
+  return 0;
+}
+
+static bool get_timespec(User *u, uint64_t addr, struct timespec *ts) {
+  uint8_t b[16];
+  if (!copy_in(u, b, addr, sizeof(b))) {
+    return false;
+  }
+  ts->tv_sec = (time_t)read_u64_le(b);
+  ts->tv_nsec = (long)read_u64_le(b + 8);
+  return true;
+}
+
+static bool put_timespec(User *u, uint64_t addr, const struct timespec *ts) {
+  uint8_t b[16];
+  put_u64(b, (uint64_t)ts->tv_sec);
+  put_u64(b + 8, (uint64_t)ts->tv_nsec);
+  return copy_out(u, addr, b, sizeof(b));
+}
+
+/* Initial stack */
+
+static uint64_t push(User *u, uint64_t *sp, const void *src, size_t len) {
+  *sp -= len;
+  memcpy(u->m->ram + *sp, src, len);
+  return *sp;
+}
+
+bool user_load(User *u, Machine *m, const char *path, int argc, char **argv,
+               char **envp) {
+  memset(u, 0, sizeof(*u));
+  u->m = m;
+  u->exe = path;
+  if (m->ram_base != 0 || m->ram_size < 2 * USER_STACK_SIZE) {
+    errno = EINVAL;
+    return false;
+  }
+
+  ElfUserImage img;
+  if (!load_elf_user(m, path, USER_DYN_BASE, &img)) {
+    return false;
+  }
+  uint64_t top = m->ram_size;
+  u->entry = img.entry;
+  u->brk_start = u->brk = img.end;
+  u->mmap_low = top - USER_STACK_SIZE;
+  if (img.end > u->mmap_low) {
+    errno = ENOMEM;
+    return false;
+  }
+
+  int envc = 0;
+  size_t strings = strlen(path) + 1;
+  for (int i = 0; i < argc; i++) {
+    strings += strlen(argv[i]) + 1;
+  }
+  for (; envp && envp[envc]; envc++) {
+    strings += strlen(envp[envc]) + 1;
+  }
+  if (strings + 8 * ((size_t)argc + (size_t)envc + 64) >
+      USER_STACK_SIZE / 4) {
+    errno = E2BIG;
+    return false;
+  }
+
+  uint64_t sp = top;
+  uint64_t execfn = push(u, &sp, path, strlen(path) + 1);
+  uint64_t *env_at = (uint64_t *)calloc((size_t)envc + 1, sizeof(uint64_t));
+  uint64_t *arg_at = (uint64_t *)calloc((size_t)argc + 1, sizeof(uint64_t));
+  if (!env_at || !arg_at) {
+    free(env_at);
+    free(arg_at);
+    errno = ENOMEM;
+    return false;
+  }
+  for (int i = envc - 1; i >= 0; i--) {
+    env_at[i] = push(u, &sp, envp[i], strlen(envp[i]) + 1);
+  }
+  for (int i = argc - 1; i >= 0; i--) {
+    arg_at[i] = push(u, &sp, argv[i], strlen(argv[i]) + 1);
+  }
+  uint8_t rnd[16];
+  if (getrandom(rnd, sizeof(rnd), 0) != (ssize_t)sizeof(rnd)) {
+    memset(rnd, 0x5a, sizeof(rnd));
+  }
+  uint64_t random_at = push(u, &sp, rnd, sizeof(rnd));
+
+  const uint64_t hwcap = 1u << ('i' - 'a') | 1u << ('m' - 'a') |
+                         1u << ('a' - 'a') | 1u << ('f' - 'a') |
+                         1u << ('d' - 'a') | 1u << ('v' - 'a');
+  const uint64_t auxv[][2] = {
+      {AT_PHDR, img.phdr},       {AT_PHENT, img.phent},
+      {AT_PHNUM, img.phnum},     {AT_PAGESZ, RIVOS_SIM_PAGE_SIZE},
+      {AT_BASE, 0},              {AT_FLAGS, 0},
+      {AT_ENTRY, img.entry},     {AT_UID, getuid()},
+      {AT_EUID, geteuid()},      {AT_GID, getgid()},
+      {AT_EGID, getegid()},      {AT_HWCAP, hwcap},
+      {AT_CLKTCK, 100},          {AT_SECURE, 0},
+      {AT_RANDOM, random_at},    {AT_EXECFN, execfn},
+      {AT_NULL, 0},
+  };
+
+  size_t nwords = 1 + (size_t)argc + 1 + (size_t)envc + 1 +
+                  sizeof(auxv) / sizeof(uint64_t);
+  sp = (sp - 8 * nwords) & ~(uint64_t)15;
+  uint8_t *p = m->ram + sp;
+  put_u64(p, (uint64_t)argc);
+  p += 8;
+  for (int i = 0; i <= argc; i++, p += 8) {
+    put_u64(p, arg_at[i]);
+  }
+  for (int i = 0; i <= envc; i++, p += 8) {
+    put_u64(p, env_at[i]);
+  }
+  for (size_t i = 0; i < sizeof(auxv) / sizeof(auxv[0]); i++, p += 16) {
+    put_u64(p, auxv[i][0]);
+    put_u64(p + 8, auxv[i][1]);
+  }
+  free(env_at);
+  free(arg_at);
+  mem_mark_dirty(m, sp, top - sp);
+  u->sp = sp;
+  return true;
+}
+
+void user_start(User *u, Cpu *cpu) {
+  cpu->x[2] = u->sp;
+  cpu->linux_user = true;
+  /* rdcycle, rdtime and rdinstret are usable from U-mode, as on Linux. */
+  cpu->csr[CSR_SCOUNTEREN] = 7;
+  u->m->user = u;
+}
+
+/* Memory */
+
+static int64_t sys_brk(User *u, uint64_t addr) {
+  if (addr < u->brk_start || addr > u->mmap_low) {
+    return (int64_t)u->brk;
+  }
+  if (addr > u->brk) {
+    memset(u->m->ram + u->brk, 0, (size_t)(addr - u->brk));
+    mem_mark_dirty(u->m, u->brk, addr - u->brk);
+  }
+  u->brk = addr;
+  return (int64_t)u->brk;
+}
+
+static int64_t sys_mmap(User *u, const uint64_t *a) {
+  uint64_t addr = a[0];
+  uint64_t len = page_up(a[1]);
+  uint64_t flags = a[3];
+  int fd = (int)a[4];
+  uint64_t off = a[5];
+  if (a[1] == 0 || len < a[1] || (off & (RIVOS_SIM_PAGE_SIZE - 1))) {
+    return -EINVAL;
+  }
+
+  uint64_t start;
+  if (flags & (G_MAP_FIXED | G_MAP_FIXED_NOREPLACE)) {
+    if ((addr & (RIVOS_SIM_PAGE_SIZE - 1)) || !guest_ptr(u, addr, len)) {
+      return -EINVAL;
+    }
+    start = addr;
+  } else {
+    if (len > u->mmap_low - u->brk) {
+      return -ENOMEM;
+    }
+    start = u->mmap_low - len;
+    u->mmap_low = start;
+  }
+
+  /* Private copies only: MAP_SHARED writes do not reach the file. */
+  uint8_t *p = u->m->ram + start;
+  memset(p, 0, (size_t)len);
+  if (!(flags & G_MAP_ANONYMOUS)) {
+    uint64_t done = 0;
+    while (done < len) {
+      ssize_t n = pread(fd, p + done, (size_t)(len - done),
+                        (off_t)(off + done));
+      if (n < 0 && errno == EINTR) {
+        continue;
+      }
+      if (n < 0) {
+        int err = errno;
+        if (start == u->mmap_low) {
+          u->mmap_low += len;
+        }
+        return -err;
+      }
+      if (n == 0) {
+        break;
+      }
+      done += (uint64_t)n;
+    }
+  }
+  mem_mark_dirty(u->m, start, len);
+  return (int64_t)start;
+}
+
+static int64_t sys_munmap(User *u, uint64_t addr, uint64_t len) {
+  len = page_up(len);
+  if ((addr & (RIVOS_SIM_PAGE_SIZE - 1)) || !guest_ptr(u, addr, len)) {
+    return -EINVAL;
+  }
+  if (addr == u->mmap_low && addr + len <= u->m->ram_size - USER_STACK_SIZE) {
+    u->mmap_low += len;
+  }
+  return 0;
+}
+
+static int64_t sys_madvise(User *u, uint64_t addr, uint64_t len,
+                           uint64_t advice) {
+  len = page_up(len);
+  if (!guest_ptr(u, addr, len)) {
+    return -ENOMEM;
+  }
+  /* Anonymous pages read back as zero after MADV_DONTNEED. */
+  if (advice == G_MADV_DONTNEED) {
+    memset(u->m->ram + addr, 0, (size_t)len);
+    mem_mark_dirty(u->m, addr, len);
+  }
+  return 0;
+}
+
+/* Files */
+
+static int64_t sys_rw(User *u, const uint64_t *a, bool write_op,
+                      bool positional) {
+  uint8_t *p = guest_ptr(u, a[1], a[2]);
+  if (!p) {
+    return -EFAULT;
+  }
+  int fd = (int)a[0];
+  size_t len = (size_t)a[2];
+  ssize_t n;
+  if (positional) {
+    n = write_op ? pwrite(fd, p, len, (off_t)a[3])
+                 : pread(fd, p, len, (off_t)a[3]);
+  } else {
+    n = write_op ? write(fd, p, len) : read(fd, p, len);
+  }
+  if (n > 0 && !write_op) {
+    mem_mark_dirty(u->m, a[1], (uint64_t)n);
+  }
+  return host_ret(n);
+}
+
+static int64_t sys_rwv(User *u, const uint64_t *a, bool write_op) {
+  static struct iovec iov[IOV_MAX];
+  uint64_t cnt = a[2];
+  if (cnt > IOV_MAX) {
+    return -EINVAL;
+  }
+  for (uint64_t i = 0; i < cnt; i++) {
+    uint8_t b[16];
+    if (!copy_in(u, b, a[1] + 16 * i, sizeof(b))) {
+      return -EFAULT;
+    }
+    uint64_t base = read_u64_le(b);
+    uint64_t len = read_u64_le(b + 8);
+    uint8_t *p = guest_ptr(u, base, len);
+    if (!p) {
+      return -EFAULT;
+    }
+    iov[i] = (struct iovec){p, (size_t)len};
+  }
+  ssize_t n = write_op ? writev((int)a[0], iov, (int)cnt)
+                       : readv((int)a[0], iov, (int)cnt);
+  if (n < 0) {
+    return -errno;
+  }
+  if (!write_op) {
+    uint64_t left = (uint64_t)n;
+    for (uint64_t i = 0; i < cnt && left; i++) {
+      uint64_t k = iov[i].iov_len < left ? iov[i].iov_len : left;
+      mem_mark_dirty(u->m, (uint64_t)((uint8_t *)iov[i].iov_base - u->m->ram),
+                     k);
+      left -= k;
+    }
+  }
+  return n;
+}
+
+static int64_t sys_openat(User *u, const uint64_t *a) {
+  char path[PATH_MAX];
+  int64_t err = guest_path(u, a[1], path, sizeof(path));
+  if (err) {
+    return err;
+  }
+  return host_ret(openat((int)a[0], path, host_open_flags(a[2]),
+                         (mode_t)a[3]));
+}
+
+/* struct stat of the generic ABI that riscv64 uses. */
+static int64_t put_stat(User *u, uint64_t addr, const struct stat *st) {
+  uint8_t b[G_STAT_SIZE];
+  memset(b, 0, sizeof(b));
+  put_u64(b + 0, (uint64_t)st->st_dev);
+  put_u64(b + 8, (uint64_t)st->st_ino);
+  put_u32(b + 16, (uint32_t)st->st_mode);
+  put_u32(b + 20, (uint32_t)st->st_nlink);
+  put_u32(b + 24, (uint32_t)st->st_uid);
+  put_u32(b + 28, (uint32_t)st->st_gid);
+  put_u64(b + 32, (uint64_t)st->st_rdev);
+  put_u64(b + 48, (uint64_t)st->st_size);
+  put_u32(b + 56, (uint32_t)st->st_blksize);
+  put_u64(b + 64, (uint64_t)st->st_blocks);
+  put_u64(b + 72, (uint64_t)st->st_atim.tv_sec);
+  put_u64(b + 80, (uint64_t)st->st_atim.tv_nsec);
+  put_u64(b + 88, (uint64_t)st->st_mtim.tv_sec);
+  put_u64(b + 96, (uint64_t)st->st_mtim.tv_nsec);
+  put_u64(b + 104, (uint64_t)st->st_ctim.tv_sec);
+  put_u64(b + 112, (uint64_t)st->st_ctim.tv_nsec);
+  return copy_out(u, addr, b, sizeof(b)) ? 0 : -EFAULT;
+}
+
+static int64_t sys_fstatat(User *u, int dirfd, uint64_t path_addr,
+                           uint64_t buf, int flags) {
+  char path[PATH_MAX] = "";
+  if (path_addr) {
+    int64_t err = guest_path(u, path_addr, path, sizeof(path));
+    if (err) {
+      return err;
+    }
+  }
+  struct stat st;
+  if (fstatat(dirfd, path, &st, flags) != 0) {
+    return -errno;
+  }
+  return put_stat(u, buf, &st);
+}
+
+static int64_t sys_readlinkat(User *u, const uint64_t *a) {
+  char path[PATH_MAX];
+  int64_t err = guest_path(u, a[1], path, sizeof(path));
+  if (err) {
+    return err;
+  }
+  uint8_t *buf = guest_ptr(u, a[2], a[3]);
+  if (!buf) {
+    return -EFAULT;
+  }
+  char target[PATH_MAX];
+  ssize_t n;
+  if (strcmp(path, "/proc/self/exe") == 0) {
+    if (!realpath(u->exe, target)) {
+      return -errno;
+    }
+    n = (ssize_t)strlen(target);
+  } else {
+    n = readlinkat((int)a[0], path, target, sizeof(target));
+    if (n < 0) {
+      return -errno;
+    }
+  }
+  if ((uint64_t)n > a[3]) {
+    n = (ssize_t)a[3];
+  }
+  memcpy(buf, target, (size_t)n);
+  mem_mark_dirty(u->m, a[2], (uint64_t)n);
+  return n;
+}
+
+/* Path-only calls that map one-to-one onto the host. */
+static int64_t sys_path(User *u, uint64_t nr, const uint64_t *a) {
+  char path[PATH_MAX];
+  int64_t err = guest_path(u, nr == NR_CHDIR ? a[0] : a[1], path,
+                           sizeof(path));
+  if (err) {
+    return err;
+  }
+  switch (nr) {
+  case NR_CHDIR:
+    return host_ret(chdir(path));
+  case NR_MKDIRAT:
+    return host_ret(mkdirat((int)a[0], path, (mode_t)a[2]));
+  case NR_UNLINKAT:
+    return host_ret(unlinkat((int)a[0], path, (int)a[2]));
+  default: /* NR_FACCESSAT */
+    return host_ret(faccessat((int)a[0], path, (int)a[2], 0));
+  }
+}
+
+static int64_t sys_fcntl(const uint64_t *a) {
+  switch (a[1]) {
+  case G_F_GETFL: {
+    int r = fcntl((int)a[0], F_GETFL);
+    return r < 0 ? -errno : guest_open_flags(r);
+  }
+  case G_F_SETFL:
+    return host_ret(fcntl((int)a[0], F_SETFL, host_open_flags(a[2])));
+  case F_DUPFD:
+  case F_GETFD:
+  case F_SETFD:
+  case F_DUPFD_CLOEXEC:
+    return host_ret(fcntl((int)a[0], (int)a[1], (int)a[2]));
+  default:
+    return -EINVAL;
+  }
+}
+
+/* Terminal queries, so that isatty() and line editing behave. */
+static int64_t sys_ioctl(User *u, const uint64_t *a) {
+  int fd = (int)a[0];
+  uint8_t b[G_TERMIOS_SIZE];
+  struct termios t;
+  switch (a[1]) {
+  case G_TCGETS:
+    if (tcgetattr(fd, &t) != 0) {
+      return -errno;
+    }
+    put_u32(b, t.c_iflag);
+    put_u32(b + 4, t.c_oflag);
+    put_u32(b + 8, t.c_cflag);
+    put_u32(b + 12, t.c_lflag);
+    b[16] = t.c_line;
+    memcpy(b + 17, t.c_cc, G_NCCS);
+    return copy_out(u, a[2], b, sizeof(b)) ? 0 : -EFAULT;
+  case G_TCSETS:
+  case G_TCSETSW:
+  case G_TCSETSF:
+    if (!copy_in(u, b, a[2], sizeof(b))) {
+      return -EFAULT;
+    }
+    if (tcgetattr(fd, &t) != 0) {
+      return -errno;
+    }
+    t.c_iflag = read_u32_le(b);
+    t.c_oflag = read_u32_le(b + 4);
+    t.c_cflag = read_u32_le(b + 8);
+    t.c_lflag = read_u32_le(b + 12);
+    t.c_line = b[16];
+    memcpy(t.c_cc, b + 17, G_NCCS);
+    return host_ret(tcsetattr(fd, (int)(a[1] - G_TCSETS), &t));
+  case G_TIOCGWINSZ: {
+    struct winsize ws;
+    if (ioctl(fd, TIOCGWINSZ, &ws) != 0) {
+      return -errno;
+    }
+    return copy_out(u, a[2], &ws, sizeof(ws)) ? 0 : -EFAULT;
+  }
+  default:
+    return -ENOTTY;
+  }
+}
+
+/* Time */
+
+static int64_t sys_clock(User *u, const uint64_t *a, bool res) {
+  struct timespec ts;
+  int r = res ? clock_getres((clockid_t)a[0], &ts)
+              : clock_gettime((clockid_t)a[0], &ts);
+  if (r != 0) {
+    return -errno;
+  }
+  if (a[1] && !put_timespec(u, a[1], &ts)) {
+    return -EFAULT;
+  }
+  return 0;
+}
+
+static int64_t sys_sleep(User *u, clockid_t clk, int flags, uint64_t req,
+                         uint64_t rem) {
+  struct timespec ts, left = {0, 0};
+  if (!get_timespec(u, req, &ts)) {
+    return -EFAULT;
+  }
+  int r = clock_nanosleep(clk, flags, &ts, &left);
+  if (r == EINTR && rem) {
+    put_timespec(u, rem, &left);
+  }
+  return -r;
+}
+
+static int64_t sys_gettimeofday(User *u, uint64_t tv) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  uint8_t b[16];
+  put_u64(b, (uint64_t)ts.tv_sec);
+  put_u64(b + 8, (uint64_t)(ts.tv_nsec / 1000));
+  return !tv || copy_out(u, tv, b, sizeof(b)) ? 0 : -EFAULT;
+}
+
+static int64_t sys_times(User *u, uint64_t buf) {
+  struct tms t;
+  clock_t r = times(&t);
+  uint8_t b[32];
+  put_u64(b, (uint64_t)t.tms_utime);
+  put_u64(b + 8, (uint64_t)t.tms_stime);
+  put_u64(b + 16, (uint64_t)t.tms_cutime);
+  put_u64(b + 24, (uint64_t)t.tms_cstime);
+  if (buf && !copy_out(u, buf, b, sizeof(b))) {
+    return -EFAULT;
+  }
+  return (int64_t)r;
+}
+
+/* Process */
+
+static int64_t sys_uname(User *u, uint64_t buf) {
+  struct utsname h;
+  uname(&h);
+  char b[6][65];
+  memset(b, 0, sizeof(b));
+  snprintf(b[0], sizeof(b[0]), "Linux");
+  snprintf(b[1], sizeof(b[1]), "%s", h.nodename);
+  snprintf(b[2], sizeof(b[2]), "%s", h.release);
+  snprintf(b[3], sizeof(b[3]), "%s", h.version);
+  snprintf(b[4], sizeof(b[4]), "riscv64");
+  snprintf(b[5], sizeof(b[5]), "%s", h.domainname);
+  return copy_out(u, buf, b, sizeof(b)) ? 0 : -EFAULT;
+}
+
+static int64_t sys_prlimit(User *u, uint64_t resource, uint64_t old) {
+  uint64_t cur = RLIM_INFINITY, max = RLIM_INFINITY;
+  if (resource == G_RLIMIT_STACK) {
+    cur = max = USER_STACK_SIZE;
+  } else if (resource == G_RLIMIT_NOFILE) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0) {
+      cur = rl.rlim_cur;
+      max = rl.rlim_max;
+    }
+  }
+  uint8_t b[16];
+  put_u64(b, cur);
+  put_u64(b + 8, max);
+  return !old || copy_out(u, old, b, sizeof(b)) ? 0 : -EFAULT;
+}
+
+static int64_t sys_kill(Cpu *cpu, User *u, uint64_t pid, uint64_t sig) {
+  if (sig == 0 || sig == SIGCHLD || sig == SIGWINCH || sig == SIGURG) {
+    return 0;
+  }
+  if (pid != 0 && (pid_t)pid != getpid()) {
+    return -EPERM;
+  }
+  u->signal = (int)sig;
+  u->exited = true;
+  cpu->halted = true;
+  return 0;
+}
+
+/* Single-threaded: nothing else can change a futex word or wait on it. */
+static int64_t sys_futex(User *u, const uint64_t *a) {
+  switch (a[1] & 0x7f) {
+  case 0: /* FUTEX_WAIT */
+  case 9: /* FUTEX_WAIT_BITSET */
+    return guest_ptr(u, a[0], 4) ? -EAGAIN : -EFAULT;
+  case 1: /* FUTEX_WAKE */
+  case 10: /* FUTEX_WAKE_BITSET */
+    return 0;
+  default:
+    return -ENOSYS;
+  }
+}
+
+static int64_t sys_zero(User *u, uint64_t addr, size_t len) {
+  static const uint8_t z[32];
+  return !addr || copy_out(u, addr, z, len) ? 0 : -EFAULT;
+}
+
+static int64_t unsupported(User *u, uint64_t nr) {
+  if (nr >= 64 * sizeof(u->warned) / sizeof(u->warned[0]) ||
+      !(u->warned[nr / 64] & (1ull << (nr % 64)))) {
+    if (nr < 64 * sizeof(u->warned) / sizeof(u->warned[0])) {
+      u->warned[nr / 64] |= 1ull << (nr % 64);
+    }
+    fprintf(stderr, "[rivos-sim] unsupported system call %" PRIu64 "\n", nr);
+  }
+  return -ENOSYS;
+}
+
+void user_syscall(Machine *m, Cpu *cpu) {
+  User *u = m->user;
+  uint64_t nr = cpu->x[17];
+  const uint64_t *a = &cpu->x[10];
+  int64_t ret;
+
+  switch (nr) {
+  case NR_READ:
+  case NR_WRITE:
+    ret = sys_rw(u, a, nr == NR_WRITE, false);
+    break;
+  case NR_PREAD64:
+  case NR_PWRITE64:
+    ret = sys_rw(u, a, nr == NR_PWRITE64, true);
+    break;
+  case NR_READV:
+  case NR_WRITEV:
+    ret = sys_rwv(u, a, nr == NR_WRITEV);
+    break;
+  case NR_OPENAT:
+    ret = sys_openat(u, a);
+    break;
+  case NR_CLOSE:
+    ret = host_ret(close((int)a[0]));
+    break;
+  case NR_LSEEK:
+    ret = host_ret(lseek((int)a[0], (off_t)a[1], (int)a[2]));
+    break;
+  case NR_DUP:
+    ret = host_ret(dup((int)a[0]));
+    break;
+  case NR_DUP3:
+    ret = host_ret(dup3((int)a[0], (int)a[1], host_open_flags(a[2])));
+    break;
+  case NR_PIPE2: {
+    int fds[2];
+    uint8_t b[8];
+    if (pipe2(fds, host_open_flags(a[1])) != 0) {
+      ret = -errno;
+      break;
+    }
+    put_u32(b, (uint32_t)fds[0]);
+    put_u32(b + 4, (uint32_t)fds[1]);
+    ret = copy_out(u, a[0], b, sizeof(b)) ? 0 : -EFAULT;
+    break;
+  }
+  case NR_FCNTL:
+    ret = sys_fcntl(a);
+    break;
+  case NR_IOCTL:
+    ret = sys_ioctl(u, a);
+    break;
+  case NR_FTRUNCATE:
+    ret = host_ret(ftruncate((int)a[0], (off_t)a[1]));
+    break;
+  case NR_FSYNC:
+    ret = host_ret(fsync((int)a[0]));
+    break;
+  case NR_GETDENTS64: {
+    uint8_t *p = guest_ptr(u, a[1], a[2]);
+    ret = p ? host_ret(syscall(SYS_getdents64, (int)a[0], p, (size_t)a[2]))
+            : -EFAULT;
+    if (ret > 0) {
+      mem_mark_dirty(m, a[1], (uint64_t)ret);
+    }
+    break;
+  }
+  case NR_FSTAT:
+    ret = sys_fstatat(u, (int)a[0], 0, a[1], AT_EMPTY_PATH);
+    break;
+  case NR_NEWFSTATAT:
+    ret = sys_fstatat(u, (int)a[0], a[1], a[2], (int)a[3]);
+    break;
+  case NR_READLINKAT:
+    ret = sys_readlinkat(u, a);
+    break;
+  case NR_CHDIR:
+  case NR_MKDIRAT:
+  case NR_UNLINKAT:
+  case NR_FACCESSAT:
+    ret = sys_path(u, nr, a);
+    break;
+  case NR_GETCWD: {
+    char cwd[PATH_MAX];
+    if (!getcwd(cwd, sizeof(cwd))) {
+      ret = -errno;
+    } else if (strlen(cwd) + 1 > a[1]) {
+      ret = -ERANGE;
+    } else {
+      ret = copy_out(u, a[0], cwd, strlen(cwd) + 1) ? (int64_t)strlen(cwd) + 1
+                                                    : -EFAULT;
+    }
+    break;
+  }
+  case NR_UMASK:
+    ret = umask((mode_t)a[0]);
+    break;
+
+  case NR_BRK:
+    ret = sys_brk(u, a[0]);
+    break;
+  case NR_MMAP:
+    ret = sys_mmap(u, a);
+    break;
+  case NR_MUNMAP:
+    ret = sys_munmap(u, a[0], a[1]);
+    break;
+  case NR_MREMAP:
+    ret = -ENOMEM;
+    break;
+  case NR_MADVISE:
+    ret = sys_madvise(u, a[0], a[1], a[2]);
+    break;
+  case NR_MPROTECT:
+  case NR_RISCV_FLUSH_ICACHE:
+    ret = 0;
+    break;
+
+  case NR_CLOCK_GETTIME:
+  case NR_CLOCK_GETRES:
+    ret = sys_clock(u, a, nr == NR_CLOCK_GETRES);
+    break;
+  case NR_NANOSLEEP:
+    ret = sys_sleep(u, CLOCK_REALTIME, 0, a[0], a[1]);
+    break;
+  case NR_CLOCK_NANOSLEEP:
+    ret = sys_sleep(u, (clockid_t)a[0], (int)a[1], a[2], a[3]);
+    break;
+  case NR_GETTIMEOFDAY:
+    ret = sys_gettimeofday(u, a[0]);
+    break;
+  case NR_TIMES:
+    ret = sys_times(u, a[0]);
+    break;
+
+  case NR_EXIT:
+  case NR_EXIT_GROUP:
+    m->exit_code = (int)(a[0] & 0xff);
+    u->exited = true;
+    cpu->halted = true;
+    return;
+  case NR_KILL:
+  case NR_TKILL:
+    ret = sys_kill(cpu, u, nr == NR_KILL ? a[0] : 0, a[1]);
+    break;
+  case NR_TGKILL:
+    ret = sys_kill(cpu, u, 0, a[2]);
+    break;
+  case NR_GETPID:
+  case NR_GETTID:
+  case NR_SET_TID_ADDRESS:
+    ret = getpid();
+    break;
+  case NR_GETPPID:
+    ret = getppid();
+    break;
+  case NR_GETUID:
+    ret = getuid();
+    break;
+  case NR_GETEUID:
+    ret = geteuid();
+    break;
+  case NR_GETGID:
+    ret = getgid();
+    break;
+  case NR_GETEGID:
+    ret = getegid();
+    break;
+  case NR_UNAME:
+    ret = sys_uname(u, a[0]);
+    break;
+  case NR_GETRLIMIT:
+    ret = sys_prlimit(u, a[0], a[1]);
+    break;
+  case NR_PRLIMIT64:
+    ret = a[0] && (pid_t)a[0] != getpid() ? -EPERM
+                                           : sys_prlimit(u, a[1], a[3]);
+    break;
+  case NR_SCHED_GETAFFINITY: {
+    uint8_t one[8] = {1};
+    ret = a[1] < sizeof(one) ? -EINVAL
+          : copy_out(u, a[2], one, sizeof(one)) ? (int64_t)sizeof(one)
+                                                : -EFAULT;
+    break;
+  }
+  case NR_GETRANDOM: {
+    uint8_t *p = guest_ptr(u, a[0], a[1]);
+    ret = p ? host_ret(getrandom(p, (size_t)a[1], (unsigned)a[2])) : -EFAULT;
+    if (ret > 0) {
+      mem_mark_dirty(m, a[0], (uint64_t)ret);
+    }
+    break;
+  }
+  case NR_FUTEX:
+    ret = sys_futex(u, a);
+    break;
+
+  /* Signals are never delivered, so handlers and masks are only noted. */
+  case NR_RT_SIGACTION:
+    ret = sys_zero(u, a[2], 24);
+    break;
+  case NR_RT_SIGPROCMASK:
+    ret = sys_zero(u, a[2], 8);
+    break;
+  case NR_SIGALTSTACK:
+    ret = sys_zero(u, a[1], 24);
+    break;
+  case NR_SET_ROBUST_LIST:
+  case NR_SCHED_YIELD:
+    ret = 0;
+    break;
+  case NR_PRCTL:
+    ret = -EINVAL;
+    break;
+  default:
+    ret = unsupported(u, nr);
+    break;
+  }
+  cpu->x[10] = (uint64_t)ret;
+}
+
+int user_exit_status(const User *u, const Cpu *cpu) {
+  if (u->exited && !u->signal) {
+    return u->m->exit_code;
+  }
+  int sig = u->signal;
+  if (!u->exited) {
+    uint64_t cause = cpu->csr[CSR_MCAUSE];
+    sig = cause == CAUSE_ILLEGAL_INSN ? SIGILL
+          : cause == CAUSE_BREAKPOINT ? SIGTRAP
+                                      : SIGSEGV;
+    fprintf(stderr, "[rivos-sim] trap cause %" PRIu64 " at pc=0x%016" PRIx64
+                    " tval=0x%" PRIx64 "\n",
+            cause, cpu->csr[CSR_MEPC], cpu->csr[CSR_MTVAL]);
+  }
+  fprintf(stderr, "[rivos-sim] killed by signal %d (%s)\n", sig,
+          strsignal(sig));
+  return 128 + sig;
+}
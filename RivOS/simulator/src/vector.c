@@ -0,0 +1,1210 @@
+#include <pthread.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "rivos_sim/csr.h"
+#include "rivos_sim/heat.h"
+#include "rivos_sim/mem.h"
+#include "rivos_sim/vector.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define VEC_X86 1
+#endif
+
+/*
+ * RVV 1.0 integer subset: vset{i}vl{i}, unit-stride/strided/indexed and
+ * segment loads and stores, whole-register moves, integer arithmetic,
+ * compares, mask logic and (widening) reductions. ELEN is 64; tail and mask policies
+ * are always undisturbed, which satisfies both agnostic settings.
+ *
+ * Elements live little-endian in cpu->v. Unmasked operations starting at
+ * vstart 0 go through the kernel tables below, which process a whole
+ * register group per call; everything else takes the element loop.
+ */
+
+enum {
+  VLENB_MAX = RIVOS_SIM_VLEN_MAX / 8,
+  /* Largest register group, LMUL 8. */
+  GROUP_MAX = 8 * VLENB_MAX,
+};
+
+/* ---- host kernels ------------------------------------------------------ */
+
+/* d = a op b over n bytes; a is vs2 and b is vs1 or a splatted scalar. */
+typedef void (*VecBinFn)(uint8_t *d, const uint8_t *a, const uint8_t *b,
+                         size_t n);
+/*
+ * Writes mask bits for leading elements in whole bytes and returns how many
+ * elements were done; the element loop finishes the rest.
+ */
+typedef size_t (*VecCmpFn)(uint8_t *mask, const uint8_t *a, const uint8_t *b,
+                           size_t n);
+/* Wrapping sum of n bytes of elements, truncated by the caller. */
+typedef uint64_t (*VecSumFn)(const uint8_t *a, size_t n);
+
+enum {
+  VK_ADD,
+  VK_SUB,
+  VK_AND,
+  VK_OR,
+  VK_XOR,
+  VK_MINU,
+  VK_MIN,
+  VK_MAXU,
+  VK_MAX,
+  VK_COUNT,
+};
+
+enum {
+  VC_EQ,
+  VC_NE,
+  VC_COUNT,
+};
+
+/* Indexed by kernel and log2(SEW / 8). */
+static VecBinFn vk_bin[VK_COUNT][4];
+static VecCmpFn vk_cmp[VC_COUNT][4];
+static VecSumFn vk_sum[4];
+
+#define SCALAR_BIN(name, T, expr)                                            \
+  static void name(uint8_t *d, const uint8_t *a, const uint8_t *b,           \
+                   size_t n) {                                               \
+    for (size_t i = 0; i < n; i += sizeof(T)) {                              \
+      T x, y, r;                                                             \
+      memcpy(&x, a + i, sizeof(T));                                          \
+      memcpy(&y, b + i, sizeof(T));                                          \
+      r = (T)(expr);                                                         \
+      memcpy(d + i, &r, sizeof(T));                                          \
+    }                                                                        \
+  }
+
+#define SCALAR_SUM(name, T)                                                  \
+  static uint64_t name(const uint8_t *a, size_t n) {                         \
+    uint64_t s = 0;                                                          \
+    for (size_t i = 0; i < n; i += sizeof(T)) {                              \
+      T x;                                                                   \
+      memcpy(&x, a + i, sizeof(T));                                          \
+      s += x;                                                                \
+    }                                                                        \
+    return s;                                                                \
+  }
+
+#define SCALAR_KERNELS(bits)                                                 \
+  SCALAR_BIN(add_##bits, uint##bits##_t, x + y)                              \
+  SCALAR_BIN(sub_##bits, uint##bits##_t, x - y)                              \
+  SCALAR_BIN(and_##bits, uint##bits##_t, x & y)                              \
+  SCALAR_BIN(or_##bits, uint##bits##_t, x | y)                               \
+  SCALAR_BIN(xor_##bits, uint##bits##_t, x ^ y)                              \
+  SCALAR_BIN(minu_##bits, uint##bits##_t, x < y ? x : y)                     \
+  SCALAR_BIN(min_##bits, int##bits##_t, x < y ? x : y)                       \
+  SCALAR_BIN(maxu_##bits, uint##bits##_t, x > y ? x : y)                     \
+  SCALAR_BIN(max_##bits, int##bits##_t, x > y ? x : y)                       \
+  SCALAR_SUM(sum_##bits, uint##bits##_t)
+
+SCALAR_KERNELS(8)
+SCALAR_KERNELS(16)
+SCALAR_KERNELS(32)
+SCALAR_KERNELS(64)
+
+/* Eight elements per mask byte; a partial last byte is left to the caller. */
+#define SCALAR_CMP(name, T, invert)                                          \
+  static size_t name(uint8_t *mask, const uint8_t *a, const uint8_t *b,      \
+                     size_t n) {                                             \
+    size_t i = 0;                                                            \
+    for (; i + 8 <= n; i += 8) {                                             \
+      uint8_t bits = 0;                                                      \
+      for (size_t j = 0; j < 8; j++) {                                       \
+        T x, y;                                                              \
+        memcpy(&x, a + (i + j) * sizeof(T), sizeof(T));                      \
+        memcpy(&y, b + (i + j) * sizeof(T), sizeof(T));                      \
+        bits |= (uint8_t)(((x == y) != (invert)) << j);                      \
+      }                                                                      \
+      mask[i / 8] = bits;                                                    \
+    }                                                                        \
+    return i;                                                                \
+  }
+
+#define SCALAR_CMPS(bits)                                                    \
+  SCALAR_CMP(eq_##bits, uint##bits##_t, false)                               \
+  SCALAR_CMP(ne_##bits, uint##bits##_t, true)
+
+SCALAR_CMPS(8)
+SCALAR_CMPS(16)
+SCALAR_CMPS(32)
+SCALAR_CMPS(64)
+
+#define SCALAR_ROW(op)                                                       \
+  {op##_8, op##_16, op##_32, op##_64}
+
+static void select_scalar(void) {
+  static const VecBinFn bin[VK_COUNT][4] = {
+      SCALAR_ROW(add),  SCALAR_ROW(sub), SCALAR_ROW(and),
+      SCALAR_ROW(or),   SCALAR_ROW(xor), SCALAR_ROW(minu),
+      SCALAR_ROW(min),  SCALAR_ROW(maxu), SCALAR_ROW(max),
+  };
+  static const VecCmpFn cmp[VC_COUNT][4] = {SCALAR_ROW(eq), SCALAR_ROW(ne)};
+  static const VecSumFn sum[4] = SCALAR_ROW(sum);
+
+  memcpy(vk_bin, bin, sizeof(vk_bin));
+  memcpy(vk_cmp, cmp, sizeof(vk_cmp));
+  memcpy(vk_sum, sum, sizeof(vk_sum));
+}
+
+#ifdef VEC_X86
+
+#define AVX2 __attribute__((target("avx2")))
+
+#define AVX2_BIN(name, expr, tail)                                           \
+  AVX2 static void name(uint8_t *d, const uint8_t *a, const uint8_t *b,      \
+                        size_t n) {                                          \
+    size_t i = 0;                                                            \
+    for (; i + 32 <= n; i += 32) {                                           \
+      __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));              \
+      __m256i y = _mm256_loadu_si256((const __m256i *)(b + i));              \
+      _mm256_storeu_si256((__m256i *)(d + i), expr);                         \
+    }                                                                        \
+    if (i < n) {                                                             \
+      tail(d + i, a + i, b + i, n - i);                                      \
+    }                                                                        \
+  }
+
+#define AVX2_ARITH(bits)                                                     \
+  AVX2_BIN(avx2_add_##bits, _mm256_add_epi##bits(x, y), add_##bits)          \
+  AVX2_BIN(avx2_sub_##bits, _mm256_sub_epi##bits(x, y), sub_##bits)
+
+#define AVX2_MINMAX(bits)                                                    \
+  AVX2_BIN(avx2_minu_##bits, _mm256_min_epu##bits(x, y), minu_##bits)        \
+  AVX2_BIN(avx2_min_##bits, _mm256_min_epi##bits(x, y), min_##bits)          \
+  AVX2_BIN(avx2_maxu_##bits, _mm256_max_epu##bits(x, y), maxu_##bits)        \
+  AVX2_BIN(avx2_max_##bits, _mm256_max_epi##bits(x, y), max_##bits)
+
+AVX2_ARITH(8)
+AVX2_ARITH(16)
+AVX2_ARITH(32)
+AVX2_ARITH(64)
+AVX2_MINMAX(8)
+AVX2_MINMAX(16)
+AVX2_MINMAX(32)
+/* Bitwise ops do not care about element width; the tail is whole bytes. */
+AVX2_BIN(avx2_and, _mm256_and_si256(x, y), and_8)
+AVX2_BIN(avx2_or, _mm256_or_si256(x, y), or_8)
+AVX2_BIN(avx2_xor, _mm256_xor_si256(x, y), xor_8)
+
+/* e8 compares: 32 elements become one 32-bit mask word. */
+#define AVX2_CMP8(name, invert)                                              \
+  AVX2 static size_t name(uint8_t *mask, const uint8_t *a, const uint8_t *b, \
+                          size_t n) {                                        \
+    size_t i = 0;                                                            \
+    for (; i + 32 <= n; i += 32) {                                           \
+      __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));              \
+      __m256i y = _mm256_loadu_si256((const __m256i *)(b + i));              \
+      uint32_t bits = (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y)); \
+      bits = (invert) ? ~bits : bits;                                        \
+      memcpy(mask + i / 8, &bits, sizeof(bits));                             \
+    }                                                                        \
+    return i;                                                                \
+  }
+
+AVX2_CMP8(avx2_eq_8, false)
+AVX2_CMP8(avx2_ne_8, true)
+
+/* Lanes wrap at the element width, which is all the caller keeps. */
+#define AVX2_SUM(bits)                                                       \
+  AVX2 static uint64_t avx2_sum_##bits(const uint8_t *a, size_t n) {         \
+    __m256i acc = _mm256_setzero_si256();                                    \
+    size_t i = 0;                                                            \
+    for (; i + 32 <= n; i += 32) {                                           \
+      acc = _mm256_add_epi##bits(                                            \
+          acc, _mm256_loadu_si256((const __m256i *)(a + i)));                \
+    }                                                                        \
+    uint##bits##_t lanes[32 / sizeof(uint##bits##_t)];                       \
+    _mm256_storeu_si256((__m256i *)lanes, acc);                              \
+    uint64_t s = sum_##bits(a + i, n - i);                                   \
+    for (size_t l = 0; l < sizeof(lanes) / sizeof(lanes[0]); l++) {         \
+      s += lanes[l];                                                         \
+    }                                                                        \
+    return s;                                                                \
+  }
+
+AVX2_SUM(16)
+AVX2_SUM(32)
+AVX2_SUM(64)
+
+/* Byte sums via SAD against zero: four 64-bit partial sums per step. */
+AVX2 static uint64_t avx2_sum_8(const uint8_t *a, size_t n) {
+  __m256i acc = _mm256_setzero_si256();
+  size_t i = 0;
+  for (; i + 32 <= n; i += 32) {
+    __m256i x = _mm256_loadu_si256((const __m256i *)(a + i));
+    acc = _mm256_add_epi64(acc, _mm256_sad_epu8(x, _mm256_setzero_si256()));
+  }
+  uint64_t lanes[4];
+  _mm256_storeu_si256((__m256i *)lanes, acc);
+  return lanes[0] + lanes[1] + lanes[2] + lanes[3] + sum_8(a + i, n - i);
+}
+
+static void select_avx2(void) {
+  static const VecBinFn bin[VK_COUNT][4] = {
+      {avx2_add_8, avx2_add_16, avx2_add_32, avx2_add_64},
+      {avx2_sub_8, avx2_sub_16, avx2_sub_32, avx2_sub_64},
+      {avx2_and, avx2_and, avx2_and, avx2_and},
+      {avx2_or, avx2_or, avx2_or, avx2_or},
+      {avx2_xor, avx2_xor, avx2_xor, avx2_xor},
+      /* AVX2 has no 64-bit min/max. */
+      {avx2_minu_8, avx2_minu_16, avx2_minu_32, minu_64},
+      {avx2_min_8, avx2_min_16, avx2_min_32, min_64},
+      {avx2_maxu_8, avx2_maxu_16, avx2_maxu_32, maxu_64},
+      {avx2_max_8, avx2_max_16, avx2_max_32, max_64},
+  };
+  static const VecSumFn sum[4] = {avx2_sum_8, avx2_sum_16, avx2_sum_32,
+                                  avx2_sum_64};
+
+  memcpy(vk_bin, bin, sizeof(vk_bin));
+  memcpy(vk_sum, sum, sizeof(vk_sum));
+  vk_cmp[VC_EQ][0] = avx2_eq_8;
+  vk_cmp[VC_NE][0] = avx2_ne_8;
+}
+
+#endif
+
+static pthread_once_t kernels_once = PTHREAD_ONCE_INIT;
+
+static void select_kernels(void) {
+  select_scalar();
+#ifdef VEC_X86
+  if (__builtin_cpu_supports("avx2")) {
+    select_avx2();
+  }
+#endif
+}
+
+/* ---- element access ---------------------------------------------------- */
+
+typedef struct {
+  unsigned sb;    /* SEW in bytes */
+  unsigned lmul8; /* LMUL * 8 */
+  uint64_t vl;
+  uint64_t vstart;
+  uint64_t vlmax;
+} VecCfg;
+
+static inline uint8_t *vreg(Cpu *cpu, uint32_t r) {
+  return cpu->v + (size_t)r * cpu->vlenb;
+}
+
+static inline uint64_t vget(const uint8_t *base, uint64_t i, unsigned sb) {
+  uint64_t v = 0;
+  memcpy(&v, base + i * sb, sb);
+  return v;
+}
+
+static inline void vput(uint8_t *base, uint64_t i, unsigned sb, uint64_t v) {
+  memcpy(base + i * sb, &v, sb);
+}
+
+static inline bool mbit(const uint8_t *m, uint64_t i) {
+  return (m[i >> 3] >> (i & 7)) & 1;
+}
+
+static inline void mput(uint8_t *m, uint64_t i, bool b) {
+  uint8_t bit = (uint8_t)(1u << (i & 7));
+  m[i >> 3] = b ? (m[i >> 3] | bit) : (m[i >> 3] & ~bit);
+}
+
+static inline uint64_t trunc_sew(uint64_t v, unsigned sb) {
+  return sb == 8 ? v : v & ((1ull << (8 * sb)) - 1);
+}
+
+static inline int64_t sext_sew(uint64_t v, unsigned sb) {
+  unsigned sh = 64 - 8 * sb;
+  return (int64_t)(v << sh) >> sh;
+}
+
+static inline unsigned log2_sb(unsigned sb) {
+  return sb == 1 ? 0 : sb == 2 ? 1 : sb == 4 ? 2 : 3;
+}
+
+/* Registers covered by a group of the given LMUL * 8. */
+static inline unsigned group_regs(unsigned lmul8) {
+  return lmul8 <= 8 ? 1 : lmul8 / 8;
+}
+
+static inline bool group_ok(uint32_t r, unsigned lmul8) {
+  unsigned n = group_regs(lmul8);
+  return r % n == 0 && r + n <= 32;
+}
+
+static inline bool active(const Cpu *cpu, bool vm, uint64_t i) {
+  return vm || mbit(cpu->v, i);
+}
+
+static void mark_dirty(Cpu *cpu) {
+  cpu->csr[CSR_MSTATUS] |= MSTATUS_VS;
+}
+
+/* LMUL * 8 for each vlmul encoding; 0 is reserved. */
+static const uint8_t lmul8_of[8] = {8, 16, 32, 64, 0, 1, 2, 4};
+
+static bool load_cfg(const Cpu *cpu, VecCfg *c) {
+  uint64_t vtype = cpu->csr[CSR_VTYPE];
+  if (vtype >> VTYPE_VILL) {
+    return false;
+  }
+  c->sb = 1u << ((vtype >> 3) & 7);
+  c->lmul8 = lmul8_of[vtype & 7];
+  c->vl = cpu->csr[CSR_VL];
+  c->vstart = cpu->csr[CSR_VSTART];
+  c->vlmax = (uint64_t)cpu->vlenb * c->lmul8 / (8 * c->sb);
+  return true;
+}
+
+void vec_reset(Cpu *cpu, unsigned vlen) {
+  pthread_once(&kernels_once, select_kernels);
+  cpu->vlenb = (uint16_t)(vlen / 8);
+  memset(cpu->v, 0, sizeof(cpu->v));
+  cpu->csr[CSR_VTYPE] = 1ull << VTYPE_VILL;
+  cpu->csr[CSR_VL] = 0;
+  cpu->csr[CSR_VSTART] = 0;
+}
+
+/* ---- vsetvl ------------------------------------------------------------ */
+
+static void exec_vsetvl(Cpu *cpu, uint32_t insn) {
+  uint32_t rd = (insn >> 7) & 0x1F;
+  uint32_t rs1 = (insn >> 15) & 0x1F;
+  uint64_t vtype;
+  uint64_t avl;
+  bool keep_vl = false;
+
+  if ((insn >> 30) == 3) { /* vsetivli */
+    vtype = (insn >> 20) & 0x3FF;
+    avl = rs1;
+  } else {
+    vtype = (insn >> 31) ? cpu->x[(insn >> 20) & 0x1F] : (insn >> 20) & 0x7FF;
+    if (rs1) {
+      avl = cpu->x[rs1];
+    } else {
+      avl = UINT64_MAX;
+      keep_vl = rd == 0;
+    }
+  }
+
+  unsigned vsew = (vtype >> 3) & 7;
+  unsigned lmul8 = lmul8_of[vtype & 7];
+  /* Fractional LMUL must leave room for one SEW element within ELEN. */
+  bool ill = (vtype >> 8) != 0 || vsew > 3 || lmul8 == 0 ||
+             (8u << vsew) * 8 > 64u * lmul8;
+  uint64_t vlmax = ill ? 0 : (uint64_t)cpu->vlenb * lmul8 / (8u << vsew);
+  if (vlmax == 0) {
+    ill = true;
+  }
+
+  if (ill) {
+    cpu->csr[CSR_VTYPE] = 1ull << VTYPE_VILL;
+    cpu->csr[CSR_VL] = 0;
+  } else {
+    cpu->csr[CSR_VTYPE] = vtype;
+    uint64_t vl = keep_vl ? cpu->csr[CSR_VL] : avl;
+    cpu->csr[CSR_VL] = vl < vlmax ? vl : vlmax;
+  }
+  cpu->csr[CSR_VSTART] = 0;
+  if (rd) {
+    cpu->x[rd] = cpu->csr[CSR_VL];
+  }
+}
+
+/* ---- loads and stores -------------------------------------------------- */
+
+static uint64_t mem_get(Machine *m, uint64_t addr, unsigned sb) {
+  switch (sb) {
+  case 1:
+    return mem_read8(m, addr);
+  case 2:
+    return mem_read16(m, addr);
+  case 4:
+    return mem_read32(m, addr);
+  default:
+    return mem_read64(m, addr);
+  }
+}
+
+static void mem_put(Machine *m, uint64_t addr, unsigned sb, uint64_t v) {
+  switch (sb) {
+  case 1:
+    mem_write8(m, addr, (uint8_t)v);
+    break;
+  case 2:
+    mem_write16(m, addr, (uint16_t)v);
+    break;
+  case 4:
+    mem_write32(m, addr, (uint32_t)v);
+    break;
+  default:
+    mem_write64(m, addr, v);
+    break;
+  }
+}
+
+/* Copies a contiguous RAM range to or from registers; false if not RAM. */
+static bool bulk_copy(Machine *m, uint8_t *regs, uint64_t addr, uint64_t len,
+                      bool store) {
+  uint8_t *p = mem_ram_ptr(m, addr, len);
+  if (!p) {
+    return false;
+  }
+  if (m->heat && len) {
+    /* Once per page: the element-wise path would count each element. */
+    uint64_t off = addr - m->ram_base;
+    for (uint64_t pg = off >> RIVOS_SIM_PAGE_SHIFT;
+         pg <= (off + len - 1) >> RIVOS_SIM_PAGE_SHIFT; pg++) {
+      heat_touch(m->heat, store ? HEAT_WRITE : HEAT_READ,
+                 pg << RIVOS_SIM_PAGE_SHIFT);
+    }
+  }
+  if (store) {
+    memcpy(p, regs, len);
+    mem_mark_dirty(m, addr, len);
+  } else {
+    memcpy(regs, p, len);
+  }
+  return true;
+}
+
+static bool exec_mem(Machine *m, Cpu *cpu, uint32_t insn, bool store) {
+  uint32_t vd = (insn >> 7) & 0x1F;
+  uint32_t width = (insn >> 12) & 0x7;
+  uint32_t rs1 = (insn >> 15) & 0x1F;
+  uint32_t rs2 = (insn >> 20) & 0x1F;
+  bool vm = (insn >> 25) & 1;
+  uint32_t mop = (insn >> 26) & 3;
+  uint32_t nf = (insn >> 29) + 1;
+  unsigned eew = width == 0 ? 1 : 1u << (width - 4);
+  uint64_t base = cpu->x[rs1];
+
+  if ((insn >> 28) & 1) { /* mew: EEW > 64 */
+    return false;
+  }
+
+  /* Whole-register and mask transfers ignore vtype. */
+  if (mop == 0 && rs2 == 0x08) {
+    if (!vm || (nf & (nf - 1)) || vd % nf) {
+      return false;
+    }
+    uint64_t len = (uint64_t)nf * cpu->vlenb;
+    if (!bulk_copy(m, vreg(cpu, vd), base, len, store)) {
+      for (uint64_t i = 0; i < len; i++) {
+        if (store) {
+          mem_write8(m, base + i, vreg(cpu, vd)[i]);
+        } else {
+          vreg(cpu, vd)[i] = mem_read8(m, base + i);
+        }
+      }
+    }
+    cpu->csr[CSR_VSTART] = 0;
+    return true;
+  }
+
+  VecCfg c;
+  if (!load_cfg(cpu, &c)) {
+    return false;
+  }
+
+  if (mop == 0 && rs2 == 0x0B) { /* vlm.v / vsm.v */
+    if (!vm || nf != 1 || eew != 1) {
+      return false;
+    }
+    uint64_t len = (c.vl + 7) / 8;
+    for (uint64_t i = c.vstart; i < len; i++) {
+      if (store) {
+        mem_write8(m, base + i, vreg(cpu, vd)[i]);
+      } else {
+        vreg(cpu, vd)[i] = mem_read8(m, base + i);
+      }
+    }
+    cpu->csr[CSR_VSTART] = 0;
+    return true;
+  }
+  /* Unit-stride: plain, or fault-only-first which cannot fault here. */
+  if (mop == 0 && rs2 != 0 && rs2 != 0x10) {
+    return false;
+  }
+
+  bool indexed = mop & 1;
+  /* Indexed accesses use SEW/LMUL for data and EEW for the index. */
+  unsigned sb = indexed ? c.sb : eew;
+  unsigned emul8 = indexed ? c.lmul8 : c.lmul8 * eew / c.sb;
+  unsigned iemul8 = c.lmul8 * eew / c.sb;
+  if (emul8 < 1 || emul8 > 64 || (indexed && (iemul8 < 1 || iemul8 > 64))) {
+    return false;
+  }
+  unsigned regs = group_regs(emul8);
+  if (!group_ok(vd, emul8) || vd + nf * regs > 32 || nf * regs > 8 ||
+      (!vm && vd == 0 && !store) ||
+      (indexed && !group_ok(rs2, iemul8))) {
+    return false;
+  }
+
+  uint64_t stride = mop == 2 ? cpu->x[rs2] : (uint64_t)nf * sb;
+
+  if (mop == 0 && nf == 1 && vm && c.vstart == 0 && c.vl > 0 &&
+      bulk_copy(m, vreg(cpu, vd), base, c.vl * sb, store)) {
+    cpu->csr[CSR_VSTART] = 0;
+    return true;
+  }
+
+  for (uint64_t i = c.vstart; i < c.vl; i++) {
+    if (!active(cpu, vm, i)) {
+      continue;
+    }
+    uint64_t addr = indexed ? base + vget(vreg(cpu, rs2), i, eew)
+                            : base + i * stride;
+    for (uint32_t f = 0; f < nf; f++) {
+      uint8_t *r = vreg(cpu, vd + f * regs);
+      uint64_t a = addr + (uint64_t)f * sb;
+      if (store) {
+        mem_put(m, a, sb, vget(r, i, sb));
+      } else {
+        vput(r, i, sb, mem_get(m, a, sb));
+      }
+    }
+  }
+  cpu->csr[CSR_VSTART] = 0;
+  return true;
+}
+
+/* ---- integer arithmetic ------------------------------------------------ */
+
+enum {
+  F3_OPIVV = 0,
+  F3_OPFVV = 1,
+  F3_OPMVV = 2,
+  F3_OPIVI = 3,
+  F3_OPIVX = 4,
+  F3_OPFVF = 5,
+  F3_OPMVX = 6,
+  F3_OPCFG = 7,
+};
+
+/* Operand forms each funct6 accepts: bit 0 .vv, bit 1 .vx, bit 2 .vi. */
+enum {
+  VV = 1,
+  VX = 2,
+  VI = 4,
+};
+
+static const uint8_t opi_forms[64] = {
+    [0x00] = VV | VX | VI, /* vadd */
+    [0x02] = VV | VX,      /* vsub */
+    [0x03] = VX | VI,      /* vrsub */
+    [0x04] = VV | VX,      /* vminu */
+    [0x05] = VV | VX,      /* vmin */
+    [0x06] = VV | VX,      /* vmaxu */
+    [0x07] = VV | VX,      /* vmax */
+    [0x09] = VV | VX | VI, /* vand */
+    [0x0A] = VV | VX | VI, /* vor */
+    [0x0B] = VV | VX | VI, /* vxor */
+    [0x0E] = VX | VI,      /* vslideup */
+    [0x0F] = VX | VI,      /* vslidedown */
+    [0x17] = VV | VX | VI, /* vmerge, vmv.v */
+    [0x18] = VV | VX | VI, /* vmseq */
+    [0x19] = VV | VX | VI, /* vmsne */
+    [0x1A] = VV | VX,      /* vmsltu */
+    [0x1B] = VV | VX,      /* vmslt */
+    [0x1C] = VV | VX | VI, /* vmsleu */
+    [0x1D] = VV | VX | VI, /* vmsle */
+    [0x1E] = VX | VI,      /* vmsgtu */
+    [0x1F] = VX | VI,      /* vmsgt */
+    [0x20] = VV | VX | VI, /* vsaddu */
+    [0x21] = VV | VX | VI, /* vsadd */
+    [0x22] = VV | VX,      /* vssubu */
+    [0x23] = VV | VX,      /* vssub */
+    [0x25] = VV | VX | VI, /* vsll */
+    [0x27] = VI,           /* vmv<nr>r */
+    [0x28] = VV | VX | VI, /* vsrl */
+    [0x29] = VV | VX | VI, /* vsra */
+    [0x30] = VV,           /* vwredsumu */
+    [0x31] = VV,           /* vwredsum */
+};
+
+/* OP-V funct6 values with a host kernel, as VK_* + 1. */
+static const uint8_t opi_kernel[64] = {
+    [0x00] = VK_ADD + 1,  [0x02] = VK_SUB + 1, [0x04] = VK_MINU + 1,
+    [0x05] = VK_MIN + 1,  [0x06] = VK_MAXU + 1, [0x07] = VK_MAX + 1,
+    [0x09] = VK_AND + 1,  [0x0A] = VK_OR + 1,  [0x0B] = VK_XOR + 1,
+};
+
+static bool is_compare(uint32_t f6) {
+  return f6 >= 0x18 && f6 <= 0x1F;
+}
+
+static uint64_t opi_elem(Cpu *cpu, uint32_t f6, uint64_t a, uint64_t b,
+                         unsigned sb) {
+  int64_t sa = sext_sew(a, sb), sbv = sext_sew(b, sb);
+  unsigned bits = 8 * sb;
+  uint64_t umax = trunc_sew(~0ull, sb);
+  int64_t smax = (int64_t)(umax >> 1), smin = -smax - 1;
+
+  switch (f6) {
+  case 0x00:
+    return a + b;
+  case 0x02:
+    return a - b;
+  case 0x03:
+    return b - a;
+  case 0x04:
+    return a < b ? a : b;
+  case 0x05:
+    return sa < sbv ? a : b;
+  case 0x06:
+    return a > b ? a : b;
+  case 0x07:
+    return sa > sbv ? a : b;
+  case 0x09:
+    return a & b;
+  case 0x0A:
+    return a | b;
+  case 0x0B:
+    return a ^ b;
+  case 0x18:
+    return a == b;
+  case 0x19:
+    return a != b;
+  case 0x1A:
+    return a < b;
+  case 0x1B:
+    return sa < sbv;
+  case 0x1C:
+    return a <= b;
+  case 0x1D:
+    return sa <= sbv;
+  case 0x1E:
+    return a > b;
+  case 0x1F:
+    return sa > sbv;
+  case 0x20: {
+    uint64_t r = trunc_sew(a + b, sb);
+    if (r < a) {
+      cpu->csr[CSR_VXSAT] = 1;
+      return umax;
+    }
+    return r;
+  }
+  case 0x21:
+  case 0x23: {
+    /* Widen to 128 bits so 64-bit elements cannot overflow the check. */
+    __int128 r = f6 == 0x21 ? (__int128)sa + sbv : (__int128)sa - sbv;
+    if (r > smax || r < smin) {
+      cpu->csr[CSR_VXSAT] = 1;
+      return (uint64_t)(r > smax ? smax : smin);
+    }
+    return (uint64_t)(int64_t)r;
+  }
+  case 0x22:
+    if (b > a) {
+      cpu->csr[CSR_VXSAT] = 1;
+      return 0;
+    }
+    return a - b;
+  case 0x25:
+    return a << (b & (bits - 1));
+  case 0x28:
+    return a >> (b & (bits - 1));
+  case 0x29:
+    return (uint64_t)(sa >> (b & (bits - 1)));
+  default:
+    return 0;
+  }
+}
+
+static uint64_t mulh(uint64_t a, uint64_t b, unsigned sb, int sign) {
+  /* sign: 0 unsigned, 1 signed, 2 signed a * unsigned b */
+  __int128 x = sign ? (__int128)sext_sew(a, sb) : (__int128)a;
+  __int128 y = sign == 1 ? (__int128)sext_sew(b, sb) : (__int128)b;
+  if (sign == 0) {
+    return (uint64_t)(((unsigned __int128)a * b) >> (8 * sb));
+  }
+  return (uint64_t)((x * y) >> (8 * sb));
+}
+
+static uint64_t opm_elem(uint32_t f6, uint64_t a, uint64_t b, uint64_t d,
+                         unsigned sb) {
+  int64_t sa = sext_sew(a, sb), sbv = sext_sew(b, sb);
+  int64_t smin = sext_sew(1ull << (8 * sb - 1), sb);
+
+  switch (f6) {
+  case 0x20:
+    return b == 0 ? ~0ull : a / b;
+  case 0x21:
+    if (b == 0) {
+      return ~0ull;
+    }
+    if (sa == smin && sbv == -1) {
+      return a;
+    }
+    return (uint64_t)(sa / sbv);
+  case 0x22:
+    return b == 0 ? a : a % b;
+  case 0x23:
+    if (b == 0) {
+      return a;
+    }
+    if (sa == smin && sbv == -1) {
+      return 0;
+    }
+    return (uint64_t)(sa % sbv);
+  case 0x24:
+    return mulh(a, b, sb, 0);
+  case 0x25:
+    return a * b;
+  case 0x26:
+    return mulh(a, b, sb, 2);
+  case 0x27:
+    return mulh(a, b, sb, 1);
+  case 0x29: /* vmadd: vd = vs1 * vd + vs2 */
+    return b * d + a;
+  case 0x2B: /* vnmsub: vd = -(vs1 * vd) + vs2 */
+    return a - b * d;
+  case 0x2D: /* vmacc: vd = vs1 * vs2 + vd */
+    return b * a + d;
+  case 0x2F: /* vnmsac: vd = -(vs1 * vs2) + vd */
+    return d - b * a;
+  default:
+    return 0;
+  }
+}
+
+static bool opm_arith(uint32_t f6) {
+  return (f6 >= 0x20 && f6 <= 0x27) || f6 == 0x29 || f6 == 0x2B ||
+         f6 == 0x2D || f6 == 0x2F;
+}
+
+/* Fills n bytes with copies of an SEW-wide scalar, doubling each copy. */
+static void splat(uint8_t *buf, uint64_t v, unsigned sb, uint64_t n) {
+  if (sb == 1) {
+    memset(buf, (int)v, n);
+    return;
+  }
+  memcpy(buf, &v, sb);
+  for (uint64_t have = sb; have < n; have *= 2) {
+    memcpy(buf + have, buf, have < n - have ? have : n - have);
+  }
+}
+
+static void exec_slide(Cpu *cpu, const VecCfg *c, uint32_t f6, uint32_t vd,
+                       uint32_t vs2, uint64_t off, bool vm, bool one,
+                       uint64_t x) {
+  uint8_t *d = vreg(cpu, vd);
+  const uint8_t *s = vreg(cpu, vs2);
+  unsigned sb = c->sb;
+
+  if (f6 == 0x0E) { /* slideup: walk down so vd may not be read after write */
+    for (uint64_t i = c->vl; i-- > c->vstart;) {
+      if (!active(cpu, vm, i)) {
+        continue;
+      }
+      if (i >= off) {
+        vput(d, i, sb, vget(s, i - off, sb));
+      } else if (one && i == 0) {
+        vput(d, i, sb, x);
+      }
+    }
+  } else {
+    for (uint64_t i = c->vstart; i < c->vl; i++) {
+      if (!active(cpu, vm, i)) {
+        continue;
+      }
+      uint64_t v;
+      if (one && i == c->vl - 1) {
+        v = x;
+      } else {
+        v = (off < c->vlmax && i + off < c->vlmax) ? vget(s, i + off, sb) : 0;
+      }
+      vput(d, i, sb, v);
+    }
+  }
+}
+
+static bool exec_opi(Cpu *cpu, uint32_t insn, uint32_t f3) {
+  uint32_t vd = (insn >> 7) & 0x1F;
+  uint32_t rs1 = (insn >> 15) & 0x1F;
+  uint32_t vs2 = (insn >> 20) & 0x1F;
+  bool vm = (insn >> 25) & 1;
+  uint32_t f6 = insn >> 26;
+  unsigned form = f3 == F3_OPIVV ? VV : f3 == F3_OPIVX ? VX : VI;
+
+  if (!(opi_forms[f6] & form)) {
+    return false;
+  }
+
+  if (f6 == 0x27) { /* vmv<nr>r.v: whole registers, ignores vtype */
+    uint32_t nr = rs1 + 1;
+    if (!vm || (nr & (nr - 1)) || nr > 8 || vd % nr || vs2 % nr) {
+      return false;
+    }
+    memmove(vreg(cpu, vd), vreg(cpu, vs2), (size_t)nr * cpu->vlenb);
+    cpu->csr[CSR_VSTART] = 0;
+    return true;
+  }
+
+  VecCfg c;
+  if (!load_cfg(cpu, &c)) {
+    return false;
+  }
+  unsigned sb = c.sb;
+  bool cmp = is_compare(f6);
+  bool merge = f6 == 0x17;
+
+  if (f6 == 0x30 || f6 == 0x31) { /* 2*SEW sum of SEW elements */
+    if (sb == 8 || !group_ok(vs2, c.lmul8)) {
+      return false;
+    }
+    if (c.vl > 0) {
+      uint64_t acc = vget(vreg(cpu, rs1), 0, 2 * sb);
+      uint64_t i = c.vstart;
+      if (f6 == 0x30 && vm && i == 0) {
+        acc += vk_sum[log2_sb(sb)](vreg(cpu, vs2), c.vl * sb);
+        i = c.vl;
+      }
+      for (; i < c.vl; i++) {
+        if (active(cpu, vm, i)) {
+          uint64_t x = vget(vreg(cpu, vs2), i, sb);
+          acc += f6 == 0x30 ? x : (uint64_t)sext_sew(x, sb);
+        }
+      }
+      vput(vreg(cpu, vd), 0, 2 * sb, acc);
+    }
+    cpu->csr[CSR_VSTART] = 0;
+    return true;
+  }
+
+  if (!group_ok(vs2, c.lmul8) || (form == VV && !group_ok(rs1, c.lmul8)) ||
+      (!cmp && !group_ok(vd, c.lmul8)) || (!cmp && !vm && vd == 0) ||
+      (merge && vm && vs2 != 0)) {
+    return false;
+  }
+
+  /* Scalar operand: x[rs1], or simm5 (uimm5 for shifts and slides). */
+  bool unsigned_imm = f6 == 0x25 || f6 == 0x28 || f6 == 0x29 ||
+                      f6 == 0x0E || f6 == 0x0F;
+  uint64_t scalar;
+  if (form == VX) {
+    scalar = cpu->x[rs1];
+  } else {
+    scalar = unsigned_imm ? rs1 : (uint64_t)((int64_t)(rs1 << 27) >> 27);
+  }
+
+  if (f6 == 0x0E || f6 == 0x0F) {
+    if (f6 == 0x0E && vd == vs2) {
+      return false;
+    }
+    exec_slide(cpu, &c, f6, vd, vs2, scalar, vm, false, 0);
+    cpu->csr[CSR_VSTART] = 0;
+    return true;
+  }
+  if (form != VV) {
+    scalar = trunc_sew(scalar, sb);
+  }
+
+  uint8_t *d = vreg(cpu, vd);
+  const uint8_t *a = vreg(cpu, vs2);
+  const uint8_t *b = vreg(cpu, rs1);
+  _Alignas(32) uint8_t tmp[GROUP_MAX];
+  uint64_t start = c.vstart;
+
+  if (c.vstart == 0 && c.vl > 0 && (vm || merge)) {
+    uint64_t n = c.vl * sb;
+    unsigned k = opi_kernel[f6];
+    unsigned ls = log2_sb(sb);
+    bool eq = f6 == 0x18 || f6 == 0x19;
+    if (form != VV && (k || eq || f6 == 0x03 || (merge && vm))) {
+      splat(tmp, scalar, sb, n);
+      b = tmp;
+    }
+    if (merge && vm) { /* vmv.v.{v,x,i} */
+      memmove(d, b, n);
+      start = c.vl;
+    } else if (k && vm) {
+      vk_bin[k - 1][ls](d, a, b, n);
+      start = c.vl;
+    } else if (f6 == 0x03 && vm) {
+      vk_bin[VK_SUB][ls](d, b, a, n);
+      start = c.vl;
+    } else if (eq && vm) {
+      start = vk_cmp[f6 == 0x18 ? VC_EQ : VC_NE][ls](d, a, b, c.vl);
+    }
+  }
+
+  for (uint64_t i = start; i < c.vl; i++) {
+    bool on = active(cpu, vm, i);
+    uint64_t x = vget(a, i, sb);
+    uint64_t y = form == VV ? vget(b, i, sb) : scalar;
+    if (merge) {
+      vput(d, i, sb, on ? y : x);
+    } else if (!on) {
+      continue;
+    } else if (cmp) {
+      mput(d, i, opi_elem(cpu, f6, x, y, sb));
+    } else {
+      vput(d, i, sb, opi_elem(cpu, f6, x, y, sb));
+    }
+  }
+  cpu->csr[CSR_VSTART] = 0;
+  return true;
+}
+
+static uint64_t reduce(uint32_t f6, uint64_t acc, uint64_t x, unsigned sb) {
+  switch (f6) {
+  case 0x00:
+    return acc + x;
+  case 0x01:
+    return acc & x;
+  case 0x02:
+    return acc | x;
+  case 0x03:
+    return acc ^ x;
+  case 0x04:
+    return x < acc ? x : acc;
+  case 0x05:
+    return sext_sew(x, sb) < sext_sew(acc, sb) ? x : acc;
+  case 0x06:
+    return x > acc ? x : acc;
+  default:
+    return sext_sew(x, sb) > sext_sew(acc, sb) ? x : acc;
+  }
+}
+
+static bool mask_logic(uint32_t f6, bool a, bool b) {
+  switch (f6) {
+  case 0x18:
+    return a && !b;
+  case 0x19:
+    return a && b;
+  case 0x1A:
+    return a || b;
+  case 0x1B:
+    return a != b;
+  case 0x1C:
+    return a || !b;
+  case 0x1D:
+    return !(a && b);
+  case 0x1E:
+    return !(a || b);
+  default:
+    return a == b;
+  }
+}
+
+static uint8_t mask_logic_byte(uint32_t f6, uint8_t a, uint8_t b) {
+  switch (f6) {
+  case 0x18:
+    return a & (uint8_t)~b;
+  case 0x19:
+    return a & b;
+  case 0x1A:
+    return a | b;
+  case 0x1B:
+    return a ^ b;
+  case 0x1C:
+    return a | (uint8_t)~b;
+  case 0x1D:
+    return (uint8_t)~(a & b);
+  case 0x1E:
+    return (uint8_t)~(a | b);
+  default:
+    return (uint8_t)~(a ^ b);
+  }
+}
+
+static bool exec_opm(Cpu *cpu, uint32_t insn, uint32_t f3) {
+  uint32_t vd = (insn >> 7) & 0x1F;
+  uint32_t rs1 = (insn >> 15) & 0x1F;
+  uint32_t vs2 = (insn >> 20) & 0x1F;
+  bool vm = (insn >> 25) & 1;
+  uint32_t f6 = insn >> 26;
+  bool vx = f3 == F3_OPMVX;
+
+  VecCfg c;
+  if (!load_cfg(cpu, &c)) {
+    return false;
+  }
+  unsigned sb = c.sb;
+  uint8_t *d = vreg(cpu, vd);
+  const uint8_t *a = vreg(cpu, vs2);
+  const uint8_t *b = vreg(cpu, rs1);
+
+  if (f6 == 0x10) {
+    if (vx) { /* vmv.s.x */
+      if (vs2 != 0 || !vm) {
+        return false;
+      }
+      if (c.vstart < c.vl) {
+        vput(d, 0, sb, trunc_sew(cpu->x[rs1], sb));
+      }
+    } else {
+      uint64_t r;
+      if (!vm && rs1 == 0) {
+        return false;
+      }
+      if (rs1 == 0x00) { /* vmv.x.s */
+        r = (uint64_t)sext_sew(vget(a, 0, sb), sb);
+      } else if (rs1 == 0x10 || rs1 == 0x11) { /* vcpop.m, vfirst.m */
+        uint64_t count = 0, first = ~0ull;
+        for (uint64_t i = 0; i < c.vl; i++) {
+          if (active(cpu, vm, i) && mbit(a, i)) {
+            first = count++ == 0 ? i : first;
+          }
+        }
+        r = rs1 == 0x10 ? count : first;
+      } else {
+        return false;
+      }
+      if (vd) {
+        cpu->x[vd] = r;
+      }
+    }
+    cpu->csr[CSR_VSTART] = 0;
+    return true;
+  }
+
+  if (f6 == 0x0E || f6 == 0x0F) { /* vslide1up, vslide1down */
+    if (!vx || !group_ok(vd, c.lmul8) || !group_ok(vs2, c.lmul8) ||
+        (!vm && vd == 0) || (f6 == 0x0E && vd == vs2)) {
+      return false;
+    }
+    exec_slide(cpu, &c, f6, vd, vs2, 1, vm, true,
+               trunc_sew(cpu->x[rs1], sb));
+    cpu->csr[CSR_VSTART] = 0;
+    return true;
+  }
+
+  if (!vx && f6 <= 0x07) { /* reductions */
+    if (!group_ok(vs2, c.lmul8)) {
+      return false;
+    }
+    if (c.vl > 0) {
+      uint64_t acc = vget(b, 0, sb);
+      uint64_t i = c.vstart;
+      if (f6 == 0x00 && vm && i == 0) {
+        acc += vk_sum[log2_sb(sb)](a, c.vl * sb);
+        i = c.vl;
+      }
+      for (; i < c.vl; i++) {
+        if (active(cpu, vm, i)) {
+          acc = reduce(f6, acc, vget(a, i, sb), sb);
+        }
+      }
+      vput(d, 0, sb, trunc_sew(acc, sb));
+    }
+    cpu->csr[CSR_VSTART] = 0;
+    return true;
+  }
+
+  if (!vx && f6 >= 0x18 && f6 <= 0x1F) { /* mask logical */
+    if (!vm) {
+      return false;
+    }
+    uint64_t i = c.vstart;
+    if (i == 0) {
+      for (; i + 8 <= c.vl; i += 8) {
+        d[i / 8] = mask_logic_byte(f6, a[i / 8], b[i / 8]);
+      }
+    }
+    for (; i < c.vl; i++) {
+      mput(d, i, mask_logic(f6, mbit(a, i), mbit(b, i)));
+    }
+    cpu->csr[CSR_VSTART] = 0;
+    return true;
+  }
+
+  if (!vx && f6 == 0x14) { /* VMUNARY0 */
+    bool to_mask = rs1 >= 1 && rs1 <= 3;
+    if ((!to_mask && !group_ok(vd, c.lmul8)) || (!vm && vd == 0)) {
+      return false;
+    }
+    if (rs1 == 0x11) { /* vid.v */
+      for (uint64_t i = c.vstart; i < c.vl; i++) {
+        if (active(cpu, vm, i)) {
+          vput(d, i, sb, i);
+        }
+      }
+    } else if (rs1 == 0x10) { /* viota.m */
+      uint64_t n = 0;
+      for (uint64_t i = 0; i < c.vl; i++) {
+        if (active(cpu, vm, i)) {
+          bool bit = mbit(a, i);
+          vput(d, i, sb, n);
+          n += bit;
+        }
+      }
+    } else if (to_mask) { /* vmsbf, vmsof, vmsif */
+      bool seen = false;
+      for (uint64_t i = 0; i < c.vl; i++) {
+        if (!active(cpu, vm, i)) {
+          continue;
+        }
+        bool hit = mbit(a, i) && !seen;
+        bool r = rs1 == 1 ? !seen && !hit : rs1 == 2 ? hit : !seen;
+        seen = seen || hit;
+        mput(d, i, r);
+      }
+    } else {
+      return false;
+    }
+    cpu->csr[CSR_VSTART] = 0;
+    return true;
+  }
+
+  if (!opm_arith(f6) || !group_ok(vd, c.lmul8) || !group_ok(vs2, c.lmul8) ||
+      (!vx && !group_ok(rs1, c.lmul8)) || (!vm && vd == 0)) {
+    return false;
+  }
+  uint64_t scalar = trunc_sew(cpu->x[rs1], sb);
+  for (uint64_t i = c.vstart; i < c.vl; i++) {
+    if (!active(cpu, vm, i)) {
+      continue;
+    }
+    uint64_t x = vget(a, i, sb);
+    uint64_t y = vx ? scalar : vget(b, i, sb);
+    vput(d, i, sb, opm_elem(f6, x, y, vget(d, i, sb), sb));
+  }
+  cpu->csr[CSR_VSTART] = 0;
+  return true;
+}
+
+bool vec_exec(Machine *m, Cpu *cpu, uint32_t insn) {
+  if (!(cpu->csr[CSR_MSTATUS] & MSTATUS_VS)) {
+    return false;
+  }
+
+  uint32_t opcode = insn & 0x7F;
+  bool ok;
+  if (opcode == 0x07 || opcode == 0x27) {
+    ok = exec_mem(m, cpu, insn, opcode == 0x27);
+  } else {
+    uint32_t f3 = (insn >> 12) & 0x7;
+    switch (f3) {
+    case F3_OPCFG:
+      exec_vsetvl(cpu, insn);
+      ok = true;
+      break;
+    case F3_OPIVV:
+    case F3_OPIVI:
+    case F3_OPIVX:
+      ok = exec_opi(cpu, insn, f3);
+      break;
+    case F3_OPMVV:
+    case F3_OPMVX:
+      ok = exec_opm(cpu, insn, f3);
+      break;
+    default: /* vector floating point is not implemented */
+      ok = false;
+      break;
+    }
+  }
+
+  if (ok && opcode != 0x27) {
+    mark_dirty(cpu);
+  }
+  return ok;
+}
@@ -0,0 +1,475 @@
+#include <stdlib.h>
+#include <string.h>
+
+#include "rivos_sim/mem.h"
+#include "rivos_sim/virtio.h"
+
+enum {
+  VIRTIO_MMIO_MAGIC = 0x000,
+  VIRTIO_MMIO_VERSION = 0x004,
+  VIRTIO_MMIO_DEVICE_ID = 0x008,
+  VIRTIO_MMIO_VENDOR_ID = 0x00c,
+  VIRTIO_MMIO_DEVICE_FEATURES = 0x010,
+  VIRTIO_MMIO_DEVICE_FEATURES_SEL = 0x014,
+  VIRTIO_MMIO_DRIVER_FEATURES = 0x020,
+  VIRTIO_MMIO_DRIVER_FEATURES_SEL = 0x024,
+  VIRTIO_MMIO_QUEUE_SEL = 0x030,
+  VIRTIO_MMIO_QUEUE_NUM_MAX = 0x034,
+  VIRTIO_MMIO_QUEUE_NUM = 0x038,
+  VIRTIO_MMIO_QUEUE_READY = 0x044,
+  VIRTIO_MMIO_QUEUE_NOTIFY = 0x050,
+  VIRTIO_MMIO_INTERRUPT_STATUS = 0x060,
+  VIRTIO_MMIO_INTERRUPT_ACK = 0x064,
+  VIRTIO_MMIO_STATUS = 0x070,
+  VIRTIO_MMIO_QUEUE_DESC_LOW = 0x080,
+  VIRTIO_MMIO_QUEUE_DESC_HIGH = 0x084,
+  VIRTIO_MMIO_QUEUE_DRIVER_LOW = 0x090,
+  VIRTIO_MMIO_QUEUE_DRIVER_HIGH = 0x094,
+  VIRTIO_MMIO_QUEUE_DEVICE_LOW = 0x0a0,
+  VIRTIO_MMIO_QUEUE_DEVICE_HIGH = 0x0a4,
+  VIRTIO_MMIO_CONFIG_GENERATION = 0x0fc,
+  VIRTIO_MMIO_CONFIG = 0x100,
+};
+
+enum {
+  VIRTQ_DESC_F_NEXT = 1,
+  VIRTQ_DESC_F_WRITE = 2,
+  VIRTQ_DESC_F_INDIRECT = 4,
+};
+
+enum {
+  VIRTIO_INT_USED_RING = 1,
+};
+
+static inline uint16_t ld16(const uint8_t *p) {
+  return (uint16_t)(p[0] | p[1] << 8);
+}
+
+static inline uint32_t ld32(const uint8_t *p) {
+  return (uint32_t)ld16(p) | (uint32_t)ld16(p + 2) << 16;
+}
+
+static inline uint64_t ld64(const uint8_t *p) {
+  return (uint64_t)ld32(p) | (uint64_t)ld32(p + 4) << 32;
+}
+
+static inline void st16(uint8_t *p, uint16_t v) {
+  p[0] = (uint8_t)v;
+  p[1] = (uint8_t)(v >> 8);
+}
+
+static inline void st32(uint8_t *p, uint32_t v) {
+  st16(p, (uint16_t)v);
+  st16(p + 2, (uint16_t)(v >> 16));
+}
+
+static void set_hi(uint64_t *r, uint32_t v) {
+  *r = (*r & 0xffffffffull) | (uint64_t)v << 32;
+}
+
+static void set_lo(uint64_t *r, uint32_t v) {
+  *r = (*r & ~0xffffffffull) | v;
+}
+
+static void update_irq(VirtioDev *d) {
+  machine_set_irq(d->m, d->irq, atomic_load(&d->int_status) != 0);
+}
+
+static void reset(VirtioDev *d) {
+  if (d->ops->reset) {
+    d->ops->reset(d);
+  }
+  atomic_store(&d->status, 0);
+  d->dev_features_sel = 0;
+  d->drv_features_sel = 0;
+  d->driver_features = 0;
+  d->queue_sel = 0;
+  for (uint32_t i = 0; i < d->ops->num_queues; i++) {
+    VirtQueue *q = &d->queues[i];
+    atomic_store(&q->ready, false);
+    q->num = 0;
+    q->desc = q->avail = q->used = 0;
+    q->last_avail = q->used_idx = 0;
+  }
+  atomic_store(&d->int_status, 0);
+  update_irq(d);
+}
+
+static VirtQueue *cur_queue(VirtioDev *d) {
+  return d->queue_sel < d->ops->num_queues ? &d->queues[d->queue_sel] : NULL;
+}
+
+static uint64_t mmio_read(void *opaque, uint64_t off, unsigned size) {
+  VirtioDev *d = (VirtioDev *)opaque;
+
+  if (off >= VIRTIO_MMIO_CONFIG) {
+    uint64_t co = off - VIRTIO_MMIO_CONFIG;
+    uint64_t v = 0;
+    for (unsigned i = 0; i < size; i++) {
+      if (co + i < d->config_size) {
+        v |= (uint64_t)d->config[co + i] << (8 * i);
+      }
+    }
+    return v;
+  }
+  if (size != 4) {
+    return 0;
+  }
+
+  VirtQueue *q = cur_queue(d);
+  switch (off) {
+  case VIRTIO_MMIO_MAGIC:
+    return 0x74726976; /* "virt" */
+  case VIRTIO_MMIO_VERSION:
+    return 2;
+  case VIRTIO_MMIO_DEVICE_ID:
+    return d->ops->device_id;
+  case VIRTIO_MMIO_VENDOR_ID:
+    return 0x554d4551; /* "QEMU", which Linux and OpenSBI recognise */
+  case VIRTIO_MMIO_DEVICE_FEATURES:
+    return d->dev_features_sel < 2
+               ? (uint32_t)(d->ops->features >> (32 * d->dev_features_sel))
+               : 0;
+  case VIRTIO_MMIO_QUEUE_NUM_MAX:
+    return q ? VIRTQ_MAX_SIZE : 0;
+  case VIRTIO_MMIO_QUEUE_READY:
+    return q ? atomic_load(&q->ready) : 0;
+  case VIRTIO_MMIO_INTERRUPT_STATUS:
+    return atomic_load(&d->int_status);
+  case VIRTIO_MMIO_STATUS:
+    return atomic_load(&d->status);
+  case VIRTIO_MMIO_CONFIG_GENERATION:
+    return 0;
+  default:
+    return 0;
+  }
+}
+
+static void mmio_write(void *opaque, uint64_t off, unsigned size,
+                       uint64_t val) {
+  VirtioDev *d = (VirtioDev *)opaque;
+  uint32_t v = (uint32_t)val;
+
+  /* Config space is read-only for the devices we model. */
+  if (off >= VIRTIO_MMIO_CONFIG || size != 4) {
+    return;
+  }
+
+  VirtQueue *q = cur_queue(d);
+  /* Queue layout may only change while the queue is disabled. */
+  bool q_live = q && atomic_load(&q->ready);
+  switch (off) {
+  case VIRTIO_MMIO_DEVICE_FEATURES_SEL:
+    d->dev_features_sel = v;
+    break;
+  case VIRTIO_MMIO_DRIVER_FEATURES:
+    if (d->drv_features_sel == 0) {
+      set_lo(&d->driver_features, v);
+    } else if (d->drv_features_sel == 1) {
+      set_hi(&d->driver_features, v);
+    }
+    break;
+  case VIRTIO_MMIO_DRIVER_FEATURES_SEL:
+    d->drv_features_sel = v;
+    break;
+  case VIRTIO_MMIO_QUEUE_SEL:
+    d->queue_sel = v;
+    break;
+  case VIRTIO_MMIO_QUEUE_NUM:
+    if (q && !q_live && v && v <= VIRTQ_MAX_SIZE && !(v & (v - 1))) {
+      q->num = v;
+    }
+    break;
+  case VIRTIO_MMIO_QUEUE_READY:
+    if (q) {
+      if (v && q->num) {
+        q->last_avail = 0;
+        q->used_idx = 0;
+      }
+      atomic_store(&q->ready, v && q->num);
+    }
+    break;
+  case VIRTIO_MMIO_QUEUE_NOTIFY:
+    if (v < d->ops->num_queues && atomic_load(&d->queues[v].ready) &&
+        (atomic_load(&d->status) & VIRTIO_STATUS_DRIVER_OK)) {
+      d->ops->notify(d, v);
+    }
+    break;
+  case VIRTIO_MMIO_INTERRUPT_ACK:
+    atomic_fetch_and(&d->int_status, ~v);
+    update_irq(d);
+    break;
+  case VIRTIO_MMIO_STATUS:
+    if (v == 0) {
+      reset(d);
+    } else {
+      if ((v & VIRTIO_STATUS_FEATURES_OK) &&
+          (d->driver_features & ~d->ops->features)) {
+        v &= ~(uint32_t)VIRTIO_STATUS_FEATURES_OK;
+      }
+      /* NEEDS_RESET is the device's; only a reset clears it. */
+      atomic_fetch_and(&d->status, VIRTIO_STATUS_NEEDS_RESET);
+      atomic_fetch_or(&d->status, v);
+    }
+    break;
+  case VIRTIO_MMIO_QUEUE_DESC_LOW:
+    if (q && !q_live) set_lo(&q->desc, v);
+    break;
+  case VIRTIO_MMIO_QUEUE_DESC_HIGH:
+    if (q && !q_live) set_hi(&q->desc, v);
+    break;
+  case VIRTIO_MMIO_QUEUE_DRIVER_LOW:
+    if (q && !q_live) set_lo(&q->avail, v);
+    break;
+  case VIRTIO_MMIO_QUEUE_DRIVER_HIGH:
+    if (q && !q_live) set_hi(&q->avail, v);
+    break;
+  case VIRTIO_MMIO_QUEUE_DEVICE_LOW:
+    if (q && !q_live) set_lo(&q->used, v);
+    break;
+  case VIRTIO_MMIO_QUEUE_DEVICE_HIGH:
+    if (q && !q_live) set_hi(&q->used, v);
+    break;
+  default:
+    break;
+  }
+}
+
+static void mmio_destroy(void *opaque) {
+  VirtioDev *d = (VirtioDev *)opaque;
+  /* The device may free d itself once its workers are stopped. */
+  VirtQueue *queues = d->queues;
+  if (d->ops->destroy) {
+    d->ops->destroy(d);
+  }
+  free(queues);
+}
+
+bool virtio_mmio_add(Machine *m, VirtioDev *d, const VirtioOps *ops,
+                     void *opaque, const void *config, size_t config_size) {
+  size_t slot = 0;
+  for (; slot < RIVOS_SIM_VIRTIO_SLOTS; slot++) {
+    uint64_t base = RIVOS_SIM_VIRTIO_BASE + slot * RIVOS_SIM_VIRTIO_STRIDE;
+    bool used = false;
+    for (size_t i = 0; i < m->nmmio; i++) {
+      used |= m->mmio[i].base == base;
+    }
+    if (!used) {
+      break;
+    }
+  }
+  if (slot == RIVOS_SIM_VIRTIO_SLOTS) {
+    return false;
+  }
+
+  memset(d, 0, sizeof(*d));
+  d->m = m;
+  d->ops = ops;
+  d->opaque = opaque;
+  d->irq = RIVOS_SIM_VIRTIO_IRQ + (uint32_t)slot;
+  d->config = (const uint8_t *)config;
+  d->config_size = config_size;
+  d->queues = (VirtQueue *)calloc(ops->num_queues, sizeof(VirtQueue));
+  if (!d->queues) {
+    return false;
+  }
+
+  MmioRegion r = {
+      .base = RIVOS_SIM_VIRTIO_BASE + slot * RIVOS_SIM_VIRTIO_STRIDE,
+      .size = RIVOS_SIM_VIRTIO_STRIDE,
+      .opaque = d,
+      .read = mmio_read,
+      .write = mmio_write,
+      .destroy = mmio_destroy,
+  };
+  if (!machine_add_mmio(m, &r)) {
+    free(d->queues);
+    d->queues = NULL;
+    return false;
+  }
+  return true;
+}
+
+static bool chain_fail(VirtioDev *d) {
+  atomic_fetch_or(&d->status, VIRTIO_STATUS_NEEDS_RESET);
+  return false;
+}
+
+static bool add_seg(VirtioDev *d, VirtqChain *c, const uint8_t *desc) {
+  uint64_t addr = ld64(desc);
+  uint32_t len = ld32(desc + 8);
+  bool writable = ld16(desc + 12) & VIRTQ_DESC_F_WRITE;
+  uint32_t n = c->nin + c->nout;
+
+  /* Readable segments must all precede writable ones. */
+  if (n == VIRTQ_MAX_SEGS || (!writable && c->nout)) {
+    return false;
+  }
+  uint8_t *p = mem_ram_ptr(d->m, addr, len);
+  if (!p) {
+    return false;
+  }
+  c->iov[n].iov_base = p;
+  c->iov[n].iov_len = len;
+  c->gpa[n] = addr;
+  if (writable) {
+    c->nout++;
+  } else {
+    c->nin++;
+  }
+  return true;
+}
+
+bool virtq_pop(VirtioDev *d, VirtQueue *q, VirtqChain *c) {
+  if (!atomic_load(&q->ready)) {
+    return false;
+  }
+  uint8_t *avail = mem_ram_ptr(d->m, q->avail, 4 + 2 * (uint64_t)q->num);
+  uint8_t *desc = mem_ram_ptr(d->m, q->desc, 16 * (uint64_t)q->num);
+  if (!avail || !desc) {
+    return chain_fail(d);
+  }
+
+  uint16_t idx = __atomic_load_n((uint16_t *)(avail + 2), __ATOMIC_ACQUIRE);
+  if (idx == q->last_avail) {
+    return false;
+  }
+  uint16_t head = ld16(avail + 4 + 2 * (q->last_avail % q->num));
+  q->last_avail++;
+
+  c->head = head;
+  c->nin = c->nout = 0;
+
+  const uint8_t *table = desc;
+  uint32_t table_num = q->num;
+  uint32_t i = head;
+  for (uint32_t steps = 0;; steps++) {
+    if (i >= table_num || steps >= table_num) {
+      return chain_fail(d);
+    }
+    const uint8_t *e = table + 16 * i;
+    uint16_t flags = ld16(e + 12);
+
+    if (flags & VIRTQ_DESC_F_INDIRECT) {
+      uint32_t len = ld32(e + 8);
+      if (table != desc || (flags & VIRTQ_DESC_F_NEXT) || len % 16 ||
+          len == 0) {
+        return chain_fail(d);
+      }
+      table = mem_ram_ptr(d->m, ld64(e), len);
+      if (!table) {
+        return chain_fail(d);
+      }
+      table_num = len / 16;
+      i = 0;
+      steps = 0;
+      continue;
+    }
+
+    if (!add_seg(d, c, e)) {
+      return chain_fail(d);
+    }
+    if (!(flags & VIRTQ_DESC_F_NEXT)) {
+      return true;
+    }
+    i = ld16(e + 14);
+  }
+}
+
+void virtq_mark_written(VirtioDev *d, const VirtqChain *c, uint32_t written) {
+  for (uint32_t i = c->nin, left = written; i < c->nin + c->nout && left;
+       i++) {
+    uint32_t n = left < c->iov[i].iov_len ? left : (uint32_t)c->iov[i].iov_len;
+    mem_mark_dirty(d->m, c->gpa[i], n);
+    left -= n;
+  }
+}
+
+void virtq_push(VirtioDev *d, VirtQueue *q, const VirtqChain *c,
+                uint32_t written) {
+  virtq_mark_written(d, c, written);
+  virtq_push_used(d, q, c->head, written);
+}
+
+void virtq_push_used(VirtioDev *d, VirtQueue *q, uint16_t head,
+                     uint32_t written) {
+  uint8_t *used = mem_ram_ptr(d->m, q->used, 4 + 8 * (uint64_t)q->num);
+  if (!used) {
+    atomic_fetch_or(&d->status, VIRTIO_STATUS_NEEDS_RESET);
+    return;
+  }
+  uint8_t *elem = used + 4 + 8 * (q->used_idx % q->num);
+  st32(elem, head);
+  st32(elem + 4, written);
+  q->used_idx++;
+  __atomic_store_n((uint16_t *)(used + 2), q->used_idx, __ATOMIC_RELEASE);
+  mem_mark_dirty(d->m, q->used, 4 + 8 * (uint64_t)q->num);
+
+  atomic_fetch_or(&d->int_status, VIRTIO_INT_USED_RING);
+  update_irq(d);
+}
+
+size_t virtq_chain_len(const VirtqChain *c, bool writable) {
+  uint32_t lo = writable ? c->nin : 0;
+  uint32_t hi = writable ? c->nin + c->nout : c->nin;
+  size_t n = 0;
+  for (uint32_t i = lo; i < hi; i++) {
+    n += c->iov[i].iov_len;
+  }
+  return n;
+}
+
+static size_t chain_copy(const VirtqChain *c, bool writable, size_t off,
+                         void *buf, size_t len) {
+  uint32_t lo = writable ? c->nin : 0;
+  uint32_t hi = writable ? c->nin + c->nout : c->nin;
+  size_t done = 0;
+  for (uint32_t i = lo; i < hi && done < len; i++) {
+    size_t seg = c->iov[i].iov_len;
+    if (off >= seg) {
+      off -= seg;
+      continue;
+    }
+    size_t n = seg - off < len - done ? seg - off : len - done;
+    uint8_t *p = (uint8_t *)c->iov[i].iov_base + off;
+    if (writable) {
+      memcpy(p, (uint8_t *)buf + done, n);
+    } else {
+      memcpy((uint8_t *)buf + done, p, n);
+    }
+    done += n;
+    off = 0;
+  }
+  return done;
+}
+
+size_t virtq_chain_read(const VirtqChain *c, size_t off, void *dst,
+                        size_t len) {
+  return chain_copy(c, false, off, dst, len);
+}
+
+size_t virtq_chain_write(const VirtqChain *c, size_t off, const void *src,
+                         size_t len) {
+  return chain_copy(c, true, off, (void *)src, len);
+}
+
+int virtq_chain_iov(const VirtqChain *c, bool writable, size_t off,
+                    size_t len, struct iovec *out) {
+  uint32_t lo = writable ? c->nin : 0;
+  uint32_t hi = writable ? c->nin + c->nout : c->nin;
+  int n = 0;
+  for (uint32_t i = lo; i < hi && len; i++) {
+    size_t seg = c->iov[i].iov_len;
+    if (off >= seg) {
+      off -= seg;
+      continue;
+    }
+    size_t take = seg - off < len ? seg - off : len;
+    out[n].iov_base = (uint8_t *)c->iov[i].iov_base + off;
+    out[n].iov_len = take;
+    n++;
+    len -= take;
+    off = 0;
+  }
+  return n;
+}
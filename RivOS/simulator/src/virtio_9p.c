@@ -0,0 +1,1163 @@
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/statfs.h>
+#include <sys/sysmacros.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "rivos_sim/devworker.h"
+#include "rivos_sim/virtio.h"
+#include "rivos_sim/virtio_9p.h"
+
+enum {
+  VIRTIO_9P_F_MOUNT_TAG = 0,
+};
+
+enum {
+  P9_RLERROR = 7,
+  P9_TSTATFS = 8,
+  P9_TLOPEN = 12,
+  P9_TLCREATE = 14,
+  P9_TSYMLINK = 16,
+  P9_TMKNOD = 18,
+  P9_TRENAME = 20,
+  P9_TREADLINK = 22,
+  P9_TGETATTR = 24,
+  P9_TSETATTR = 26,
+  P9_TXATTRWALK = 30,
+  P9_TXATTRCREATE = 32,
+  P9_TREADDIR = 40,
+  P9_TFSYNC = 50,
+  P9_TLOCK = 52,
+  P9_TGETLOCK = 54,
+  P9_TLINK = 70,
+  P9_TMKDIR = 72,
+  P9_TRENAMEAT = 74,
+  P9_TUNLINKAT = 76,
+  P9_TVERSION = 100,
+  P9_TATTACH = 104,
+  P9_TFLUSH = 108,
+  P9_TWALK = 110,
+  P9_TREAD = 116,
+  P9_TWRITE = 118,
+  P9_TCLUNK = 120,
+  P9_TREMOVE = 122,
+};
+
+enum {
+  /* size[4] type[1] tag[2] */
+  P9_HDR_SIZE = 7,
+  /* Twrite up to its data: fid[4] offset[8] count[4]. */
+  P9_TWRITE_HDR = P9_HDR_SIZE + 16,
+  /* Rread up to its data: count[4]. */
+  P9_RREAD_HDR = P9_HDR_SIZE + 4,
+  P9_MAX_MSIZE = 1u << 20,
+  /* Largest message other than Twrite: Tsymlink with two long names. */
+  P9_MAX_TMSG = 2 * PATH_MAX + 64,
+  /* Largest reply other than Rread, and so the largest Rreaddir. */
+  P9_MAX_RMSG = 64u * 1024u,
+  P9_MAX_WELEM = 16,
+  P9_MAX_FIDS = 1u << 16,
+  P9_NOFID = 0xffffffffu,
+  P9_QTDIR = 0x80,
+  P9_QTSYMLINK = 0x02,
+  P9_GETATTR_BASIC = 0x7ff,
+  P9_LOCK_SUCCESS = 0,
+  P9_AT_REMOVEDIR = 0x200,
+  /* Read-only file descriptors kept after their fids are clunked. */
+  P9_FD_CACHE = 32,
+};
+
+/* Tsetattr valid bits. */
+enum {
+  P9_SETATTR_MODE = 1u << 0,
+  P9_SETATTR_UID = 1u << 1,
+  P9_SETATTR_GID = 1u << 2,
+  P9_SETATTR_SIZE = 1u << 3,
+  P9_SETATTR_ATIME = 1u << 4,
+  P9_SETATTR_MTIME = 1u << 5,
+  P9_SETATTR_ATIME_SET = 1u << 7,
+  P9_SETATTR_MTIME_SET = 1u << 8,
+};
+
+/* Tlopen and Tlcreate flags, as Linux numbers them on every arch. */
+enum {
+  P9_DOTL_ACCMODE = 03,
+  P9_DOTL_EXCL = 0200,
+  P9_DOTL_TRUNC = 01000,
+  P9_DOTL_APPEND = 02000,
+  P9_DOTL_DSYNC = 010000,
+  P9_DOTL_DIRECTORY = 0200000,
+  P9_DOTL_SYNC = 04000000,
+};
+
+typedef struct {
+  bool used;
+  /* O_PATH, not following symlinks; the file the fid names. */
+  int pfd;
+  /* After Tlopen or Tlcreate; -1 before. */
+  int fd;
+  bool cacheable;
+  DIR *dir;
+  long dir_pos;
+} Fid;
+
+typedef struct {
+  dev_t dev;
+  ino_t ino;
+  int fd;
+} CachedFd;
+
+typedef struct {
+  VirtioDev dev;
+  VirtioOps ops;
+  DevWorker w;
+  bool readonly;
+  int root;
+  /* The root's identity, so that ".." stops there. */
+  dev_t root_dev;
+  ino_t root_ino;
+  uint32_t msize;
+
+  Fid *fids;
+  uint32_t nfids;
+  CachedFd cache[P9_FD_CACHE];
+  uint32_t cache_next;
+
+  uint8_t config[2 + VIRTIO_9P_MAX_TAG];
+  uint8_t in[P9_MAX_TMSG];
+  uint8_t out[P9_MAX_RMSG];
+} P9;
+
+/* Little-endian message fields; a short message sets bad. */
+typedef struct {
+  const uint8_t *p;
+  size_t len;
+  size_t pos;
+  bool bad;
+} P9In;
+
+typedef struct {
+  uint8_t *p;
+  size_t cap;
+  size_t pos;
+} P9Out;
+
+static uint64_t get_le(P9In *in, unsigned n) {
+  if (in->len - in->pos < n || in->pos > in->len) {
+    in->bad = true;
+    return 0;
+  }
+  uint64_t v = 0;
+  for (unsigned i = 0; i < n; i++) {
+    v |= (uint64_t)in->p[in->pos + i] << (8 * i);
+  }
+  in->pos += n;
+  return v;
+}
+
+static uint8_t get8(P9In *in) {
+  return (uint8_t)get_le(in, 1);
+}
+
+static uint16_t get16(P9In *in) {
+  return (uint16_t)get_le(in, 2);
+}
+
+static uint32_t get32(P9In *in) {
+  return (uint32_t)get_le(in, 4);
+}
+
+static uint64_t get64(P9In *in) {
+  return get_le(in, 8);
+}
+
+/* Copies a string field into buf, NUL-terminated. */
+static void get_str(P9In *in, char *buf, size_t cap) {
+  uint16_t n = get16(in);
+  if (in->bad || n >= cap || in->len - in->pos < n ||
+      memchr(in->p + in->pos, 0, n)) {
+    in->bad = true;
+    buf[0] = '\0';
+    return;
+  }
+  memcpy(buf, in->p + in->pos, n);
+  buf[n] = '\0';
+  in->pos += n;
+}
+
+static void put_le(P9Out *out, uint64_t v, unsigned n) {
+  if (out->cap - out->pos < n) {
+    out->pos = out->cap + 1;
+    return;
+  }
+  for (unsigned i = 0; i < n; i++) {
+    out->p[out->pos + i] = (uint8_t)(v >> (8 * i));
+  }
+  out->pos += n;
+}
+
+static void put8(P9Out *out, uint8_t v) {
+  put_le(out, v, 1);
+}
+
+static void put16(P9Out *out, uint16_t v) {
+  put_le(out, v, 2);
+}
+
+static void put32(P9Out *out, uint32_t v) {
+  put_le(out, v, 4);
+}
+
+static void put64(P9Out *out, uint64_t v) {
+  put_le(out, v, 8);
+}
+
+static void put_str(P9Out *out, const char *s) {
+  size_t n = strlen(s);
+  put16(out, (uint16_t)n);
+  if (out->pos <= out->cap && out->cap - out->pos >= n) {
+    memcpy(out->p + out->pos, s, n);
+    out->pos += n;
+  } else {
+    out->pos = out->cap + 1;
+  }
+}
+
+static void put_qid(P9Out *out, const struct stat *st) {
+  uint8_t type = S_ISDIR(st->st_mode)   ? P9_QTDIR
+                 : S_ISLNK(st->st_mode) ? P9_QTSYMLINK
+                                        : 0;
+  put8(out, type);
+  put32(out, (uint32_t)(st->st_mtime ^ (st->st_size << 8)));
+  put64(out, (uint64_t)st->st_ino);
+}
+
+/* A single path component the client may create or look up. */
+static bool valid_name(const char *name) {
+  return name[0] && strchr(name, '/') == NULL && strcmp(name, ".") != 0 &&
+         strcmp(name, "..") != 0;
+}
+
+static void proc_path(int fd, char *buf, size_t cap) {
+  snprintf(buf, cap, "/proc/self/fd/%d", fd);
+}
+
+static int host_flags(uint32_t f) {
+  int h = (int)(f & P9_DOTL_ACCMODE);
+  h |= (f & P9_DOTL_TRUNC) ? O_TRUNC : 0;
+  h |= (f & P9_DOTL_APPEND) ? O_APPEND : 0;
+  h |= (f & P9_DOTL_DSYNC) ? O_DSYNC : 0;
+  h |= (f & P9_DOTL_DIRECTORY) ? O_DIRECTORY : 0;
+  h |= (f & P9_DOTL_SYNC) ? O_SYNC : 0;
+  return h | O_CLOEXEC;
+}
+
+static bool modifies(uint32_t f) {
+  return (f & P9_DOTL_ACCMODE) != O_RDONLY || (f & P9_DOTL_TRUNC);
+}
+
+static Fid *get_fid(P9 *p, uint32_t id) {
+  return id < p->nfids && p->fids[id].used ? &p->fids[id] : NULL;
+}
+
+/* A free slot for id, growing the table; NULL if id is taken. */
+static Fid *new_fid(P9 *p, uint32_t id) {
+  if (id >= P9_MAX_FIDS) {
+    errno = EMFILE;
+    return NULL;
+  }
+  if (id >= p->nfids) {
+    uint32_t n = p->nfids ? p->nfids : 64;
+    while (n <= id) {
+      n *= 2;
+    }
+    Fid *f = (Fid *)realloc(p->fids, n * sizeof(Fid));
+    if (!f) {
+      errno = ENOMEM;
+      return NULL;
+    }
+    memset(f + p->nfids, 0, (n - p->nfids) * sizeof(Fid));
+    p->fids = f;
+    p->nfids = n;
+  }
+  Fid *f = &p->fids[id];
+  if (f->used) {
+    errno = EBADF;
+    return NULL;
+  }
+  memset(f, 0, sizeof(*f));
+  f->used = true;
+  f->pfd = -1;
+  f->fd = -1;
+  return f;
+}
+
+static int cache_take(P9 *p, const struct stat *st) {
+  for (uint32_t i = 0; i < P9_FD_CACHE; i++) {
+    CachedFd *c = &p->cache[i];
+    if (c->fd >= 0 && c->dev == st->st_dev && c->ino == st->st_ino) {
+      int fd = c->fd;
+      c->fd = -1;
+      return fd;
+    }
+  }
+  return -1;
+}
+
+static void cache_put(P9 *p, int fd) {
+  struct stat st;
+  if (fstat(fd, &st) != 0) {
+    close(fd);
+    return;
+  }
+  CachedFd *c = &p->cache[p->cache_next];
+  p->cache_next = (p->cache_next + 1) % P9_FD_CACHE;
+  if (c->fd >= 0) {
+    close(c->fd);
+  }
+  *c = (CachedFd){st.st_dev, st.st_ino, fd};
+}
+
+static void close_fid(P9 *p, Fid *f) {
+  if (f->dir) {
+    closedir(f->dir);
+  }
+  if (f->fd >= 0) {
+    if (f->cacheable) {
+      cache_put(p, f->fd);
+    } else {
+      close(f->fd);
+    }
+  }
+  if (f->pfd >= 0) {
+    close(f->pfd);
+  }
+  memset(f, 0, sizeof(*f));
+}
+
+static void close_all(P9 *p) {
+  for (uint32_t i = 0; i < p->nfids; i++) {
+    if (p->fids[i].used) {
+      close_fid(p, &p->fids[i]);
+    }
+  }
+}
+
+static int walk_one(P9 *p, int cur, const char *name) {
+  if (strcmp(name, "..") == 0) {
+    /* Checked against the root itself: renames can move a fid's file. */
+    struct stat st;
+    if (fstat(cur, &st) != 0) {
+      return -1;
+    }
+    if (st.st_dev == p->root_dev && st.st_ino == p->root_ino) {
+      return fcntl(p->root, F_DUPFD_CLOEXEC, 0);
+    }
+    return openat(cur, "..", O_PATH | O_DIRECTORY | O_CLOEXEC);
+  }
+  if (!valid_name(name)) {
+    errno = ENOENT;
+    return -1;
+  }
+  return openat(cur, name, O_PATH | O_NOFOLLOW | O_CLOEXEC);
+}
+
+static int do_walk(P9 *p, P9In *in, P9Out *out) {
+  uint32_t fid = get32(in), newfid = get32(in);
+  uint16_t n = get16(in);
+  Fid *f = get_fid(p, fid);
+  if (in->bad || !f || n > P9_MAX_WELEM) {
+    return in->bad || f ? EINVAL : EBADF;
+  }
+  if (newfid != fid && get_fid(p, newfid)) {
+    return EBADF;
+  }
+
+  int cur = fcntl(f->pfd, F_DUPFD_CLOEXEC, 0);
+  if (cur < 0) {
+    return errno;
+  }
+  size_t nq_pos = out->pos;
+  put16(out, 0);
+  uint16_t done = 0;
+  int err = 0;
+  for (; done < n; done++) {
+    char name[NAME_MAX + 1];
+    get_str(in, name, sizeof(name));
+    struct stat st;
+    int next = in->bad ? -1 : walk_one(p, cur, name);
+    if (next < 0 || fstat(next, &st) != 0) {
+      err = in->bad ? EINVAL : errno;
+      if (next >= 0) {
+        close(next);
+      }
+      break;
+    }
+    close(cur);
+    cur = next;
+    put_qid(out, &st);
+  }
+  if (done < n) {
+    close(cur);
+    if (done == 0) {
+      return err;
+    }
+    /* A partial walk answers with the qids it found; newfid stays free. */
+    out->p[nq_pos] = (uint8_t)done;
+    out->p[nq_pos + 1] = (uint8_t)(done >> 8);
+    return 0;
+  }
+  out->p[nq_pos] = (uint8_t)done;
+  out->p[nq_pos + 1] = (uint8_t)(done >> 8);
+
+  if (newfid == fid) {
+    close_fid(p, f);
+    f->used = true;
+    f->fd = -1;
+  } else if (!(f = new_fid(p, newfid))) {
+    close(cur);
+    return errno;
+  }
+  f->pfd = cur;
+  return 0;
+}
+
+static int do_attach(P9 *p, P9In *in, P9Out *out) {
+  uint32_t fid = get32(in);
+  (void)get32(in); /* afid */
+  if (in->bad) {
+    return EINVAL;
+  }
+  Fid *f = new_fid(p, fid);
+  if (!f) {
+    return errno;
+  }
+  struct stat st;
+  f->pfd = fcntl(p->root, F_DUPFD_CLOEXEC, 0);
+  if (f->pfd < 0 || fstat(f->pfd, &st) != 0) {
+    int err = errno;
+    close_fid(p, f);
+    return err;
+  }
+  put_qid(out, &st);
+  return 0;
+}
+
+static int do_lopen(P9 *p, P9In *in, P9Out *out) {
+  uint32_t fid = get32(in), flags = get32(in);
+  Fid *f = get_fid(p, fid);
+  if (in->bad || !f) {
+    return in->bad ? EINVAL : EBADF;
+  }
+  if (f->fd >= 0) {
+    return EBUSY;
+  }
+  if (p->readonly && modifies(flags)) {
+    return EROFS;
+  }
+  struct stat st;
+  if (fstat(f->pfd, &st) != 0) {
+    return errno;
+  }
+  bool plain_read = !modifies(flags) && !S_ISDIR(st.st_mode);
+  int fd = plain_read ? cache_take(p, &st) : -1;
+  if (fd < 0) {
+    char path[32];
+    proc_path(f->pfd, path, sizeof(path));
+    fd = open(path, host_flags(flags));
+    if (fd < 0) {
+      return errno;
+    }
+  }
+  f->fd = fd;
+  f->cacheable = plain_read && (flags & ~P9_DOTL_ACCMODE) == 0;
+  put_qid(out, &st);
+  put32(out, 0); /* iounit: msize */
+  return 0;
+}
+
+static int do_lcreate(P9 *p, P9In *in, P9Out *out) {
+  char name[NAME_MAX + 1];
+  uint32_t fid = get32(in);
+  get_str(in, name, sizeof(name));
+  uint32_t flags = get32(in), mode = get32(in);
+  Fid *f = get_fid(p, fid);
+  if (in->bad || !f || !valid_name(name)) {
+    return !f ? EBADF : EINVAL;
+  }
+  if (p->readonly) {
+    return EROFS;
+  }
+  if (f->fd >= 0) {
+    return EBUSY;
+  }
+  int oflags = host_flags(flags) | O_CREAT | O_NOFOLLOW |
+               ((flags & P9_DOTL_EXCL) ? O_EXCL : 0);
+  int fd = openat(f->pfd, name, oflags, (mode_t)(mode & 07777));
+  if (fd < 0) {
+    return errno;
+  }
+  struct stat st;
+  int pfd = openat(f->pfd, name, O_PATH | O_NOFOLLOW | O_CLOEXEC);
+  if (pfd < 0 || fstat(fd, &st) != 0) {
+    int err = errno;
+    close(fd);
+    if (pfd >= 0) {
+      close(pfd);
+    }
+    return err;
+  }
+  /* The fid now stands for the new, open file. */
+  close(f->pfd);
+  f->pfd = pfd;
+  f->fd = fd;
+  put_qid(out, &st);
+  put32(out, 0);
+  return 0;
+}
+
+/* Qid of dir/name after creating it. */
+static int created(int dir, const char *name, P9Out *out) {
+  struct stat st;
+  if (fstatat(dir, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+    return errno;
+  }
+  put_qid(out, &st);
+  return 0;
+}
+
+/* Tsymlink, Tmknod and Tmkdir: dfid[4] name[s] and then their own. */
+static int do_create(P9 *p, uint8_t type, P9In *in, P9Out *out) {
+  char name[NAME_MAX + 1];
+  char target[PATH_MAX];
+  uint32_t dfid = get32(in);
+  get_str(in, name, sizeof(name));
+  uint32_t mode = 0, major = 0, minor = 0;
+  if (type == P9_TSYMLINK) {
+    get_str(in, target, sizeof(target));
+  } else {
+    mode = get32(in);
+  }
+  if (type == P9_TMKNOD) {
+    major = get32(in);
+    minor = get32(in);
+  }
+  (void)get32(in); /* gid */
+  Fid *d = get_fid(p, dfid);
+  if (in->bad || !d || !valid_name(name)) {
+    return !d ? EBADF : EINVAL;
+  }
+  if (p->readonly) {
+    return EROFS;
+  }
+  int rc;
+  if (type == P9_TSYMLINK) {
+    rc = symlinkat(target, d->pfd, name);
+  } else if (type == P9_TMKNOD) {
+    if (S_ISBLK(mode) || S_ISCHR(mode)) {
+      /* Device nodes would give the guest the host's devices. */
+      return EPERM;
+    }
+    rc = mknodat(d->pfd, name, (mode_t)mode, makedev(major, minor));
+  } else {
+    rc = mkdirat(d->pfd, name, (mode_t)(mode & 07777));
+  }
+  return rc != 0 ? errno : created(d->pfd, name, out);
+}
+
+static int do_readlink(P9 *p, P9In *in, P9Out *out) {
+  Fid *f = get_fid(p, get32(in));
+  if (in->bad || !f) {
+    return in->bad ? EINVAL : EBADF;
+  }
+  char buf[PATH_MAX];
+  ssize_t n = readlinkat(f->pfd, "", buf, sizeof(buf) - 1);
+  if (n < 0) {
+    return errno;
+  }
+  buf[n] = '\0';
+  put_str(out, buf);
+  return 0;
+}
+
+static int do_getattr(P9 *p, P9In *in, P9Out *out) {
+  Fid *f = get_fid(p, get32(in));
+  (void)get64(in); /* request mask */
+  if (in->bad || !f) {
+    return in->bad ? EINVAL : EBADF;
+  }
+  struct stat st;
+  if (fstat(f->fd >= 0 ? f->fd : f->pfd, &st) != 0) {
+    return errno;
+  }
+  put64(out, P9_GETATTR_BASIC);
+  put_qid(out, &st);
+  put32(out, st.st_mode);
+  put32(out, st.st_uid);
+  put32(out, st.st_gid);
+  put64(out, st.st_nlink);
+  put64(out, st.st_rdev);
+  put64(out, (uint64_t)st.st_size);
+  put64(out, (uint64_t)st.st_blksize);
+  put64(out, (uint64_t)st.st_blocks);
+  put64(out, (uint64_t)st.st_atim.tv_sec);
+  put64(out, (uint64_t)st.st_atim.tv_nsec);
+  put64(out, (uint64_t)st.st_mtim.tv_sec);
+  put64(out, (uint64_t)st.st_mtim.tv_nsec);
+  put64(out, (uint64_t)st.st_ctim.tv_sec);
+  put64(out, (uint64_t)st.st_ctim.tv_nsec);
+  /* btime, gen, data_version: not reported. */
+  for (int i = 0; i < 4; i++) {
+    put64(out, 0);
+  }
+  return 0;
+}
+
+static int do_setattr(P9 *p, P9In *in) {
+  Fid *f = get_fid(p, get32(in));
+  uint32_t valid = get32(in), mode = get32(in), uid = get32(in),
+           gid = get32(in);
+  uint64_t size = get64(in);
+  struct timespec ts[2];
+  ts[0].tv_sec = (time_t)get64(in);
+  ts[0].tv_nsec = (long)get64(in);
+  ts[1].tv_sec = (time_t)get64(in);
+  ts[1].tv_nsec = (long)get64(in);
+  if (in->bad || !f) {
+    return in->bad ? EINVAL : EBADF;
+  }
+  if (p->readonly) {
+    return EROFS;
+  }
+
+  char path[32];
+  proc_path(f->pfd, path, sizeof(path));
+  if ((valid & P9_SETATTR_MODE) && chmod(path, (mode_t)(mode & 07777))) {
+    return errno;
+  }
+  if ((valid & (P9_SETATTR_UID | P9_SETATTR_GID)) &&
+      fchownat(f->pfd, "",
+               (valid & P9_SETATTR_UID) ? (uid_t)uid : (uid_t)-1,
+               (valid & P9_SETATTR_GID) ? (gid_t)gid : (gid_t)-1,
+               AT_EMPTY_PATH | AT_SYMLINK_NOFOLLOW) != 0) {
+    return errno;
+  }
+  if ((valid & P9_SETATTR_SIZE) &&
+      (f->fd >= 0 ? ftruncate(f->fd, (off_t)size)
+                  : truncate(path, (off_t)size)) != 0) {
+    return errno;
+  }
+  if (valid & (P9_SETATTR_ATIME | P9_SETATTR_MTIME)) {
+    if (!(valid & P9_SETATTR_ATIME)) {
+      ts[0].tv_nsec = UTIME_OMIT;
+    } else if (!(valid & P9_SETATTR_ATIME_SET)) {
+      ts[0].tv_nsec = UTIME_NOW;
+    }
+    if (!(valid & P9_SETATTR_MTIME)) {
+      ts[1].tv_nsec = UTIME_OMIT;
+    } else if (!(valid & P9_SETATTR_MTIME_SET)) {
+      ts[1].tv_nsec = UTIME_NOW;
+    }
+    if (utimensat(AT_FDCWD, path, ts, 0) != 0) {
+      return errno;
+    }
+  }
+  return 0;
+}
+
+static int do_statfs(P9 *p, P9In *in, P9Out *out) {
+  Fid *f = get_fid(p, get32(in));
+  if (in->bad || !f) {
+    return in->bad ? EINVAL : EBADF;
+  }
+  struct statfs sf;
+  if (fstatfs(f->pfd, &sf) != 0) {
+    return errno;
+  }
+  put32(out, (uint32_t)sf.f_type);
+  put32(out, (uint32_t)sf.f_bsize);
+  put64(out, sf.f_blocks);
+  put64(out, sf.f_bfree);
+  put64(out, sf.f_bavail);
+  put64(out, sf.f_files);
+  put64(out, sf.f_ffree);
+  uint64_t fsid;
+  memcpy(&fsid, &sf.f_fsid, sizeof(fsid));
+  put64(out, fsid);
+  put32(out, (uint32_t)sf.f_namelen);
+  return 0;
+}
+
+static int do_readdir(P9 *p, P9In *in, P9Out *out) {
+  Fid *f = get_fid(p, get32(in));
+  uint64_t offset = get64(in);
+  uint32_t count = get32(in);
+  if (in->bad || !f) {
+    return in->bad ? EINVAL : EBADF;
+  }
+  if (f->fd < 0) {
+    return EBADF;
+  }
+  if (!f->dir) {
+    int fd = fcntl(f->fd, F_DUPFD_CLOEXEC, 0);
+    if (fd < 0 || !(f->dir = fdopendir(fd))) {
+      int err = errno;
+      if (fd >= 0) {
+        close(fd);
+      }
+      return err;
+    }
+    f->dir_pos = 0;
+  }
+  if ((long)offset != f->dir_pos) {
+    if (offset == 0) {
+      rewinddir(f->dir);
+    } else {
+      seekdir(f->dir, (long)offset);
+    }
+    f->dir_pos = (long)offset;
+  }
+
+  size_t count_pos = out->pos;
+  put32(out, 0);
+  size_t start = out->pos;
+  if (count > out->cap - start) {
+    count = (uint32_t)(out->cap - start);
+  }
+  P9Out ents = {out->p, start + count, start};
+  for (;;) {
+    long before = telldir(f->dir);
+    errno = 0;
+    struct dirent *de = readdir(f->dir);
+    if (!de) {
+      if (errno) {
+        return errno;
+      }
+      break;
+    }
+    long next = telldir(f->dir);
+    size_t mark = ents.pos;
+    uint8_t type = de->d_type == DT_DIR   ? P9_QTDIR
+                   : de->d_type == DT_LNK ? P9_QTSYMLINK
+                                          : 0;
+    put8(&ents, type);
+    put32(&ents, 0);
+    put64(&ents, (uint64_t)de->d_ino);
+    put64(&ents, (uint64_t)next);
+    put8(&ents, de->d_type);
+    put_str(&ents, de->d_name);
+    if (ents.pos > ents.cap) {
+      /* Full: this entry starts the next reply. */
+      ents.pos = mark;
+      seekdir(f->dir, before);
+      break;
+    }
+    f->dir_pos = next;
+  }
+  uint32_t n = (uint32_t)(ents.pos - start);
+  out->pos = ents.pos;
+  for (unsigned i = 0; i < 4; i++) {
+    out->p[count_pos + i] = (uint8_t)(n >> (8 * i));
+  }
+  return 0;
+}
+
+/* Tread: the data goes straight from the file into the guest's buffers. */
+static int do_read(P9 *p, P9In *in, const VirtqChain *c, uint32_t *count) {
+  Fid *f = get_fid(p, get32(in));
+  uint64_t offset = get64(in);
+  uint32_t want = get32(in);
+  if (in->bad || !f) {
+    return in->bad ? EINVAL : EBADF;
+  }
+  if (f->fd < 0) {
+    return EBADF;
+  }
+  size_t room = virtq_chain_len(c, true);
+  room = room > P9_RREAD_HDR ? room - P9_RREAD_HDR : 0;
+  if (want > room) {
+    want = (uint32_t)room;
+  }
+  if (want > p->msize - P9_RREAD_HDR) {
+    want = p->msize - P9_RREAD_HDR;
+  }
+  struct iovec iov[VIRTQ_MAX_SEGS];
+  int niov = virtq_chain_iov(c, true, P9_RREAD_HDR, want, iov);
+  ssize_t n;
+  do {
+    n = preadv(f->fd, iov, niov, (off_t)offset);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) {
+    return errno;
+  }
+  *count = (uint32_t)n;
+  return 0;
+}
+
+static int do_write(P9 *p, P9In *in, const VirtqChain *c, P9Out *out) {
+  Fid *f = get_fid(p, get32(in));
+  uint64_t offset = get64(in);
+  uint32_t count = get32(in);
+  if (in->bad || !f) {
+    return in->bad ? EINVAL : EBADF;
+  }
+  if (f->fd < 0) {
+    return EBADF;
+  }
+  if (count > virtq_chain_len(c, false) - P9_TWRITE_HDR) {
+    return EINVAL;
+  }
+  struct iovec iov[VIRTQ_MAX_SEGS];
+  int niov = virtq_chain_iov(c, false, P9_TWRITE_HDR, count, iov);
+  ssize_t n;
+  do {
+    n = pwritev(f->fd, iov, niov, (off_t)offset);
+  } while (n < 0 && errno == EINTR);
+  if (n < 0) {
+    return errno;
+  }
+  put32(out, (uint32_t)n);
+  return 0;
+}
+
+static int do_version(P9 *p, P9In *in, P9Out *out) {
+  uint32_t msize = get32(in);
+  char version[32];
+  get_str(in, version, sizeof(version));
+  if (in->bad) {
+    return EINVAL;
+  }
+  close_all(p);
+  p->msize = msize < P9_MAX_MSIZE ? msize : P9_MAX_MSIZE;
+  put32(out, p->msize);
+  put_str(out, strncmp(version, "9P2000.L", 8) == 0 ? "9P2000.L" : "unknown");
+  return 0;
+}
+
+/* Serves one message into out; returns 0 or the errno for Rlerror. */
+static int dispatch(P9 *p, uint8_t type, P9In *in, P9Out *out,
+                    const VirtqChain *c) {
+  char name[NAME_MAX + 1], name2[NAME_MAX + 1];
+  Fid *f, *d;
+  switch (type) {
+  case P9_TVERSION:
+    return do_version(p, in, out);
+  case P9_TATTACH:
+    return do_attach(p, in, out);
+  case P9_TWALK:
+    return do_walk(p, in, out);
+  case P9_TLOPEN:
+    return do_lopen(p, in, out);
+  case P9_TLCREATE:
+    return do_lcreate(p, in, out);
+  case P9_TSYMLINK:
+  case P9_TMKNOD:
+  case P9_TMKDIR:
+    return do_create(p, type, in, out);
+  case P9_TREADLINK:
+    return do_readlink(p, in, out);
+  case P9_TGETATTR:
+    return do_getattr(p, in, out);
+  case P9_TSETATTR:
+    return do_setattr(p, in);
+  case P9_TSTATFS:
+    return do_statfs(p, in, out);
+  case P9_TREADDIR:
+    return do_readdir(p, in, out);
+  case P9_TWRITE:
+    if (p->readonly) {
+      return EROFS;
+    }
+    return do_write(p, in, c, out);
+  case P9_TCLUNK:
+  case P9_TREMOVE:
+    if (!(f = get_fid(p, get32(in)))) {
+      return EBADF;
+    }
+    close_fid(p, f);
+    /*
+     * Linux sends Tunlinkat, which names the parent, and only falls back
+     * to Tremove if that is unsupported. Tremove still clunks the fid.
+     */
+    return type == P9_TREMOVE ? EOPNOTSUPP : 0;
+  case P9_TFSYNC:
+    if (!(f = get_fid(p, get32(in)))) {
+      return EBADF;
+    }
+    if (f->fd >= 0 && (get32(in) ? fdatasync(f->fd) : fsync(f->fd)) != 0) {
+      return errno;
+    }
+    return 0;
+  case P9_TLOCK:
+    /* Nothing else opens these files through us. */
+    put8(out, P9_LOCK_SUCCESS);
+    return 0;
+  case P9_TGETLOCK: {
+    (void)get32(in);
+    (void)get8(in);
+    uint64_t start = get64(in), length = get64(in);
+    uint32_t proc_id = get32(in);
+    char client[256];
+    get_str(in, client, sizeof(client));
+    put8(out, F_UNLCK);
+    put64(out, start);
+    put64(out, length);
+    put32(out, proc_id);
+    put_str(out, client);
+    return in->bad ? EINVAL : 0;
+  }
+  case P9_TLINK: {
+    d = get_fid(p, get32(in));
+    f = get_fid(p, get32(in));
+    get_str(in, name, sizeof(name));
+    if (in->bad || !d || !f || !valid_name(name)) {
+      return !d || !f ? EBADF : EINVAL;
+    }
+    if (p->readonly) {
+      return EROFS;
+    }
+    char path[32];
+    proc_path(f->pfd, path, sizeof(path));
+    return linkat(AT_FDCWD, path, d->pfd, name, AT_SYMLINK_FOLLOW) != 0
+               ? errno
+               : 0;
+  }
+  case P9_TRENAMEAT: {
+    d = get_fid(p, get32(in));
+    get_str(in, name, sizeof(name));
+    f = get_fid(p, get32(in));
+    get_str(in, name2, sizeof(name2));
+    if (in->bad || !d || !f || !valid_name(name) || !valid_name(name2)) {
+      return !d || !f ? EBADF : EINVAL;
+    }
+    if (p->readonly) {
+      return EROFS;
+    }
+    return renameat(d->pfd, name, f->pfd, name2) != 0 ? errno : 0;
+  }
+  case P9_TUNLINKAT: {
+    d = get_fid(p, get32(in));
+    get_str(in, name, sizeof(name));
+    uint32_t flags = get32(in);
+    if (in->bad || !d || !valid_name(name)) {
+      return !d ? EBADF : EINVAL;
+    }
+    if (p->readonly) {
+      return EROFS;
+    }
+    int at = (flags & P9_AT_REMOVEDIR) ? AT_REMOVEDIR : 0;
+    return unlinkat(d->pfd, name, at) != 0 ? errno : 0;
+  }
+  case P9_TFLUSH:
+    /* Requests complete in order, so the flushed one is already done. */
+    return 0;
+  case P9_TRENAME:
+  case P9_TXATTRWALK:
+  case P9_TXATTRCREATE:
+  default:
+    return EOPNOTSUPP;
+  }
+}
+
+static void set_size(uint8_t *hdr, uint32_t size, uint8_t type,
+                     uint16_t tag) {
+  for (unsigned i = 0; i < 4; i++) {
+    hdr[i] = (uint8_t)(size >> (8 * i));
+  }
+  hdr[4] = type;
+  hdr[5] = (uint8_t)tag;
+  hdr[6] = (uint8_t)(tag >> 8);
+}
+
+/* Serves one request; returns the number of bytes written to the guest. */
+static uint32_t p9_request(P9 *p, const VirtqChain *c) {
+  size_t rlen = virtq_chain_len(c, false);
+  size_t wlen = virtq_chain_len(c, true);
+  if (rlen < P9_HDR_SIZE || wlen < P9_HDR_SIZE + 4) {
+    return 0;
+  }
+  virtq_chain_read(c, 0, p->in, P9_HDR_SIZE);
+  uint8_t type = p->in[4];
+  uint16_t tag = (uint16_t)(p->in[5] | p->in[6] << 8);
+
+  /* Twrite's data stays in the guest's buffers. */
+  size_t want = type == P9_TWRITE ? P9_TWRITE_HDR : rlen;
+  size_t len = virtq_chain_read(c, 0, p->in,
+                                want < sizeof(p->in) ? want : sizeof(p->in));
+  P9In in = {p->in, len, P9_HDR_SIZE, false};
+  P9Out out = {p->out, wlen < sizeof(p->out) ? wlen : sizeof(p->out),
+               P9_HDR_SIZE};
+
+  int err;
+  if (want > sizeof(p->in)) {
+    err = EMSGSIZE;
+  } else if (type == P9_TREAD) {
+    uint32_t n = 0;
+    err = do_read(p, &in, c, &n);
+    if (!err) {
+      set_size(p->out, P9_RREAD_HDR + n, type + 1, tag);
+      for (unsigned i = 0; i < 4; i++) {
+        p->out[P9_HDR_SIZE + i] = (uint8_t)(n >> (8 * i));
+      }
+      virtq_chain_write(c, 0, p->out, P9_RREAD_HDR);
+      return P9_RREAD_HDR + n;
+    }
+  } else {
+    err = dispatch(p, type, &in, &out, c);
+    if (!err && out.pos > out.cap) {
+      err = EMSGSIZE;
+    }
+  }
+
+  if (err) {
+    out.pos = P9_HDR_SIZE;
+    put32(&out, (uint32_t)err);
+    type = P9_RLERROR - 1;
+  }
+  set_size(p->out, (uint32_t)out.pos, type + 1, tag);
+  virtq_chain_write(c, 0, p->out, out.pos);
+  return (uint32_t)out.pos;
+}
+
+/*
+ * A doorbell drains the request queue on the worker; each completion
+ * (head << 32 | bytes written) is published by the CPU thread.
+ */
+static void worker_drain(DevWorker *w, uint64_t msg) {
+  P9 *p = (P9 *)w->opaque;
+  VirtQueue *q = &p->dev.queues[0];
+  VirtqChain c;
+  (void)msg;
+  while (virtq_pop(&p->dev, q, &c)) {
+    uint32_t written = p9_request(p, &c);
+    virtq_mark_written(&p->dev, &c, written);
+    devworker_post(w, (uint64_t)c.head << 32 | written);
+  }
+}
+
+static void worker_complete(DevWorker *w, uint64_t msg) {
+  P9 *p = (P9 *)w->opaque;
+  virtq_push_used(&p->dev, &p->dev.queues[0], (uint16_t)(msg >> 32),
+                  (uint32_t)msg);
+}
+
+static const DevWorkerOps worker_ops = {
+    .work = worker_drain,
+    .complete = worker_complete,
+    .irq_source = true,
+};
+
+static void p9_notify(VirtioDev *d, uint32_t q) {
+  P9 *p = (P9 *)d->opaque;
+  (void)q;
+  devworker_ring(&p->w, 0);
+}
+
+/* A reset driver starts over with Tversion, which drops the fids. */
+static void p9_reset(VirtioDev *d) {
+  P9 *p = (P9 *)d->opaque;
+  devworker_quiesce(&p->w, false);
+}
+
+static void p9_free(P9 *p) {
+  if (p->w.live) {
+    devworker_stop(&p->w);
+  }
+  close_all(p);
+  free(p->fids);
+  for (uint32_t i = 0; i < P9_FD_CACHE; i++) {
+    if (p->cache[i].fd >= 0) {
+      close(p->cache[i].fd);
+    }
+  }
+  if (p->root >= 0) {
+    close(p->root);
+  }
+  free(p);
+}
+
+static void p9_destroy(VirtioDev *d) {
+  p9_free((P9 *)d->opaque);
+}
+
+bool virtio_9p_parse(P9Config *cfg, char *spec) {
+  memset(cfg, 0, sizeof(*cfg));
+  cfg->tag = "rivos";
+
+  char *save = NULL;
+  cfg->path = strtok_r(spec, ",", &save);
+  if (!cfg->path || !*cfg->path) {
+    return false;
+  }
+  for (char *tok; (tok = strtok_r(NULL, ",", &save)) != NULL;) {
+    if (strcmp(tok, "ro") == 0) {
+      cfg->readonly = true;
+    } else if (strncmp(tok, "tag=", 4) == 0 && tok[4] &&
+               strlen(tok + 4) <= VIRTIO_9P_MAX_TAG) {
+      cfg->tag = tok + 4;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool virtio_9p_add(Machine *m, const P9Config *cfg) {
+  /* The worker's rings want their cache-line alignment. */
+  size_t sz = (sizeof(P9) + 63) & ~(size_t)63;
+  P9 *p = (P9 *)aligned_alloc(64, sz);
+  if (!p) {
+    return false;
+  }
+  memset(p, 0, sizeof(*p));
+  p->readonly = cfg->readonly;
+  p->msize = P9_MAX_MSIZE;
+  for (uint32_t i = 0; i < P9_FD_CACHE; i++) {
+    p->cache[i].fd = -1;
+  }
+  p->root = open(cfg->path, O_PATH | O_DIRECTORY | O_CLOEXEC);
+  struct stat st;
+  if (p->root < 0 || fstat(p->root, &st) != 0) {
+    goto fail;
+  }
+  p->root_dev = st.st_dev;
+  p->root_ino = st.st_ino;
+
+  size_t tag_len = strlen(cfg->tag);
+  p->config[0] = (uint8_t)tag_len;
+  p->config[1] = (uint8_t)(tag_len >> 8);
+  memcpy(p->config + 2, cfg->tag, tag_len);
+
+  p->ops.device_id = VIRTIO_ID_9P;
+  p->ops.features = 1ull << VIRTIO_F_VERSION_1 |
+                    1ull << VIRTIO_F_INDIRECT_DESC |
+                    1ull << VIRTIO_9P_F_MOUNT_TAG;
+  p->ops.num_queues = 1;
+  p->ops.notify = p9_notify;
+  p->ops.reset = p9_reset;
+  p->ops.destroy = p9_destroy;
+
+  if (!devworker_start(&p->w, m, &worker_ops, p)) {
+    goto fail;
+  }
+  if (!virtio_mmio_add(m, &p->dev, &p->ops, p, p->config,
+                       2 + tag_len)) {
+    errno = ENOSPC;
+    goto fail;
+  }
+  return true;
+
+fail: {
+  int err = errno;
+  p9_free(p);
+  errno = err;
+  return false;
+}
+}
@@ -0,0 +1,341 @@
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include "rivos_sim/devworker.h"
+#include "rivos_sim/virtio.h"
+#include "rivos_sim/virtio_blk.h"
+
+enum {
+  VIRTIO_BLK_F_SEG_MAX = 2,
+  VIRTIO_BLK_F_RO = 5,
+  VIRTIO_BLK_F_BLK_SIZE = 6,
+  VIRTIO_BLK_F_FLUSH = 9,
+  VIRTIO_BLK_F_MQ = 12,
+};
+
+enum {
+  VIRTIO_BLK_T_IN = 0,
+  VIRTIO_BLK_T_OUT = 1,
+  VIRTIO_BLK_T_FLUSH = 4,
+  VIRTIO_BLK_T_GET_ID = 8,
+};
+
+enum {
+  VIRTIO_BLK_S_OK = 0,
+  VIRTIO_BLK_S_IOERR = 1,
+  VIRTIO_BLK_S_UNSUPP = 2,
+};
+
+enum {
+  SECTOR_SIZE = 512,
+  REQ_HDR_SIZE = 16,
+  BLK_ID_LEN = 20,
+};
+
+typedef struct VirtioBlk VirtioBlk;
+
+typedef struct {
+  VirtioBlk *blk;
+  uint32_t q;
+  DevWorker w;
+} BlkWorker;
+
+struct VirtioBlk {
+  VirtioDev dev;
+  VirtioOps ops;
+  BlkMode mode;
+  bool readonly;
+  int fd;
+  uint64_t size;
+  uint8_t *map;
+  uint8_t config[64];
+  BlkWorker workers[VIRTIO_BLK_MAX_QUEUES];
+  uint32_t nworkers;
+};
+
+static void put_le(uint8_t *p, uint64_t v, unsigned n) {
+  for (unsigned i = 0; i < n; i++) {
+    p[i] = (uint8_t)(v >> (8 * i));
+  }
+}
+
+static bool do_io(VirtioBlk *b, const VirtqChain *c, bool write, size_t off,
+                  size_t len, uint64_t pos) {
+  if (b->mode == BLK_MODE_MMAP) {
+    size_t n = write ? virtq_chain_read(c, off, b->map + pos, len)
+                     : virtq_chain_write(c, off, b->map + pos, len);
+    return n == len;
+  }
+
+  struct iovec iov[VIRTQ_MAX_SEGS];
+  int niov = virtq_chain_iov(c, !write, off, len, iov);
+  while (len) {
+    ssize_t n = write ? pwritev(b->fd, iov, niov, (off_t)pos)
+                      : preadv(b->fd, iov, niov, (off_t)pos);
+    if (n < 0 && errno == EINTR) {
+      continue;
+    }
+    if (n <= 0) {
+      return false;
+    }
+    /* Short transfer: advance the iovec array and retry the rest. */
+    len -= (size_t)n;
+    pos += (uint64_t)n;
+    while (niov && (size_t)n >= iov[0].iov_len) {
+      n -= (ssize_t)iov[0].iov_len;
+      memmove(iov, iov + 1, --niov * sizeof(iov[0]));
+    }
+    if (niov) {
+      iov[0].iov_base = (uint8_t *)iov[0].iov_base + n;
+      iov[0].iov_len -= (size_t)n;
+    }
+  }
+  return true;
+}
+
+/* Serves one request; returns the number of bytes written to the guest. */
+static uint32_t blk_request(VirtioBlk *b, const VirtqChain *c) {
+  uint8_t hdr[REQ_HDR_SIZE];
+  size_t rlen = virtq_chain_len(c, false);
+  size_t wlen = virtq_chain_len(c, true);
+  if (wlen == 0) {
+    return 0;
+  }
+
+  uint8_t status = VIRTIO_BLK_S_OK;
+  size_t written = 0;
+  if (virtq_chain_read(c, 0, hdr, sizeof(hdr)) != sizeof(hdr)) {
+    status = VIRTIO_BLK_S_IOERR;
+    goto done;
+  }
+
+  uint32_t type = (uint32_t)hdr[0] | (uint32_t)hdr[1] << 8 |
+                  (uint32_t)hdr[2] << 16 | (uint32_t)hdr[3] << 24;
+  uint64_t sector = 0;
+  for (int i = 7; i >= 0; i--) {
+    sector = sector << 8 | hdr[8 + i];
+  }
+
+  switch (type) {
+  case VIRTIO_BLK_T_IN:
+  case VIRTIO_BLK_T_OUT: {
+    bool write = type == VIRTIO_BLK_T_OUT;
+    size_t len = write ? rlen - REQ_HDR_SIZE : wlen - 1;
+    uint64_t pos = sector * SECTOR_SIZE;
+    if ((write && b->readonly) || sector > b->size / SECTOR_SIZE ||
+        len > b->size - pos ||
+        !do_io(b, c, write, write ? REQ_HDR_SIZE : 0, len, pos)) {
+      status = VIRTIO_BLK_S_IOERR;
+    } else if (!write) {
+      written = len;
+    }
+    break;
+  }
+  case VIRTIO_BLK_T_FLUSH:
+    if (b->mode == BLK_MODE_MMAP ? msync(b->map, b->size, MS_SYNC) != 0
+                                 : fdatasync(b->fd) != 0) {
+      status = VIRTIO_BLK_S_IOERR;
+    }
+    break;
+  case VIRTIO_BLK_T_GET_ID: {
+    char id[BLK_ID_LEN] = "rivos-blk";
+    written = wlen - 1 < BLK_ID_LEN ? wlen - 1 : BLK_ID_LEN;
+    virtq_chain_write(c, 0, id, written);
+    break;
+  }
+  default:
+    status = VIRTIO_BLK_S_UNSUPP;
+    break;
+  }
+
+done:
+  virtq_chain_write(c, wlen - 1, &status, 1);
+  return (uint32_t)(written + 1);
+}
+
+static void drain(VirtioBlk *b, uint32_t qi) {
+  VirtQueue *q = &b->dev.queues[qi];
+  VirtqChain c;
+  while (virtq_pop(&b->dev, q, &c)) {
+    virtq_push(&b->dev, q, &c, blk_request(b, &c));
+  }
+}
+
+/*
+ * Thread mode: a doorbell drains the queue on its worker, and each
+ * completion (head << 32 | bytes written) goes back to the CPU thread to
+ * be published in the used ring.
+ */
+static void worker_drain(DevWorker *dw, uint64_t msg) {
+  BlkWorker *w = (BlkWorker *)dw->opaque;
+  VirtioBlk *b = w->blk;
+  VirtQueue *q = &b->dev.queues[w->q];
+  VirtqChain c;
+  (void)msg;
+  while (virtq_pop(&b->dev, q, &c)) {
+    uint32_t written = blk_request(b, &c);
+    virtq_mark_written(&b->dev, &c, written);
+    devworker_post(dw, (uint64_t)c.head << 32 | written);
+  }
+}
+
+static void worker_complete(DevWorker *dw, uint64_t msg) {
+  BlkWorker *w = (BlkWorker *)dw->opaque;
+  VirtioBlk *b = w->blk;
+  virtq_push_used(&b->dev, &b->dev.queues[w->q], (uint16_t)(msg >> 32),
+                  (uint32_t)msg);
+}
+
+static const DevWorkerOps worker_ops = {
+    .work = worker_drain,
+    .complete = worker_complete,
+    .irq_source = true,
+};
+
+static void blk_notify(VirtioDev *d, uint32_t q) {
+  VirtioBlk *b = (VirtioBlk *)d->opaque;
+  if (b->mode == BLK_MODE_MMAP) {
+    drain(b, q);
+    return;
+  }
+  devworker_ring(&b->workers[q].w, 0);
+}
+
+/* Waits out in-flight requests so the transport can clear queue state. */
+static void blk_reset(VirtioDev *d) {
+  VirtioBlk *b = (VirtioBlk *)d->opaque;
+  for (uint32_t i = 0; i < b->nworkers; i++) {
+    devworker_quiesce(&b->workers[i].w, false);
+  }
+}
+
+static void blk_free(VirtioBlk *b) {
+  for (uint32_t i = 0; i < b->nworkers; i++) {
+    devworker_stop(&b->workers[i].w);
+  }
+  if (b->map) {
+    munmap(b->map, b->size);
+  }
+  if (b->fd >= 0) {
+    close(b->fd);
+  }
+  free(b);
+}
+
+static void blk_destroy(VirtioDev *d) {
+  blk_free((VirtioBlk *)d->opaque);
+}
+
+bool virtio_blk_parse(BlkConfig *cfg, char *spec) {
+  memset(cfg, 0, sizeof(*cfg));
+  cfg->queues = 1;
+  cfg->mode = BLK_MODE_THREAD;
+
+  char *save = NULL;
+  cfg->path = strtok_r(spec, ",", &save);
+  if (!cfg->path || !*cfg->path) {
+    return false;
+  }
+  for (char *tok; (tok = strtok_r(NULL, ",", &save)) != NULL;) {
+    if (strcmp(tok, "ro") == 0) {
+      cfg->readonly = true;
+    } else if (strcmp(tok, "mmap") == 0) {
+      cfg->mode = BLK_MODE_MMAP;
+    } else if (strcmp(tok, "thread") == 0) {
+      cfg->mode = BLK_MODE_THREAD;
+    } else if (strncmp(tok, "queues=", 7) == 0) {
+      char *end = NULL;
+      unsigned long n = strtoul(tok + 7, &end, 0);
+      if (*end || n == 0 || n > VIRTIO_BLK_MAX_QUEUES) {
+        return false;
+      }
+      cfg->queues = (uint32_t)n;
+    } else {
+      return false;
+    }
+  }
+  return true;
+}
+
+bool virtio_blk_add(Machine *m, const BlkConfig *cfg) {
+  /* The workers' rings want their cache-line alignment. */
+  size_t sz = (sizeof(VirtioBlk) + 63) & ~(size_t)63;
+  VirtioBlk *b = (VirtioBlk *)aligned_alloc(64, sz);
+  if (!b) {
+    return false;
+  }
+  memset(b, 0, sizeof(*b));
+  b->mode = cfg->mode;
+  b->readonly = cfg->readonly;
+
+  b->fd = open(cfg->path, cfg->readonly ? O_RDONLY : O_RDWR);
+  struct stat st;
+  if (b->fd < 0 || fstat(b->fd, &st) != 0) {
+    goto fail;
+  }
+  b->size = (uint64_t)st.st_size;
+  if (b->size < SECTOR_SIZE) {
+    errno = EINVAL;
+    goto fail;
+  }
+
+  if (b->mode == BLK_MODE_MMAP) {
+    int prot = PROT_READ | (cfg->readonly ? 0 : PROT_WRITE);
+    void *p = mmap(NULL, b->size, prot, MAP_SHARED, b->fd, 0);
+    if (p == MAP_FAILED) {
+      goto fail;
+    }
+    b->map = (uint8_t *)p;
+  }
+
+  put_le(b->config + 0, b->size / SECTOR_SIZE, 8); /* capacity */
+  put_le(b->config + 12, VIRTQ_MAX_SEGS - 2, 4);   /* seg_max */
+  put_le(b->config + 20, SECTOR_SIZE, 4);          /* blk_size */
+  put_le(b->config + 34, cfg->queues, 2);          /* num_queues */
+
+  b->ops.device_id = VIRTIO_ID_BLOCK;
+  b->ops.features = 1ull << VIRTIO_F_VERSION_1 |
+                    1ull << VIRTIO_F_INDIRECT_DESC |
+                    1ull << VIRTIO_BLK_F_SEG_MAX |
+                    1ull << VIRTIO_BLK_F_BLK_SIZE | 1ull << VIRTIO_BLK_F_FLUSH |
+                    1ull << VIRTIO_BLK_F_MQ;
+  if (cfg->readonly) {
+    b->ops.features |= 1ull << VIRTIO_BLK_F_RO;
+  }
+  b->ops.num_queues = cfg->queues;
+  b->ops.notify = blk_notify;
+  b->ops.reset = blk_reset;
+  b->ops.destroy = blk_destroy;
+
+  if (b->mode == BLK_MODE_THREAD) {
+    for (uint32_t i = 0; i < cfg->queues; i++) {
+      BlkWorker *w = &b->workers[i];
+      w->blk = b;
+      w->q = i;
+      if (!devworker_start(&w->w, m, &worker_ops, w)) {
+        goto fail;
+      }
+      b->nworkers++;
+    }
+  }
+
+  if (!virtio_mmio_add(m, &b->dev, &b->ops, b, b->config, sizeof(b->config))) {
+    errno = ENOSPC;
+    goto fail;
+  }
+  return true;
+
+fail: {
+  int err = errno;
+  blk_free(b);
+  errno = err;
+  return false;
+}
+}
@@ -0,0 +1,762 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rivos_sim/alu.h"
+#include "rivos_sim/aot.h"
+#include "rivos_sim/common.h"
+#include "rivos_sim/elf.h"
+#include "rivos_sim/machine.h"
+#include "rivos_sim/mem.h"
+#include "rivos_sim/symtab.h"
+
+/*
+ * Static translator: finds code by recursive descent from the entry point
+ * and every function symbol, and writes one C function per basic block.
+ * Only instructions that cannot trap are translated (RV64I/M, Zba/Zbb/Zbs,
+ * loads and stores, which the simulator never faults). CSR, FP, vector and
+ * system instructions end a block and run in the interpreter, as do
+ * indirect jump targets nobody discovered statically.
+ */
+
+enum {
+  MAX_BLOCK_INSNS = 128,
+  MAX_EXEC_RANGES = 16,
+};
+
+typedef enum {
+  K_NONE,
+  K_LINEAR,
+  K_BRANCH,
+  K_JAL,
+  K_JALR,
+} Kind;
+
+typedef struct {
+  uint64_t pc;
+  uint32_t len;
+} Block;
+
+typedef struct {
+  Machine m;
+  ElfRange exec[MAX_EXEC_RANGES];
+  size_t nexec;
+
+  /* Open-addressed set of block starts already queued. */
+  uint64_t *seen;
+  size_t seen_mask;
+  size_t nseen;
+
+  uint64_t *work;
+  size_t nwork, work_cap;
+
+  Block *blocks;
+  size_t nblocks, blocks_cap;
+} Aotc;
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [-o out.c] <kernel.elf>\n"
+          "\n"
+          "Translates the kernel's statically reachable code to C. Link the\n"
+          "result into a native runner with: make aot AOT_ELF=<kernel.elf>\n",
+          argv0);
+}
+
+static void *xrealloc(void *p, size_t n) {
+  p = realloc(p, n);
+  if (!p) {
+    fprintf(stderr, "out of memory\n");
+    exit(1);
+  }
+  return p;
+}
+
+static bool is_exec(const Aotc *c, uint64_t pc) {
+  for (size_t i = 0; i < c->nexec; i++) {
+    if (pc >= c->exec[i].start && pc + 4 <= c->exec[i].end) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void add_start(Aotc *c, uint64_t pc) {
+  if ((pc & 3) || !is_exec(c, pc)) {
+    return;
+  }
+  if (2 * (c->nseen + 1) > c->seen_mask + 1) {
+    size_t size = (c->seen_mask + 1) * 2;
+    uint64_t *old = c->seen;
+    size_t old_size = c->seen_mask + 1;
+    c->seen = (uint64_t *)calloc(size, sizeof(uint64_t));
+    if (!c->seen) {
+      fprintf(stderr, "out of memory\n");
+      exit(1);
+    }
+    c->seen_mask = size - 1;
+    for (size_t i = 0; i < old_size; i++) {
+      if (old[i]) {
+        size_t s = aot_slot(old[i], c->seen_mask);
+        while (c->seen[s]) {
+          s = (s + 1) & c->seen_mask;
+        }
+        c->seen[s] = old[i];
+      }
+    }
+    free(old);
+  }
+  size_t s = aot_slot(pc, c->seen_mask);
+  while (c->seen[s]) {
+    if (c->seen[s] == pc) {
+      return;
+    }
+    s = (s + 1) & c->seen_mask;
+  }
+  c->seen[s] = pc;
+  c->nseen++;
+
+  if (c->nwork == c->work_cap) {
+    c->work_cap = c->work_cap ? c->work_cap * 2 : 256;
+    c->work = (uint64_t *)xrealloc(c->work, c->work_cap * sizeof(uint64_t));
+  }
+  c->work[c->nwork++] = pc;
+}
+
+/* Mirrors the decode in cpu_exec_one: anything it would trap on, or that
+ * touches state other than x[] and memory, is K_NONE. */
+static Kind classify(uint32_t insn) {
+  uint32_t opcode = insn & 0x7F;
+  uint32_t funct3 = (insn >> 12) & 0x7;
+  uint32_t funct7 = insn >> 25;
+  uint64_t dummy;
+
+  switch (opcode) {
+  case 0x37:
+  case 0x17:
+    return K_LINEAR;
+  case 0x6F:
+    return K_JAL;
+  case 0x67:
+    return K_JALR;
+  case 0x63:
+    return funct3 == 2 || funct3 == 3 ? K_NONE : K_BRANCH;
+  case 0x03:
+    return funct3 == 7 ? K_NONE : K_LINEAR;
+  case 0x23:
+    return funct3 > 3 ? K_NONE : K_LINEAR;
+  case 0x0F:
+    /* fence.i goes to the run loop, which resyncs with code writes. */
+    return funct3 == 0 ? K_LINEAR : K_NONE;
+  case 0x13:
+    if (funct3 == 1 || funct3 == 5) {
+      uint32_t f6 = insn >> 26;
+      if (f6 == 0 || (f6 == 0x10 && funct3 == 5)) {
+        return K_LINEAR;
+      }
+      return alu_bitmanip(insn, 0, (insn >> 20) & 0x3F, &dummy) ? K_LINEAR
+                                                                 : K_NONE;
+    }
+    return K_LINEAR;
+  case 0x1B:
+    if (funct3 == 0) {
+      return K_LINEAR;
+    }
+    if (funct3 == 1 || funct3 == 5) {
+      if ((funct7 == 0) || (funct7 == 0x20 && funct3 == 5)) {
+        return K_LINEAR;
+      }
+      return alu_bitmanip(insn, 0, (insn >> 20) & 0x3F, &dummy) ? K_LINEAR
+                                                                 : K_NONE;
+    }
+    return K_NONE;
+  case 0x33:
+  case 0x3B:
+    if (funct7 == 0x01) {
+      return opcode == 0x33 || alu_muldivw(funct3, 0, 0, &dummy) ? K_LINEAR
+                                                                 : K_NONE;
+    }
+    if (funct7 != 0 && !(funct7 == 0x20 && (funct3 == 0 || funct3 == 5))) {
+      return alu_bitmanip(insn, 0, 0, &dummy) ? K_LINEAR : K_NONE;
+    }
+    if (opcode == 0x3B && funct3 != 0 && funct3 != 1 && funct3 != 5) {
+      return K_NONE;
+    }
+    return K_LINEAR;
+  default:
+    return K_NONE;
+  }
+}
+
+/* Instructions the interpreter runs in line with the code after them. */
+static bool resumes(uint32_t insn) {
+  switch (insn & 0x7F) {
+  case 0x0F:
+  case 0x2F:
+  case 0x07:
+  case 0x27:
+  case 0x43:
+  case 0x47:
+  case 0x4B:
+  case 0x4F:
+  case 0x53:
+  case 0x57:
+  case 0x73:
+    return true;
+  default:
+    return false;
+  }
+}
+
+static uint64_t imm_i(uint32_t insn) {
+  return sign_extend(insn >> 20, 12);
+}
+
+static uint64_t imm_s(uint32_t insn) {
+  return sign_extend(((insn >> 25) << 5) | ((insn >> 7) & 0x1F), 12);
+}
+
+static uint64_t imm_b(uint32_t insn) {
+  uint64_t imm = (uint64_t)((insn >> 31) & 0x1) << 12;
+  imm |= (uint64_t)((insn >> 25) & 0x3F) << 5;
+  imm |= (uint64_t)((insn >> 8) & 0xF) << 1;
+  imm |= (uint64_t)((insn >> 7) & 0x1) << 11;
+  return sign_extend(imm, 13);
+}
+
+static uint64_t imm_j(uint32_t insn) {
+  uint64_t imm = (uint64_t)((insn >> 31) & 0x1) << 20;
+  imm |= (uint64_t)((insn >> 21) & 0x3FF) << 1;
+  imm |= (uint64_t)((insn >> 20) & 0x1) << 11;
+  imm |= (uint64_t)((insn >> 12) & 0xFF) << 12;
+  return sign_extend(imm, 21);
+}
+
+static void discover(Aotc *c) {
+  while (c->nwork) {
+    uint64_t start = c->work[--c->nwork];
+    uint64_t pc = start;
+    uint32_t len = 0;
+    bool open_end = true;
+
+    for (; len < MAX_BLOCK_INSNS && is_exec(c, pc); len++, pc += 4) {
+      uint32_t insn = mem_read32(&c->m, pc);
+      Kind k = classify(insn);
+      if (k == K_NONE) {
+        if (resumes(insn)) {
+          add_start(c, pc + 4);
+        }
+        open_end = false;
+        break;
+      }
+      if (k == K_BRANCH) {
+        add_start(c, pc + imm_b(insn));
+        add_start(c, pc + 4);
+      } else if (k == K_JAL) {
+        add_start(c, pc + imm_j(insn));
+      }
+      if (k == K_JAL || k == K_JALR) {
+        /* Return site of a call. */
+        if (((insn >> 7) & 0x1F) != 0) {
+          add_start(c, pc + 4);
+        }
+      }
+      if (k != K_LINEAR) {
+        len++;
+        open_end = false;
+        break;
+      }
+    }
+    if (open_end) {
+      add_start(c, pc);
+    }
+    if (len == 0) {
+      continue;
+    }
+
+    if (c->nblocks == c->blocks_cap) {
+      c->blocks_cap = c->blocks_cap ? c->blocks_cap * 2 : 256;
+      c->blocks = (Block *)xrealloc(c->blocks, c->blocks_cap * sizeof(Block));
+    }
+    c->blocks[c->nblocks++] = (Block){start, len};
+  }
+}
+
+static int32_t block_index(const Aotc *c, uint64_t pc) {
+  size_t lo = 0, hi = c->nblocks;
+  while (lo < hi) {
+    size_t mid = lo + (hi - lo) / 2;
+    if (c->blocks[mid].pc < pc) {
+      lo = mid + 1;
+    } else {
+      hi = mid;
+    }
+  }
+  return lo < c->nblocks && c->blocks[lo].pc == pc ? (int32_t)lo : -1;
+}
+
+/* Exit kind and static successors, from the block's last instruction. */
+static const char *block_exit(Aotc *c, const Block *b, int32_t succ[2]) {
+  uint64_t pc = b->pc + 4ull * (b->len - 1);
+  uint32_t insn = mem_read32(&c->m, pc);
+  uint32_t rd = (insn >> 7) & 0x1F;
+  uint32_t rs1 = (insn >> 15) & 0x1F;
+  bool link = rd == 1 || rd == 5;
+
+  succ[0] = succ[1] = -1;
+  switch (classify(insn)) {
+  case K_BRANCH:
+    succ[0] = block_index(c, pc + imm_b(insn));
+    succ[1] = block_index(c, pc + 4);
+    return "AOT_EXIT_BRANCH";
+  case K_JAL:
+    succ[0] = block_index(c, pc + imm_j(insn));
+    if (!link) {
+      return "AOT_EXIT_JUMP";
+    }
+    succ[1] = block_index(c, pc + 4);
+    return "AOT_EXIT_CALL";
+  case K_JALR:
+    if (rd == 0 && (rs1 == 1 || rs1 == 5) && (insn >> 20) == 0) {
+      return "AOT_EXIT_RET";
+    }
+    if (!link) {
+      return "AOT_EXIT_INDIRECT";
+    }
+    succ[1] = block_index(c, pc + 4);
+    return "AOT_EXIT_CALL";
+  default:
+    succ[1] = block_index(c, pc + 4);
+    return "AOT_EXIT_FALL";
+  }
+}
+
+static int block_cmp(const void *a, const void *b) {
+  uint64_t x = ((const Block *)a)->pc;
+  uint64_t y = ((const Block *)b)->pc;
+  return (x > y) - (x < y);
+}
+
+/* ---- C emission ---- */
+
+static const char *reg(uint32_t r) {
+  static char names[32][8];
+  if (r == 0) {
+    return "(uint64_t)0";
+  }
+  snprintf(names[r], sizeof(names[r]), "x%u", r);
+  return names[r];
+}
+
+/* Registers an instruction reads (bit per register) and the one it writes. */
+static void reg_use(uint32_t insn, uint32_t *reads, uint32_t *writes) {
+  uint32_t opcode = insn & 0x7F;
+  uint32_t rd = (insn >> 7) & 0x1F;
+  uint32_t rs1 = (insn >> 15) & 0x1F;
+  uint32_t rs2 = (insn >> 20) & 0x1F;
+
+  switch (opcode) {
+  case 0x37:
+  case 0x17:
+  case 0x6F:
+    *writes |= 1u << rd;
+    break;
+  case 0x67:
+  case 0x03:
+  case 0x13:
+  case 0x1B:
+    *reads |= 1u << rs1;
+    *writes |= 1u << rd;
+    break;
+  case 0x63:
+  case 0x23:
+    *reads |= 1u << rs1 | 1u << rs2;
+    break;
+  case 0x33:
+  case 0x3B:
+    *reads |= 1u << rs1 | 1u << rs2;
+    *writes |= 1u << rd;
+    break;
+  default:
+    break;
+  }
+  *reads &= ~1u;
+  *writes &= ~1u;
+}
+
+static bool uses_memory(uint32_t insn) {
+  uint32_t opcode = insn & 0x7F;
+  return opcode == 0x03 || opcode == 0x23;
+}
+
+static void emit_alu(FILE *out, uint32_t insn) {
+  uint32_t opcode = insn & 0x7F;
+  uint32_t rd = (insn >> 7) & 0x1F;
+  uint32_t funct3 = (insn >> 12) & 0x7;
+  uint32_t funct7 = insn >> 25;
+  const char *a = reg((insn >> 15) & 0x1F);
+  uint64_t imm = imm_i(insn);
+
+  if (rd == 0) {
+    return;
+  }
+  const char *d = reg(rd);
+
+  if (opcode == 0x13) {
+    uint32_t sh = (insn >> 20) & 0x3F;
+    uint32_t f6 = insn >> 26;
+    switch (funct3) {
+    case 0x0:
+      fprintf(out, "  %s = %s + 0x%" PRIx64 "ull;\n", d, a, imm);
+      return;
+    case 0x2:
+      fprintf(out, "  %s = (int64_t)%s < (int64_t)0x%" PRIx64 "ull;\n", d, a,
+              imm);
+      return;
+    case 0x3:
+      fprintf(out, "  %s = %s < 0x%" PRIx64 "ull;\n", d, a, imm);
+      return;
+    case 0x4:
+      fprintf(out, "  %s = %s ^ 0x%" PRIx64 "ull;\n", d, a, imm);
+      return;
+    case 0x6:
+      fprintf(out, "  %s = %s | 0x%" PRIx64 "ull;\n", d, a, imm);
+      return;
+    case 0x7:
+      fprintf(out, "  %s = %s & 0x%" PRIx64 "ull;\n", d, a, imm);
+      return;
+    default:
+      if (f6 == 0 && funct3 == 1) {
+        fprintf(out, "  %s = %s << %u;\n", d, a, sh);
+      } else if (f6 == 0 && funct3 == 5) {
+        fprintf(out, "  %s = %s >> %u;\n", d, a, sh);
+      } else if (f6 == 0x10 && funct3 == 5) {
+        fprintf(out, "  %s = (uint64_t)((int64_t)%s >> %u);\n", d, a, sh);
+      } else {
+        fprintf(out, "  alu_bitmanip(0x%08" PRIx32 "u, %s, %u, &%s);\n", insn,
+                a, sh, d);
+      }
+      return;
+    }
+  }
+
+  if (opcode == 0x1B) {
+    uint32_t sh = (insn >> 20) & 0x1F;
+    if (funct3 == 0) {
+      fprintf(out, "  %s = sext32((uint32_t)(%s + 0x%" PRIx64 "ull));\n", d, a,
+              imm);
+    } else if (funct7 == 0 && funct3 == 1) {
+      fprintf(out, "  %s = sext32((uint32_t)%s << %u);\n", d, a, sh);
+    } else if (funct7 == 0 && funct3 == 5) {
+      fprintf(out, "  %s = sext32((uint32_t)%s >> %u);\n", d, a, sh);
+    } else if (funct7 == 0x20 && funct3 == 5) {
+      fprintf(out, "  %s = sext32((uint32_t)((int32_t)(uint32_t)%s >> %u));\n",
+              d, a, sh);
+    } else {
+      fprintf(out, "  alu_bitmanip(0x%08" PRIx32 "u, %s, %u, &%s);\n", insn, a,
+              (insn >> 20) & 0x3F, d);
+    }
+    return;
+  }
+
+  const char *b = reg((insn >> 20) & 0x1F);
+  if (funct7 == 0x01) {
+    if (opcode == 0x33) {
+      fprintf(out, "  %s = alu_muldiv(%u, %s, %s);\n", d, funct3, a, b);
+    } else {
+      fprintf(out, "  alu_muldivw(%u, %s, %s, &%s);\n", funct3, a, b, d);
+    }
+    return;
+  }
+  if (funct7 != 0 && !(funct7 == 0x20 && (funct3 == 0 || funct3 == 5))) {
+    fprintf(out, "  alu_bitmanip(0x%08" PRIx32 "u, %s, %s, &%s);\n", insn, a,
+            b, d);
+    return;
+  }
+
+  if (opcode == 0x33) {
+    static const char *const fmt[8] = {
+        "%s + %s",
+        "%s << (%s & 0x3F)",
+        "(int64_t)%s < (int64_t)%s",
+        "%s < %s",
+        "%s ^ %s",
+        "%s >> (%s & 0x3F)",
+        "%s | %s",
+        "%s & %s",
+    };
+    fprintf(out, "  %s = ", d);
+    if (funct7 == 0x20 && funct3 == 0) {
+      fprintf(out, "%s - %s", a, b);
+    } else if (funct7 == 0x20 && funct3 == 5) {
+      fprintf(out, "(uint64_t)((int64_t)%s >> (%s & 0x3F))", a, b);
+    } else {
+      fprintf(out, fmt[funct3], a, b);
+    }
+    fprintf(out, ";\n");
+    return;
+  }
+
+  switch (funct3) {
+  case 0x0:
+    fprintf(out, "  %s = sext32((uint32_t)%s %c (uint32_t)%s);\n", d, a,
+            funct7 == 0x20 ? '-' : '+', b);
+    return;
+  case 0x1:
+    fprintf(out, "  %s = sext32((uint32_t)%s << (%s & 0x1F));\n", d, a, b);
+    return;
+  default:
+    if (funct7 == 0x20) {
+      fprintf(out,
+              "  %s = sext32((uint32_t)((int32_t)(uint32_t)%s >> (%s & 0x1F)));"
+              "\n",
+              d, a, b);
+    } else {
+      fprintf(out, "  %s = sext32((uint32_t)%s >> (%s & 0x1F));\n", d, a, b);
+    }
+    return;
+  }
+}
+
+static void emit_insn(FILE *out, uint64_t pc, uint32_t insn) {
+  uint32_t opcode = insn & 0x7F;
+  uint32_t rd = (insn >> 7) & 0x1F;
+  uint32_t funct3 = (insn >> 12) & 0x7;
+  const char *a = reg((insn >> 15) & 0x1F);
+  const char *b = reg((insn >> 20) & 0x1F);
+  const char *d = reg(rd);
+
+  switch (opcode) {
+  case 0x37:
+  case 0x17: {
+    uint64_t v = sign_extend(insn & 0xFFFFF000u, 32);
+    if (rd) {
+      fprintf(out, "  %s = 0x%" PRIx64 "ull;\n", d,
+              opcode == 0x17 ? pc + v : v);
+    }
+    return;
+  }
+  case 0x6F:
+    if (rd) {
+      fprintf(out, "  %s = 0x%" PRIx64 "ull;\n", d, pc + 4);
+    }
+    fprintf(out, "  next = 0x%" PRIx64 "ull;\n", pc + imm_j(insn));
+    return;
+  case 0x67:
+    fprintf(out, "  next = (%s + 0x%" PRIx64 "ull) & ~1ull;\n", a,
+            imm_i(insn));
+    if (rd) {
+      fprintf(out, "  %s = 0x%" PRIx64 "ull;\n", d, pc + 4);
+    }
+    return;
+  case 0x63: {
+    static const char *const cond[8] = {
+        "%s == %s", "%s != %s", NULL, NULL,
+        "(int64_t)%s < (int64_t)%s", "(int64_t)%s >= (int64_t)%s",
+        "%s < %s", "%s >= %s",
+    };
+    fprintf(out, "  next = ");
+    fprintf(out, cond[funct3], a, b);
+    fprintf(out, " ? 0x%" PRIx64 "ull : 0x%" PRIx64 "ull;\n",
+            pc + imm_b(insn), pc + 4);
+    return;
+  }
+  case 0x03: {
+    static const char *const ld[7] = {
+        "(uint64_t)(int64_t)(int8_t)aot_ld8",
+        "(uint64_t)(int64_t)(int16_t)aot_ld16",
+        "(uint64_t)(int64_t)(int32_t)aot_ld32",
+        "aot_ld64",
+        "(uint64_t)aot_ld8",
+        "(uint64_t)aot_ld16",
+        "(uint64_t)aot_ld32",
+    };
+    if (rd) {
+      fprintf(out, "  %s = ", d);
+    } else {
+      fprintf(out, "  (void)");
+    }
+    fprintf(out, "%s(m, %s + 0x%" PRIx64 "ull);\n", ld[funct3], a,
+            imm_i(insn));
+    return;
+  }
+  case 0x23: {
+    static const unsigned bits[4] = {8, 16, 32, 64};
+    fprintf(out, "  aot_st%u(m, %s + 0x%" PRIx64 "ull, (uint%u_t)%s);\n",
+            bits[funct3], a, imm_s(insn), bits[funct3], b);
+    return;
+  }
+  case 0x0F:
+    return;
+  default:
+    emit_alu(out, insn);
+    return;
+  }
+}
+
+static void emit_block(Aotc *c, FILE *out, const Block *b,
+                       const SymbolTable *syms) {
+  uint32_t reads = 0, writes = 0;
+  bool mem = false;
+  for (uint32_t k = 0; k < b->len; k++) {
+    uint32_t insn = mem_read32(&c->m, b->pc + 4ull * k);
+    reg_use(insn, &reads, &writes);
+    mem |= uses_memory(insn);
+  }
+
+  const Symbol *s = symtab_lookup(syms, b->pc);
+  if (s) {
+    fprintf(out, "/* %s+0x%" PRIx64 " */\n", s->name, b->pc - s->addr);
+  }
+  fprintf(out, "static uint64_t b_%" PRIx64 "(Machine *m, Cpu *cpu) {\n",
+          b->pc);
+  if (!mem) {
+    fprintf(out, "  (void)m;\n");
+  }
+  if (!(reads | writes)) {
+    fprintf(out, "  (void)cpu;\n");
+  }
+  for (uint32_t r = 1; r < 32; r++) {
+    if ((reads | writes) >> r & 1) {
+      fprintf(out, "  uint64_t x%u = cpu->x[%u];\n", r, r);
+    }
+  }
+
+  uint64_t last_pc = b->pc + 4ull * (b->len - 1);
+  Kind last = classify(mem_read32(&c->m, last_pc));
+  bool has_next = last == K_BRANCH || last == K_JAL || last == K_JALR;
+  if (has_next) {
+    fprintf(out, "  uint64_t next;\n");
+  }
+  for (uint32_t k = 0; k < b->len; k++) {
+    uint64_t pc = b->pc + 4ull * k;
+    emit_insn(out, pc, mem_read32(&c->m, pc));
+  }
+  for (uint32_t r = 1; r < 32; r++) {
+    if (writes >> r & 1) {
+      fprintf(out, "  cpu->x[%u] = x%u;\n", r, r);
+    }
+  }
+  if (has_next) {
+    fprintf(out, "  return next;\n}\n\n");
+  } else {
+    fprintf(out, "  return 0x%" PRIx64 "ull;\n}\n\n", last_pc + 4);
+  }
+}
+
+static bool emit(Aotc *c, FILE *out, const char *elf_path,
+                 const SymbolTable *syms) {
+  fprintf(out,
+          "/* Generated by rivos-aot from %s; do not edit. */\n"
+          "#include \"rivos_sim/aot.h\"\n\n",
+          elf_path);
+
+  uint64_t h = AOT_HASH_INIT;
+  uint64_t insns = 0;
+  for (size_t i = 0; i < c->nblocks; i++) {
+    const Block *b = &c->blocks[i];
+    emit_block(c, out, b, syms);
+    for (uint32_t k = 0; k < b->len; k++) {
+      h = aot_hash(h, b->pc + 4ull * k, mem_read32(&c->m, b->pc + 4ull * k));
+    }
+    insns += b->len;
+  }
+
+  fprintf(out, "static const AotBlock blocks[] = {\n");
+  for (size_t i = 0; i < c->nblocks; i++) {
+    int32_t succ[2];
+    const char *exit = block_exit(c, &c->blocks[i], succ);
+    fprintf(out, "    {0x%" PRIx64 "ull, %u, %s, {%d, %d}, b_%" PRIx64 "},\n",
+            c->blocks[i].pc, c->blocks[i].len, exit, succ[0], succ[1],
+            c->blocks[i].pc);
+  }
+  if (c->nblocks == 0) {
+    fprintf(out, "    {0, 0, AOT_EXIT_FALL, {-1, -1}, NULL},\n");
+  }
+  fprintf(out,
+          "};\n\n"
+          "const AotImage rivos_aot_image = {\n"
+          "    .blocks = blocks,\n"
+          "    .nblocks = %zu,\n"
+          "    .code_hash = 0x%" PRIx64 "ull,\n"
+          "    .source = \"%s\",\n"
+          "};\n",
+          c->nblocks, h, elf_path);
+
+  fprintf(stderr, "rivos-aot: %zu blocks, %" PRIu64 " instructions\n",
+          c->nblocks, insns);
+  return !ferror(out);
+}
+
+int main(int argc, char **argv) {
+  const char *out_path = NULL;
+
+  int argi = 1;
+  for (; argi < argc && argv[argi][0] == '-'; argi++) {
+    if (strcmp(argv[argi], "-o") == 0 && argi + 1 < argc) {
+      out_path = argv[++argi];
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (argc - argi != 1) {
+    usage(argv[0]);
+    return 2;
+  }
+  const char *elf_path = argv[argi];
+
+  static Aotc c;
+  if (!machine_init(&c.m, (size_t)RIVOS_SIM_RAM_SIZE)) {
+    fprintf(stderr, "failed to allocate RAM\n");
+    return 1;
+  }
+
+  uint64_t entry = 0;
+  if (!load_elf(&c.m, elf_path, &entry)) {
+    fprintf(stderr, "failed to load ELF: %s\n", strerror(errno));
+    return 1;
+  }
+  c.nexec = load_elf_exec_ranges(&c.m, elf_path, c.exec, MAX_EXEC_RANGES);
+
+  SymbolTable syms = {NULL, 0};
+  if (!load_elf_symbols(elf_path, &syms)) {
+    fprintf(stderr, "failed to read ELF symbols: %s\n", strerror(errno));
+  }
+
+  c.seen_mask = 1023;
+  c.seen = (uint64_t *)calloc(c.seen_mask + 1, sizeof(uint64_t));
+  if (!c.seen) {
+    fprintf(stderr, "out of memory\n");
+    return 1;
+  }
+  add_start(&c, entry);
+  for (size_t i = 0; i < syms.count; i++) {
+    if (syms.syms[i].type == SYMBOL_FUNC) {
+      add_start(&c, syms.syms[i].addr);
+    }
+  }
+  discover(&c);
+  qsort(c.blocks, c.nblocks, sizeof(Block), block_cmp);
+
+  FILE *out = out_path ? fopen(out_path, "w") : stdout;
+  if (!out) {
+    fprintf(stderr, "failed to open %s: %s\n", out_path, strerror(errno));
+    return 1;
+  }
+  bool ok = emit(&c, out, elf_path, &syms);
+  if (out != stdout && fclose(out) != 0) {
+    ok = false;
+  }
+  if (!ok) {
+    fprintf(stderr, "failed to write output\n");
+  }
+
+  symtab_free(&syms);
+  machine_destroy(&c.m);
+  return ok ? 0 : 1;
+}
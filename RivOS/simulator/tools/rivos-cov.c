@@ -0,0 +1,145 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rivos_sim/coverage.h"
+#include "rivos_sim/elf.h"
+#include "rivos_sim/machine.h"
+#include "rivos_sim/mem.h"
+#include "rivos_sim/symtab.h"
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [-l] [-f function] <kernel.elf> <coverage.bin>\n"
+          "\n"
+          "Renders a rivos-sim --cov dump as per-function instruction coverage.\n"
+          "  -l           also print an annotated listing ('+' executed, '-' not)\n"
+          "  -f function  restrict the report to one function\n",
+          argv0);
+}
+
+static bool ends_block(uint32_t insn) {
+  uint32_t opcode = insn & 0x7F;
+  if (opcode == 0x63 || opcode == 0x6F || opcode == 0x67) {
+    return true;
+  }
+  return opcode == 0x73 && ((insn >> 12) & 0x7) == 0;
+}
+
+int main(int argc, char **argv) {
+  bool listing = false;
+  const char *only = NULL;
+
+  int argi = 1;
+  for (; argi < argc && argv[argi][0] == '-'; argi++) {
+    if (strcmp(argv[argi], "-l") == 0) {
+      listing = true;
+    } else if (strcmp(argv[argi], "-f") == 0 && argi + 1 < argc) {
+      only = argv[++argi];
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (argc - argi != 2) {
+    usage(argv[0]);
+    return 2;
+  }
+
+  const char *elf_path = argv[argi];
+  const char *cov_path = argv[argi + 1];
+
+  Machine m;
+  if (!machine_init(&m, (size_t)RIVOS_SIM_RAM_SIZE)) {
+    fprintf(stderr, "failed to allocate RAM\n");
+    return 1;
+  }
+
+  uint64_t entry = 0;
+  SymbolTable syms;
+  if (!load_elf(&m, elf_path, &entry) || !load_elf_symbols(elf_path, &syms)) {
+    fprintf(stderr, "failed to load ELF: %s\n", strerror(errno));
+    return 1;
+  }
+
+  Coverage cov;
+  if (!cov_init(&cov) || !cov_load(&cov, cov_path)) {
+    fprintf(stderr, "failed to read coverage from %s\n", cov_path);
+    return 1;
+  }
+
+  /* One bit per 4-byte instruction slot in RAM. */
+  size_t nslots = m.ram_size / 4;
+  uint8_t *hit = (uint8_t *)calloc((nslots + 7) / 8, 1);
+  if (!hit) {
+    fprintf(stderr, "failed to allocate coverage bitmap\n");
+    return 1;
+  }
+
+  for (size_t i = 0; i < cov.nblocks; i++) {
+    /* Blocks may fall through into the next symbol, so walk to the branch. */
+    uint64_t pc = cov.blocks[i];
+    for (; pc >= RIVOS_SIM_RAM_BASE && pc + 4 <= RIVOS_SIM_RAM_BASE + m.ram_size;
+         pc += 4) {
+      size_t slot = (size_t)((pc - RIVOS_SIM_RAM_BASE) / 4);
+      hit[slot / 8] |= (uint8_t)(1u << (slot % 8));
+      if (ends_block(mem_read32(&m, pc))) {
+        break;
+      }
+    }
+  }
+
+  size_t edges = 0;
+  for (size_t i = 0; i < COV_MAP_SIZE; i++) {
+    edges += cov.map[i] != 0;
+  }
+  printf("edges hit: %zu, block entries: %zu\n\n", edges, cov.nblocks);
+  printf("%8s %8s %7s  %s\n", "covered", "insns", "%", "function");
+
+  uint64_t total_cov = 0;
+  uint64_t total = 0;
+  for (size_t i = 0; i < syms.count; i++) {
+    const Symbol *s = &syms.syms[i];
+    if (s->type != SYMBOL_FUNC || (only && strcmp(s->name, only) != 0)) {
+      continue;
+    }
+    if (s->addr < RIVOS_SIM_RAM_BASE ||
+        s->addr + s->size > RIVOS_SIM_RAM_BASE + m.ram_size) {
+      continue;
+    }
+
+    uint64_t n = 0;
+    uint64_t c = 0;
+    for (uint64_t pc = s->addr; pc + 4 <= s->addr + s->size; pc += 4) {
+      size_t slot = (size_t)((pc - RIVOS_SIM_RAM_BASE) / 4);
+      n++;
+      c += (hit[slot / 8] >> (slot % 8)) & 1;
+    }
+    total += n;
+    total_cov += c;
+    printf("%8" PRIu64 " %8" PRIu64 " %6.1f%%  %s\n", c, n,
+           n ? 100.0 * (double)c / (double)n : 0.0, s->name);
+
+    if (!listing) {
+      continue;
+    }
+    for (uint64_t pc = s->addr; pc + 4 <= s->addr + s->size; pc += 4) {
+      size_t slot = (size_t)((pc - RIVOS_SIM_RAM_BASE) / 4);
+      bool h = (hit[slot / 8] >> (slot % 8)) & 1;
+      printf("    %c %016" PRIx64 ":  %08" PRIx32 "\n", h ? '+' : '-', pc,
+             mem_read32(&m, pc));
+    }
+  }
+
+  printf("%8" PRIu64 " %8" PRIu64 " %6.1f%%  total\n", total_cov, total,
+         total ? 100.0 * (double)total_cov / (double)total : 0.0);
+
+  free(hit);
+  cov_destroy(&cov);
+  symtab_free(&syms);
+  machine_destroy(&m);
+  return 0;
+}
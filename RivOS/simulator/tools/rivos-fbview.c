@@ -0,0 +1,175 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rivos_sim/fb.h"
+
+enum {
+  TERM_COLS = 80,
+};
+
+typedef struct {
+  uint64_t frame;
+  uint64_t bytes;
+  unsigned tiles;
+} FrameInfo;
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [-d seconds] [-n count] [-o out.ppm] <fb-file>\n"
+          "\n"
+          "Shows the framebuffer of rivos-sim --fb=WxH,file=<fb-file>, read\n"
+          "straight from the shared mapping. Redraws when the guest flushes a\n"
+          "frame: as %d-column true-colour text, or into out.ppm.\n"
+          "  -d seconds   poll interval (default 0.1)\n"
+          "  -n count     stop after count frames (default: forever)\n",
+          argv0, TERM_COLS);
+}
+
+static unsigned popcount_tiles(const FbHeader *h) {
+  unsigned n = 0;
+  for (uint32_t i = 0; i < (fb_tiles_x(h) * fb_tiles_y(h) + 63) / 64; i++) {
+    n += (unsigned)__builtin_popcountll(h->dirty[i]);
+  }
+  return n;
+}
+
+static bool read_info(const FbHeader *h, FrameInfo *out) {
+  for (int tries = 0; tries < 1 << 20; tries++) {
+    uint64_t s0 = atomic_load_explicit(&h->seq, memory_order_acquire);
+    if (s0 & 1) {
+      continue;
+    }
+    out->frame = h->frame;
+    out->bytes = h->frame_bytes;
+    out->tiles = popcount_tiles(h);
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&h->seq, memory_order_relaxed) == s0) {
+      return true;
+    }
+  }
+  return false;
+}
+
+static void pixel_rgb(const FbHeader *h, uint32_t x, uint32_t y, uint8_t *rgb) {
+  const uint8_t *p = (const uint8_t *)h + FB_HEADER_SIZE +
+                     (size_t)y * h->stride + (size_t)x * fb_bpp(h->format);
+  if (h->format == FB_RGB565) {
+    uint32_t v = (uint32_t)p[0] | (uint32_t)p[1] << 8;
+    rgb[0] = (uint8_t)((v >> 11) * 255 / 31);
+    rgb[1] = (uint8_t)(((v >> 5) & 0x3f) * 255 / 63);
+    rgb[2] = (uint8_t)((v & 0x1f) * 255 / 31);
+  } else {
+    rgb[0] = p[2];
+    rgb[1] = p[1];
+    rgb[2] = p[0];
+  }
+}
+
+/* Nearest-neighbour downscale; each cell is two pixel rows (upper half
+ * block in the foreground colour over the background colour). */
+static void draw_term(const FbHeader *h) {
+  uint32_t cols = h->width < TERM_COLS ? h->width : TERM_COLS;
+  uint32_t rows = (uint32_t)((uint64_t)h->height * cols / h->width + 1) / 2;
+  printf("\033[H");
+  for (uint32_t r = 0; r < rows; r++) {
+    uint32_t y0 = (uint32_t)((uint64_t)(2 * r) * h->height / (2 * rows));
+    uint32_t y1 = (uint32_t)((uint64_t)(2 * r + 1) * h->height / (2 * rows));
+    for (uint32_t c = 0; c < cols; c++) {
+      uint32_t x = (uint32_t)((uint64_t)c * h->width / cols);
+      uint8_t a[3], b[3];
+      pixel_rgb(h, x, y0, a);
+      pixel_rgb(h, x, y1, b);
+      printf("\033[38;2;%u;%u;%um\033[48;2;%u;%u;%um\xe2\x96\x80", a[0], a[1],
+             a[2], b[0], b[1], b[2]);
+    }
+    printf("\033[0m\n");
+  }
+}
+
+static bool save_ppm(const FbHeader *h, const char *path) {
+  char tmp[4096];
+  snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+  FILE *f = fopen(tmp, "wb");
+  if (!f) {
+    return false;
+  }
+  bool ok = fb_write_ppm(h, f);
+  ok = fclose(f) == 0 && ok;
+  return ok && rename(tmp, path) == 0;
+}
+
+int main(int argc, char **argv) {
+  double delay = 0.1;
+  long count = -1;
+  const char *out_path = NULL;
+
+  int argi = 1;
+  for (; argi < argc && argv[argi][0] == '-'; argi++) {
+    if (strcmp(argv[argi], "-d") == 0 && argi + 1 < argc) {
+      delay = strtod(argv[++argi], NULL);
+    } else if (strcmp(argv[argi], "-n") == 0 && argi + 1 < argc) {
+      count = strtol(argv[++argi], NULL, 0);
+    } else if (strcmp(argv[argi], "-o") == 0 && argi + 1 < argc) {
+      out_path = argv[++argi];
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (argc - argi != 1) {
+    usage(argv[0]);
+    return 2;
+  }
+  if (delay <= 0) {
+    delay = 0.1;
+  }
+
+  size_t size = 0;
+  const FbHeader *h = fb_attach(argv[argi], &size);
+  if (!h) {
+    fprintf(stderr, "cannot attach %s: %s\n", argv[argi], strerror(errno));
+    return 1;
+  }
+  fprintf(stderr, "%ux%u %s, %ux%u tiles of %u pixels\n", h->width, h->height,
+          h->format == FB_RGB565 ? "rgb565" : "xrgb8888", fb_tiles_x(h),
+          fb_tiles_y(h), h->tile);
+
+  bool tty = !out_path && isatty(STDOUT_FILENO);
+  if (tty) {
+    printf("\033[2J");
+  }
+  struct timespec ts = {(time_t)delay,
+                        (long)((delay - (double)(time_t)delay) * 1e9)};
+  uint64_t last = 0;
+  for (long shown = 0; count < 0 || shown < count;) {
+    FrameInfo fi;
+    if (!read_info(h, &fi) || fi.frame == last) {
+      nanosleep(&ts, NULL);
+      continue;
+    }
+    last = fi.frame;
+    shown++;
+
+    if (out_path) {
+      if (!save_ppm(h, out_path)) {
+        fprintf(stderr, "cannot write %s: %s\n", out_path, strerror(errno));
+        return 1;
+      }
+    } else if (tty) {
+      draw_term(h);
+    }
+    printf("frame %" PRIu64 "  %" PRIu64 " bytes  %u/%u tiles dirty\n",
+           fi.frame, fi.bytes, fi.tiles, fb_tiles_x(h) * fb_tiles_y(h));
+    fflush(stdout);
+  }
+
+  munmap((void *)h, size);
+  return 0;
+}
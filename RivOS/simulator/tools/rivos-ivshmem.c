@@ -0,0 +1,111 @@
+#include <errno.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "rivos_sim/ivshmem.h"
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s <sock> <command> [args...]\n"
+          "\n"
+          "Talks to a rivos-sim started with --ivshmem=NAME,sock=<sock>.\n"
+          "Commands run in order, so one invocation can hand the guest an\n"
+          "input, wait for its answer and read the result:\n"
+          "  put FILE OFF    copy FILE into shared memory at OFF\n"
+          "  get OFF LEN     write LEN bytes at OFF to stdout\n"
+          "  ring [N]        ring the guest's doorbell (N times, default 1)\n"
+          "  wait            block until the guest rings; prints the count\n"
+          "  size            print the size of the shared memory\n",
+          argv0);
+}
+
+static bool parse_range(const IvshmemPeer *p, const char *off_s,
+                        const char *len_s, uint64_t *off, uint64_t *len) {
+  char *end = NULL;
+  *off = strtoull(off_s, &end, 0);
+  if (*end || *off > p->size) {
+    return false;
+  }
+  if (len_s) {
+    *len = strtoull(len_s, &end, 0);
+    if (*end || *len > p->size - *off) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static bool put(IvshmemPeer *p, const char *path, uint64_t off) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    return false;
+  }
+  size_t n = fread(p->mem + off, 1, p->size - off, f);
+  bool ok = !ferror(f);
+  if (ok && fgetc(f) != EOF) {
+    errno = EFBIG;
+    ok = false;
+  }
+  fclose(f);
+  if (ok) {
+    fprintf(stderr, "%zu bytes at 0x%" PRIx64 "\n", n, off);
+  }
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    usage(argv[0]);
+    return 2;
+  }
+  IvshmemPeer p;
+  if (!ivshmem_connect(argv[1], &p)) {
+    fprintf(stderr, "cannot connect to %s: %s\n", argv[1], strerror(errno));
+    return 1;
+  }
+
+  int rc = 0;
+  for (int i = 2; i < argc && rc == 0; i++) {
+    const char *cmd = argv[i];
+    uint64_t off = 0, len = 0, n;
+    if (strcmp(cmd, "put") == 0 && i + 2 < argc &&
+        parse_range(&p, argv[i + 2], NULL, &off, NULL)) {
+      if (!put(&p, argv[i + 1], off)) {
+        fprintf(stderr, "cannot put %s: %s\n", argv[i + 1], strerror(errno));
+        rc = 1;
+      }
+      i += 2;
+    } else if (strcmp(cmd, "get") == 0 && i + 2 < argc &&
+               parse_range(&p, argv[i + 1], argv[i + 2], &off, &len)) {
+      if (fwrite(p.mem + off, 1, len, stdout) != len || fflush(stdout)) {
+        rc = 1;
+      }
+      i += 2;
+    } else if (strcmp(cmd, "ring") == 0) {
+      n = 1;
+      if (i + 1 < argc && argv[i + 1][0] >= '0' && argv[i + 1][0] <= '9') {
+        n = strtoull(argv[++i], NULL, 0);
+      }
+      if (n && write(p.to_guest, &n, sizeof(n)) != sizeof(n)) {
+        rc = 1;
+      }
+    } else if (strcmp(cmd, "wait") == 0) {
+      if (read(p.to_host, &n, sizeof(n)) != sizeof(n)) {
+        rc = 1;
+      } else {
+        fprintf(stderr, "%" PRIu64 " rings\n", n);
+      }
+    } else if (strcmp(cmd, "size") == 0) {
+      printf("%" PRIu64 "\n", p.size);
+    } else {
+      usage(argv[0]);
+      rc = 2;
+    }
+  }
+  ivshmem_disconnect(&p);
+  return rc;
+}
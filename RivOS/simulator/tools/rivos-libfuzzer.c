@@ -0,0 +1,93 @@
+/*
+ * libFuzzer front end for the rivos-sim snapshot fuzzer. Build with
+ * `make libfuzzer` (needs clang) and configure through the environment:
+ *
+ *   RIVOS_FUZZ_ELF=kernel.elf        guest image (required)
+ *   RIVOS_FUZZ_AT=SYM|ADDR           snapshot marker (default: SBI FUZZ_START)
+ *   RIVOS_FUZZ_BUF=SYM|ADDR:SIZE     input buffer for RIVOS_FUZZ_AT
+ *   RIVOS_FUZZ_STOP=SYM|ADDR         input done marker
+ *   RIVOS_FUZZ_CRASH=SYM|ADDR        crash marker
+ *   RIVOS_FUZZ_TIMEOUT=N             instructions per input
+ *
+ * The guest edge map is registered as an extra 8-bit counter region, so
+ * libFuzzer steers by guest coverage.
+ */
+#include <errno.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "rivos_sim/elf.h"
+#include "rivos_sim/fuzz.h"
+#include "rivos_sim/machine.h"
+
+void __sanitizer_cov_8bit_counters_init(uint8_t *start, uint8_t *stop);
+
+int LLVMFuzzerInitialize(int *argc, char ***argv);
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static Machine machine;
+static Cpu cpu;
+static Fuzz fuzz;
+
+int LLVMFuzzerInitialize(int *argc, char ***argv) {
+  (void)argc;
+  (void)argv;
+
+  const char *elf_path = getenv("RIVOS_FUZZ_ELF");
+  if (!elf_path) {
+    fprintf(stderr, "RIVOS_FUZZ_ELF is not set\n");
+    exit(2);
+  }
+
+  FuzzConfig cfg;
+  fuzz_default_config(&cfg);
+  cfg.at = getenv("RIVOS_FUZZ_AT");
+  cfg.buf = getenv("RIVOS_FUZZ_BUF");
+  if ((cfg.stop[0] = getenv("RIVOS_FUZZ_STOP")) != NULL) {
+    cfg.nstop = 1;
+  }
+  if ((cfg.crash[0] = getenv("RIVOS_FUZZ_CRASH")) != NULL) {
+    cfg.ncrash = 1;
+  }
+  const char *timeout = getenv("RIVOS_FUZZ_TIMEOUT");
+  if (timeout) {
+    cfg.exec_insns = strtoull(timeout, NULL, 0);
+  }
+
+  uint64_t entry = 0;
+  SymbolTable syms;
+  if (!machine_init(&machine, (size_t)RIVOS_SIM_RAM_SIZE) ||
+      !load_elf(&machine, elf_path, &entry) ||
+      !load_elf_symbols(elf_path, &syms)) {
+    fprintf(stderr, "failed to load %s: %s\n", elf_path, strerror(errno));
+    exit(1);
+  }
+
+  cpu_reset(&cpu, entry, PRIV_S);
+  if (!fuzz_boot(&fuzz, &machine, &cpu, &syms, &cfg)) {
+    exit(1);
+  }
+  symtab_free(&syms);
+
+  machine.console_muted = true;
+  __sanitizer_cov_8bit_counters_init(fuzz.cov.map,
+                                     fuzz.cov.map + COV_MAP_SIZE);
+  return 0;
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+  FuzzStatus st = fuzz_exec(&fuzz, data, size);
+  if (st == FUZZ_CRASH) {
+    fprintf(stderr, "rivos-sim: guest crash at pc=0x%llx\n",
+            (unsigned long long)cpu.pc);
+    abort();
+  }
+  if (st == FUZZ_HANG) {
+    fprintf(stderr, "rivos-sim: guest hang at pc=0x%llx\n",
+            (unsigned long long)cpu.pc);
+    abort();
+  }
+  return 0;
+}
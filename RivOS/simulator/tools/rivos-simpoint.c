@@ -0,0 +1,342 @@
+#include <errno.h>
+#include <float.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+  DEFAULT_MAX_K = 10,
+  DEFAULT_DIM = 15,
+  DEFAULT_TRIES = 5,
+  MAX_ITERS = 100,
+};
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [-k maxk] [-d dim] [-s seed] <file.bb> <prefix>\n"
+          "\n"
+          "Clusters the basic-block vectors written by rivos-sim --bbv and\n"
+          "picks one representative interval per cluster, SimPoint style:\n"
+          "vectors are normalised, randomly projected to dim dimensions and\n"
+          "clustered by k-means for k = 1..maxk; the smallest k whose BIC\n"
+          "score reaches 90%% of the best is kept. Writes prefix.simpoints\n"
+          "and prefix.weights for rivos-sim --simpoints=prefix.\n"
+          "  -k maxk   largest number of clusters tried (default 10)\n"
+          "  -d dim    projected dimensions (default 15)\n"
+          "  -s seed   projection and seeding RNG seed (default 1)\n",
+          argv0);
+}
+
+static uint64_t splitmix(uint64_t *s) {
+  uint64_t z = (*s += 0x9E3779B97F4A7C15ull);
+  z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+  z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+  return z ^ (z >> 31);
+}
+
+/* Uniform in [0, 1). */
+static double uniform(uint64_t *s) {
+  return (double)(splitmix(s) >> 11) * (1.0 / 9007199254740992.0);
+}
+
+/* Projection weight of block id in dimension j, in [-1, 1). */
+static double proj(uint64_t seed, uint64_t id, unsigned j) {
+  uint64_t s = seed ^ (id * 0x100000001B3ull + j);
+  return 2.0 * uniform(&s) - 1.0;
+}
+
+/* One "T:id:count :id:count ..." line per interval, projected. */
+static double *read_bb(const char *path, unsigned dim, uint64_t seed,
+                       size_t *n_out) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    return NULL;
+  }
+  double *pts = NULL;
+  size_t n = 0, cap = 0;
+  char *line = NULL;
+  size_t len = 0;
+  while (getline(&line, &len, f) > 0) {
+    if (line[0] != 'T') {
+      continue;
+    }
+    if (n == cap) {
+      cap = cap ? 2 * cap : 256;
+      double *p = (double *)realloc(pts, cap * dim * sizeof(double));
+      if (!p) {
+        free(pts);
+        pts = NULL;
+        break;
+      }
+      pts = p;
+    }
+    double *v = &pts[n * dim];
+    memset(v, 0, dim * sizeof(double));
+    double total = 0;
+    const char *s = line + 1;
+    unsigned long long id, count;
+    int used;
+    while (sscanf(s, " :%llu:%llu%n", &id, &count, &used) == 2) {
+      for (unsigned j = 0; j < dim; j++) {
+        v[j] += (double)count * proj(seed, id, j);
+      }
+      total += (double)count;
+      s += used;
+    }
+    for (unsigned j = 0; j < dim && total > 0; j++) {
+      v[j] /= total;
+    }
+    n++;
+  }
+  free(line);
+  fclose(f);
+  *n_out = n;
+  if (pts && n == 0) {
+    free(pts);
+    pts = NULL;
+  }
+  if (!pts) {
+    errno = errno ? errno : EINVAL;
+  }
+  return pts;
+}
+
+static double dist2(const double *a, const double *b, unsigned dim) {
+  double d = 0;
+  for (unsigned j = 0; j < dim; j++) {
+    d += (a[j] - b[j]) * (a[j] - b[j]);
+  }
+  return d;
+}
+
+typedef struct {
+  unsigned k;
+  double *centers;
+  size_t *assign;
+  size_t *sizes;
+  double sse;
+  double bic;
+} Clustering;
+
+/* k-means++ seeding, then Lloyd iterations until assignments settle. */
+static void kmeans(const double *pts, size_t n, unsigned dim, Clustering *c,
+                   uint64_t *rng) {
+  unsigned k = c->k;
+  double *d = (double *)malloc(n * sizeof(double));
+  size_t first = (size_t)(uniform(rng) * (double)n);
+  memcpy(c->centers, &pts[first * dim], dim * sizeof(double));
+  for (size_t i = 0; i < n; i++) {
+    d[i] = dist2(&pts[i * dim], c->centers, dim);
+  }
+  for (unsigned m = 1; m < k; m++) {
+    double sum = 0;
+    for (size_t i = 0; i < n; i++) {
+      sum += d[i];
+    }
+    double r = uniform(rng) * sum;
+    size_t pick = n - 1;
+    for (size_t i = 0; i < n; i++) {
+      if ((r -= d[i]) <= 0) {
+        pick = i;
+        break;
+      }
+    }
+    double *ctr = &c->centers[m * dim];
+    memcpy(ctr, &pts[pick * dim], dim * sizeof(double));
+    for (size_t i = 0; i < n; i++) {
+      double e = dist2(&pts[i * dim], ctr, dim);
+      d[i] = e < d[i] ? e : d[i];
+    }
+  }
+  free(d);
+
+  for (size_t i = 0; i < n; i++) {
+    c->assign[i] = SIZE_MAX;
+  }
+  for (int iter = 0; iter < MAX_ITERS; iter++) {
+    bool moved = false;
+    c->sse = 0;
+    for (size_t i = 0; i < n; i++) {
+      size_t best = 0;
+      double bd = DBL_MAX;
+      for (unsigned m = 0; m < k; m++) {
+        double e = dist2(&pts[i * dim], &c->centers[m * dim], dim);
+        if (e < bd) {
+          bd = e;
+          best = m;
+        }
+      }
+      moved |= c->assign[i] != best;
+      c->assign[i] = best;
+      c->sse += bd;
+    }
+    if (!moved) {
+      break;
+    }
+    memset(c->centers, 0, k * dim * sizeof(double));
+    memset(c->sizes, 0, k * sizeof(size_t));
+    for (size_t i = 0; i < n; i++) {
+      c->sizes[c->assign[i]]++;
+      for (unsigned j = 0; j < dim; j++) {
+        c->centers[c->assign[i] * dim + j] += pts[i * dim + j];
+      }
+    }
+    for (unsigned m = 0; m < k; m++) {
+      for (unsigned j = 0; j < dim && c->sizes[m]; j++) {
+        c->centers[m * dim + j] /= (double)c->sizes[m];
+      }
+    }
+  }
+  memset(c->sizes, 0, k * sizeof(size_t));
+  for (size_t i = 0; i < n; i++) {
+    c->sizes[c->assign[i]]++;
+  }
+}
+
+/* Pelleg and Moore's BIC for a spherical Gaussian mixture, as in SimPoint. */
+static double bic(const Clustering *c, size_t n, unsigned dim) {
+  double r = (double)n;
+  double k = (double)c->k;
+  double var = n > c->k ? c->sse / (r - k) : 0;
+  var = var > 1e-12 ? var : 1e-12;
+  double l = 0;
+  for (unsigned m = 0; m < c->k; m++) {
+    double rn = (double)c->sizes[m];
+    if (rn == 0) {
+      continue;
+    }
+    l += rn * log(rn) - rn * log(r) - rn / 2.0 * log(2.0 * M_PI) -
+         rn * dim / 2.0 * log(var) - (rn - k) / 2.0;
+  }
+  double params = (k - 1) + dim * k + 1;
+  return l - params / 2.0 * log(r);
+}
+
+static bool alloc_clustering(Clustering *c, unsigned k, size_t n,
+                             unsigned dim) {
+  c->k = k;
+  c->centers = (double *)calloc((size_t)k * dim, sizeof(double));
+  c->assign = (size_t *)calloc(n, sizeof(size_t));
+  c->sizes = (size_t *)calloc(k, sizeof(size_t));
+  return c->centers && c->assign && c->sizes;
+}
+
+static void free_clustering(Clustering *c) {
+  free(c->centers);
+  free(c->assign);
+  free(c->sizes);
+  memset(c, 0, sizeof(*c));
+}
+
+int main(int argc, char **argv) {
+  unsigned max_k = DEFAULT_MAX_K;
+  unsigned dim = DEFAULT_DIM;
+  uint64_t seed = 1;
+
+  int argi = 1;
+  for (; argi + 1 < argc && argv[argi][0] == '-'; argi += 2) {
+    unsigned long v = strtoul(argv[argi + 1], NULL, 0);
+    if (strcmp(argv[argi], "-k") == 0 && v > 0) {
+      max_k = (unsigned)v;
+    } else if (strcmp(argv[argi], "-d") == 0 && v > 0) {
+      dim = (unsigned)v;
+    } else if (strcmp(argv[argi], "-s") == 0) {
+      seed = v;
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (argc - argi != 2) {
+    usage(argv[0]);
+    return 2;
+  }
+  const char *prefix = argv[argi + 1];
+
+  size_t n = 0;
+  double *pts = read_bb(argv[argi], dim, seed, &n);
+  if (!pts) {
+    fprintf(stderr, "cannot read %s: %s\n", argv[argi], strerror(errno));
+    return 1;
+  }
+  if (max_k > n) {
+    max_k = (unsigned)n;
+  }
+
+  Clustering *runs = (Clustering *)calloc(max_k + 1, sizeof(Clustering));
+  uint64_t rng = seed;
+  double lo = DBL_MAX, hi = -DBL_MAX;
+  for (unsigned k = 1; k <= max_k; k++) {
+    Clustering *best = &runs[k];
+    for (int t = 0; t < DEFAULT_TRIES; t++) {
+      Clustering c;
+      if (!alloc_clustering(&c, k, n, dim)) {
+        fprintf(stderr, "out of memory\n");
+        return 1;
+      }
+      kmeans(pts, n, dim, &c, &rng);
+      if (!best->centers || c.sse < best->sse) {
+        free_clustering(best);
+        *best = c;
+      } else {
+        free_clustering(&c);
+      }
+    }
+    best->bic = bic(best, n, dim);
+    lo = best->bic < lo ? best->bic : lo;
+    hi = best->bic > hi ? best->bic : hi;
+  }
+  unsigned k = 1;
+  while (k < max_k && runs[k].bic < lo + 0.9 * (hi - lo)) {
+    k++;
+  }
+  const Clustering *c = &runs[k];
+
+  char path[4096];
+  snprintf(path, sizeof(path), "%s.simpoints", prefix);
+  FILE *sf = fopen(path, "w");
+  snprintf(path, sizeof(path), "%s.weights", prefix);
+  FILE *wf = fopen(path, "w");
+  if (!sf || !wf) {
+    fprintf(stderr, "cannot write %s: %s\n", path, strerror(errno));
+    return 1;
+  }
+
+  printf("%zu intervals, k=%u (BIC %.1f, range %.1f..%.1f)\n", n, k, c->bic,
+         lo, hi);
+  unsigned cluster = 0;
+  for (unsigned m = 0; m < k; m++) {
+    if (!c->sizes[m]) {
+      continue;
+    }
+    size_t rep = 0;
+    double bd = DBL_MAX;
+    for (size_t i = 0; i < n; i++) {
+      if (c->assign[i] == m) {
+        double e = dist2(&pts[i * dim], &c->centers[m * dim], dim);
+        if (e < bd) {
+          bd = e;
+          rep = i;
+        }
+      }
+    }
+    double w = (double)c->sizes[m] / (double)n;
+    fprintf(sf, "%zu %u\n", rep, cluster);
+    fprintf(wf, "%.6f %u\n", w, cluster);
+    printf("  cluster %u: %zu intervals, weight %.4f, representative %zu\n",
+           cluster, c->sizes[m], w, rep);
+    cluster++;
+  }
+  bool ok = fclose(sf) == 0;
+  ok = fclose(wf) == 0 && ok;
+
+  for (unsigned i = 1; i <= max_k; i++) {
+    free_clustering(&runs[i]);
+  }
+  free(runs);
+  free(pts);
+  return ok ? 0 : 1;
+}
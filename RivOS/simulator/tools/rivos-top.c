@@ -0,0 +1,206 @@
+#include <dirent.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <signal.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "rivos_sim/stats.h"
+
+enum {
+  MAX_SIMS = 64,
+};
+
+typedef struct {
+  char name[64];
+  const StatsPage *page;
+} Sim;
+
+static void usage(const char *argv0) {
+  fprintf(stderr,
+          "usage: %s [-d seconds] [-n count] [NAME|PID...]\n"
+          "\n"
+          "Shows counters published by rivos-sim --stats. Without arguments\n"
+          "every /rivos-sim.* segment is listed; with a single simulator the\n"
+          "trap breakdown is shown too. Reading never blocks the simulator.\n"
+          "  -d seconds   refresh interval (default 1)\n"
+          "  -n count     stop after count refreshes (default: forever)\n",
+          argv0);
+}
+
+static uint64_t now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_REALTIME, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+/* A bare number is a simulator PID using the default segment name. */
+static void add_sim(Sim *sims, size_t *n, const char *arg) {
+  if (*n == MAX_SIMS) {
+    return;
+  }
+  char name[64];
+  if (arg[0] >= '0' && arg[0] <= '9') {
+    snprintf(name, sizeof(name), "/rivos-sim.%s", arg);
+  } else {
+    snprintf(name, sizeof(name), "%s", arg);
+  }
+  const StatsPage *page = stats_attach(name);
+  if (!page) {
+    fprintf(stderr, "cannot attach %s: %s\n", name, strerror(errno));
+    return;
+  }
+  snprintf(sims[*n].name, sizeof(sims[*n].name), "%s", name);
+  sims[*n].page = page;
+  (*n)++;
+}
+
+/* POSIX shared memory lives in /dev/shm on Linux. */
+static void scan_sims(Sim *sims, size_t *n) {
+  DIR *d = opendir("/dev/shm");
+  if (!d) {
+    return;
+  }
+  struct dirent *e;
+  while ((e = readdir(d)) != NULL) {
+    if (strncmp(e->d_name, "rivos-sim.", 10) == 0) {
+      char name[sizeof(e->d_name) + 1];
+      snprintf(name, sizeof(name), "/%s", e->d_name);
+      add_sim(sims, n, name);
+    }
+  }
+  closedir(d);
+}
+
+static const char *state_of(const StatsPage *page, const StatsSnapshot *s,
+                            uint64_t now) {
+  if (s->halted) {
+    return "halted";
+  }
+  if (kill(page->pid, 0) != 0 && errno == ESRCH) {
+    return "dead";
+  }
+  /* No publish for a while: blocked in wfi or in a device. */
+  return now - s->update_ns > 2000000000ull ? "idle" : "run";
+}
+
+static uint64_t total_traps(const StatsSnapshot *s) {
+  uint64_t t = 0;
+  for (unsigned i = 0; i < STATS_TRAP_SLOTS; i++) {
+    t += s->traps[i];
+  }
+  return t;
+}
+
+static void print_table(const Sim *sims, size_t n) {
+  uint64_t now = now_ns();
+  printf("%7s %-20s %14s %9s %10s %10s %-6s %-18s %s\n", "PID", "NAME",
+         "INSNS", "MIPS", "CONSOLE", "TRAPS", "STATE", "PC", "SYMBOL");
+  for (size_t i = 0; i < n; i++) {
+    StatsSnapshot s;
+    if (!stats_read(sims[i].page, &s)) {
+      printf("%7s %-20s (unreadable)\n", "-", sims[i].name);
+      continue;
+    }
+    printf("%7d %-20s %14" PRIu64 " %5" PRIu64 ".%03" PRIu64 " %10" PRIu64
+           " %10" PRIu64 " %-6s 0x%016" PRIx64 " %s",
+           (int)sims[i].page->pid, sims[i].name, s.instret,
+           s.mips_milli / 1000, s.mips_milli % 1000, s.console_bytes,
+           total_traps(&s), state_of(sims[i].page, &s, now), s.pc, s.sym);
+    if (s.sym[0]) {
+      printf("+0x%" PRIx64, s.sym_off);
+    }
+    printf("\n");
+  }
+}
+
+static void print_detail(const Sim *sim) {
+  StatsSnapshot s;
+  if (!stats_read(sim->page, &s)) {
+    printf("%s: not a rivos-sim stats page\n", sim->name);
+    return;
+  }
+  uint64_t now = now_ns();
+  printf("%s  pid %d  %s  up %.1fs\n\n", sim->name, (int)sim->page->pid,
+         state_of(sim->page, &s, now),
+         (double)(s.update_ns - s.start_ns) / 1e9);
+  printf("  instret   %" PRIu64 "\n", s.instret);
+  printf("  mips      %" PRIu64 ".%03" PRIu64 "\n", s.mips_milli / 1000,
+         s.mips_milli % 1000);
+  printf("  console   %" PRIu64 " bytes\n", s.console_bytes);
+  printf("  pc        0x%016" PRIx64, s.pc);
+  if (s.sym[0]) {
+    printf("  %s+0x%" PRIx64, s.sym, s.sym_off);
+  }
+  printf("\n\n  traps     %" PRIu64 "\n", total_traps(&s));
+  for (unsigned i = 0; i < STATS_TRAP_SLOTS; i++) {
+    if (s.traps[i]) {
+      const char *name = stats_trap_name(i);
+      printf("    %-18s %" PRIu64 "\n", name ? name : "?", s.traps[i]);
+    }
+  }
+}
+
+int main(int argc, char **argv) {
+  double delay = 1.0;
+  long count = -1;
+
+  int argi = 1;
+  for (; argi < argc && argv[argi][0] == '-'; argi++) {
+    if (strcmp(argv[argi], "-d") == 0 && argi + 1 < argc) {
+      delay = strtod(argv[++argi], NULL);
+    } else if (strcmp(argv[argi], "-n") == 0 && argi + 1 < argc) {
+      count = strtol(argv[++argi], NULL, 0);
+    } else {
+      usage(argv[0]);
+      return 2;
+    }
+  }
+  if (delay <= 0) {
+    delay = 1.0;
+  }
+
+  Sim sims[MAX_SIMS];
+  size_t nsims = 0;
+  bool scan = argi == argc;
+  for (; argi < argc; argi++) {
+    add_sim(sims, &nsims, argv[argi]);
+  }
+  if (scan) {
+    scan_sims(sims, &nsims);
+  }
+  if (nsims == 0) {
+    fprintf(stderr, "no simulators found (run rivos-sim --stats)\n");
+    return 1;
+  }
+
+  bool tty = isatty(STDOUT_FILENO);
+  struct timespec ts = {(time_t)delay,
+                        (long)((delay - (double)(time_t)delay) * 1e9)};
+  for (long i = 0; count < 0 || i < count; i++) {
+    if (i > 0) {
+      nanosleep(&ts, NULL);
+    }
+    if (tty) {
+      printf("\033[H\033[J");
+    }
+    if (nsims == 1) {
+      print_detail(&sims[0]);
+    } else {
+      print_table(sims, nsims);
+    }
+    if (!tty) {
+      printf("\n");
+    }
+    fflush(stdout);
+  }
+
+  for (size_t i = 0; i < nsims; i++) {
+    stats_detach(sims[i].page);
+  }
+  return 0;
+}